@@ -0,0 +1,303 @@
+// Benchmarks for the handlers and for whole-file analysis over a generated
+// corpus. Each benchmark prints one tab-separated line, so the output of two
+// builds can be compared with diff or loaded into a spreadsheet
+
+// Define _GNU_SOURCE to enable mkdtemp() and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "corpus.h"        // Fixture generator
+#include "file_info.h"     // FileContext and process_file()
+#include "handlers.h"      // The handlers measured one by one
+#include "detect.h"        // Release of the cached libmagic cookies
+#include "version.h"       // Version of the build being measured
+#include <getopt.h>        // getopt_long() for command line parsing
+#include <stdio.h>         // printf(), fprintf(), fopen()
+#include <stdlib.h>        // malloc(), free(), qsort(), strtoul(), getenv()
+#include <string.h>        // strstr()
+#include <sys/resource.h>  // getrusage() for the peak RSS
+#include <sys/stat.h>      // stat()
+#include <time.h>          // clock_gettime()
+#include <unistd.h>        // rmdir()
+
+// A handler as seen by the benchmarks
+typedef void (*Handler)(FileContext *ctx);
+
+// One benchmark: a handler (or all of process_file) over some fixture kinds
+typedef struct {
+    const char *name;
+    Handler handler;         // NULL measures process_file() end to end
+    CorpusKind kinds[4];     // Fixture kinds fed to it
+    int kind_count;
+    DigestAlgorithm digest;  // Digest process_file() adds, as with --hash
+    SniffMode sniff;         // Whether the signature table answers first, as with --sniff
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    { "handler/text",    get_text_file_info, { CORPUS_TEXT }, 1, DIGEST_NONE, SNIFF_OFF },
+    { "handler/image",   get_image_info,     { CORPUS_PNG, CORPUS_JPEG }, 2, DIGEST_NONE, SNIFF_OFF },
+    { "handler/video",   get_video_duration, { CORPUS_MP4, CORPUS_MKV }, 2, DIGEST_NONE, SNIFF_OFF },
+    { "handler/pdf",     get_pdf_info,       { CORPUS_PDF }, 1, DIGEST_NONE, SNIFF_OFF },
+    { "handler/archive", get_archive_info,   { CORPUS_ZIP, CORPUS_TAR, CORPUS_GZIP }, 3, DIGEST_NONE, SNIFF_OFF },
+    { "process/text",    NULL, { CORPUS_TEXT }, 1, DIGEST_NONE, SNIFF_OFF },
+    { "process/image",   NULL, { CORPUS_PNG, CORPUS_JPEG }, 2, DIGEST_NONE, SNIFF_OFF },
+    { "process/video",   NULL, { CORPUS_MP4, CORPUS_MKV }, 2, DIGEST_NONE, SNIFF_OFF },
+    { "process/pdf",     NULL, { CORPUS_PDF }, 1, DIGEST_NONE, SNIFF_OFF },
+    { "process/archive", NULL, { CORPUS_ZIP, CORPUS_TAR, CORPUS_GZIP }, 3, DIGEST_NONE, SNIFF_OFF },
+    // Text is digested in the pass that counts it, archives in a pass of their own
+    { "hash/text/xxh3",      NULL, { CORPUS_TEXT }, 1, DIGEST_XXH3, SNIFF_OFF },
+    { "hash/text/blake3",    NULL, { CORPUS_TEXT }, 1, DIGEST_BLAKE3, SNIFF_OFF },
+    { "hash/text/sha256",    NULL, { CORPUS_TEXT }, 1, DIGEST_SHA256, SNIFF_OFF },
+    { "hash/archive/xxh3",   NULL, { CORPUS_ZIP, CORPUS_TAR, CORPUS_GZIP }, 3, DIGEST_XXH3, SNIFF_OFF },
+    // The MIME type from the signature table, the description still from libmagic
+    { "sniff/image",     NULL, { CORPUS_PNG, CORPUS_JPEG }, 2, DIGEST_NONE, SNIFF_ON },
+    { "sniff/video",     NULL, { CORPUS_MP4, CORPUS_MKV }, 2, DIGEST_NONE, SNIFF_ON },
+    { "sniff/archive",   NULL, { CORPUS_ZIP, CORPUS_TAR, CORPUS_GZIP }, 3, DIGEST_NONE, SNIFF_ON },
+};
+
+// What one benchmark measured
+typedef struct {
+    size_t calls;        // Handler or process_file() calls timed
+    uint64_t bytes;      // Sum of the sizes of the files behind those calls
+    uint64_t total_ns;   // Time spent in the timed calls
+    uint64_t p50_ns;     // Median call
+    uint64_t p99_ns;     // 99th percentile call
+    long peak_rss_kib;   // Peak resident set size of the process so far
+    unsigned children;   // External tools started
+} BenchResult;
+
+// Monotonic time in nanoseconds
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Count the fixtures of a kind present in dir (indexes 0, 1, ... until one is missing)
+static unsigned count_fixtures(const char *dir, CorpusKind kind) {
+    char path[4096];
+    struct stat st;
+    unsigned n = 0;
+    while (corpus_path(path, sizeof(path), dir, kind, n) == 0 && stat(path, &st) == 0) {
+        n++;
+    }
+    return n;
+}
+
+// Analyze one fixture the way the benchmark wants; returns the nanoseconds timed
+static uint64_t run_once(const Benchmark *bench, FileContext *ctx, const char *path,
+                         BenchResult *result) {
+    reset_file_context(ctx, path);
+    ctx->digest = bench->digest;
+    ctx->sniff = bench->sniff;
+    uint64_t start, elapsed;
+    if (bench->handler == NULL) {
+        start = now_ns();
+        process_file(ctx);
+        elapsed = now_ns() - start;
+    } else {
+        // Handlers expect the stat data and the description to be filled in
+        get_basic_info(ctx);
+        get_file_type(ctx);
+        start = now_ns();
+        bench->handler(ctx);
+        elapsed = now_ns() - start;
+        close_file(ctx);
+    }
+    if (result != NULL) {
+        result->bytes += (uint64_t)ctx->st.st_size;
+        result->children += ctx->tool_runs;
+    }
+    return elapsed;
+}
+
+// Run one benchmark iterations times over every matching fixture
+// Returns 0 on success, -1 if there is nothing to measure
+static int run_benchmark(const Benchmark *bench, const char *dir, unsigned iterations,
+                         BenchResult *result) {
+    char path[4096];
+    unsigned counts[4];
+    size_t files = 0;
+    for (int k = 0; k < bench->kind_count; k++) {
+        counts[k] = count_fixtures(dir, bench->kinds[k]);
+        files += counts[k];
+    }
+    if (files == 0) {
+        return -1;
+    }
+    uint64_t *samples = malloc(files * iterations * sizeof(uint64_t));
+    if (samples == NULL) {
+        return -1;
+    }
+
+    FileContext ctx;
+    init_file_context(&ctx, NULL);
+    *result = (BenchResult){ 0 };
+
+    // One untimed pass loads the magic database and warms the page cache
+    for (int k = 0; k < bench->kind_count; k++) {
+        for (unsigned i = 0; i < counts[k]; i++) {
+            corpus_path(path, sizeof(path), dir, bench->kinds[k], i);
+            run_once(bench, &ctx, path, NULL);
+        }
+    }
+
+    for (unsigned it = 0; it < iterations; it++) {
+        for (int k = 0; k < bench->kind_count; k++) {
+            for (unsigned i = 0; i < counts[k]; i++) {
+                corpus_path(path, sizeof(path), dir, bench->kinds[k], i);
+                uint64_t ns = run_once(bench, &ctx, path, result);
+                samples[result->calls++] = ns;
+                result->total_ns += ns;
+            }
+        }
+    }
+    free_file_context(&ctx);
+
+    qsort(samples, result->calls, sizeof(uint64_t), compare_u64);
+    result->p50_ns = samples[(result->calls - 1) / 2];
+    result->p99_ns = samples[(result->calls - 1) * 99 / 100];
+    free(samples);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        result->peak_rss_kib = usage.ru_maxrss;
+    }
+    return 0;
+}
+
+// Print usage instructions
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTION]...\n", program_name);
+    printf("Measure the handlers and process_file() over a generated corpus.\n\n");
+    printf("Options:\n");
+    printf("  -h, --help           Display this help and exit\n");
+    printf("      --corpus=DIR     Use fixtures written by gen_corpus instead of\n");
+    printf("                       generating a temporary corpus\n");
+    printf("  -n, --count=N        Files of each kind to generate (default: 20)\n");
+    printf("  -s, --size=BYTES     Approximate size of each file (default: 65536)\n");
+    printf("  -i, --iterations=N   Timed passes over the corpus (default: 5)\n");
+    printf("  -o, --output=FILE    Write results to FILE instead of stdout\n");
+    printf("      --filter=TEXT    Only run benchmarks whose name contains TEXT\n");
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",       no_argument,       NULL, 'h'},
+        {"corpus",     required_argument, NULL, 'c'},
+        {"count",      required_argument, NULL, 'n'},
+        {"size",       required_argument, NULL, 's'},
+        {"iterations", required_argument, NULL, 'i'},
+        {"output",     required_argument, NULL, 'o'},
+        {"filter",     required_argument, NULL, 'f'},
+        {NULL, 0, NULL, 0}
+    };
+    CorpusOptions corpus = { .count = 20, .size = 65536, .seed = 1 };
+    unsigned iterations = 5;
+    const char *corpus_dir = NULL;
+    const char *output = NULL;
+    const char *filter = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hn:s:i:o:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        case 'c':
+            corpus_dir = optarg;
+            break;
+        case 'n':
+            corpus.count = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            corpus.size = strtoull(optarg, NULL, 10);
+            break;
+        case 'i':
+            iterations = (unsigned)strtoul(optarg, NULL, 10);
+            if (iterations < 1) {
+                fprintf(stderr, "Invalid iteration count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Generate a private corpus unless one was given
+    char temp_dir[4096];
+    if (corpus_dir == NULL) {
+        const char *tmpdir = getenv("TMPDIR");
+        snprintf(temp_dir, sizeof(temp_dir), "%s/inf-bench-XXXXXX",
+                 tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp");
+        if (mkdtemp(temp_dir) == NULL) {
+            fprintf(stderr, "Cannot create corpus directory: %s\n", temp_dir);
+            return 1;
+        }
+        if (corpus_generate(temp_dir, &corpus) != 0) {
+            corpus_remove(temp_dir, &corpus);
+            rmdir(temp_dir);
+            return 1;
+        }
+        corpus_dir = temp_dir;
+    }
+
+    FILE *out = stdout;
+    if (output != NULL) {
+        out = fopen(output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Cannot open output file: %s\n", output);
+            return 1;
+        }
+    }
+
+    // Header: what was measured, then the column names
+    fprintf(out, "# inf %s, %u files of each kind, about %llu bytes each, %u iterations\n",
+            FILE_INFO_VERSION, corpus.count, (unsigned long long)corpus.size, iterations);
+    fprintf(out, "benchmark\tcalls\tbytes\tfiles_per_s\tmb_per_s\tp50_us\tp99_us\t"
+                 "peak_rss_kib\tchild_processes\n");
+
+    int status = 0;
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        const Benchmark *bench = &benchmarks[b];
+        if (filter != NULL && strstr(bench->name, filter) == NULL) {
+            continue;
+        }
+        BenchResult r;
+        if (run_benchmark(bench, corpus_dir, iterations, &r) != 0) {
+            fprintf(stderr, "Cannot run benchmark: %s\n", bench->name);
+            status = 1;
+            continue;
+        }
+        double seconds = r.total_ns > 0 ? r.total_ns / 1e9 : 1e-9;
+        fprintf(out, "%s\t%zu\t%llu\t%.1f\t%.2f\t%.1f\t%.1f\t%ld\t%u\n",
+                bench->name, r.calls, (unsigned long long)r.bytes,
+                r.calls / seconds, r.bytes / seconds / 1e6,
+                r.p50_ns / 1e3, r.p99_ns / 1e3, r.peak_rss_kib, r.children);
+        fflush(out);
+    }
+
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Cannot write output file: %s\n", output);
+        status = 1;
+    }
+    if (corpus_dir == temp_dir) {
+        corpus_remove(temp_dir, &corpus);
+        rmdir(temp_dir);
+    }
+    detect_cleanup();
+    return status;
+}
@@ -0,0 +1,796 @@
+// Deterministic fixtures for the benchmarks: every file is built in memory
+// from a seeded generator, so two runs with the same options write the same
+// bytes and timings from different builds can be compared
+
+// Include necessary header files
+#include "corpus.h"    // Declarations for the functions defined in this file
+#include <math.h>      // sqrt()
+#include <stdio.h>     // fopen(), fwrite(), snprintf()
+#include <stdlib.h>    // malloc(), realloc(), free()
+#include <string.h>    // memcpy(), memset(), strlen()
+#include <unistd.h>    // unlink()
+#include <zlib.h>      // crc32(), compress2(), gzopen()
+
+// File name prefix and extension of each kind, in CorpusKind order
+static const char *const kind_names[CORPUS_KINDS] = {
+    "text", "png", "jpeg", "mp4", "mkv", "pdf", "zip", "tar", "gzip"
+};
+static const char *const kind_extensions[CORPUS_KINDS] = {
+    "txt", "png", "jpg", "mp4", "mkv", "pdf", "zip", "tar", "gz"
+};
+
+// Words the text generator strings together
+static const char *const words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "file",
+    "information", "size", "type", "archive", "image", "video", "document",
+    "metadata", "latency", "throughput", "benchmark", "corpus", "handler",
+    "of", "and", "a", "to", "in", "is", "it", "that", "with", "for", "on"
+};
+
+// A growable byte buffer the fixtures are assembled in
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int failed;  // Set once an allocation fails; later writes are dropped
+} Buffer;
+
+// xorshift32: small, fast and identical on every platform
+static uint32_t next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Make sure n more bytes fit
+static int reserve(Buffer *b, size_t n) {
+    if (b->failed) {
+        return -1;
+    }
+    if (b->len + n <= b->cap) {
+        return 0;
+    }
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + n) {
+        cap *= 2;
+    }
+    unsigned char *data = realloc(b->data, cap);
+    if (data == NULL) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static void put_bytes(Buffer *b, const void *p, size_t n) {
+    if (n > 0 && reserve(b, n) == 0) {
+        memcpy(b->data + b->len, p, n);
+        b->len += n;
+    }
+}
+
+static void put_fill(Buffer *b, int c, size_t n) {
+    if (reserve(b, n) == 0) {
+        memset(b->data + b->len, c, n);
+        b->len += n;
+    }
+}
+
+static void put_str(Buffer *b, const char *s) {
+    put_bytes(b, s, strlen(s));
+}
+
+static void put_u8(Buffer *b, unsigned v) {
+    unsigned char c = (unsigned char)v;
+    put_bytes(b, &c, 1);
+}
+
+static void put_be16(Buffer *b, unsigned v) {
+    put_u8(b, v >> 8);
+    put_u8(b, v);
+}
+
+static void put_be32(Buffer *b, uint32_t v) {
+    put_be16(b, v >> 16);
+    put_be16(b, v & 0xFFFF);
+}
+
+static void put_le16(Buffer *b, unsigned v) {
+    put_u8(b, v);
+    put_u8(b, v >> 8);
+}
+
+static void put_le32(Buffer *b, uint32_t v) {
+    put_le16(b, v & 0xFFFF);
+    put_le16(b, v >> 16);
+}
+
+// Overwrite a big-endian 32-bit value written earlier
+static void patch_be32(Buffer *b, size_t at, uint32_t v) {
+    if (!b->failed) {
+        b->data[at] = v >> 24;
+        b->data[at + 1] = v >> 16;
+        b->data[at + 2] = v >> 8;
+        b->data[at + 3] = v;
+    }
+}
+
+// Append roughly n bytes of English-looking lines
+static void put_text(Buffer *b, size_t n, uint32_t *rng) {
+    size_t end = b->len + n;
+    size_t line = 0;
+    while (b->len < end && !b->failed) {
+        const char *word = words[next_random(rng) % (sizeof(words) / sizeof(words[0]))];
+        put_str(b, word);
+        line += strlen(word) + 1;
+        // Wrap lines at about 72 columns
+        if (line > 60 + next_random(rng) % 12) {
+            put_u8(b, '\n');
+            line = 0;
+        } else {
+            put_u8(b, ' ');
+        }
+    }
+    if (!b->failed && b->len > 0) {
+        b->data[b->len - 1] = '\n';
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Images
+// ---------------------------------------------------------------------------
+
+// Append one PNG chunk with its CRC
+static void put_png_chunk(Buffer *b, const char *type, const unsigned char *data, size_t n) {
+    put_be32(b, (uint32_t)n);
+    size_t start = b->len;
+    put_bytes(b, type, 4);
+    put_bytes(b, data, n);
+    if (!b->failed) {
+        put_be32(b, (uint32_t)crc32(0, b->data + start, (uInt)(n + 4)));
+    }
+}
+
+// An RGB gradient with noise, square, with about size bytes of raw pixels
+static void build_png(Buffer *b, uint64_t size, uint32_t *rng) {
+    uint32_t side = (uint32_t)sqrt((double)size / 3);
+    if (side < 1) {
+        side = 1;
+    }
+    size_t row = 1 + (size_t)side * 3;
+    size_t raw_len = row * side;
+    unsigned char *raw = malloc(raw_len);
+    uLongf packed_len = compressBound(raw_len);
+    unsigned char *packed = malloc(packed_len);
+    if (raw == NULL || packed == NULL) {
+        free(raw);
+        free(packed);
+        b->failed = 1;
+        return;
+    }
+    for (uint32_t y = 0; y < side; y++) {
+        unsigned char *p = raw + y * row;
+        *p++ = 0;  // Filter type: none
+        for (uint32_t x = 0; x < side; x++) {
+            unsigned noise = next_random(rng) & 15;
+            *p++ = (unsigned char)(x * 255 / side + noise);
+            *p++ = (unsigned char)(y * 255 / side + noise);
+            *p++ = (unsigned char)((x + y) * 127 / side);
+        }
+    }
+    if (compress2(packed, &packed_len, raw, raw_len, 6) != Z_OK) {
+        b->failed = 1;
+    }
+
+    unsigned char ihdr[13];
+    ihdr[0] = side >> 24; ihdr[1] = side >> 16; ihdr[2] = side >> 8; ihdr[3] = side;
+    memcpy(ihdr + 4, ihdr, 4);  // Square: height equals width
+    ihdr[8] = 8;    // Bit depth
+    ihdr[9] = 2;    // Truecolor
+    ihdr[10] = 0;   // Deflate
+    ihdr[11] = 0;   // Adaptive filtering
+    ihdr[12] = 0;   // No interlace
+    put_bytes(b, "\x89PNG\r\n\x1a\n", 8);
+    put_png_chunk(b, "IHDR", ihdr, sizeof(ihdr));
+    put_png_chunk(b, "IDAT", packed, packed_len);
+    put_png_chunk(b, "IEND", NULL, 0);
+    free(raw);
+    free(packed);
+}
+
+// A flat grey baseline JPEG; comment segments pad it to about size bytes,
+// the way EXIF and ICC data sit in front of the frame header of real photos
+static void build_jpeg(Buffer *b, uint64_t size, unsigned index) {
+    unsigned width = 320 + 16 * (index % 40);
+    unsigned height = 240 + 16 * (index % 30);
+
+    put_bytes(b, "\xFF\xD8", 2);  // SOI
+    put_bytes(b, "\xFF\xE0\x00\x10JFIF\0\x01\x01\x00\x00\x01\x00\x01\x00\x00", 18);
+    while (b->len + 256 < size && !b->failed) {
+        size_t n = size - b->len - 256;
+        if (n > 65000) {
+            n = 65000;
+        }
+        put_bytes(b, "\xFF\xFE", 2);  // COM
+        put_be16(b, (unsigned)n + 2);
+        put_fill(b, 'c', n);
+    }
+    // Quantization table: all ones
+    put_bytes(b, "\xFF\xDB\x00\x43\x00", 5);
+    put_fill(b, 1, 64);
+    // Frame header: 8-bit, one component
+    put_bytes(b, "\xFF\xC0\x00\x0B\x08", 5);
+    put_be16(b, height);
+    put_be16(b, width);
+    put_bytes(b, "\x01\x01\x11\x00", 4);
+    // Huffman tables with a single one-bit code each: DC difference 0 and EOB
+    static const unsigned char one_code[16] = { 1 };
+    put_bytes(b, "\xFF\xC4\x00\x14\x00", 5);
+    put_bytes(b, one_code, 16);
+    put_u8(b, 0);
+    put_bytes(b, "\xFF\xC4\x00\x14\x10", 5);
+    put_bytes(b, one_code, 16);
+    put_u8(b, 0);
+    // Scan: every 8x8 block is "DC 0, EOB", two zero bits
+    put_bytes(b, "\xFF\xDA\x00\x08\x01\x01\x00\x00\x3F\x00", 10);
+    size_t bits = 2 * (size_t)((width + 7) / 8) * ((height + 7) / 8);
+    put_fill(b, 0, bits / 8);
+    if (bits % 8 != 0) {
+        put_u8(b, (1u << (8 - bits % 8)) - 1);  // Pad the last byte with ones
+    }
+    put_bytes(b, "\xFF\xD9", 2);  // EOI
+}
+
+// ---------------------------------------------------------------------------
+// Video containers
+// ---------------------------------------------------------------------------
+
+// Start an MP4 box; returns the offset end_box() patches
+static size_t begin_box(Buffer *b, const char *type) {
+    size_t at = b->len;
+    put_be32(b, 0);
+    put_bytes(b, type, 4);
+    return at;
+}
+
+static void end_box(Buffer *b, size_t at) {
+    patch_be32(b, at, (uint32_t)(b->len - at));
+}
+
+// Identity transformation matrix used by mvhd and tkhd
+static void put_matrix(Buffer *b) {
+    static const uint32_t matrix[9] = { 0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; i++) {
+        put_be32(b, matrix[i]);
+    }
+}
+
+// ISO base media file with one AVC video track and an mdat of padding
+static void build_mp4(Buffer *b, uint64_t size, unsigned index) {
+    uint32_t timescale = 1000;
+    uint32_t duration = 5000 + 1234 * (index % 97);  // Milliseconds
+    unsigned width = 640 + 16 * (index % 20);
+    unsigned height = 360 + 16 * (index % 15);
+
+    size_t ftyp = begin_box(b, "ftyp");
+    put_bytes(b, "isom\0\0\x02\0isomiso2avc1mp41", 24);
+    end_box(b, ftyp);
+
+    size_t moov = begin_box(b, "moov");
+    size_t mvhd = begin_box(b, "mvhd");
+    put_be32(b, 0);  // Version and flags
+    put_be32(b, 0);  // Creation time
+    put_be32(b, 0);  // Modification time
+    put_be32(b, timescale);
+    put_be32(b, duration);
+    put_be32(b, 0x10000);  // Rate 1.0
+    put_be16(b, 0x100);    // Volume 1.0
+    put_fill(b, 0, 10);
+    put_matrix(b);
+    put_fill(b, 0, 24);
+    put_be32(b, 2);  // Next track ID
+    end_box(b, mvhd);
+
+    size_t trak = begin_box(b, "trak");
+    size_t tkhd = begin_box(b, "tkhd");
+    put_be32(b, 3);  // Version 0, enabled and in movie
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, 1);  // Track ID
+    put_be32(b, 0);
+    put_be32(b, duration);
+    put_fill(b, 0, 16);  // Reserved, layer, group, volume, reserved
+    put_matrix(b);
+    put_be32(b, width << 16);
+    put_be32(b, height << 16);
+    end_box(b, tkhd);
+
+    size_t mdia = begin_box(b, "mdia");
+    size_t mdhd = begin_box(b, "mdhd");
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, timescale);
+    put_be32(b, duration);
+    put_be16(b, 0x55C4);  // Language: und
+    put_be16(b, 0);
+    end_box(b, mdhd);
+    size_t hdlr = begin_box(b, "hdlr");
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_bytes(b, "vide", 4);
+    put_fill(b, 0, 12);
+    put_bytes(b, "VideoHandler", 13);
+    end_box(b, hdlr);
+
+    size_t minf = begin_box(b, "minf");
+    size_t vmhd = begin_box(b, "vmhd");
+    put_be32(b, 1);
+    put_fill(b, 0, 8);
+    end_box(b, vmhd);
+    size_t dinf = begin_box(b, "dinf");
+    size_t dref = begin_box(b, "dref");
+    put_be32(b, 0);
+    put_be32(b, 1);
+    size_t url = begin_box(b, "url ");
+    put_be32(b, 1);  // Media is in this file
+    end_box(b, url);
+    end_box(b, dref);
+    end_box(b, dinf);
+
+    size_t stbl = begin_box(b, "stbl");
+    size_t stsd = begin_box(b, "stsd");
+    put_be32(b, 0);
+    put_be32(b, 1);
+    size_t avc1 = begin_box(b, "avc1");
+    put_fill(b, 0, 6);
+    put_be16(b, 1);  // Data reference index
+    put_fill(b, 0, 16);
+    put_be16(b, width);
+    put_be16(b, height);
+    put_be32(b, 0x480000);  // 72 dpi
+    put_be32(b, 0x480000);
+    put_be32(b, 0);
+    put_be16(b, 1);  // Frames per sample
+    put_fill(b, 0, 32);
+    put_be16(b, 0x18);
+    put_be16(b, 0xFFFF);
+    end_box(b, avc1);
+    end_box(b, stsd);
+    // Empty sample tables
+    static const char *const tables[] = { "stts", "stsc", "stco" };
+    for (int i = 0; i < 3; i++) {
+        size_t table = begin_box(b, tables[i]);
+        put_be32(b, 0);
+        put_be32(b, 0);
+        end_box(b, table);
+    }
+    size_t stsz = begin_box(b, "stsz");
+    put_fill(b, 0, 12);
+    end_box(b, stsz);
+    end_box(b, stbl);
+    end_box(b, minf);
+    end_box(b, mdia);
+    end_box(b, trak);
+    end_box(b, moov);
+
+    // The media data: just padding up to the requested size
+    size_t mdat = begin_box(b, "mdat");
+    if (size > b->len) {
+        put_fill(b, 0, size - b->len);
+    }
+    end_box(b, mdat);
+}
+
+// Append an EBML ID; the IDs below keep their length marker bits
+static void put_element_id(Buffer *b, uint32_t id) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if ((id >> shift) != 0) {
+            put_u8(b, id >> shift);
+        }
+    }
+}
+
+// Start an EBML master element with an 8-byte size; returns what end_element() patches
+static size_t begin_element(Buffer *b, uint32_t id) {
+    put_element_id(b, id);
+    size_t at = b->len;
+    put_u8(b, 0x01);
+    put_fill(b, 0, 7);
+    return at;
+}
+
+static void end_element(Buffer *b, size_t at) {
+    if (!b->failed) {
+        uint64_t size = b->len - at - 8;
+        for (int i = 7; i >= 1; i--) {
+            b->data[at + i] = (unsigned char)size;
+            size >>= 8;
+        }
+    }
+}
+
+// Leaf elements use one-byte sizes, as muxers write them
+static void put_element_uint(Buffer *b, uint32_t id, uint32_t value) {
+    put_element_id(b, id);
+    put_u8(b, 0x84);
+    put_be32(b, value);
+}
+
+static void put_element_str(Buffer *b, uint32_t id, const char *value) {
+    put_element_id(b, id);
+    put_u8(b, 0x80 | (unsigned)strlen(value));
+    put_str(b, value);
+}
+
+// Matroska file with one AVC track and a Void element for padding
+static void build_mkv(Buffer *b, uint64_t size, unsigned index) {
+    double duration = 5000 + 1234 * (index % 97);  // Milliseconds
+    unsigned width = 640 + 16 * (index % 20);
+    unsigned height = 360 + 16 * (index % 15);
+
+    size_t header = begin_element(b, 0x1A45DFA3);
+    put_element_uint(b, 0x4286, 1);  // EBMLVersion
+    put_element_uint(b, 0x42F7, 1);  // EBMLReadVersion
+    put_element_uint(b, 0x42F2, 4);  // EBMLMaxIDLength
+    put_element_uint(b, 0x42F3, 8);  // EBMLMaxSizeLength
+    put_element_str(b, 0x4282, "matroska");
+    put_element_uint(b, 0x4287, 4);  // DocTypeVersion
+    put_element_uint(b, 0x4285, 2);  // DocTypeReadVersion
+    end_element(b, header);
+
+    size_t segment = begin_element(b, 0x18538067);
+    size_t info = begin_element(b, 0x1549A966);
+    put_element_uint(b, 0x2AD7B1, 1000000);  // Timestamps in milliseconds
+    uint64_t bits;
+    memcpy(&bits, &duration, sizeof(bits));
+    put_element_id(b, 0x4489);  // Duration, a 64-bit float
+    put_u8(b, 0x88);
+    put_be32(b, (uint32_t)(bits >> 32));
+    put_be32(b, (uint32_t)bits);
+    put_element_str(b, 0x4D80, "inf-bench");
+    put_element_str(b, 0x5741, "inf-bench");
+    end_element(b, info);
+
+    size_t tracks = begin_element(b, 0x1654AE6B);
+    size_t entry = begin_element(b, 0xAE);
+    put_element_uint(b, 0xD7, 1);    // TrackNumber
+    put_element_uint(b, 0x73C5, 1);  // TrackUID
+    put_element_uint(b, 0x83, 1);    // TrackType: video
+    put_element_str(b, 0x86, "V_MPEG4/ISO/AVC");
+    size_t video = begin_element(b, 0xE0);
+    put_element_uint(b, 0xB0, width);
+    put_element_uint(b, 0xBA, height);
+    end_element(b, video);
+    end_element(b, entry);
+    end_element(b, tracks);
+
+    size_t pad = begin_element(b, 0xEC);  // Void
+    if (size > b->len) {
+        put_fill(b, 0, size - b->len);
+    }
+    end_element(b, pad);
+    end_element(b, segment);
+}
+
+// ---------------------------------------------------------------------------
+// Documents
+// ---------------------------------------------------------------------------
+
+// A PDF with an Info dictionary and enough text content to reach size bytes
+static void build_pdf(Buffer *b, uint64_t size, unsigned index, uint32_t *rng) {
+    unsigned pages = 1 + (unsigned)(size / 16384);
+    if (pages > 1000) {
+        pages = 1000;
+    }
+    unsigned objects = 3 + 2 * pages;  // Catalog, Pages, Info, then page and content pairs
+    size_t *offsets = malloc((objects + 1) * sizeof(size_t));
+    if (offsets == NULL) {
+        b->failed = 1;
+        return;
+    }
+    char line[256];
+
+    put_str(b, "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+    offsets[1] = b->len;
+    put_str(b, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+    offsets[2] = b->len;
+    put_str(b, "2 0 obj\n<< /Type /Pages /Kids [");
+    for (unsigned i = 0; i < pages; i++) {
+        snprintf(line, sizeof(line), " %u 0 R", 4 + 2 * i);
+        put_str(b, line);
+    }
+    snprintf(line, sizeof(line), " ] /Count %u >>\nendobj\n", pages);
+    put_str(b, line);
+    offsets[3] = b->len;
+    snprintf(line, sizeof(line),
+             "3 0 obj\n<< /Title (Benchmark document %u) /Author (inf bench) "
+             "/Producer (inf corpus) /CreationDate (D:20240102030405Z) >>\nendobj\n", index);
+    put_str(b, line);
+
+    size_t per_page = size / pages;
+    for (unsigned i = 0; i < pages; i++) {
+        unsigned page = 4 + 2 * i;
+        offsets[page] = b->len;
+        snprintf(line, sizeof(line),
+                 "%u 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] "
+                 "/Contents %u 0 R >>\nendobj\n", page, page + 1);
+        put_str(b, line);
+
+        // Content stream: the text is drawn line by line
+        Buffer content = { 0 };
+        while (content.len < per_page && !content.failed) {
+            put_str(&content, "BT /F1 10 Tf 72 720 Td (");
+            size_t before = content.len;
+            put_text(&content, 60, rng);
+            if (!content.failed) {
+                content.len = before + 59;  // Keep the line, drop its newline
+            }
+            put_str(&content, ") Tj ET\n");
+        }
+        offsets[page + 1] = b->len;
+        snprintf(line, sizeof(line), "%u 0 obj\n<< /Length %zu >>\nstream\n", page + 1, content.len);
+        put_str(b, line);
+        put_bytes(b, content.data, content.len);
+        put_str(b, "\nendstream\nendobj\n");
+        b->failed |= content.failed;
+        free(content.data);
+    }
+
+    // Cross-reference table and trailer
+    size_t xref = b->len;
+    snprintf(line, sizeof(line), "xref\n0 %u\n0000000000 65535 f \n", objects + 1);
+    put_str(b, line);
+    for (unsigned i = 1; i <= objects; i++) {
+        snprintf(line, sizeof(line), "%010zu 00000 n \n", offsets[i]);
+        put_str(b, line);
+    }
+    snprintf(line, sizeof(line),
+             "trailer\n<< /Size %u /Root 1 0 R /Info 3 0 R >>\nstartxref\n%zu\n%%%%EOF\n",
+             objects + 1, xref);
+    put_str(b, line);
+    free(offsets);
+}
+
+// ---------------------------------------------------------------------------
+// Archives
+// ---------------------------------------------------------------------------
+
+// Number and size of the members of an archive of about size bytes
+static void archive_layout(uint64_t size, unsigned *members, size_t *member_size) {
+    *members = (unsigned)(size / 4096);
+    if (*members < 1) {
+        *members = 1;
+    }
+    if (*members > 10000) {
+        *members = 10000;
+    }
+    *member_size = (size_t)(size / *members);
+}
+
+// A stored (uncompressed) ZIP with one directory and text members
+static void build_zip(Buffer *b, uint64_t size, uint32_t *rng) {
+    unsigned members;
+    size_t member_size;
+    archive_layout(size, &members, &member_size);
+    Buffer central = { 0 };
+    Buffer data = { 0 };
+    char name[64];
+
+    for (unsigned i = 0; i <= members; i++) {
+        // Entry 0 is the directory, the rest are files inside it
+        data.len = 0;
+        if (i == 0) {
+            snprintf(name, sizeof(name), "docs/");
+        } else {
+            snprintf(name, sizeof(name), "docs/file%05u.txt", i);
+            put_text(&data, member_size, rng);
+        }
+        uint32_t crc = (uint32_t)crc32(0, data.data, (uInt)data.len);
+        uint32_t offset = (uint32_t)b->len;
+
+        put_le32(b, 0x04034B50);
+        put_le16(b, 20);      // Version needed
+        put_le16(b, 0);       // Flags
+        put_le16(b, 0);       // Stored
+        put_le16(b, 0x6000);  // 12:00
+        put_le16(b, 0x5821);  // 2024-01-01
+        put_le32(b, crc);
+        put_le32(b, (uint32_t)data.len);
+        put_le32(b, (uint32_t)data.len);
+        put_le16(b, (unsigned)strlen(name));
+        put_le16(b, 0);
+        put_str(b, name);
+        put_bytes(b, data.data, data.len);
+
+        put_le32(&central, 0x02014B50);
+        put_le16(&central, 20);  // Version made by
+        put_le16(&central, 20);
+        put_le16(&central, 0);
+        put_le16(&central, 0);
+        put_le16(&central, 0x6000);
+        put_le16(&central, 0x5821);
+        put_le32(&central, crc);
+        put_le32(&central, (uint32_t)data.len);
+        put_le32(&central, (uint32_t)data.len);
+        put_le16(&central, (unsigned)strlen(name));
+        put_fill(&central, 0, 8);  // Extra, comment, disk, internal attributes
+        put_le32(&central, i == 0 ? 0x10 : 0);  // MS-DOS directory attribute
+        put_le32(&central, offset);
+        put_str(&central, name);
+    }
+
+    // Central directory and its end record
+    uint32_t directory = (uint32_t)b->len;
+    put_bytes(b, central.data, central.len);
+    put_le32(b, 0x06054B50);
+    put_le32(b, 0);
+    put_le16(b, members + 1);
+    put_le16(b, members + 1);
+    put_le32(b, (uint32_t)central.len);
+    put_le32(b, directory);
+    put_le16(b, 0);
+    b->failed |= central.failed | data.failed;
+    free(central.data);
+    free(data.data);
+}
+
+// Append one ustar header block
+static void put_tar_header(Buffer *b, const char *name, size_t size, char type) {
+    unsigned char block[512] = { 0 };
+    snprintf((char *)block, 100, "%s", name);
+    memcpy(block + 100, type == '5' ? "0000755" : "0000644", 8);
+    memcpy(block + 108, "0001750", 8);  // uid 1000
+    memcpy(block + 116, "0001750", 8);  // gid 1000
+    snprintf((char *)block + 124, 12, "%011zo", size);
+    snprintf((char *)block + 136, 12, "%011o", 1704067200u);  // 2024-01-01
+    memset(block + 148, ' ', 8);
+    block[156] = (unsigned char)type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    memcpy(block + 265, "bench", 6);
+    memcpy(block + 297, "bench", 6);
+    unsigned sum = 0;
+    for (int i = 0; i < 512; i++) {
+        sum += block[i];
+    }
+    snprintf((char *)block + 148, 8, "%06o", sum);
+    put_bytes(b, block, sizeof(block));
+}
+
+// A ustar archive with one directory and text members
+static void build_tar(Buffer *b, uint64_t size, uint32_t *rng) {
+    unsigned members;
+    size_t member_size;
+    archive_layout(size, &members, &member_size);
+    char name[64];
+
+    put_tar_header(b, "docs/", 0, '5');
+    for (unsigned i = 1; i <= members; i++) {
+        snprintf(name, sizeof(name), "docs/file%05u.txt", i);
+        // The header needs the exact size, so build the member first
+        Buffer data = { 0 };
+        put_text(&data, member_size, rng);
+        put_tar_header(b, name, data.len, '0');
+        put_bytes(b, data.data, data.len);
+        put_fill(b, 0, (512 - data.len % 512) % 512);
+        b->failed |= data.failed;
+        free(data.data);
+    }
+    put_fill(b, 0, 1024);  // End of archive
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+const char *corpus_kind_name(CorpusKind kind) {
+    return kind_names[kind];
+}
+
+int corpus_path(char *buf, size_t size, const char *dir, CorpusKind kind, unsigned index) {
+    int n = snprintf(buf, size, "%s/%s-%04u.%s", dir, kind_names[kind], index,
+                     kind_extensions[kind]);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+// Write a finished buffer to path
+static int write_file(const char *path, const Buffer *b) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    size_t written = fwrite(b->data, 1, b->len, f);
+    if (fclose(f) != 0 || written != b->len) {
+        return -1;
+    }
+    return 0;
+}
+
+// Generate and write fixture index of one kind
+static int generate_one(const char *path, CorpusKind kind, unsigned index, const CorpusOptions *opts) {
+    // Every file gets its own stream, so changing the count keeps the others
+    uint32_t rng = opts->seed * 2654435761u ^ (kind * 40503u + index * 69069u) ^ 0x9E3779B9u;
+    if (rng == 0) {
+        rng = 1;
+    }
+    Buffer b = { 0 };
+    int status = 0;
+
+    switch (kind) {
+    case CORPUS_TEXT:
+        put_text(&b, opts->size, &rng);
+        break;
+    case CORPUS_PNG:
+        build_png(&b, opts->size, &rng);
+        break;
+    case CORPUS_JPEG:
+        build_jpeg(&b, opts->size, index);
+        break;
+    case CORPUS_MP4:
+        build_mp4(&b, opts->size, index);
+        break;
+    case CORPUS_MKV:
+        build_mkv(&b, opts->size, index);
+        break;
+    case CORPUS_PDF:
+        build_pdf(&b, opts->size, index, &rng);
+        break;
+    case CORPUS_ZIP:
+        build_zip(&b, opts->size, &rng);
+        break;
+    case CORPUS_TAR:
+        build_tar(&b, opts->size, &rng);
+        break;
+    case CORPUS_GZIP: {
+        // Compress text through zlib's gzip writer; it stores no name or time
+        put_text(&b, opts->size, &rng);
+        gzFile gz = b.failed ? NULL : gzopen(path, "wb6");
+        if (gz == NULL || gzwrite(gz, b.data, (unsigned)b.len) != (int)b.len) {
+            status = -1;
+        }
+        if (gz != NULL && gzclose(gz) != Z_OK) {
+            status = -1;
+        }
+        free(b.data);
+        return status;
+    }
+    default:
+        break;
+    }
+
+    if (b.failed || write_file(path, &b) != 0) {
+        status = -1;
+    }
+    free(b.data);
+    return status;
+}
+
+int corpus_generate(const char *dir, const CorpusOptions *opts) {
+    char path[4096];
+    for (int kind = 0; kind < CORPUS_KINDS; kind++) {
+        for (unsigned i = 0; i < opts->count; i++) {
+            if (corpus_path(path, sizeof(path), dir, kind, i) != 0 ||
+                generate_one(path, kind, i, opts) != 0) {
+                fprintf(stderr, "Cannot write fixture: %s\n", path);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void corpus_remove(const char *dir, const CorpusOptions *opts) {
+    char path[4096];
+    for (int kind = 0; kind < CORPUS_KINDS; kind++) {
+        for (unsigned i = 0; i < opts->count; i++) {
+            if (corpus_path(path, sizeof(path), dir, kind, i) == 0) {
+                unlink(path);
+            }
+        }
+    }
+}
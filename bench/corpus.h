@@ -0,0 +1,39 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kinds of fixture the generator writes; each exercises one handler path
+typedef enum {
+    CORPUS_TEXT,
+    CORPUS_PNG,
+    CORPUS_JPEG,
+    CORPUS_MP4,
+    CORPUS_MKV,
+    CORPUS_PDF,
+    CORPUS_ZIP,
+    CORPUS_TAR,
+    CORPUS_GZIP,
+    CORPUS_KINDS
+} CorpusKind;
+
+// What to generate
+typedef struct {
+    unsigned count;  // Files of each kind
+    uint64_t size;   // Approximate size of each file in bytes
+    uint32_t seed;   // Same seed, same bytes
+} CorpusOptions;
+
+// Short name of a kind, also used as its file name prefix ("text", "png", ...)
+const char *corpus_kind_name(CorpusKind kind);
+// Build the path of fixture index of the given kind inside dir
+// Returns 0 on success, -1 if it does not fit in size bytes
+int corpus_path(char *buf, size_t size, const char *dir, CorpusKind kind, unsigned index);
+// Write every fixture into dir, which must exist
+// Returns 0 on success, -1 after reporting the first failure
+int corpus_generate(const char *dir, const CorpusOptions *opts);
+// Delete the fixtures corpus_generate() wrote with the same options
+void corpus_remove(const char *dir, const CorpusOptions *opts);
+
+#endif // CORPUS_H
@@ -0,0 +1,61 @@
+// Write the benchmark corpus to a directory, for profiling by hand or for
+// running inf itself over the same files the benchmarks use
+
+// Include necessary header files
+#include "corpus.h"   // The fixture generator
+#include <getopt.h>   // getopt_long() for command line parsing
+#include <stdio.h>    // printf(), fprintf()
+#include <stdlib.h>   // strtoul(), strtoull()
+#include <sys/stat.h> // mkdir()
+
+// Print usage instructions
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTION]... <directory>\n", program_name);
+    printf("Write deterministic text, image, video, PDF and archive fixtures.\n\n");
+    printf("Options:\n");
+    printf("  -h, --help        Display this help and exit\n");
+    printf("  -n, --count=N     Files of each kind (default: 20)\n");
+    printf("  -s, --size=BYTES  Approximate size of each file (default: 65536)\n");
+    printf("      --seed=N      Seed for the generated content (default: 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",  no_argument,       NULL, 'h'},
+        {"count", required_argument, NULL, 'n'},
+        {"size",  required_argument, NULL, 's'},
+        {"seed",  required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}
+    };
+    CorpusOptions opts = { .count = 20, .size = 65536, .seed = 1 };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hn:s:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        case 'n':
+            opts.count = (unsigned)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            opts.size = strtoull(optarg, NULL, 10);
+            break;
+        case 'S':
+            opts.seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Create the directory if needed; an existing one is overwritten file by file
+    const char *dir = argv[optind];
+    mkdir(dir, 0755);
+    return corpus_generate(dir, &opts) == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Include necessary header files
+#include "arena.h"     // Declarations for the functions defined in this file
+#include <stdalign.h>  // alignof
+#include <stddef.h>    // max_align_t
+#include <stdint.h>    // SIZE_MAX
+#include <stdlib.h>    // malloc(), free()
+#include <string.h>    // memcpy(), strlen(), strnlen()
+
+// Size of the first block; enough for everything a typical file reports
+#define ARENA_FIRST_CHUNK 4096
+
+// Allocations are rounded up to this so any type can be stored
+#define ARENA_ALIGN alignof(max_align_t)
+
+void arena_init(Arena *arena) {
+    arena->head = NULL;
+    arena->current = NULL;
+}
+
+// Link a block with room for at least size bytes in after prev (at the
+// front when prev is NULL), keeping any later blocks for reuse
+static ArenaChunk *arena_grow(Arena *arena, ArenaChunk *prev, size_t size) {
+    // Each new block is twice the last, so a busy arena settles quickly
+    size_t chunk_size = prev ? prev->size * 2 : ARENA_FIRST_CHUNK;
+    if (chunk_size < size) {
+        chunk_size = size;
+    }
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    if (prev == NULL) {
+        chunk->next = arena->head;
+        arena->head = chunk;
+    } else {
+        chunk->next = prev->next;
+        prev->next = chunk;
+    }
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    // Refuse sizes that would overflow the block arithmetic below
+    if (size > SIZE_MAX / 4) {
+        return NULL;
+    }
+    // Round up so the next allocation stays aligned
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) {
+        size = ARENA_ALIGN;
+    }
+
+    ArenaChunk *prev = NULL;
+    ArenaChunk *chunk = arena->current;
+    if (chunk == NULL && arena->head != NULL) {
+        // First allocation after a reset: start over in the first block
+        chunk = arena->head;
+        chunk->used = 0;
+    }
+    // Move on through blocks kept from earlier rounds, emptying each one
+    // as it is reached; that is what keeps arena_reset() O(1)
+    while (chunk != NULL && chunk->size - chunk->used < size) {
+        prev = chunk;
+        chunk = chunk->next;
+        if (chunk != NULL) {
+            chunk->used = 0;
+        }
+    }
+    if (chunk == NULL) {
+        chunk = arena_grow(arena, prev, size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+    }
+    arena->current = chunk;
+
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_reset(Arena *arena) {
+    // Blocks are emptied lazily by arena_alloc() when it reaches them
+    arena->current = NULL;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(arena);
+}
@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdalign.h>  // alignas
+#include <stddef.h>    // max_align_t, size_t
+
+// One block of arena memory; blocks are chained and kept across resets
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;  // Next block in the chain, NULL for the last
+    size_t size;              // Usable bytes in data
+    size_t used;              // Bytes handed out so far
+    // The memory itself; aligned like malloc()'s, so are the rounded
+    // offsets arena_alloc() hands out from it
+    alignas(max_align_t) char data[];
+} ArenaChunk;
+
+// Bump allocator for strings that all die together, such as the values
+// gathered for one file. Individual allocations are never freed; the whole
+// arena is emptied at once by arena_reset().
+typedef struct {
+    ArenaChunk *head;     // First block, NULL until something is allocated
+    ArenaChunk *current;  // Block allocations are taken from
+} Arena;
+
+// Start with an empty arena; no memory is allocated until first use
+void arena_init(Arena *arena);
+// Return size bytes aligned for any type, or NULL if memory runs out
+void *arena_alloc(Arena *arena, size_t size);
+// Copy a string into the arena
+char *arena_strdup(Arena *arena, const char *s);
+// Copy at most n bytes of s into the arena and terminate the copy
+char *arena_strndup(Arena *arena, const char *s, size_t n);
+// Forget every allocation but keep the blocks for reuse; O(1)
+void arena_reset(Arena *arena);
+// Release all blocks and leave the arena empty
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,491 @@
+// Define _GNU_SOURCE to enable getdelim() and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "batch.h"      // Declarations for the batch runner
+#include "detect.h"     // How much of a file detection reads
+#include "prefetch.h"   // Opening and reading files ahead of the workers
+#include "profile.h"    // Reporting the prefetch setup under --profile
+#include <pthread.h>    // Worker threads, mutexes and condition variables
+#include <stdio.h>      // getdelim()
+#include <stdlib.h>     // malloc(), calloc(), free()
+#include <string.h>     // strdup(), strlen()
+#include <unistd.h>     // sysconf()
+
+// Number of in-flight slots per worker; bounds memory for endless path lists
+#define SLOTS_PER_JOB 16
+// Smallest read-ahead buffer worth giving a file
+#define MIN_PREFETCH_SIZE 4096
+
+// Lifecycle of a slot in the batch window
+enum {
+    SLOT_FREE,    // Available for the next path
+    SLOT_QUEUED,  // Holds a path waiting for (or being handled by) a worker
+    SLOT_DONE     // Finished, waiting to be emitted
+};
+
+// One file travelling through the pipeline
+typedef struct {
+    char *path;      // Owned copy of the path
+    FileContext ctx; // Analysis result for this path
+    int state;       // One of the SLOT_* values
+    PrefetchRequest prefetch;  // The file opened and read ahead, when prefetching
+} BatchSlot;
+
+// Shared state of one batch run
+typedef struct Batch {
+    const BatchOptions *opts;
+    BatchSink sink;
+    void *sink_arg;
+    BatchSlot *slots;       // In-flight files; a ring indexed by sequence number in ordered mode
+    size_t window;          // Number of slots
+    size_t *queue;          // Slot of each queued sequence number, a ring of window entries
+    size_t *free_slots;     // Stack of free slots in unordered mode, where any one will do
+    size_t free_count;
+    size_t next_fill;       // Sequence number the producer will queue next
+    size_t next_claim;      // Sequence number a worker will take next
+    size_t next_emit;       // Sequence number to emit next in ordered mode
+    size_t finished;        // Number of files analyzed so far
+    int input_done;         // Set once the source is exhausted
+    size_t failed;          // Number of files that could not be examined
+    Prefetcher *prefetcher; // Opens and reads queued files ahead, or NULL
+    size_t prefetch_size;   // Read-ahead buffer of each slot
+    pthread_mutex_t lock;   // Protects everything above
+    pthread_cond_t work_ready;  // Signalled when a path is queued or input ends
+    pthread_cond_t slot_free;   // Signalled when a slot is released
+    size_t tickets;         // Queued files the pool has not taken yet (pool lock)
+    struct Batch *pool_next;    // Next batch run waiting for the pool (pool lock)
+} Batch;
+
+// Shared workers and the batch runs waiting for them
+struct BatchPool {
+    pthread_t *threads;
+    int started;            // Number of workers running
+    Batch *head;            // Batch runs with queued files, served in turn
+    Batch *tail;
+    int stopping;           // Set by batch_pool_stop()
+    pthread_mutex_t lock;   // Protects everything above and each batch's tickets
+    pthread_cond_t work_ready;  // Signalled when a file is queued or the pool stops
+};
+
+// Hand out paths from argv first, then from the list stream
+char *path_source_next(void *arg) {
+    PathSource *src = arg;
+
+    // Command line arguments come first, in order
+    if (src->next < src->count) {
+        return strdup(src->paths[src->next++]);
+    }
+
+    // Then read delimited entries from the list, skipping empty ones
+    if (src->list == NULL) {
+        return NULL;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getdelim(&line, &cap, src->delimiter, src->list)) != -1) {
+        // Drop the trailing delimiter (and a CR from DOS-style lists)
+        if (len > 0 && line[len - 1] == src->delimiter) {
+            line[--len] = '\0';
+        }
+        if (src->delimiter == '\n' && len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            return line;
+        }
+    }
+    free(line);
+    return NULL;
+}
+
+// Use one worker per online CPU by default
+int default_job_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Hand a finished slot to the sink and make it reusable (lock held)
+static void emit_slot(Batch *batch, BatchSlot *slot) {
+    if (slot->ctx.failed) {
+        batch->failed++;
+    }
+    batch->sink(&slot->ctx, batch->sink_arg);
+    // The context keeps its storage; the next file in this slot reuses it
+    free(slot->path);
+    slot->path = NULL;
+    slot->state = SLOT_FREE;
+    if (batch->opts->unordered) {
+        batch->free_slots[batch->free_count++] = (size_t)(slot - batch->slots);
+    }
+}
+
+// Take the next queued slot in sequence (lock held)
+static BatchSlot *claim_slot(Batch *batch) {
+    return &batch->slots[batch->queue[batch->next_claim++ % batch->window]];
+}
+
+// Analyze a claimed slot; called without the lock
+static void analyze_slot(Batch *batch, BatchSlot *slot) {
+    if (batch->prefetcher != NULL) {
+        // Start from the descriptor and bytes the prefetcher got, if any
+        prefetch_wait(batch->prefetcher, &slot->prefetch);
+        slot->ctx.fd = slot->prefetch.fd;
+        if (slot->prefetch.length > 0) {
+            slot->ctx.head = slot->prefetch.buffer;
+            slot->ctx.head_length = slot->prefetch.length;
+        }
+    }
+    process_file(&slot->ctx);
+}
+
+// Record an analyzed slot and emit whatever may leave now (lock held)
+static void finish_slot(Batch *batch, BatchSlot *slot) {
+    slot->state = SLOT_DONE;
+    batch->finished++;
+    if (batch->opts->unordered) {
+        // Completion order: emit right away
+        emit_slot(batch, slot);
+    } else {
+        // Input order: emit every finished slot at the head of the window
+        while (batch->next_emit < batch->next_fill) {
+            BatchSlot *head = &batch->slots[batch->next_emit % batch->window];
+            if (head->state != SLOT_DONE) {
+                break;
+            }
+            emit_slot(batch, head);
+            batch->next_emit++;
+        }
+    }
+    pthread_cond_broadcast(&batch->slot_free);
+}
+
+// Worker thread: claim queued paths in sequence and analyze them
+static void *batch_worker(void *arg) {
+    Batch *batch = arg;
+
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        // Wait until there is something to claim or nothing more will come
+        while (batch->next_claim == batch->next_fill && !batch->input_done) {
+            pthread_cond_wait(&batch->work_ready, &batch->lock);
+        }
+        if (batch->next_claim == batch->next_fill) {
+            break;
+        }
+        BatchSlot *slot = claim_slot(batch);
+
+        // Analyze without holding the lock
+        pthread_mutex_unlock(&batch->lock);
+        analyze_slot(batch, slot);
+        pthread_mutex_lock(&batch->lock);
+        finish_slot(batch, slot);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+// Put a batch run at the back of the pool's line (pool lock held)
+static void pool_append(BatchPool *pool, Batch *batch) {
+    batch->pool_next = NULL;
+    if (pool->tail != NULL) {
+        pool->tail->pool_next = batch;
+    } else {
+        pool->head = batch;
+    }
+    pool->tail = batch;
+}
+
+// Tell the pool that batch queued one more file
+static void pool_submit(BatchPool *pool, Batch *batch) {
+    pthread_mutex_lock(&pool->lock);
+    if (batch->tickets++ == 0) {
+        pool_append(pool, batch);
+    }
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Pool worker: take one file at a time from the batch runs in turn
+static void *pool_worker(void *arg) {
+    BatchPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->head == NULL) {
+            break;
+        }
+        // One file from the first run, which then goes to the back, so a
+        // long list does not hold up the runs that came after it
+        Batch *batch = pool->head;
+        pool->head = batch->pool_next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        if (--batch->tickets > 0) {
+            pool_append(pool, batch);
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        // The run stays alive until every file it queued is finished
+        pthread_mutex_lock(&batch->lock);
+        BatchSlot *slot = claim_slot(batch);
+        pthread_mutex_unlock(&batch->lock);
+        analyze_slot(batch, slot);
+        pthread_mutex_lock(&batch->lock);
+        finish_slot(batch, slot);
+        pthread_mutex_unlock(&batch->lock);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+BatchPool *batch_pool_start(int jobs) {
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    BatchPool *pool = calloc(1, sizeof(BatchPool));
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    if (pool == NULL || threads == NULL) {
+        free(pool);
+        free(threads);
+        return NULL;
+    }
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[pool->started], NULL, pool_worker, pool) == 0) {
+            pool->started++;
+        }
+    }
+    if (pool->started == 0) {
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->work_ready);
+        free(threads);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void batch_pool_stop(BatchPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    free(pool->threads);
+    free(pool);
+}
+
+// Prepare a context for the next path under the batch's options
+void batch_start_file(FileContext *ctx, const BatchOptions *opts, const char *path) {
+    reset_file_context(ctx, path);
+    ctx->max_cost = opts->max_cost;
+    ctx->fields = opts->fields;
+    ctx->read_limit = opts->read_limit;
+    ctx->incremental = opts->incremental;
+    ctx->digest = opts->digest;
+    ctx->sniff = opts->sniff;
+    ctx->estimate_budget = opts->estimate_budget;
+    if (opts->deep_depth > 0) {
+        ctx->deep.depth = opts->deep_depth;
+        ctx->deep.bytes = opts->deep_budget;
+        ctx->deep.members = DEEP_MAX_MEMBERS;
+    }
+}
+
+// Analyze every path from source on the calling thread
+static size_t run_inline(const BatchOptions *opts, BatchSource source, void *source_arg,
+                         BatchSink sink, void *sink_arg) {
+    size_t failed = 0;
+    char *path;
+    // One context serves every file, so its storage is allocated only once
+    FileContext ctx;
+    init_file_context(&ctx, NULL);
+    while ((path = source(source_arg)) != NULL) {
+        batch_start_file(&ctx, opts, path);
+        process_file(&ctx);
+        if (ctx.failed) {
+            failed++;
+        }
+        sink(&ctx, sink_arg);
+        free(path);
+    }
+    free_file_context(&ctx);
+    return failed;
+}
+
+// Analyze every path from source with a pool of worker threads
+// Returns the number of files that could not be examined
+size_t batch_run(const BatchOptions *opts, BatchSource source, void *source_arg,
+                 BatchSink sink, void *sink_arg) {
+    // One job without prefetching needs no threads at all, unless the
+    // files have to go through a shared pool
+    if (opts->pool == NULL && opts->jobs <= 1 && opts->prefetch_depth <= 0) {
+        return run_inline(opts, source, source_arg, sink, sink_arg);
+    }
+    int jobs = opts->jobs > 1 ? opts->jobs : 1;
+
+    Batch batch = {
+        .opts = opts,
+        .sink = sink,
+        .sink_arg = sink_arg,
+        .window = (size_t)jobs * SLOTS_PER_JOB,
+    };
+    if (opts->prefetch_depth > 0) {
+        batch.prefetcher = prefetch_start(opts->prefetch_depth);
+    }
+    if (batch.prefetcher != NULL) {
+        // Room for the prefetched files on top of the workers' own slots;
+        // the memory cap is split evenly between all of them
+        batch.window += (size_t)opts->prefetch_depth;
+        batch.prefetch_size = opts->prefetch_memory / batch.window;
+        if (batch.prefetch_size < MIN_PREFETCH_SIZE) {
+            batch.prefetch_size = MIN_PREFETCH_SIZE;
+        }
+        // No more than detection will use: libmagic's limit, or half of
+        // the read limit when there is one
+        size_t read_size = detect_read_size();
+        if (opts->read_limit != 0 && read_size > opts->read_limit / 2) {
+            read_size = (size_t)(opts->read_limit / 2);
+        }
+        if (batch.prefetch_size > read_size) {
+            batch.prefetch_size = read_size;
+        }
+        if (profile_is_enabled()) {
+            fprintf(stderr, "prefetch: backend=%s depth=%d buffer_bytes=%zu\n",
+                    prefetch_backend(batch.prefetcher), opts->prefetch_depth,
+                    batch.prefetch_size);
+        }
+    }
+    batch.slots = calloc(batch.window, sizeof(BatchSlot));
+    batch.queue = calloc(batch.window, sizeof(size_t));
+    batch.free_slots = calloc(batch.window, sizeof(size_t));
+    // A shared pool brings its own workers
+    pthread_t *threads = opts->pool == NULL ? calloc(jobs, sizeof(pthread_t)) : NULL;
+    if (batch.slots == NULL || batch.queue == NULL || batch.free_slots == NULL ||
+        (opts->pool == NULL && threads == NULL)) {
+        if (batch.prefetcher != NULL) {
+            prefetch_stop(batch.prefetcher);
+        }
+        free(batch.slots);
+        free(batch.queue);
+        free(batch.free_slots);
+        free(threads);
+        return run_inline(opts, source, source_arg, sink, sink_arg);
+    }
+    // Lowest slots first
+    for (size_t i = 0; i < batch.window; i++) {
+        batch.free_slots[i] = batch.window - 1 - i;
+    }
+    batch.free_count = batch.window;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.work_ready, NULL);
+    pthread_cond_init(&batch.slot_free, NULL);
+
+    // Start the workers; carry on with however many could be created
+    int started = 0;
+    for (int i = 0; i < jobs && opts->pool == NULL; i++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &batch) == 0) {
+            started++;
+        }
+    }
+    if (opts->pool == NULL && started == 0) {
+        if (batch.prefetcher != NULL) {
+            prefetch_stop(batch.prefetcher);
+        }
+        pthread_mutex_destroy(&batch.lock);
+        pthread_cond_destroy(&batch.work_ready);
+        pthread_cond_destroy(&batch.slot_free);
+        free(batch.slots);
+        free(batch.queue);
+        free(batch.free_slots);
+        free(threads);
+        return run_inline(opts, source, source_arg, sink, sink_arg);
+    }
+
+    // Feed paths into the window, waiting whenever it is full
+    char *path;
+    while ((path = source(source_arg)) != NULL) {
+        pthread_mutex_lock(&batch.lock);
+        size_t index;
+        if (opts->unordered) {
+            // Any free slot: one slow file holds up only its own
+            while (batch.free_count == 0) {
+                pthread_cond_wait(&batch.slot_free, &batch.lock);
+            }
+            index = batch.free_slots[--batch.free_count];
+        } else {
+            // The slot of this sequence number, so results leave in order
+            index = batch.next_fill % batch.window;
+            while (batch.slots[index].state != SLOT_FREE) {
+                pthread_cond_wait(&batch.slot_free, &batch.lock);
+            }
+        }
+        BatchSlot *slot = &batch.slots[index];
+        batch.queue[batch.next_fill % batch.window] = index;
+        slot->path = path;
+        // Slots start zero-filled, which reset_file_context() accepts
+        batch_start_file(&slot->ctx, opts, path);
+        if (batch.prefetcher != NULL) {
+            // Each slot keeps its buffer for the files that follow
+            if (slot->prefetch.buffer == NULL) {
+                slot->prefetch.buffer = malloc(batch.prefetch_size);
+                slot->prefetch.capacity = slot->prefetch.buffer != NULL ? batch.prefetch_size : 0;
+            }
+            slot->prefetch.path = path;
+            prefetch_submit(batch.prefetcher, &slot->prefetch);
+        }
+        slot->state = SLOT_QUEUED;
+        batch.next_fill++;
+        pthread_cond_signal(&batch.work_ready);
+        pthread_mutex_unlock(&batch.lock);
+        if (opts->pool != NULL) {
+            pool_submit(opts->pool, &batch);
+        }
+    }
+
+    // Tell the workers no more paths are coming and wait for them to drain;
+    // pool workers carry on with other runs, so wait for the files instead
+    pthread_mutex_lock(&batch.lock);
+    batch.input_done = 1;
+    pthread_cond_broadcast(&batch.work_ready);
+    while (opts->pool != NULL && batch.finished < batch.next_fill) {
+        pthread_cond_wait(&batch.slot_free, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (batch.prefetcher != NULL) {
+        prefetch_stop(batch.prefetcher);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.work_ready);
+    pthread_cond_destroy(&batch.slot_free);
+    for (size_t i = 0; i < batch.window; i++) {
+        free_file_context(&batch.slots[i].ctx);
+        free(batch.slots[i].prefetch.buffer);
+    }
+    free(batch.slots);
+    free(batch.queue);
+    free(batch.free_slots);
+    free(threads);
+    return batch.failed;
+}
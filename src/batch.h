@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "file_info.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Supplies the next path to analyze as a malloc'd string, or NULL when exhausted
+typedef char *(*BatchSource)(void *arg);
+// Receives each finished file; calls never overlap, so it may write freely
+typedef void (*BatchSink)(const FileContext *ctx, void *arg);
+// Worker threads shared by batch runs going on at the same time, so that
+// together they analyze no more files at once than the pool has workers
+typedef struct BatchPool BatchPool;
+
+typedef struct {
+    int jobs;       // Number of worker threads (1 or less runs inline)
+    int unordered;  // Emit results as they complete instead of in input order
+    int prefetch_depth;      // Files opened and read ahead of the workers, 0 for none
+    size_t prefetch_memory;  // Bytes of read-ahead buffers shared by those files
+    HandlerCost max_cost;    // Most expensive handler or tool allowed (see registry.h)
+    const FieldSelection *fields;  // Fields to report, NULL for all of them
+    uint64_t read_limit;     // Bytes read per file for detection and handlers, 0 for no limit
+    int incremental;         // Count grown text files on from their cached checkpoints
+    DigestAlgorithm digest;  // Content digest to add to every file, DIGEST_NONE for none
+    SniffMode sniff;         // Whether the signature table answers before libmagic
+    uint64_t estimate_budget;  // Bytes sampled from large text files, 0 to count them all
+    unsigned deep_depth;     // Levels of archive members to analyze, 0 for none
+    uint64_t deep_budget;    // Bytes those members may decompress to, per file
+    BatchPool *pool;         // Workers to hand files to instead of starting jobs threads, or NULL
+} BatchOptions;
+
+// Paths given on the command line, followed by an optional list stream
+typedef struct {
+    char **paths;   // Paths given as arguments
+    size_t count;   // Number of argument paths
+    size_t next;    // Index of the next argument path to hand out
+    FILE *list;     // Stream with further paths, or NULL
+    int delimiter;  // Separator used in the list stream ('\n' or '\0')
+} PathSource;
+
+char *path_source_next(void *arg);
+int default_job_count(void);
+// Reset ctx for path and apply the per-file options (tools, fields, limits,
+// digest, signature table, estimates, archive members)
+void batch_start_file(FileContext *ctx, const BatchOptions *opts, const char *path);
+size_t batch_run(const BatchOptions *opts, BatchSource source, void *source_arg,
+                 BatchSink sink, void *sink_arg);
+// Start jobs shared workers; NULL if none could be started
+BatchPool *batch_pool_start(int jobs);
+// Stop the workers once no batch run uses them any more
+void batch_pool_stop(BatchPool *pool);
+
+#endif // BATCH_H
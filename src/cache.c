@@ -0,0 +1,789 @@
+// Define _GNU_SOURCE to enable certain GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "cache.h"      // Declarations for this file
+#include <errno.h>      // errno, EEXIST
+#include <fcntl.h>      // open()
+#include <pthread.h>    // Locks around the pending records and the mapping
+#include <signal.h>     // sigset_t, SIGINT, SIGTERM, SIGHUP
+#include <stdio.h>      // fprintf(), snprintf(), FILE
+#include <stdlib.h>     // malloc(), realloc(), free(), qsort(), getenv()
+#include <string.h>     // memcpy(), memcmp(), strlen()
+#include <sys/file.h>   // flock()
+#include <sys/mman.h>   // mmap(), munmap()
+#include <sys/stat.h>   // fstat(), mkdir()
+#include <time.h>       // time()
+#include <unistd.h>     // close(), unlink()
+#include <zlib.h>       // crc32() over each record
+
+// The cache file is written at the end of a run (every little while by a
+// run that does not end) and only ever replaced with rename(), so readers
+// mapping it never see a half-written file. Layout:
+//
+//   CacheHeader                     64 bytes
+//   CacheSlot[bucket_count]         open-addressing index on (st_dev, st_ino)
+//   records                         data_size bytes, see RecordHeader
+//
+// A record holds the key, a last-used time for eviction, the MIME type and
+// description, and the info entries the type detection and handlers added.
+// Size, date and permissions always come from a fresh stat(). Under
+// --incremental a text file's record also carries a checkpoint of its count.
+
+#define CACHE_MAGIC "INFCACH1"
+#define CACHE_FORMAT 2
+// Hits on records older than this are written back with a new last-used time
+#define TOUCH_INTERVAL 3600
+// Larger results are simply not cached
+#define MAX_RECORD_SIZE (1u << 20)
+// Processes that run until stopped write their records back this often, in
+// seconds, or sooner once this many wait
+#define FLUSH_INTERVAL 30
+#define FLUSH_RECORDS 4096
+
+typedef struct {
+    char magic[8];             // CACHE_MAGIC
+    uint32_t format;           // CACHE_FORMAT
+    uint32_t handler_version;  // CACHE_HANDLER_VERSION of the writer
+    uint64_t bucket_count;     // Slots in the index, a power of two
+    uint64_t record_count;     // Records in the data area
+    uint64_t data_size;        // Bytes in the data area
+    unsigned char reserved[24];
+} CacheHeader;
+
+typedef struct {
+    uint64_t hash;    // Hash of (st_dev, st_ino), 0 for an empty slot
+    uint32_t offset;  // Record offset within the data area
+    uint32_t length;  // Record length in bytes
+} CacheSlot;
+
+// Fixed start of a record; a CheckpointRecord if flagged, the MIME type,
+// description and the entries follow, each entry as a 32-bit key length, a
+// 32-bit value length and the bytes
+typedef struct {
+    uint64_t dev, ino, size, mtime_ns;  // Key
+    uint64_t last_used;                 // Unix time of the last hit or store
+    uint32_t entry_count;
+    uint16_t mime_len;
+    uint16_t description_len;
+    uint32_t checksum;                  // CRC-32 of the counts, flags and everything after
+    uint32_t flags;                     // RECORD_* bits
+} RecordHeader;
+
+// The record carries a text checkpoint
+#define RECORD_CHECKPOINT 1
+
+// A TextCheckpoint as stored, without padding
+typedef struct {
+    uint64_t lines, words, chars, code_points;
+    uint32_t in_word;
+    uint32_t block_crc;
+} CheckpointRecord;
+
+// A mapped cache file
+typedef struct {
+    unsigned char *map;
+    size_t map_size;
+    const CacheSlot *slots;
+    uint64_t bucket_count;
+    const unsigned char *data;
+    uint64_t data_size;
+} CacheMap;
+
+// A record to be written: this run's are malloc'd, older ones point into a mapping
+typedef struct {
+    uint64_t dev, ino, last_used;
+    const unsigned char *bytes;
+    uint32_t length;
+    size_t order;  // Tie-breaker that keeps this run's records first
+} CacheRecord;
+
+// State for the cache of this process; lookups read the mapping under the
+// read side of map_lock, stores append to the pending list under lock, and
+// lookups consult that list first, since its records are newer
+static struct {
+    int open;
+    int rebuild;
+    char *path;
+    uint64_t now;
+    CacheMap map;
+    pthread_rwlock_t map_lock;  // Write side only to replace the mapping
+    pthread_mutex_t lock;
+    CacheRecord *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    size_t *pending_index;      // Newest pending record per file, plus one; 0 is empty
+    size_t index_buckets;       // A power of two, at least twice pending_capacity
+    int flushing;               // A thread writes records back periodically
+    int stopping;               // ... until this is set
+    pthread_t flusher;
+    pthread_cond_t wake;        // Signalled when the flusher has work or should stop
+} cache = {
+    .map_lock = PTHREAD_RWLOCK_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// Mix device and inode numbers into a non-zero slot hash
+static uint64_t key_hash(uint64_t dev, uint64_t ino) {
+    uint64_t h = dev * 0x9E3779B97F4A7C15u ^ ino;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDu;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53u;
+    h ^= h >> 33;
+    return h | 1;
+}
+
+// Checksum of a record; the key is compared anyway and last_used changes on hits
+static uint32_t record_checksum(const RecordHeader *rec, const unsigned char *p, uint32_t length) {
+    uLong crc = crc32(0L, (const Bytef *)&rec->entry_count,
+                      sizeof(rec->entry_count) + sizeof(rec->mime_len) + sizeof(rec->description_len));
+    crc = crc32(crc, (const Bytef *)&rec->flags, sizeof(rec->flags));
+    return (uint32_t)crc32(crc, p + sizeof(RecordHeader), length - sizeof(RecordHeader));
+}
+
+static uint64_t mtime_ns(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000u + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+// Map a cache file and check that it is one this build can read
+static int map_cache(const char *path, CacheMap *map) {
+    memset(map, 0, sizeof(*map));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping stays valid, even after the file is replaced
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    map->map = p;
+    map->map_size = st.st_size;
+
+    const CacheHeader *header = p;
+    uint64_t buckets = header->bucket_count;
+    if (memcmp(header->magic, CACHE_MAGIC, 8) != 0 || header->format != CACHE_FORMAT ||
+        header->handler_version != CACHE_HANDLER_VERSION ||
+        buckets == 0 || (buckets & (buckets - 1)) != 0 ||
+        buckets > (map->map_size - sizeof(CacheHeader)) / sizeof(CacheSlot) ||
+        header->data_size > map->map_size - sizeof(CacheHeader) - buckets * sizeof(CacheSlot)) {
+        munmap(map->map, map->map_size);
+        memset(map, 0, sizeof(*map));
+        return -1;
+    }
+    map->slots = (const CacheSlot *)(map->map + sizeof(CacheHeader));
+    map->bucket_count = buckets;
+    map->data = map->map + sizeof(CacheHeader) + buckets * sizeof(CacheSlot);
+    map->data_size = header->data_size;
+    return 0;
+}
+
+static void unmap_cache(CacheMap *map) {
+    if (map->map != NULL) {
+        munmap(map->map, map->map_size);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+// Default location: $XDG_CACHE_HOME/inf/cache.bin or ~/.cache/inf/cache.bin
+static char *default_path(void) {
+    const char *base = getenv("XDG_CACHE_HOME");
+    char dir[4096];
+    if (base != NULL && base[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s", base);
+    } else if ((base = getenv("HOME")) != NULL && base[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache", base);
+    } else {
+        return NULL;
+    }
+    mkdir(dir, 0700);  // Usually there already
+    size_t len = strlen(dir);
+    snprintf(dir + len, sizeof(dir) - len, "/inf");
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    char *path = malloc(strlen(dir) + sizeof("/cache.bin"));
+    if (path != NULL) {
+        sprintf(path, "%s/cache.bin", dir);
+    }
+    return path;
+}
+
+int cache_open(const char *path, int rebuild) {
+    cache.path = path != NULL ? strdup(path) : default_path();
+    if (cache.path == NULL) {
+        fprintf(stderr, "Cannot locate cache directory\n");
+        return -1;
+    }
+    cache.rebuild = rebuild;
+    cache.now = (uint64_t)time(NULL);
+    // A missing or unreadable file just means every lookup misses
+    if (!rebuild) {
+        map_cache(cache.path, &cache.map);
+    }
+    cache.open = 1;
+    return 0;
+}
+
+// Current time for last-used stamps; a long-running process cannot go by
+// the time it started
+static uint64_t cache_now(void) {
+    return cache.flushing ? (uint64_t)time(NULL) : cache.now;
+}
+
+// Point the index entry for pending record r's file at it
+static void index_pending(size_t r) {
+    const CacheRecord *record = &cache.pending[r];
+    size_t mask = cache.index_buckets - 1;
+    size_t i = key_hash(record->dev, record->ino) & mask;
+    while (cache.pending_index[i] != 0) {
+        const CacheRecord *other = &cache.pending[cache.pending_index[i] - 1];
+        if (other->dev == record->dev && other->ino == record->ino) {
+            break;  // An older record for the same file
+        }
+        i = (i + 1) & mask;
+    }
+    cache.pending_index[i] = r + 1;
+}
+
+// The newest pending record for a device and inode, or NULL; call with the lock held
+static const CacheRecord *find_pending(uint64_t dev, uint64_t ino) {
+    if (cache.pending_count == 0) {
+        return NULL;
+    }
+    size_t mask = cache.index_buckets - 1;
+    for (size_t i = key_hash(dev, ino) & mask; cache.pending_index[i] != 0; i = (i + 1) & mask) {
+        const CacheRecord *record = &cache.pending[cache.pending_index[i] - 1];
+        if (record->dev == dev && record->ino == ino) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+// Queue a record for writing
+static void add_pending(CacheRecord record) {
+    pthread_mutex_lock(&cache.lock);
+    if (cache.pending_count == cache.pending_capacity) {
+        size_t capacity = cache.pending_capacity ? cache.pending_capacity * 2 : 64;
+        CacheRecord *grown = realloc(cache.pending, capacity * sizeof(CacheRecord));
+        size_t *index = grown != NULL ? calloc(capacity * 2, sizeof(size_t)) : NULL;
+        if (index == NULL) {
+            if (grown != NULL) {
+                cache.pending = grown;
+            }
+            pthread_mutex_unlock(&cache.lock);
+            free((void *)record.bytes);
+            return;
+        }
+        cache.pending = grown;
+        cache.pending_capacity = capacity;
+        free(cache.pending_index);
+        cache.pending_index = index;
+        cache.index_buckets = capacity * 2;
+        for (size_t r = 0; r < cache.pending_count; r++) {
+            index_pending(r);
+        }
+    }
+    record.order = cache.pending_count;
+    cache.pending[cache.pending_count] = record;
+    index_pending(cache.pending_count++);
+    if (cache.flushing && cache.pending_count >= FLUSH_RECORDS) {
+        pthread_cond_signal(&cache.wake);
+    }
+    pthread_mutex_unlock(&cache.lock);
+}
+
+// Add a record's entries to ctx; returns -1 if the record is damaged
+static int restore_record(FileContext *ctx, const unsigned char *p, uint32_t length) {
+    RecordHeader rec;
+    memcpy(&rec, p, sizeof(rec));
+    size_t at = sizeof(rec) + (rec.flags & RECORD_CHECKPOINT ? sizeof(CheckpointRecord) : 0);
+    if (rec.checksum != record_checksum(&rec, p, length) ||
+        at + rec.mime_len + rec.description_len > length ||
+        rec.mime_len >= sizeof(ctx->mime_type) || rec.description_len >= sizeof(ctx->description)) {
+        return -1;
+    }
+    memcpy(ctx->mime_type, p + at, rec.mime_len);
+    ctx->mime_type[rec.mime_len] = '\0';
+    at += rec.mime_len;
+    memcpy(ctx->description, p + at, rec.description_len);
+    ctx->description[rec.description_len] = '\0';
+    at += rec.description_len;
+
+    size_t before = ctx->info.size;
+    for (uint32_t i = 0; i < rec.entry_count; i++) {
+        uint32_t lengths[2];
+        if (at + sizeof(lengths) > length) {
+            goto damaged;
+        }
+        memcpy(lengths, p + at, sizeof(lengths));
+        at += sizeof(lengths);
+        if (lengths[0] > length - at || lengths[1] > length - at - lengths[0]) {
+            goto damaged;
+        }
+        // Entries are stored without terminators; copy them straight into
+        // the context's arena
+        char *key = arena_strndup(&ctx->info.arena, (const char *)p + at, lengths[0]);
+        char *value = arena_strndup(&ctx->info.arena, (const char *)p + at + lengths[0], lengths[1]);
+        if (key != NULL && value != NULL) {
+            add_info_borrowed(&ctx->info, key, value);
+        }
+        at += lengths[0] + lengths[1];
+    }
+    return 0;
+
+damaged:
+    // The copies stay in the arena until the context is reset
+    ctx->info.size = before;
+    return -1;
+}
+
+// Find the record for a device and inode in the mapped file, whatever the
+// file's size and date are now; NULL if there is none
+static const unsigned char *find_record(uint64_t dev, uint64_t ino, uint32_t *length) {
+    const CacheMap *map = &cache.map;
+    if (!cache.open || map->map == NULL) {
+        return NULL;
+    }
+    uint64_t hash = key_hash(dev, ino), mask = map->bucket_count - 1;
+    for (uint64_t n = 0, i = hash & mask; n < map->bucket_count; n++, i = (i + 1) & mask) {
+        const CacheSlot *slot = &map->slots[i];
+        if (slot->hash == 0) {
+            return NULL;  // Never seen
+        }
+        if (slot->hash != hash || slot->length < sizeof(RecordHeader) ||
+            (uint64_t)slot->offset + slot->length > map->data_size) {
+            continue;
+        }
+        const unsigned char *p = map->data + slot->offset;
+        RecordHeader rec;
+        memcpy(&rec, p, sizeof(rec));
+        if (rec.dev == dev && rec.ino == ino) {
+            *length = slot->length;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Restore a record if it is for ctx's file as it is now
+// Returns 1 on a hit, 0 if the file changed or the record is damaged
+static int restore_current(FileContext *ctx, const unsigned char *p, uint32_t length) {
+    RecordHeader rec;
+    memcpy(&rec, p, sizeof(rec));
+    // The same file, but changed since it was cached
+    if (rec.size != (uint64_t)ctx->st.st_size || rec.mtime_ns != mtime_ns(&ctx->st)) {
+        return 0;
+    }
+    return restore_record(ctx, p, length) == 0;
+}
+
+int cache_lookup(FileContext *ctx) {
+    if (!cache.open) {
+        return 0;
+    }
+    uint64_t dev = ctx->st.st_dev, ino = ctx->st.st_ino;
+    // Records stored since the file was mapped are the newer ones
+    pthread_mutex_lock(&cache.lock);
+    const CacheRecord *stored = find_pending(dev, ino);
+    int hit = stored != NULL && restore_current(ctx, stored->bytes, stored->length);
+    pthread_mutex_unlock(&cache.lock);
+    if (stored != NULL) {
+        return hit;
+    }
+
+    pthread_rwlock_rdlock(&cache.map_lock);
+    uint32_t length;
+    const unsigned char *p = find_record(dev, ino, &length);
+    hit = p != NULL && restore_current(ctx, p, length);
+    // Keep recently used records from being evicted
+    unsigned char *copy = NULL;
+    uint64_t now = cache_now();
+    if (hit) {
+        RecordHeader rec;
+        memcpy(&rec, p, sizeof(rec));
+        if (rec.last_used + TOUCH_INTERVAL < now && (copy = malloc(length)) != NULL) {
+            memcpy(copy, p, length);
+            rec.last_used = now;
+            memcpy(copy, &rec, sizeof(rec));
+        }
+    }
+    pthread_rwlock_unlock(&cache.map_lock);
+    // Queued only once the mapping is let go, as a flush takes the locks the
+    // other way round
+    if (copy != NULL) {
+        add_pending((CacheRecord){ dev, ino, now, copy, length, 0 });
+    }
+    return hit;
+}
+
+// Copy out a record's checkpoint and the type the file had then
+// Returns 0, or -1 if the record has no checkpoint or is damaged
+static int read_checkpoint(FileContext *ctx, const unsigned char *p, uint32_t length,
+                           TextCheckpoint *cp) {
+    RecordHeader rec;
+    memcpy(&rec, p, sizeof(rec));
+    size_t at = sizeof(rec) + sizeof(CheckpointRecord);
+    if (!(rec.flags & RECORD_CHECKPOINT) || at + rec.mime_len + rec.description_len > length ||
+        rec.mime_len >= sizeof(ctx->mime_type) || rec.description_len >= sizeof(ctx->description) ||
+        rec.checksum != record_checksum(&rec, p, length)) {
+        return -1;
+    }
+    CheckpointRecord stored;
+    memcpy(&stored, p + sizeof(rec), sizeof(stored));
+    cp->counts.lines = stored.lines;
+    cp->counts.words = stored.words;
+    cp->counts.chars = stored.chars;
+    cp->counts.code_points = stored.code_points;
+    cp->counts.in_word = (int)stored.in_word;
+    cp->block_crc = stored.block_crc;
+    memcpy(ctx->mime_type, p + at, rec.mime_len);
+    ctx->mime_type[rec.mime_len] = '\0';
+    memcpy(ctx->description, p + at + rec.mime_len, rec.description_len);
+    ctx->description[rec.description_len] = '\0';
+    return 0;
+}
+
+int cache_checkpoint(FileContext *ctx, TextCheckpoint *cp) {
+    if (!cache.open) {
+        return -1;
+    }
+    uint64_t dev = ctx->st.st_dev, ino = ctx->st.st_ino;
+    // A checkpoint stored since the file was mapped is the newer one
+    pthread_mutex_lock(&cache.lock);
+    const CacheRecord *stored = find_pending(dev, ino);
+    int status = stored != NULL ? read_checkpoint(ctx, stored->bytes, stored->length, cp) : -1;
+    pthread_mutex_unlock(&cache.lock);
+    if (stored != NULL) {
+        return status;
+    }
+
+    pthread_rwlock_rdlock(&cache.map_lock);
+    uint32_t length;
+    const unsigned char *p = find_record(dev, ino, &length);
+    status = p != NULL ? read_checkpoint(ctx, p, length, cp) : -1;
+    pthread_rwlock_unlock(&cache.map_lock);
+    return status;
+}
+
+void cache_store(const FileContext *ctx, size_t first) {
+    // Incomplete results (a tool missing or timed out) are not worth keeping
+    if (!cache.open || ctx->failed || ctx->tool_failures > 0) {
+        return;
+    }
+    RecordHeader rec = {
+        .dev = ctx->st.st_dev,
+        .ino = ctx->st.st_ino,
+        .size = (uint64_t)ctx->st.st_size,
+        .mtime_ns = mtime_ns(&ctx->st),
+        .last_used = cache_now(),
+        .entry_count = (uint32_t)(ctx->info.size - first),
+        .mime_len = (uint16_t)strlen(ctx->mime_type),
+        .description_len = (uint16_t)strlen(ctx->description),
+        .flags = ctx->checkpoint.counts.chars > 0 ? RECORD_CHECKPOINT : 0,
+    };
+    size_t length = sizeof(rec) + rec.mime_len + rec.description_len;
+    if (rec.flags & RECORD_CHECKPOINT) {
+        length += sizeof(CheckpointRecord);
+    }
+    for (size_t i = first; i < ctx->info.size; i++) {
+        length += 2 * sizeof(uint32_t) + strlen(ctx->info.data[i].key) + strlen(ctx->info.data[i].value);
+    }
+    if (length > MAX_RECORD_SIZE) {
+        return;
+    }
+    unsigned char *bytes = malloc(length);
+    if (bytes == NULL) {
+        return;
+    }
+    unsigned char *p = bytes;
+    memcpy(p, &rec, sizeof(rec));
+    p += sizeof(rec);
+    if (rec.flags & RECORD_CHECKPOINT) {
+        const TextCheckpoint *cp = &ctx->checkpoint;
+        CheckpointRecord stored = {
+            cp->counts.lines, cp->counts.words, cp->counts.chars, cp->counts.code_points,
+            (uint32_t)cp->counts.in_word, cp->block_crc
+        };
+        memcpy(p, &stored, sizeof(stored));
+        p += sizeof(stored);
+    }
+    memcpy(p, ctx->mime_type, rec.mime_len);
+    p += rec.mime_len;
+    memcpy(p, ctx->description, rec.description_len);
+    p += rec.description_len;
+    for (size_t i = first; i < ctx->info.size; i++) {
+        uint32_t lengths[2] = { (uint32_t)strlen(ctx->info.data[i].key),
+                                (uint32_t)strlen(ctx->info.data[i].value) };
+        memcpy(p, lengths, sizeof(lengths));
+        p += sizeof(lengths);
+        memcpy(p, ctx->info.data[i].key, lengths[0]);
+        p += lengths[0];
+        memcpy(p, ctx->info.data[i].value, lengths[1]);
+        p += lengths[1];
+    }
+    rec.checksum = record_checksum(&rec, bytes, (uint32_t)length);
+    memcpy(bytes, &rec, sizeof(rec));
+    add_pending((CacheRecord){ rec.dev, rec.ino, rec.last_used, bytes, (uint32_t)length, 0 });
+}
+
+// Most recently used first; among equals, this run's records first
+static int compare_records(const void *a, const void *b) {
+    const CacheRecord *x = a, *y = b;
+    if (x->last_used != y->last_used) {
+        return x->last_used > y->last_used ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Write records to a new file next to the cache and rename it into place
+static int write_cache(CacheRecord *records, size_t count) {
+    uint64_t buckets = 16;
+    while (buckets < count * 2) {
+        buckets *= 2;
+    }
+    CacheSlot *slots = calloc(buckets, sizeof(CacheSlot));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    // Assign offsets in write order and fill the index
+    uint64_t offset = 0;
+    for (size_t r = 0; r < count; r++) {
+        uint64_t hash = key_hash(records[r].dev, records[r].ino);
+        uint64_t i = hash & (buckets - 1);
+        while (slots[i].hash != 0) {
+            i = (i + 1) & (buckets - 1);
+        }
+        slots[i] = (CacheSlot){ hash, (uint32_t)offset, records[r].length };
+        offset += records[r].length;
+    }
+    CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .format = CACHE_FORMAT,
+        .handler_version = CACHE_HANDLER_VERSION,
+        .bucket_count = buckets,
+        .record_count = count,
+        .data_size = offset,
+    };
+
+    char *tmp = malloc(strlen(cache.path) + sizeof(".XXXXXX"));
+    if (tmp == NULL) {
+        free(slots);
+        return -1;
+    }
+    sprintf(tmp, "%s.XXXXXX", cache.path);
+    int fd = mkstemp(tmp);
+    FILE *out = fd != -1 ? fdopen(fd, "wb") : NULL;
+    int status = -1;
+    if (out != NULL) {
+        int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                 fwrite(slots, sizeof(CacheSlot), buckets, out) == buckets;
+        for (size_t r = 0; ok && r < count; r++) {
+            ok = fwrite(records[r].bytes, 1, records[r].length, out) == records[r].length;
+        }
+        // Replace the old file only once the new one is complete
+        if (fclose(out) == 0 && ok && rename(tmp, cache.path) == 0) {
+            status = 0;
+        }
+    } else if (fd != -1) {
+        close(fd);
+    }
+    if (status != 0 && fd != -1) {
+        unlink(tmp);
+    }
+    free(tmp);
+    free(slots);
+    return status;
+}
+
+// Merge the pending records with the file as it is now and replace it;
+// call with the lock held, or with no other thread left
+// Returns 0, or -1 if the file cannot be written
+static int write_back(void) {
+    // One writer at a time; readers never need the lock
+    char *lock_path = malloc(strlen(cache.path) + sizeof(".lock"));
+    int lock_fd = -1;
+    if (lock_path != NULL) {
+        sprintf(lock_path, "%s.lock", cache.path);
+        lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        free(lock_path);
+    }
+    if (lock_fd != -1) {
+        flock(lock_fd, LOCK_EX);
+    }
+
+    // Merge with the file as it is now, another run may have replaced it
+    int status = -1;
+    CacheMap current;
+    memset(&current, 0, sizeof(current));
+    if (!cache.rebuild) {
+        map_cache(cache.path, &current);
+    }
+    size_t count = cache.pending_count;
+    CacheRecord *records = malloc((count + current.bucket_count) * sizeof(CacheRecord));
+    if (records != NULL) {
+        memcpy(records, cache.pending, count * sizeof(CacheRecord));
+        for (uint64_t i = 0; i < current.bucket_count; i++) {
+            const CacheSlot *slot = &current.slots[i];
+            if (slot->hash == 0 || slot->length < sizeof(RecordHeader) ||
+                (uint64_t)slot->offset + slot->length > current.data_size) {
+                continue;
+            }
+            RecordHeader rec;
+            memcpy(&rec, current.data + slot->offset, sizeof(rec));
+            records[count] = (CacheRecord){ rec.dev, rec.ino, rec.last_used,
+                                            current.data + slot->offset, slot->length,
+                                            cache.pending_count + i };
+            count++;
+        }
+
+        // Keep the newest record per file until the size bound is reached
+        qsort(records, count, sizeof(CacheRecord), compare_records);
+        size_t seen_buckets = 16;
+        while (seen_buckets < count * 2) {
+            seen_buckets *= 2;
+        }
+        uint64_t *seen = calloc(seen_buckets, sizeof(uint64_t));
+        size_t kept = 0;
+        uint64_t bytes = 0;
+        for (size_t r = 0; seen != NULL && r < count; r++) {
+            uint64_t hash = key_hash(records[r].dev, records[r].ino);
+            size_t i = hash & (seen_buckets - 1);
+            int duplicate = 0;
+            while (seen[i] != 0) {
+                // Hash collisions only cost a record, never a wrong answer
+                if (seen[i] == hash) {
+                    duplicate = 1;
+                    break;
+                }
+                i = (i + 1) & (seen_buckets - 1);
+            }
+            if (duplicate || bytes + records[r].length > CACHE_MAX_BYTES) {
+                continue;
+            }
+            seen[i] = hash;
+            bytes += records[r].length;
+            records[kept++] = records[r];
+        }
+        if (seen != NULL && write_cache(records, kept) == 0) {
+            status = 0;
+        } else {
+            fprintf(stderr, "Cannot write cache: %s\n", cache.path);
+        }
+        free(seen);
+        free(records);
+    }
+    unmap_cache(&current);
+    if (lock_fd != -1) {
+        close(lock_fd);  // Releases the lock
+    }
+    return status;
+}
+
+// Drop the pending records; call with the lock held
+static void release_pending(void) {
+    for (size_t i = 0; i < cache.pending_count; i++) {
+        free((void *)cache.pending[i].bytes);
+    }
+    cache.pending_count = 0;
+    if (cache.pending_index != NULL) {
+        memset(cache.pending_index, 0, cache.index_buckets * sizeof(size_t));
+    }
+}
+
+// Write the pending records back and map the file that holds them, so
+// memory stays bounded and lookups find them there; records that cannot be
+// written are dropped all the same
+static void flush_pending(void) {
+    if (write_back() == 0) {
+        cache.rebuild = 0;  // From now on the file holds this run's records
+        CacheMap fresh;
+        if (map_cache(cache.path, &fresh) == 0) {
+            pthread_rwlock_wrlock(&cache.map_lock);
+            CacheMap old = cache.map;
+            cache.map = fresh;
+            pthread_rwlock_unlock(&cache.map_lock);
+            unmap_cache(&old);
+        }
+    }
+    release_pending();
+}
+
+// Write back every FLUSH_INTERVAL seconds, or once FLUSH_RECORDS records wait
+static void *flush_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&cache.lock);
+    while (!cache.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += FLUSH_INTERVAL;
+        int status = 0;
+        while (!cache.stopping && cache.pending_count < FLUSH_RECORDS && status != ETIMEDOUT) {
+            status = pthread_cond_timedwait(&cache.wake, &cache.lock, &deadline);
+        }
+        if (!cache.stopping && cache.pending_count > 0) {
+            flush_pending();
+        }
+    }
+    pthread_mutex_unlock(&cache.lock);
+    return NULL;
+}
+
+void cache_flush_periodically(void) {
+    if (!cache.open || cache.flushing) {
+        return;
+    }
+    // The flusher takes no signals: --serve and --watch block SIGINT and
+    // SIGTERM only once it runs, and one delivered to it would end inf
+    // before the cache is written back
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    cache.flushing = 1;
+    if (pthread_create(&cache.flusher, NULL, flush_thread, NULL) != 0) {
+        cache.flushing = 0;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+void cache_close(void) {
+    if (!cache.open) {
+        return;
+    }
+    if (cache.flushing) {
+        pthread_mutex_lock(&cache.lock);
+        cache.stopping = 1;
+        pthread_cond_signal(&cache.wake);
+        pthread_mutex_unlock(&cache.lock);
+        pthread_join(cache.flusher, NULL);
+        cache.flushing = 0;
+        cache.stopping = 0;
+    }
+    if (cache.pending_count > 0) {
+        write_back();
+    }
+
+    release_pending();
+    free(cache.pending);
+    cache.pending = NULL;
+    cache.pending_capacity = 0;
+    free(cache.pending_index);
+    cache.pending_index = NULL;
+    cache.index_buckets = 0;
+    unmap_cache(&cache.map);
+    free(cache.path);
+    cache.path = NULL;
+    cache.open = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "file_info.h"
+
+// Bump whenever a handler changes what it reports, so stale results are dropped
+#define CACHE_HANDLER_VERSION 2
+// Records beyond this many bytes are evicted, least recently used first
+#define CACHE_MAX_BYTES (64u << 20)
+
+// Open the cache file at path (NULL for the default location). With rebuild
+// set, existing records are ignored and replaced by this run's results.
+// Returns 0 on success, -1 if the cache cannot be used (inf then runs without)
+int cache_open(const char *path, int rebuild);
+// Restore the type and handler results of an unchanged file; ctx must hold
+// its stat data. Returns 1 on a hit, 0 on a miss or when no cache is open
+int cache_lookup(FileContext *ctx);
+// Find the text checkpoint an earlier run left for ctx's file (same device
+// and inode, whatever its size and date now) and copy the type that file
+// had then into ctx. Returns 0 if there is one, -1 otherwise
+int cache_checkpoint(FileContext *ctx, TextCheckpoint *cp);
+// Remember ctx's results from info entry first onwards, and its checkpoint
+void cache_store(const FileContext *ctx, size_t first);
+// For a process that runs until it is stopped (--serve, --watch): write
+// new records back every little while from a thread of its own, so they do
+// not pile up in memory, later lookups find them and a killed process loses
+// only the last few
+void cache_flush_periodically(void);
+// Write new and refreshed records back and release the cache
+void cache_close(void);
+
+#endif // CACHE_H
@@ -0,0 +1,232 @@
+// Include necessary header files
+#include "detect.h"     // Declarations for this file
+#include "profile.h"    // Timing of database loads and queries
+#include <magic.h>      // libmagic for file type detection
+#include <pthread.h>    // Thread-specific data and mutexes
+#include <stdio.h>      // fprintf(), snprintf()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcmp()
+
+// Head size used when libmagic cannot say how much it reads
+#define DEFAULT_READ_SIZE (1 << 20)
+
+// Loading the compiled magic database is by far the most expensive part of
+// detection, so loaded cookies are never thrown away. Each thread borrows a
+// cookie on first use and returns it to the idle list when it exits, where
+// the next thread picks it up already loaded.
+
+// An idle cookie waiting to be reused
+typedef struct IdleCookie {
+    magic_t cookie;
+    struct IdleCookie *next;
+} IdleCookie;
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static IdleCookie *idle_cookies = NULL;      // Cookies no thread currently owns
+static pthread_key_t cookie_key;             // The calling thread's cookie
+static pthread_once_t cookie_key_once = PTHREAD_ONCE_INIT;
+
+// Put a cookie back on the idle list
+static void release_cookie(void *cookie) {
+    IdleCookie *entry = malloc(sizeof(IdleCookie));
+    if (entry == NULL) {
+        magic_close(cookie);
+        return;
+    }
+    entry->cookie = cookie;
+    pthread_mutex_lock(&idle_lock);
+    entry->next = idle_cookies;
+    idle_cookies = entry;
+    pthread_mutex_unlock(&idle_lock);
+}
+
+// Create the thread key; thread exit hands the cookie back automatically
+static void create_cookie_key(void) {
+    pthread_key_create(&cookie_key, release_cookie);
+}
+
+// Get the calling thread's cookie, reusing an idle one or loading a new one
+static magic_t thread_cookie(void) {
+    pthread_once(&cookie_key_once, create_cookie_key);
+    magic_t cookie = pthread_getspecific(cookie_key);
+    if (cookie != NULL) {
+        return cookie;
+    }
+
+    // Prefer a cookie some earlier thread already loaded
+    pthread_mutex_lock(&idle_lock);
+    IdleCookie *entry = idle_cookies;
+    if (entry != NULL) {
+        idle_cookies = entry->next;
+    }
+    pthread_mutex_unlock(&idle_lock);
+    if (entry != NULL) {
+        cookie = entry->cookie;
+        free(entry);
+    } else {
+        PROFILE_BEGIN(start);
+        // Initialize the magic library
+        cookie = magic_open(MAGIC_NONE);
+        if (cookie == NULL) {
+            fprintf(stderr, "Unable to initialize magic library\n");
+            return NULL;
+        }
+        // Load the default magic database
+        if (magic_load(cookie, NULL) != 0) {
+            fprintf(stderr, "Cannot load magic database - %s\n", magic_error(cookie));
+            magic_close(cookie);
+            return NULL;
+        }
+        PROFILE_END(PROFILE_MAGIC_LOAD, start);
+    }
+
+    pthread_setspecific(cookie_key, cookie);
+    return cookie;
+}
+
+// Where a query reads the file from
+typedef struct {
+    const char *path;
+    int fd;
+    const unsigned char *head;
+    size_t head_length;
+} QuerySource;
+
+// Run one libmagic query with the given flags and copy the answer out
+static void query(magic_t cookie, int flags, const QuerySource *src, char *out, size_t out_size) {
+    if (out == NULL || out_size == 0) {
+        return;
+    }
+    out[0] = '\0';
+    // Switching flags is cheap; the loaded database is shared between modes
+    if (magic_setflags(cookie, flags) == -1) {
+        return;
+    }
+    // The returned string lives in the cookie, so copy it before the next call
+    const char *result;
+    if (src->head != NULL) {
+        result = magic_buffer(cookie, src->head, src->head_length);
+    } else if (src->fd != -1) {
+        result = magic_descriptor(cookie, src->fd);
+    } else {
+        result = magic_file(cookie, src->path);
+    }
+    if (result != NULL) {
+        snprintf(out, out_size, "%s", result);
+    }
+}
+
+// Whether libmagic needs the descriptor rather than the bytes to describe
+// this file as magic_file() would: ELF details come from parsing sections
+// and gzip's original size sits at the end of the file
+static int needs_descriptor(const unsigned char *head, size_t head_length) {
+    return (head_length >= 4 && memcmp(head, "\177ELF", 4) == 0) ||
+           (head_length >= 2 && head[0] == 0x1f && head[1] == 0x8b);
+}
+
+// Detect the MIME type and the file(1)-style description of a file
+// Some formats are better described from the whole file, when fd allows it
+int detect_file_type(const char *path, int fd, const unsigned char *head, size_t head_length,
+                     char *mime, size_t mime_size, char *description, size_t description_size) {
+    magic_t cookie = thread_cookie();
+    if (cookie == NULL) {
+        return -1;
+    }
+    QuerySource src = { path, fd, head, head_length };
+    if (head != NULL && head_length == 0) {
+        // An empty file's type comes from stat(), which only the path gets
+        src.head = NULL;
+        src.fd = -1;
+    } else if (head != NULL && fd != -1 && needs_descriptor(head, head_length)) {
+        src.head = NULL;
+    }
+    PROFILE_BEGIN(start);
+    query(cookie, MAGIC_MIME_TYPE, &src, mime, mime_size);
+    query(cookie, MAGIC_NONE, &src, description, description_size);
+    PROFILE_END(PROFILE_DETECT, start);
+    return 0;
+}
+
+// libmagic reads this much of a file itself, so the shared head holds as much
+size_t detect_read_size(void) {
+    size_t bytes_max = 0;
+    magic_t cookie = thread_cookie();
+    if (cookie == NULL || magic_getparam(cookie, MAGIC_PARAM_BYTES_MAX, &bytes_max) != 0 ||
+        bytes_max == 0) {
+        return DEFAULT_READ_SIZE;
+    }
+    return bytes_max;
+}
+
+// Progress of a preload: threads hold on to their cookies until all have one
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int loaded;    // Threads that have their cookie
+    int released;  // Set once every thread may exit
+} Preload;
+
+static void *preload_thread(void *arg) {
+    Preload *preload = arg;
+    thread_cookie();
+    pthread_mutex_lock(&preload->lock);
+    preload->loaded++;
+    pthread_cond_broadcast(&preload->changed);
+    while (!preload->released) {
+        pthread_cond_wait(&preload->changed, &preload->lock);
+    }
+    pthread_mutex_unlock(&preload->lock);
+    return NULL;
+}
+
+// Load count cookies on short-lived threads; they exit and leave the
+// cookies on the idle list for the workers that come later
+void detect_preload(int count) {
+    pthread_t *threads = count > 0 ? calloc(count, sizeof(pthread_t)) : NULL;
+    if (threads == NULL) {
+        return;
+    }
+    Preload preload = { .loaded = 0, .released = 0 };
+    pthread_mutex_init(&preload.lock, NULL);
+    pthread_cond_init(&preload.changed, NULL);
+
+    int started = 0;
+    while (started < count &&
+           pthread_create(&threads[started], NULL, preload_thread, &preload) == 0) {
+        started++;
+    }
+    // Let them go only when every one holds its own cookie
+    pthread_mutex_lock(&preload.lock);
+    while (preload.loaded < started) {
+        pthread_cond_wait(&preload.changed, &preload.lock);
+    }
+    preload.released = 1;
+    pthread_cond_broadcast(&preload.changed);
+    pthread_mutex_unlock(&preload.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&preload.changed);
+    pthread_mutex_destroy(&preload.lock);
+    free(threads);
+}
+
+// Close the calling thread's cookie and every idle one
+void detect_cleanup(void) {
+    pthread_once(&cookie_key_once, create_cookie_key);
+    magic_t cookie = pthread_getspecific(cookie_key);
+    if (cookie != NULL) {
+        pthread_setspecific(cookie_key, NULL);
+        magic_close(cookie);
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    while (idle_cookies != NULL) {
+        IdleCookie *entry = idle_cookies;
+        idle_cookies = entry->next;
+        magic_close(entry->cookie);
+        free(entry);
+    }
+    pthread_mutex_unlock(&idle_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stddef.h>
+
+// Detect a file's MIME type and description with a libmagic cookie that is
+// loaded once and then reused by the calling thread. The answer comes from
+// head (the file's first head_length bytes) when it is given, from the open
+// descriptor fd when it is not -1, and from path otherwise. Either output may
+// be NULL. With a head and fd -1, libmagic reads nothing beyond the head.
+// Returns 0 on success, -1 if libmagic is unavailable.
+int detect_file_type(const char *path, int fd, const unsigned char *head, size_t head_length,
+                     char *mime, size_t mime_size, char *description, size_t description_size);
+// How many leading bytes of a file libmagic looks at
+size_t detect_read_size(void);
+// Load up to count cookies ahead of time, for a long-running server
+void detect_preload(int count);
+// Close every cached cookie; call once when no thread detects any more
+void detect_cleanup(void);
+
+#endif // DETECT_H
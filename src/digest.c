@@ -0,0 +1,897 @@
+// Include necessary header files
+#include "digest.h"      // Declarations for this file
+#include <pthread.h>     // pthread_once() for one-time kernel selection
+#include <stdio.h>       // snprintf()
+#include <string.h>      // memcpy()
+#include <strings.h>     // strcasecmp()
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // AVX2 and SHA extensions intrinsics
+#define DIGEST_X86 1
+#endif
+
+// Little-endian loads, whatever the host's byte order
+static inline uint32_t load32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t load64(const unsigned char *p) {
+    return (uint64_t)load32(p) | (uint64_t)load32(p + 4) << 32;
+}
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint64_t rotl64(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+// ---------------------------------------------------------------------------
+// XXH3 (64-bit, seed 0, default secret)
+// ---------------------------------------------------------------------------
+
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPES_PER_BLOCK ((XXH3_SECRET_SIZE - 64) / 8)
+#define XXH3_MIDSIZE_MAX 240
+
+static const uint64_t XXH_PRIME32_1 = 0x9E3779B1u;
+static const uint64_t XXH_PRIME32_2 = 0x85EBCA77u;
+static const uint64_t XXH_PRIME32_3 = 0xC2B2AE3Du;
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87u;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4Fu;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9u;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63u;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5u;
+
+static const unsigned char xxh3_secret[XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+// Low and high halves of the 128-bit product, folded together
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product = (uint128)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    // Schoolbook product of the 32-bit halves
+    uint64_t lo_lo = (a & 0xFFFFFFFFu) * (b & 0xFFFFFFFFu);
+    uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFFu);
+    uint64_t lo_hi = (a & 0xFFFFFFFFu) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+    return lower ^ upper;
+#endif
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9u;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= 0x9FB21C651E98DF25u;
+    h ^= (h >> 35) + len;
+    h *= 0x9FB21C651E98DF25u;
+    return h ^ (h >> 28);
+}
+
+static inline uint64_t xxh3_mix16(const unsigned char *p, const unsigned char *secret) {
+    return mul128_fold64(load64(p) ^ load64(secret), load64(p + 8) ^ load64(secret + 8));
+}
+
+// Inputs of up to 240 bytes are hashed whole, with no accumulators
+static uint64_t xxh3_short(const unsigned char *p, size_t len) {
+    const unsigned char *secret = xxh3_secret;
+    if (len == 0) {
+        return xxh64_avalanche(load64(secret + 56) ^ load64(secret + 64));
+    }
+    if (len <= 3) {
+        uint32_t combined = (uint32_t)p[0] << 16 | (uint32_t)p[len >> 1] << 24 |
+                            (uint32_t)p[len - 1] | (uint32_t)len << 8;
+        uint64_t bitflip = load32(secret) ^ load32(secret + 4);
+        return xxh64_avalanche(combined ^ bitflip);
+    }
+    if (len <= 8) {
+        uint64_t bitflip = load64(secret + 8) ^ load64(secret + 16);
+        uint64_t input = load32(p + len - 4) + ((uint64_t)load32(p) << 32);
+        return xxh3_rrmxmx(input ^ bitflip, len);
+    }
+    if (len <= 16) {
+        uint64_t lo = load64(p) ^ (load64(secret + 24) ^ load64(secret + 32));
+        uint64_t hi = load64(p + len - 8) ^ (load64(secret + 40) ^ load64(secret + 48));
+        uint64_t acc = len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi);
+        return xxh3_avalanche(acc);
+    }
+    uint64_t acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        // Pairs of 16-byte lanes from both ends, as many as the length allows
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(p + 48, secret + 96);
+                    acc += xxh3_mix16(p + len - 64, secret + 112);
+                }
+                acc += xxh3_mix16(p + 32, secret + 64);
+                acc += xxh3_mix16(p + len - 48, secret + 80);
+            }
+            acc += xxh3_mix16(p + 16, secret + 32);
+            acc += xxh3_mix16(p + len - 32, secret + 48);
+        }
+        acc += xxh3_mix16(p, secret);
+        acc += xxh3_mix16(p + len - 16, secret + 16);
+        return xxh3_avalanche(acc);
+    }
+    size_t rounds = len / 16;
+    for (size_t i = 0; i < 8; i++) {
+        acc += xxh3_mix16(p + 16 * i, secret + 16 * i);
+    }
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8; i < rounds; i++) {
+        acc += xxh3_mix16(p + 16 * i, secret + 16 * (i - 8) + 3);
+    }
+    acc += xxh3_mix16(p + len - 16, secret + 136 - 17);
+    return xxh3_avalanche(acc);
+}
+
+// Fold one 64-byte stripe into the accumulators
+static inline void xxh3_accumulate_512(uint64_t acc[8], const unsigned char *p,
+                                       const unsigned char *secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t value = load64(p + 8 * i);
+        uint64_t key = value ^ load64(secret + 8 * i);
+        acc[i ^ 1] += value;
+        acc[i] += (key & 0xFFFFFFFFu) * (key >> 32);
+    }
+}
+
+static inline void xxh3_scramble(uint64_t acc[8], const unsigned char *secret) {
+    for (int i = 0; i < 8; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= load64(secret + 8 * i);
+        acc[i] *= XXH_PRIME32_1;
+    }
+}
+
+// Consume count stripes, scrambling after every block of them
+static void xxh3_stripes_scalar(uint64_t acc[8], const unsigned char *p, size_t count,
+                                unsigned *stripes) {
+    for (size_t s = 0; s < count; s++, p += 64) {
+        xxh3_accumulate_512(acc, p, xxh3_secret + *stripes * 8);
+        if (++*stripes == XXH3_STRIPES_PER_BLOCK) {
+            xxh3_scramble(acc, xxh3_secret + XXH3_SECRET_SIZE - 64);
+            *stripes = 0;
+        }
+    }
+}
+
+#ifdef DIGEST_X86
+// AVX2 kernel: the eight accumulators live in two registers
+__attribute__((target("avx2")))
+static void xxh3_stripes_avx2(uint64_t acc[8], const unsigned char *p, size_t count,
+                              unsigned *stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    const unsigned char *scramble_key = xxh3_secret + XXH3_SECRET_SIZE - 64;
+    unsigned stripe = *stripes;
+    for (size_t s = 0; s < count; s++, p += 64) {
+        const unsigned char *key = xxh3_secret + stripe * 8;
+        for (int half = 0; half < 2; half++) {
+            __m256i *a = half ? &a1 : &a0;
+            __m256i data = _mm256_loadu_si256((const __m256i *)(p + 32 * half));
+            __m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *)(key + 32 * half)));
+            // Low half times high half of each keyed lane
+            __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+            // Each lane also takes the raw input of its neighbour
+            __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            *a = _mm256_add_epi64(*a, _mm256_add_epi64(product, swapped));
+        }
+        if (++stripe == XXH3_STRIPES_PER_BLOCK) {
+            for (int half = 0; half < 2; half++) {
+                __m256i *a = half ? &a1 : &a0;
+                __m256i x = _mm256_xor_si256(*a, _mm256_srli_epi64(*a, 47));
+                x = _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i *)(scramble_key + 32 * half)));
+                // 64-bit lanes times a 32-bit prime, from two 32x32 products
+                __m256i lo = _mm256_mul_epu32(x, prime);
+                __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+                *a = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+            }
+            stripe = 0;
+        }
+    }
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a1);
+    *stripes = stripe;
+}
+#endif // DIGEST_X86
+
+typedef void (*Xxh3Kernel)(uint64_t acc[8], const unsigned char *p, size_t count, unsigned *stripes);
+static Xxh3Kernel xxh3_kernel = xxh3_stripes_scalar;
+static const char *xxh3_kernel_name = "scalar";
+
+static void xxh3_init(Xxh3State *s) {
+    static const uint64_t init[8] = {
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1
+    };
+    memcpy(s->acc, init, sizeof(init));
+    s->stripes = 0;
+    s->total = 0;
+    s->buffered = 0;
+}
+
+// Stripes are consumed only once more input is known to follow them: the
+// stripe that ends the input is mixed in differently
+static void xxh3_update(Xxh3State *s, const unsigned char *p, size_t len) {
+    size_t capacity = sizeof(s->buffer);
+    s->total += len;
+    if (s->buffered + len <= capacity) {
+        memcpy(s->buffer + s->buffered, p, len);
+        s->buffered += len;
+        return;
+    }
+    if (s->buffered > 0) {
+        size_t fill = capacity - s->buffered;
+        memcpy(s->buffer + s->buffered, p, fill);
+        p += fill;
+        len -= fill;
+        xxh3_kernel(s->acc, s->buffer, capacity / 64, &s->stripes);
+        s->buffered = 0;
+    }
+    // Long input is consumed in place, all but its last 1 to 64 bytes
+    if (len > capacity) {
+        size_t count = (len - 1) / 64;
+        xxh3_kernel(s->acc, p, count, &s->stripes);
+        p += count * 64;
+        len -= count * 64;
+        // The final stripe may need bytes from before what stays buffered
+        memcpy(s->buffer + capacity - 64, p - 64, 64);
+    }
+    memcpy(s->buffer, p, len);
+    s->buffered = len;
+}
+
+static uint64_t xxh3_digest(const Xxh3State *s) {
+    if (s->total <= XXH3_MIDSIZE_MAX) {
+        return xxh3_short(s->buffer, (size_t)s->total);
+    }
+    uint64_t acc[8];
+    unsigned stripes = s->stripes;
+    memcpy(acc, s->acc, sizeof(acc));
+    unsigned char last[64];
+    const unsigned char *final;
+    if (s->buffered >= 64) {
+        size_t count = (s->buffered - 1) / 64;
+        xxh3_kernel(acc, s->buffer, count, &stripes);
+        final = s->buffer + s->buffered - 64;
+    } else {
+        // The last stripe overlaps bytes that were consumed already
+        size_t catchup = 64 - s->buffered;
+        memcpy(last, s->buffer + sizeof(s->buffer) - catchup, catchup);
+        memcpy(last + catchup, s->buffer, s->buffered);
+        final = last;
+    }
+    xxh3_accumulate_512(acc, final, xxh3_secret + XXH3_SECRET_SIZE - 64 - 7);
+    // Merge the accumulators
+    uint64_t result = s->total * XXH_PRIME64_1;
+    for (int i = 0; i < 4; i++) {
+        result += mul128_fold64(acc[2 * i] ^ load64(xxh3_secret + 11 + 16 * i),
+                                acc[2 * i + 1] ^ load64(xxh3_secret + 11 + 16 * i + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+// ---------------------------------------------------------------------------
+// BLAKE3
+// ---------------------------------------------------------------------------
+
+enum {
+    BLAKE3_CHUNK_START = 1,
+    BLAKE3_CHUNK_END = 2,
+    BLAKE3_PARENT = 4,
+    BLAKE3_ROOT = 8
+};
+
+static const uint32_t blake3_iv[8] = {
+    0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+    0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+};
+
+// Message word order of each of the seven rounds
+static const unsigned char blake3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+#define BLAKE3_G(v, a, b, c, d, x, y)             \
+    do {                                          \
+        v[a] = v[a] + v[b] + (x);                 \
+        v[d] = rotr32(v[d] ^ v[a], 16);           \
+        v[c] = v[c] + v[d];                       \
+        v[b] = rotr32(v[b] ^ v[c], 12);           \
+        v[a] = v[a] + v[b] + (y);                 \
+        v[d] = rotr32(v[d] ^ v[a], 8);            \
+        v[c] = v[c] + v[d];                       \
+        v[b] = rotr32(v[b] ^ v[c], 7);            \
+    } while (0)
+
+// Compress one 64-byte block into a new chaining value
+static void blake3_compress(const uint32_t cv[8], const unsigned char block[64], uint32_t block_len,
+                            uint64_t counter, uint32_t flags, uint32_t out[8]) {
+    uint32_t m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = load32(block + 4 * i);
+    }
+    memcpy(v, cv, 8 * sizeof(uint32_t));
+    memcpy(v + 8, blake3_iv, 4 * sizeof(uint32_t));
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+    for (int r = 0; r < 7; r++) {
+        const unsigned char *s = blake3_schedule[r];
+        BLAKE3_G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        BLAKE3_G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        BLAKE3_G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        BLAKE3_G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        BLAKE3_G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        BLAKE3_G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        BLAKE3_G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        BLAKE3_G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+    }
+}
+
+// Chaining values of count whole chunks, numbered from counter on
+static void blake3_chunks_scalar(const unsigned char *p, size_t count, uint64_t counter,
+                                 uint32_t (*out)[8]) {
+    for (size_t c = 0; c < count; c++, p += BLAKE3_CHUNK_LEN) {
+        uint32_t cv[8];
+        memcpy(cv, blake3_iv, sizeof(cv));
+        for (int b = 0; b < BLAKE3_CHUNK_LEN / 64; b++) {
+            uint32_t flags = (b == 0 ? BLAKE3_CHUNK_START : 0) |
+                             (b == BLAKE3_CHUNK_LEN / 64 - 1 ? BLAKE3_CHUNK_END : 0);
+            blake3_compress(cv, p + 64 * b, 64, counter + c, flags, cv);
+        }
+        memcpy(out[c], cv, sizeof(cv));
+    }
+}
+
+#ifdef DIGEST_X86
+__attribute__((target("avx2")))
+static inline __m256i rotr_avx2(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// Turn eight rows of eight 32-bit words into eight columns
+__attribute__((target("avx2")))
+static inline void transpose8_avx2(__m256i r[8]) {
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+#define BLAKE3_G8(v, a, b, c, d, x, y)                                                   \
+    do {                                                                                 \
+        v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x);                        \
+        v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot16);                 \
+        v[c] = _mm256_add_epi32(v[c], v[d]);                                             \
+        v[b] = rotr_avx2(_mm256_xor_si256(v[b], v[c]), 12);                              \
+        v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y);                        \
+        v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot8);                  \
+        v[c] = _mm256_add_epi32(v[c], v[d]);                                             \
+        v[b] = rotr_avx2(_mm256_xor_si256(v[b], v[c]), 7);                               \
+    } while (0)
+
+// AVX2 kernel: eight chunks side by side, one per 32-bit lane
+__attribute__((target("avx2")))
+static void blake3_chunks8_avx2(const unsigned char *p, uint64_t counter, uint32_t (*out)[8]) {
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                                          1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    uint32_t lo[8], hi[8];
+    for (int j = 0; j < 8; j++) {
+        lo[j] = (uint32_t)(counter + j);
+        hi[j] = (uint32_t)((counter + j) >> 32);
+    }
+    const __m256i counter_lo = _mm256_loadu_si256((const __m256i *)lo);
+    const __m256i counter_hi = _mm256_loadu_si256((const __m256i *)hi);
+    __m256i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm256_set1_epi32((int)blake3_iv[i]);
+    }
+    for (int b = 0; b < BLAKE3_CHUNK_LEN / 64; b++) {
+        __m256i m[16], v[16];
+        for (int j = 0; j < 8; j++) {
+            const unsigned char *block = p + (size_t)j * BLAKE3_CHUNK_LEN + 64 * b;
+            m[j] = _mm256_loadu_si256((const __m256i *)block);
+            m[8 + j] = _mm256_loadu_si256((const __m256i *)(block + 32));
+        }
+        // Lane j of word w is word w of chunk j's block
+        transpose8_avx2(m);
+        transpose8_avx2(m + 8);
+        uint32_t flags = (b == 0 ? BLAKE3_CHUNK_START : 0) |
+                         (b == BLAKE3_CHUNK_LEN / 64 - 1 ? BLAKE3_CHUNK_END : 0);
+        for (int i = 0; i < 8; i++) {
+            v[i] = h[i];
+        }
+        for (int i = 0; i < 4; i++) {
+            v[8 + i] = _mm256_set1_epi32((int)blake3_iv[i]);
+        }
+        v[12] = counter_lo;
+        v[13] = counter_hi;
+        v[14] = _mm256_set1_epi32(64);
+        v[15] = _mm256_set1_epi32((int)flags);
+        for (int r = 0; r < 7; r++) {
+            const unsigned char *s = blake3_schedule[r];
+            BLAKE3_G8(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            BLAKE3_G8(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            BLAKE3_G8(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            BLAKE3_G8(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            BLAKE3_G8(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            BLAKE3_G8(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            BLAKE3_G8(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            BLAKE3_G8(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+    }
+    // Lane j of word i is word i of chunk j's chaining value
+    uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i *)words[i], h[i]);
+    }
+    for (int j = 0; j < 8; j++) {
+        for (int i = 0; i < 8; i++) {
+            out[j][i] = words[i][j];
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void blake3_chunks_avx2(const unsigned char *p, size_t count, uint64_t counter,
+                               uint32_t (*out)[8]) {
+    size_t c = 0;
+    for (; c + 8 <= count; c += 8) {
+        blake3_chunks8_avx2(p + c * BLAKE3_CHUNK_LEN, counter + c, out + c);
+    }
+    blake3_chunks_scalar(p + c * BLAKE3_CHUNK_LEN, count - c, counter + c, out + c);
+}
+#endif // DIGEST_X86
+
+typedef void (*Blake3Kernel)(const unsigned char *p, size_t count, uint64_t counter, uint32_t (*out)[8]);
+static Blake3Kernel blake3_kernel = blake3_chunks_scalar;
+static const char *blake3_kernel_name = "scalar";
+
+// Chunks handed to the kernel at once
+#define BLAKE3_BATCH 16
+
+static void blake3_start_chunk(Blake3State *s) {
+    memcpy(s->cv, blake3_iv, sizeof(s->cv));
+    s->blocks = 0;
+    s->buffered = 0;
+}
+
+static void blake3_init(Blake3State *s) {
+    s->chunk = 0;
+    s->depth = 0;
+    blake3_start_chunk(s);
+}
+
+// Chaining value of the parent of two subtrees
+static void blake3_parent(const uint32_t left[8], const uint32_t right[8], uint32_t flags,
+                          uint32_t out[8]) {
+    unsigned char block[64];
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 4; k++) {
+            block[4 * i + k] = (unsigned char)(left[i] >> (8 * k));
+            block[32 + 4 * i + k] = (unsigned char)(right[i] >> (8 * k));
+        }
+    }
+    blake3_compress(blake3_iv, block, 64, 0, BLAKE3_PARENT | flags, out);
+}
+
+// Push a finished chunk, first merging every subtree it completes; total is
+// the number of chunks finished so far, this one included
+static void blake3_push(Blake3State *s, const uint32_t cv[8], uint64_t total) {
+    uint32_t merged[8];
+    memcpy(merged, cv, sizeof(merged));
+    while ((total & 1) == 0) {
+        blake3_parent(s->stack[--s->depth], merged, 0, merged);
+        total >>= 1;
+    }
+    memcpy(s->stack[s->depth++], merged, sizeof(merged));
+}
+
+// A full block is compressed only once more input is known to follow it:
+// the one that ends the input is the root, or carries the chunk end flag
+static void blake3_update(Blake3State *s, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        if (s->buffered == 64) {
+            uint32_t flags = s->blocks == 0 ? BLAKE3_CHUNK_START : 0;
+            if (s->blocks == BLAKE3_CHUNK_LEN / 64 - 1) {
+                uint32_t cv[8];
+                blake3_compress(s->cv, s->block, 64, s->chunk, flags | BLAKE3_CHUNK_END, cv);
+                blake3_push(s, cv, ++s->chunk);
+                blake3_start_chunk(s);
+            } else {
+                blake3_compress(s->cv, s->block, 64, s->chunk, flags, s->cv);
+                s->blocks++;
+                s->buffered = 0;
+            }
+        }
+        // Whole chunks are hashed in place, several side by side
+        while (s->blocks == 0 && s->buffered == 0 && len > BLAKE3_CHUNK_LEN) {
+            uint32_t cvs[BLAKE3_BATCH][8];
+            size_t count = (len - 1) / BLAKE3_CHUNK_LEN;
+            if (count > BLAKE3_BATCH) {
+                count = BLAKE3_BATCH;
+            }
+            blake3_kernel(p, count, s->chunk, cvs);
+            for (size_t c = 0; c < count; c++) {
+                blake3_push(s, cvs[c], ++s->chunk);
+            }
+            p += count * BLAKE3_CHUNK_LEN;
+            len -= count * BLAKE3_CHUNK_LEN;
+        }
+        size_t take = 64 - s->buffered;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(s->block + s->buffered, p, take);
+        s->buffered += take;
+        p += take;
+        len -= take;
+    }
+}
+
+static void blake3_digest(const Blake3State *s, uint32_t out[8]) {
+    unsigned char block[64] = { 0 };
+    memcpy(block, s->block, s->buffered);
+    uint32_t flags = (s->blocks == 0 ? BLAKE3_CHUNK_START : 0) | BLAKE3_CHUNK_END;
+    if (s->depth == 0) {
+        blake3_compress(s->cv, block, (uint32_t)s->buffered, s->chunk, flags | BLAKE3_ROOT, out);
+        return;
+    }
+    // Fold the pending subtrees into the last chunk, the first of them last
+    uint32_t cv[8];
+    blake3_compress(s->cv, block, (uint32_t)s->buffered, s->chunk, flags, cv);
+    for (size_t i = s->depth; i-- > 0;) {
+        blake3_parent(s->stack[i], cv, i == 0 ? BLAKE3_ROOT : 0, cv);
+    }
+    memcpy(out, cv, sizeof(cv));
+}
+
+// ---------------------------------------------------------------------------
+// SHA-256
+// ---------------------------------------------------------------------------
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u, 0x3956c25bu, 0x59f111f1u, 0x923f82a4u, 0xab1c5ed5u,
+    0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u, 0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u,
+    0xe49b69c1u, 0xefbe4786u, 0x0fc19dc6u, 0x240ca1ccu, 0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+    0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u, 0xc6e00bf3u, 0xd5a79147u, 0x06ca6351u, 0x14292967u,
+    0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u, 0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u,
+    0xa2bfe8a1u, 0xa81a664bu, 0xc24b8b70u, 0xc76c51a3u, 0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+    0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u, 0x391c0cb3u, 0x4ed8aa4au, 0x5b9cca4fu, 0x682e6ff3u,
+    0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u, 0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u,
+};
+
+static inline uint32_t load32_be(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+// Compress count 64-byte blocks
+static void sha256_blocks_scalar(uint32_t h[8], const unsigned char *p, size_t count) {
+    for (; count > 0; count--, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = load32_be(p + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = k + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) +
+                          ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += k;
+    }
+}
+
+#ifdef DIGEST_X86
+// SHA extensions kernel: two rounds per instruction, the message schedule
+// four words at a time
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t h[8], const unsigned char *p, size_t count) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    // The instructions keep the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(h + 4)), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; count > 0; count--, p += 64) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i m[4];
+        #pragma GCC unroll 16
+        for (int g = 0; g < 16; g++) {
+            // Four rounds per group; message vector g % 4 holds their words
+            if (g < 4) {
+                m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * g)), byteswap);
+            }
+            __m128i msg = _mm_add_epi32(m[g % 4], _mm_loadu_si128((const __m128i *)(sha256_k + 4 * g)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (g >= 3 && g <= 14) {
+                __m128i next = _mm_add_epi32(m[(g + 1) % 4], _mm_alignr_epi8(m[g % 4], m[(g + 3) % 4], 4));
+                m[(g + 1) % 4] = _mm_sha256msg2_epu32(next, m[g % 4]);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+            if (g >= 1 && g <= 12) {
+                m[(g + 3) % 4] = _mm_sha256msg1_epu32(m[(g + 3) % 4], m[g % 4]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i *)h, _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i *)(h + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif // DIGEST_X86
+
+typedef void (*Sha256Kernel)(uint32_t h[8], const unsigned char *p, size_t count);
+static Sha256Kernel sha256_kernel = sha256_blocks_scalar;
+static const char *sha256_kernel_name = "scalar";
+
+static void sha256_init(Sha256State *s) {
+    static const uint32_t init[8] = {
+        0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au,
+        0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u
+    };
+    memcpy(s->h, init, sizeof(init));
+    s->total = 0;
+    s->buffered = 0;
+}
+
+static void sha256_update(Sha256State *s, const unsigned char *p, size_t len) {
+    s->total += len;
+    if (s->buffered > 0) {
+        size_t take = 64 - s->buffered;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(s->block + s->buffered, p, take);
+        s->buffered += take;
+        p += take;
+        len -= take;
+        if (s->buffered < 64) {
+            return;
+        }
+        sha256_kernel(s->h, s->block, 1);
+        s->buffered = 0;
+    }
+    sha256_kernel(s->h, p, len / 64);
+    memcpy(s->block, p + len / 64 * 64, len % 64);
+    s->buffered = len % 64;
+}
+
+static void sha256_digest(const Sha256State *s, unsigned char out[32]) {
+    // Pad with 0x80, zeros and the bit length into one or two last blocks
+    unsigned char block[128] = { 0 };
+    uint32_t h[8];
+    memcpy(h, s->h, sizeof(h));
+    memcpy(block, s->block, s->buffered);
+    block[s->buffered] = 0x80;
+    size_t blocks = s->buffered < 56 ? 1 : 2;
+    uint64_t bits = s->total * 8;
+    for (int i = 0; i < 8; i++) {
+        block[blocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    sha256_kernel(h, block, blocks);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------------------------
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// Choose the widest kernels the running CPU supports
+static void select_kernels(void) {
+#ifdef DIGEST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        xxh3_kernel = xxh3_stripes_avx2;
+        xxh3_kernel_name = "avx2";
+        blake3_kernel = blake3_chunks_avx2;
+        blake3_kernel_name = "avx2";
+    }
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+        sha256_kernel = sha256_blocks_shani;
+        sha256_kernel_name = "sha-ni";
+    }
+#endif
+}
+
+// Names --hash accepts, and the fields the digests are reported under
+static const struct {
+    const char *name;
+    const char *field;
+} algorithms[DIGEST_COUNT] = {
+    [DIGEST_NONE] = { "none", NULL },
+    [DIGEST_XXH3] = { "xxh3", "XXH3" },
+    [DIGEST_BLAKE3] = { "blake3", "BLAKE3" },
+    [DIGEST_SHA256] = { "sha256", "SHA-256" },
+};
+
+int digest_parse(const char *name, DigestAlgorithm *algorithm) {
+    for (int i = DIGEST_XXH3; i < DIGEST_COUNT; i++) {
+        if (strcasecmp(name, algorithms[i].name) == 0) {
+            *algorithm = (DigestAlgorithm)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *digest_field_name(DigestAlgorithm algorithm) {
+    return algorithm > DIGEST_NONE && algorithm < DIGEST_COUNT ? algorithms[algorithm].field : NULL;
+}
+
+void digest_init(DigestState *state, DigestAlgorithm algorithm) {
+    pthread_once(&kernels_once, select_kernels);
+    state->algorithm = algorithm;
+    switch (algorithm) {
+    case DIGEST_XXH3:
+        xxh3_init(&state->u.xxh3);
+        break;
+    case DIGEST_BLAKE3:
+        blake3_init(&state->u.blake3);
+        break;
+    case DIGEST_SHA256:
+        sha256_init(&state->u.sha256);
+        break;
+    default:
+        break;
+    }
+}
+
+void digest_update(DigestState *state, const unsigned char *data, size_t len) {
+    switch (state->algorithm) {
+    case DIGEST_XXH3:
+        xxh3_update(&state->u.xxh3, data, len);
+        break;
+    case DIGEST_BLAKE3:
+        blake3_update(&state->u.blake3, data, len);
+        break;
+    case DIGEST_SHA256:
+        sha256_update(&state->u.sha256, data, len);
+        break;
+    default:
+        break;
+    }
+}
+
+void digest_final(const DigestState *state, char hex[DIGEST_HEX_SIZE]) {
+    unsigned char bytes[32];
+    size_t len = 0;
+    switch (state->algorithm) {
+    case DIGEST_XXH3: {
+        // Printed as one big-endian number
+        uint64_t h = xxh3_digest(&state->u.xxh3);
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (unsigned char)(h >> (56 - 8 * i));
+        }
+        len = 8;
+        break;
+    }
+    case DIGEST_BLAKE3: {
+        uint32_t words[8];
+        blake3_digest(&state->u.blake3, words);
+        for (int i = 0; i < 32; i++) {
+            bytes[i] = (unsigned char)(words[i / 4] >> (8 * (i % 4)));
+        }
+        len = 32;
+        break;
+    }
+    case DIGEST_SHA256:
+        sha256_digest(&state->u.sha256, bytes);
+        len = 32;
+        break;
+    default:
+        break;
+    }
+    for (size_t i = 0; i < len; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", bytes[i]);
+    }
+    hex[2 * len] = '\0';
+}
+
+const char *digest_kernel_name(DigestAlgorithm algorithm) {
+    pthread_once(&kernels_once, select_kernels);
+    switch (algorithm) {
+    case DIGEST_XXH3:
+        return xxh3_kernel_name;
+    case DIGEST_BLAKE3:
+        return blake3_kernel_name;
+    case DIGEST_SHA256:
+        return sha256_kernel_name;
+    default:
+        return "none";
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content digests --hash can add to a file's fields
+typedef enum {
+    DIGEST_NONE,
+    DIGEST_XXH3,    // XXH3 64-bit, seed 0, as xxhsum -H3 prints it
+    DIGEST_BLAKE3,  // BLAKE3 with 256-bit output, as b3sum prints it
+    DIGEST_SHA256,  // SHA-256, as sha256sum prints it
+    DIGEST_COUNT
+} DigestAlgorithm;
+
+// Longest digest in hex, with the terminating NUL
+#define DIGEST_HEX_SIZE 65
+// Bytes of input BLAKE3 gathers per chunk; chunks are compressed side by side
+#define BLAKE3_CHUNK_LEN 1024
+// Chaining values BLAKE3 may keep pending: enough for 2^54 chunks
+#define BLAKE3_MAX_DEPTH 54
+
+// XXH3: eight accumulators and the input not yet known to be followed by more
+typedef struct {
+    uint64_t acc[8];
+    unsigned stripes;           // 64-byte stripes consumed in the current block
+    uint64_t total;             // Bytes seen
+    size_t buffered;            // Bytes in buffer
+    unsigned char buffer[256];  // Its last stripe is kept for the final one
+} Xxh3State;
+
+// BLAKE3: the chunk being filled and the stack of finished subtrees
+typedef struct {
+    uint32_t cv[8];             // Chaining value of the current chunk so far
+    uint64_t chunk;             // Index of the current chunk
+    unsigned blocks;            // 64-byte blocks of it compressed
+    size_t buffered;            // Bytes in block
+    unsigned char block[64];    // The block not yet known to be followed by more
+    size_t depth;               // Entries in stack
+    uint32_t stack[BLAKE3_MAX_DEPTH][8];
+} Blake3State;
+
+// SHA-256: the hash so far and the partial block
+typedef struct {
+    uint32_t h[8];
+    uint64_t total;
+    size_t buffered;
+    unsigned char block[64];
+} Sha256State;
+
+// A running digest of any of the algorithms
+typedef struct {
+    DigestAlgorithm algorithm;
+    union {
+        Xxh3State xxh3;
+        Blake3State blake3;
+        Sha256State sha256;
+    } u;
+} DigestState;
+
+// Parse an algorithm name as --hash takes it ("xxh3", "blake3", "sha256")
+// Returns 0, or -1 for an unknown name
+int digest_parse(const char *name, DigestAlgorithm *algorithm);
+// Field the digest is reported under ("XXH3", "BLAKE3", "SHA-256")
+const char *digest_field_name(DigestAlgorithm algorithm);
+void digest_init(DigestState *state, DigestAlgorithm algorithm);
+// Add the next piece of the stream; pieces may have any size
+void digest_update(DigestState *state, const unsigned char *data, size_t len);
+// Write the digest of everything added as lowercase hex; the state is left
+// as it was, so more may still be added
+void digest_final(const DigestState *state, char hex[DIGEST_HEX_SIZE]);
+// Kernel in use for an algorithm, for diagnostics
+const char *digest_kernel_name(DigestAlgorithm algorithm);
+
+#endif // DIGEST_H
@@ -3,172 +3,758 @@
 
 // Include necessary header files
 #include "file_info.h"   // Contains declarations for functions defined in this file
-#include "utils.h"       // Contains utility functions like execute_command and format_size
-#include "handlers.h"    // Contains declarations for file type specific handlers
+#include "utils.h"       // Contains utility functions like format_size
+#include "registry.h"    // Handlers by MIME type
+#include "detect.h"      // Cached libmagic cookies for file type detection
+#include "cache.h"       // Results kept from earlier runs
+#include <errno.h>       // errno, EPERM
+#include <fcntl.h>       // open() and its flags
+#include <pthread.h>     // The per-thread head buffer
 #include <stdio.h>       // Standard I/O functions
 #include <stdlib.h>      // Standard library functions, including memory allocation
 #include <string.h>      // String manipulation functions
+#include <strings.h>     // strcasecmp() for field names
 #include <sys/stat.h>    // File status and information functions
 #include <time.h>        // Time and date functions
-#include <magic.h>       // libmagic for file type detection
+#include <unistd.h>      // close()
 
-// Declare the global InfoArray variable (defined in file_info.h)
-InfoArray info_array;
-
-// Initialize the InfoArray
-void init_info_array() {
+// Initialize an InfoArray
+void init_info_array(InfoArray *info) {
     // Set all members to NULL or 0
-    info_array.data = NULL;    // No data allocated yet
-    info_array.size = 0;       // No elements in the array
-    info_array.capacity = 0;   // No capacity allocated
+    info->data = NULL;    // No data allocated yet
+    info->size = 0;       // No elements in the array
+    info->capacity = 0;   // No capacity allocated
+    arena_init(&info->arena);  // No strings stored yet
 }
 
-// Add a new key-value pair to the InfoArray
-void add_info(const char *key, const char *value) {
+// Append a key-value pair whose strings are already owned elsewhere
+void add_info_borrowed(InfoArray *info, const char *key, const char *value) {
     // Check if we need to allocate more memory
-    if (info_array.size == info_array.capacity) {
-        // Double the capacity if it's not zero, otherwise set it to 1
-        info_array.capacity = info_array.capacity ? info_array.capacity * 2 : 1;
-        // Reallocate memory for the new capacity
-        // realloc can be used here as we don't need to preserve the old data if it fails
-        info_array.data = realloc(info_array.data, info_array.capacity * sizeof(KeyValue));
-    }
-    // Allocate memory for the new key and value strings and copy them
-    // strdup allocates memory and copies the string, it's equivalent to malloc + strcpy
-    info_array.data[info_array.size].key = strdup(key);
-    info_array.data[info_array.size].value = strdup(value);
+    if (info->size == info->capacity) {
+        // Start with room for a typical file's fields, then double
+        size_t capacity = info->capacity ? info->capacity * 2 : INFO_INITIAL_CAPACITY;
+        // Reallocate memory for the new capacity, keeping the old block on failure
+        KeyValue *data = realloc(info->data, capacity * sizeof(KeyValue));
+        if (data == NULL) {
+            return;
+        }
+        info->data = data;
+        info->capacity = capacity;
+    }
+    info->data[info->size].key = key;
+    info->data[info->size].value = value;
     // Increment the size of the array
-    info_array.size++;
+    info->size++;
+}
+
+// Add a new key-value pair to an InfoArray
+void add_info(InfoArray *info, const char *key, const char *value) {
+    // Keys are literals, so only the value needs a copy
+    char *copy = arena_strdup(&info->arena, value);
+    if (copy != NULL) {
+        add_info_borrowed(info, key, copy);
+    }
 }
 
-// Free all allocated memory in the InfoArray
-void free_info_array() {
-    // Iterate through all elements
-    for (size_t i = 0; i < info_array.size; i++) {
-        // Free the memory allocated for each key and value
-        free(info_array.data[i].key);
-        free(info_array.data[i].value);
+// Add a key-value pair whose key is built at run time
+void add_info_copy(InfoArray *info, const char *key, const char *value) {
+    char *key_copy = arena_strdup(&info->arena, key);
+    if (key_copy != NULL) {
+        add_info(info, key_copy, value);
     }
+}
+
+// Empty an InfoArray but keep its storage for reuse
+void reset_info_array(InfoArray *info) {
+    info->size = 0;
+    arena_reset(&info->arena);
+}
+
+// Free all allocated memory in an InfoArray
+void free_info_array(InfoArray *info) {
+    // Keys and values all live in the arena, so they go in one step
+    arena_free(&info->arena);
     // Free the memory allocated for the array itself
-    free(info_array.data);
-}
-
-// Get basic file information using stat
-void get_basic_info(const char *path) {
-    struct stat st;  // Declare a stat struct to hold file information
-    // Use stat to get file information, returns 0 on success
-    if (stat(path, &st) == 0) {
-        // Format the file size using the utility function
-        char* formatted_size = format_size(st.st_size);
-        // Add the formatted size to the info array
-        add_info("Size", formatted_size);
-        // Free the memory allocated by format_size
-        free(formatted_size);
-
-        // Convert the modification time to a string
-        char *time_str = ctime(&st.st_mtime);
-        // Remove the newline character at the end of the time string
-        time_str[strlen(time_str) - 1] = '\0';
-        // Add the modification time to the info array
-        add_info("Last modified", time_str);
-
-        // Create a string to hold the file permissions
-        char perms[11];
-        // Use snprintf to safely format the permissions string
-        snprintf(perms, sizeof(perms), "%c%c%c%c%c%c%c%c%c%c",
-                 S_ISDIR(st.st_mode) ? 'd' : '-',  // Is it a directory?
-                 (st.st_mode & S_IRUSR) ? 'r' : '-',  // Owner read permission
-                 (st.st_mode & S_IWUSR) ? 'w' : '-',  // Owner write permission
-                 (st.st_mode & S_IXUSR) ? 'x' : '-',  // Owner execute permission
-                 (st.st_mode & S_IRGRP) ? 'r' : '-',  // Group read permission
-                 (st.st_mode & S_IWGRP) ? 'w' : '-',  // Group write permission
-                 (st.st_mode & S_IXGRP) ? 'x' : '-',  // Group execute permission
-                 (st.st_mode & S_IROTH) ? 'r' : '-',  // Others read permission
-                 (st.st_mode & S_IWOTH) ? 'w' : '-',  // Others write permission
-                 (st.st_mode & S_IXOTH) ? 'x' : '-'); // Others execute permission
-        // Add the permissions string to the info array
-        add_info("Permissions", perms);
-    }
-}
-
-// Get the MIME type of the file using libmagic
-void get_mime_type(const char *path) {
-    // Initialize the magic library
-    magic_t magic = magic_open(MAGIC_MIME_TYPE);
-    if (magic == NULL) {
-        fprintf(stderr, "Unable to initialize magic library\n");
+    free(info->data);
+    // Leave the array empty so it can be reused
+    init_info_array(info);
+}
+
+// Bytes handed to the consumer and to the digest at a time, so the digest
+// reads them while they are still in the CPU's cache
+#define STREAM_SLICE (256u << 10)
+// Blocks stream_file() reads past the head
+#define STREAM_BLOCK (1u << 20)
+
+// Fields that come from stat() alone
+static const char *const stat_fields[] = { "Size", "Last modified", "Permissions" };
+
+// Parse a comma-separated list of field names, such as "Size,MIME type,Lines"
+int parse_fields(const char *list, FieldSelection *fields) {
+    memset(fields, 0, sizeof(*fields));
+    char *copy = strdup(list);
+    if (copy == NULL) {
+        return -1;
+    }
+    // There are at most one more names than commas
+    size_t max = 1;
+    for (const char *c = list; *c != '\0'; c++) {
+        max += *c == ',';
+    }
+    fields->names = calloc(max, sizeof(char *));
+    if (fields->names == NULL) {
+        free(copy);
+        return -1;
+    }
+    char *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+        // Spaces around a name are not part of it
+        while (*name == ' ') name++;
+        size_t len = strlen(name);
+        while (len > 0 && name[len - 1] == ' ') name[--len] = '\0';
+        if (len == 0) {
+            continue;
+        }
+        char *owned = strdup(name);
+        if (owned == NULL) {
+            free(copy);
+            free_fields(fields);
+            return -1;
+        }
+        fields->names[fields->count++] = owned;
+        // Note which stages the name calls for
+        if (strcasecmp(name, "MIME type") == 0 || strcasecmp(name, "File type") == 0) {
+            fields->wants_type = 1;
+            continue;
+        }
+        int from_stat = 0;
+        for (size_t i = 0; i < sizeof(stat_fields) / sizeof(stat_fields[0]); i++) {
+            from_stat |= strcasecmp(name, stat_fields[i]) == 0;
+        }
+        fields->wants_handler |= !from_stat;
+    }
+    free(copy);
+    if (fields->count == 0) {
+        free_fields(fields);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether a field is to be reported
+int field_wanted(const FieldSelection *fields, const char *key) {
+    if (fields == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < fields->count; i++) {
+        if (strcasecmp(fields->names[i], key) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Release the names of a selection
+void free_fields(FieldSelection *fields) {
+    for (size_t i = 0; i < fields->count; i++) {
+        free(fields->names[i]);
+    }
+    free(fields->names);
+    memset(fields, 0, sizeof(*fields));
+}
+
+// Set up everything in a context except its storage
+static void start_file_context(FileContext *ctx, const char *path) {
+    ctx->path = path;             // The path is borrowed, not copied
+    ctx->failed = 0;              // Nothing has gone wrong so far
+    ctx->mime_type[0] = '\0';     // Type not detected yet
+    ctx->description[0] = '\0';
+    ctx->fd = -1;                 // Opened by get_basic_info()
+    ctx->head = NULL;
+    ctx->head_length = 0;
+    ctx->max_cost = HANDLER_COST_EXTERNAL;  // Every handler may run unless the caller says otherwise
+    ctx->fields = NULL;           // Every field is reported
+    ctx->read_limit = 0;          // Files are read as far as their handlers need
+    ctx->incremental = 0;
+    memset(&ctx->resume, 0, sizeof(ctx->resume));          // No earlier count to go on from
+    memset(&ctx->checkpoint, 0, sizeof(ctx->checkpoint));  // Nor one to leave
+    ctx->digest = DIGEST_NONE;    // No content digest unless asked for
+    ctx->digest_hex[0] = '\0';
+    ctx->sniff = SNIFF_OFF;       // libmagic alone detects the type
+    ctx->estimate_budget = 0;     // Text files are counted through
+    ctx->estimated = 0;
+    memset(&ctx->deep, 0, sizeof(ctx->deep));  // Archives are not looked into
+    ctx->tool_runs = 0;           // No external tools run yet
+    ctx->tool_failures = 0;
+    ctx->tool_ns = 0;
+    memset(&ctx->profile, 0, sizeof(ctx->profile));
+}
+
+// Prepare a context for analyzing the file at path
+void init_file_context(FileContext *ctx, const char *path) {
+    init_info_array(&ctx->info);  // No information gathered yet
+    start_file_context(ctx, path);
+}
+
+// Prepare a used context for the next file without giving back its memory,
+// so a batch allocates field storage once rather than once per file
+void reset_file_context(FileContext *ctx, const char *path) {
+    reset_info_array(&ctx->info);
+    start_file_context(ctx, path);
+}
+
+// Release everything a context collected
+void free_file_context(FileContext *ctx) {
+    free_info_array(&ctx->info);
+}
+
+// Run an external tool on behalf of a handler and return its output
+// The time it took is charged to the file; a tool that hits its timeout
+// is killed and reported, so one bad file cannot stall a whole batch
+char *run_tool(FileContext *ctx, const char *const argv[], int timeout_ms) {
+    // A latency-sensitive run settles for what the in-process parsers found
+    if (ctx->max_cost < HANDLER_COST_EXTERNAL) {
+        return NULL;
+    }
+    CommandResult result;
+    char *output = execute_command(argv, timeout_ms, &result);
+    if (result.elapsed_ns > 0) {
+        ctx->tool_runs++;
+        ctx->tool_ns += result.elapsed_ns;
+    }
+    if (output == NULL) {
+        ctx->tool_failures++;
+    }
+    if (result.timed_out) {
+        fprintf(stderr, "Cannot finish %s in %d ms: %s\n", argv[0], timeout_ms, ctx->path);
+    }
+    return output;
+}
+
+// Open the file once for every stage and take its status from the descriptor
+// Returns 0, or -1 if the file cannot even be stat()ed
+static int open_file(FileContext *ctx) {
+    // O_NOATIME spares a metadata write per file but is refused on files we
+    // do not own; O_NONBLOCK keeps a FIFO from blocking the open
+    int flags = O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC;
+    // A batch that prefetches hands over the file already open
+    int fd = ctx->fd;
+    ctx->fd = -1;
+    if (fd == -1) {
+        fd = open(ctx->path, flags | O_NOATIME);
+    }
+    if (fd == -1 && errno == EPERM) {
+        fd = open(ctx->path, flags);
+    }
+    if (fd != -1) {
+        int status = fstat(fd, &ctx->st);
+        if (status == 0 && S_ISREG(ctx->st.st_mode)) {
+            ctx->fd = fd;
+            return 0;
+        }
+        // Directories and devices are described from their path as before
+        close(fd);
+        if (status == 0) {
+            return 0;
+        }
+    }
+    // An unreadable file can still be stat()ed
+    return stat(ctx->path, &ctx->st);
+}
+
+// Get basic file information from the file's status
+void get_basic_info(FileContext *ctx) {
+    // Keep the stat data in the context; the cache is keyed on it
+    struct stat *st = &ctx->st;
+    if (open_file(ctx) != 0) {
+        // Report the problem and remember it so the caller can set the exit code
+        fprintf(stderr, "Cannot stat file: %s\n", ctx->path);
+        ctx->failed = 1;
         return;
     }
 
-    // Load the default magic database
-    if (magic_load(magic, NULL) != 0) {
-        fprintf(stderr, "Cannot load magic database - %s\n", magic_error(magic));
-        magic_close(magic);
+    // Format the file size using the utility function
+    char* formatted_size = format_size(st->st_size);
+    // Add the formatted size to the info array
+    add_info(&ctx->info, "Size", formatted_size);
+    // Free the memory allocated by format_size
+    free(formatted_size);
+
+    // Convert the modification time to a string
+    // ctime_r writes into our own buffer, so concurrent workers don't clash
+    char time_str[32];
+    ctime_r(&st->st_mtime, time_str);
+    // Remove the newline character at the end of the time string
+    time_str[strlen(time_str) - 1] = '\0';
+    // Add the modification time to the info array
+    add_info(&ctx->info, "Last modified", time_str);
+
+    // Create a string to hold the file permissions
+    char perms[11];
+    // Use snprintf to safely format the permissions string
+    snprintf(perms, sizeof(perms), "%c%c%c%c%c%c%c%c%c%c",
+             S_ISDIR(st->st_mode) ? 'd' : '-',  // Is it a directory?
+             (st->st_mode & S_IRUSR) ? 'r' : '-',  // Owner read permission
+             (st->st_mode & S_IWUSR) ? 'w' : '-',  // Owner write permission
+             (st->st_mode & S_IXUSR) ? 'x' : '-',  // Owner execute permission
+             (st->st_mode & S_IRGRP) ? 'r' : '-',  // Group read permission
+             (st->st_mode & S_IWGRP) ? 'w' : '-',  // Group write permission
+             (st->st_mode & S_IXGRP) ? 'x' : '-',  // Group execute permission
+             (st->st_mode & S_IROTH) ? 'r' : '-',  // Others read permission
+             (st->st_mode & S_IWOTH) ? 'w' : '-',  // Others write permission
+             (st->st_mode & S_IXOTH) ? 'x' : '-'); // Others execute permission
+    // Add the permissions string to the info array
+    add_info(&ctx->info, "Permissions", perms);
+}
+
+// Each thread reads file heads into one buffer that grows to the largest
+// head it has needed; the buffer goes when the thread exits
+typedef struct {
+    unsigned char *data;
+    size_t capacity;
+} HeadBuffer;
+
+static pthread_key_t head_key;
+static pthread_once_t head_key_once = PTHREAD_ONCE_INIT;
+
+static void free_head_buffer(void *arg) {
+    HeadBuffer *buffer = arg;
+    free(buffer->data);
+    free(buffer);
+}
+
+static void create_head_key(void) {
+    pthread_key_create(&head_key, free_head_buffer);
+}
+
+// Get the calling thread's head buffer with room for size bytes, or NULL
+static unsigned char *head_buffer(size_t size) {
+    pthread_once(&head_key_once, create_head_key);
+    HeadBuffer *buffer = pthread_getspecific(head_key);
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(HeadBuffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(head_key, buffer);
+    }
+    if (buffer->capacity < size) {
+        unsigned char *data = realloc(buffer->data, size);
+        if (data == NULL) {
+            return NULL;
+        }
+        buffer->data = data;
+        buffer->capacity = size;
+    }
+    return buffer->data;
+}
+
+// Read as much of the file as libmagic looks at in one go; detection and
+// the handlers' parsers all work from these bytes
+static void read_head(FileContext *ctx) {
+    if (ctx->fd == -1) {
+        ctx->head = NULL;
+        ctx->head_length = 0;
         return;
     }
+    PROFILE_BEGIN(start);
+    size_t want = detect_read_size();
+    // Under --fast the head takes at most half of the file's budget
+    if (ctx->read_limit != 0 && want > ctx->read_limit / 2) {
+        want = (size_t)(ctx->read_limit / 2);
+    }
+    if ((uint64_t)ctx->st.st_size < want) {
+        want = (size_t)ctx->st.st_size;
+    }
+    // A prefetched head may already hold all of it
+    size_t have = ctx->head != NULL ? ctx->head_length : 0;
+    if (have >= want && have > 0) {
+        ctx->head_length = want;
+    } else {
+        // Otherwise read the rest behind what was prefetched; an empty file
+        // still gets a (zero-length) head
+        unsigned char *data = head_buffer(want > 0 ? want : 1);
+        ssize_t n = -1;
+        if (data != NULL) {
+            if (have > 0) {
+                memcpy(data, ctx->head, have);
+            }
+            n = read_at(ctx->fd, data + have, want - have, (off_t)have);
+        }
+        ctx->head = n >= 0 ? data : NULL;
+        ctx->head_length = n >= 0 ? have + (size_t)n : 0;
+    }
+    PROFILE_END(PROFILE_READ, start);
+}
 
-    // Get the MIME type of the file
-    const char *mime = magic_file(magic, path);
-    if (mime != NULL) {
-        // Add the MIME type to the info array
-        add_info("MIME type", mime);
+// Take the type from the signature table when it knows the format. libmagic
+// is then only asked for its description, and not even that when the
+// description is not to be reported; the table's short one stands in for it
+// so handlers can still tell UTF-8 text.
+// Returns 0 when the table had no answer
+static int sniff_file_type(FileContext *ctx, int fd) {
+    PROFILE_BEGIN(start);
+    const SniffType *type = sniff_type(ctx->head, ctx->head_length);
+    PROFILE_END(PROFILE_DETECT, start);
+    if (type == NULL) {
+        return 0;
     }
+    snprintf(ctx->mime_type, sizeof(ctx->mime_type), "%s", type->mime_type);
+    if (!field_wanted(ctx->fields, "File type") ||
+        detect_file_type(ctx->path, fd, ctx->head, ctx->head_length, NULL, 0,
+                         ctx->description, sizeof(ctx->description)) != 0) {
+        snprintf(ctx->description, sizeof(ctx->description), "%s", type->name);
+    }
+    return 1;
+}
 
-    // Clean up the magic library
-    magic_close(magic);
+// Under --sniff=check, compare the signature table's answer with the type
+// libmagic found and report the verdict as a field; disagreements also go
+// to stderr, so a walk over a whole corpus lists them
+static void check_sniff(FileContext *ctx) {
+    const SniffType *type = sniff_type(ctx->head, ctx->head_length);
+    if (type == NULL) {
+        add_info(&ctx->info, "Signature table", "no match");
+    } else if (strcmp(type->mime_type, ctx->mime_type) == 0) {
+        add_info(&ctx->info, "Signature table", "agrees");
+    } else {
+        fprintf(stderr, "Signature table disagrees on %s: %s, libmagic says %s\n",
+                ctx->path, type->mime_type, ctx->mime_type);
+        char verdict[160];
+        snprintf(verdict, sizeof(verdict), "differs: %s", type->mime_type);
+        add_info(&ctx->info, "Signature table", verdict);
+    }
 }
 
-// Process the file and gather all relevant information
-void process_file(const char *path) {
+// Get the MIME type and the description of the file using libmagic
+void get_file_type(FileContext *ctx) {
+    // libmagic would look at no more than a checkpoint already vouches for,
+    // so the type found last time still holds and the head need not be read
+    int known = ctx->resume.counts.chars >= detect_read_size() && ctx->mime_type[0] != '\0';
+    if (!known) {
+        read_head(ctx);
+        // Without the descriptor libmagic only sees the head, which keeps a
+        // limited run within its budget
+        int fd = ctx->read_limit != 0 && ctx->head != NULL ? -1 : ctx->fd;
+        // One cached cookie answers both questions, no database reload or subprocess
+        if ((ctx->sniff != SNIFF_ON || !sniff_file_type(ctx, fd)) &&
+            detect_file_type(ctx->path, fd, ctx->head, ctx->head_length,
+                             ctx->mime_type, sizeof(ctx->mime_type),
+                             ctx->description, sizeof(ctx->description)) != 0) {
+            return;
+        }
+    }
+
+    // Add the MIME type to the info array
+    if (ctx->mime_type[0] != '\0') {
+        add_info(&ctx->info, "MIME type", ctx->mime_type);
+    }
+    // Add the file type to the info array
+    if (ctx->description[0] != '\0') {
+        add_info(&ctx->info, "File type", ctx->description);
+    }
+    if (ctx->sniff == SNIFF_CHECK && !known) {
+        check_sniff(ctx);
+    }
+}
+
+// Close the file opened by get_basic_info(); the head goes with it
+void close_file(FileContext *ctx) {
+    if (ctx->fd != -1) {
+        close(ctx->fd);
+        ctx->fd = -1;
+    }
+    ctx->head = NULL;
+    ctx->head_length = 0;
+}
+
+// Give a handler a window over the open file that starts out with the head
+int open_window(const FileContext *ctx, FileWindow *window) {
+    if (ctx->fd == -1 && ctx->head == NULL) {
+        return -1;
+    }
+    window_init(window, ctx->fd, (uint64_t)ctx->st.st_size, ctx->head, ctx->head_length);
+    if (ctx->fd == -1) {
+        window->budget = 0;  // In memory: nothing beyond the head to read
+    } else if (ctx->read_limit != 0) {
+        // The head has been read already and counts against the limit
+        window->budget = ctx->read_limit > ctx->head_length ? ctx->read_limit - ctx->head_length : 0;
+    }
+    return 0;
+}
+
+// Call the handler that matches the detected file type
+// Returns 0 if a matching handler was left out, so the results are incomplete
+static int run_handler(FileContext *ctx) {
+    // Look the handler up by the detected MIME type
+    const HandlerEntry *entry = find_handler(ctx->mime_type);
+    if (entry == NULL) {
+        return 1;
+    }
+    // Skip it when it costs too much or reports nothing that was asked for
+    if (entry->cost > ctx->max_cost || !handler_wanted(entry, ctx->fields)) {
+        return 0;
+    }
+    ctx->profile.handler = entry->name;
+    PROFILE_BEGIN(start);
+    entry->run(ctx);
+    PROFILE_END(PROFILE_HANDLER, start);
+    return 1;
+}
+
+// Whether the file's digest is to be reported
+static int digest_wanted(const FileContext *ctx) {
+    return ctx->digest != DIGEST_NONE && field_wanted(ctx->fields, digest_field_name(ctx->digest));
+}
+
+// Hand one stretch of the file to the consumer and the digest, in slices
+static void stream_piece(DigestState *digest, StreamFn fn, void *arg,
+                         const unsigned char *data, size_t len) {
+    while (len > 0) {
+        size_t n = len < STREAM_SLICE ? len : STREAM_SLICE;
+        if (fn != NULL) {
+            fn(arg, data, n);
+        }
+        if (digest != NULL) {
+            digest_update(digest, data, n);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// Read the file from start to its end, once for the handler and the digest
+int stream_file(FileContext *ctx, uint64_t start, StreamFn fn, void *arg) {
+    if (ctx->fd == -1 && ctx->head == NULL) {
+        return -1;
+    }
+    // The digest covers the whole file, so only a pass from its start can feed it
+    DigestState state;
+    DigestState *digest = NULL;
+    if (start == 0 && ctx->digest_hex[0] == '\0' && digest_wanted(ctx)) {
+        digest_init(&state, ctx->digest);
+        digest = &state;
+    }
+    uint64_t size = (uint64_t)ctx->st.st_size;
+    uint64_t pos = start;
+    // Detection has read the head already
+    if (ctx->head != NULL && pos < ctx->head_length) {
+        stream_piece(digest, fn, arg, ctx->head + pos, ctx->head_length - (size_t)pos);
+        pos = ctx->head_length;
+    }
+    if (pos < size && ctx->fd == -1) {
+        return -1;  // Held in memory, and only in part
+    }
+    if (pos < size) {
+        // The rest is read in blocks up to wherever the file ends now: a
+        // mapping would fault with SIGBUS if the file shrank while being read
+        posix_fadvise(ctx->fd, (off_t)pos, 0, POSIX_FADV_SEQUENTIAL);
+        unsigned char *buffer = malloc(STREAM_BLOCK);
+        if (buffer == NULL) {
+            return -1;
+        }
+        ssize_t n;
+        while ((n = read_at(ctx->fd, buffer, STREAM_BLOCK, (off_t)pos)) > 0) {
+            stream_piece(digest, fn, arg, buffer, (size_t)n);
+            pos += (uint64_t)n;
+        }
+        free(buffer);
+        if (n < 0) {
+            return -1;
+        }
+    }
+    if (digest != NULL) {
+        digest_final(digest, ctx->digest_hex);
+    }
+    return 0;
+}
+
+// Report the file's digest; a file its handler did not read through is read
+// for it here
+static void add_digest(FileContext *ctx) {
+    if (!digest_wanted(ctx) || ctx->fd == -1) {
+        return;
+    }
+    if (ctx->digest_hex[0] == '\0') {
+        // Under --fast only a file that fits in the head is digested
+        if (ctx->read_limit != 0 && (uint64_t)ctx->st.st_size > ctx->head_length) {
+            return;
+        }
+        PROFILE_BEGIN(start);
+        int status = stream_file(ctx, 0, NULL, NULL);
+        PROFILE_END(PROFILE_DIGEST, start);
+        if (status != 0) {
+            fprintf(stderr, "Cannot read file: %s\n", ctx->path);
+            return;
+        }
+    }
+    add_info(&ctx->info, digest_field_name(ctx->digest), ctx->digest_hex);
+}
+
+// Drop cached digests that were not asked for; returns 0 if the one asked
+// for is not among them, so the file has to be read after all
+static int keep_cached_digest(FileContext *ctx, size_t first) {
+    const char *wanted = digest_wanted(ctx) ? digest_field_name(ctx->digest) : NULL;
+    int found = wanted == NULL;
+    InfoArray *info = &ctx->info;
+    size_t kept = first;
+    for (size_t i = first; i < info->size; i++) {
+        const char *key = info->data[i].key;
+        int is_digest = 0;
+        for (int a = DIGEST_NONE + 1; a < DIGEST_COUNT; a++) {
+            is_digest |= strcmp(key, digest_field_name((DigestAlgorithm)a)) == 0;
+        }
+        if (is_digest && (wanted == NULL || strcmp(key, wanted) != 0)) {
+            continue;
+        }
+        found |= is_digest;
+        info->data[kept++] = info->data[i];
+    }
+    info->size = kept;
+    return found;
+}
+
+// Take up the checkpoint an earlier run left for this file, with the type
+// found then, if the bytes it counted are still in place
+static void resume_count(FileContext *ctx) {
+    TextCheckpoint cp;
+    if (ctx->fd == -1 || cache_checkpoint(ctx, &cp) != 0) {
+        return;
+    }
+    if (text_checkpoint_valid(ctx->fd, (uint64_t)ctx->st.st_size, &cp)) {
+        ctx->resume = cp;
+    } else {
+        // Truncated or rewritten: detect and count from scratch
+        ctx->mime_type[0] = '\0';
+        ctx->description[0] = '\0';
+    }
+}
+
+// Run every stage on one file; the stages are timed under --profile
+static void analyze_file(FileContext *ctx) {
     // Get basic file information (size, permissions, last modified date)
-    get_basic_info(path);
-    // Get the MIME type of the file
-    get_mime_type(path);
-
-    // Prepare a command to get the file type using the 'file' utility
-    char command[MAX_COMMAND_LENGTH];
-    snprintf(command, sizeof(command), "file -b '%s'", path);
-    // Execute the command and get the output
-    char *file_type = execute_command(command);
-    if (file_type) {
-        // Add the file type to the info array
-        add_info("File type", file_type);
-
-        // Based on the file type, call the appropriate handler
-        if (strstr(file_type, "text") || strstr(file_type, "ASCII")) {
-            get_text_file_info(path);
-        } else if (strstr(file_type, "image")) {
-            get_image_info(path);
-        } else if (strstr(file_type, "video") || strstr(file_type, "MP4")) {
-            get_video_duration(path);
-        } else if (strstr(file_type, "PDF")) {
-            get_pdf_info(path);
-        } else if (strstr(file_type, "archive") || strstr(file_type, "compressed")) {
-            get_archive_info(path);
-        }
-
-        // Free the memory allocated by execute_command
-        free(file_type);
-    }
-}
-
-// Display all gathered information
-void display_info() {
-    printf("File Information\n");
-    printf("================\n\n");
+    PROFILE_BEGIN(start);
+    get_basic_info(ctx);
+    PROFILE_END(PROFILE_STAT, start);
+    // Nothing else can be learned about a file we cannot stat
+    if (ctx->failed) {
+        return;
+    }
+    // Stop here when only stat() fields were asked for
+    const FieldSelection *fields = ctx->fields;
+    if (fields != NULL && !fields->wants_type && !fields->wants_handler) {
+        return;
+    }
+    // An unchanged file's type and handler results may be cached already
+    // (except when the signature table is being checked against libmagic)
+    size_t first = ctx->info.size;
+    PROFILE_BEGIN(lookup);
+    int hit = ctx->sniff != SNIFF_CHECK && ctx->deep.depth == 0 && cache_lookup(ctx);
+    PROFILE_END(PROFILE_CACHE_LOOKUP, lookup);
+    if (hit && keep_cached_digest(ctx, first)) {
+        return;
+    }
+    if (hit) {
+        // Cached before a digest was asked for: analyze it afresh
+        ctx->info.size = first;
+        ctx->mime_type[0] = '\0';
+        ctx->description[0] = '\0';
+    }
+    // A file that only grew since its last count is counted on from there,
+    // unless it is to be read through for its digest anyway
+    if (ctx->incremental && !digest_wanted(ctx)) {
+        resume_count(ctx);
+    }
+    // Get the MIME type and the file type description
+    get_file_type(ctx);
+    int complete = run_handler(ctx);
+    add_digest(ctx);
+    // Results from a run without external tools or with a read limit may be
+    // missing fields, or even have a different type; a check of the signature
+    // table adds a field of its own, the table may have stood in for
+    // libmagic's description, estimated counts are not the file's own, and
+    // archive members are reported only when --deep asks for them
+    if (!complete || ctx->max_cost < HANDLER_COST_EXTERNAL || ctx->read_limit != 0 ||
+        ctx->sniff == SNIFF_CHECK || ctx->estimated || ctx->deep.depth > 0 ||
+        (ctx->sniff == SNIFF_ON && !field_wanted(ctx->fields, "File type"))) {
+        return;
+    }
+    PROFILE_BEGIN(store);
+    cache_store(ctx, first);
+    PROFILE_END(PROFILE_CACHE_STORE, store);
+}
+
+// Drop the fields that were not asked for, keeping the order of the rest
+static void select_fields(FileContext *ctx) {
+    if (ctx->fields == NULL) {
+        return;
+    }
+    InfoArray *info = &ctx->info;
+    size_t kept = 0;
+    for (size_t i = 0; i < info->size; i++) {
+        if (field_wanted(ctx->fields, info->data[i].key)) {
+            info->data[kept++] = info->data[i];
+        }
+    }
+    info->size = kept;
+}
+
+// Members are typed from their bytes alone and analyzed without tools; the
+// time goes to the archive's handler
+void analyze_member(FileContext *ctx) {
+    if (ctx->head_length == 0) {
+        // libmagic would stat the path for an empty file, which is not on disk
+        snprintf(ctx->mime_type, sizeof(ctx->mime_type), "application/x-empty");
+        snprintf(ctx->description, sizeof(ctx->description), "empty");
+    } else if (detect_file_type(ctx->path, -1, ctx->head, ctx->head_length,
+                                ctx->mime_type, sizeof(ctx->mime_type),
+                                ctx->description, sizeof(ctx->description)) != 0) {
+        return;
+    }
+    if (ctx->mime_type[0] != '\0') {
+        add_info(&ctx->info, "MIME type", ctx->mime_type);
+    }
+    if (ctx->description[0] != '\0') {
+        add_info(&ctx->info, "File type", ctx->description);
+    }
+    const HandlerEntry *entry = find_handler(ctx->mime_type);
+    if (entry != NULL && entry->cost <= ctx->max_cost) {
+        entry->run(ctx);
+    }
+}
+
+// Process the file and gather all relevant information
+void process_file(FileContext *ctx) {
+    profile_begin(&ctx->profile);
+    analyze_file(ctx);
+    close_file(ctx);
+    select_fields(ctx);
+    profile_end(&ctx->profile, ctx->tool_runs, ctx->tool_ns);
+}
+
+// Display all gathered information under the given title
+void display_info(const FileContext *ctx, const char *title, FILE *out) {
+    const InfoArray *info = &ctx->info;
+
+    // Print the title underlined to its own width
+    fprintf(out, "%s\n", title);
+    for (size_t i = strlen(title); i > 0; i--) {
+        fputc('=', out);
+    }
+    fprintf(out, "\n\n");
 
     // Find the maximum width of the keys for alignment
     int max_key_width = 0;
-    for (size_t i = 0; i < info_array.size; i++) {
-        int key_len = strlen(info_array.data[i].key);
+    for (size_t i = 0; i < info->size; i++) {
+        int key_len = strlen(info->data[i].key);
         if (key_len > max_key_width) {
             max_key_width = key_len;
         }
     }
 
     // Display each key-value pair
-    for (size_t i = 0; i < info_array.size; i++) {
+    for (size_t i = 0; i < info->size; i++) {
         // Use %-*s for left-aligned string with dynamic width
-        printf("%-*s : %s\n", max_key_width, info_array.data[i].key, info_array.data[i].value);
+        fprintf(out, "%-*s : %s\n", max_key_width, info->data[i].key, info->data[i].value);
     }
 }
@@ -1,27 +1,145 @@
 #ifndef FILE_INFO_H
 #define FILE_INFO_H
 
+#include "arena.h"
+#include "digest.h"
+#include "profile.h"
+#include "sniff.h"
+#include "text_scan.h"
+#include "utils.h"
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
 
+// Room for this many fields is reserved on the first add_info()
+#define INFO_INITIAL_CAPACITY 16
+// Bytes --fast lets each file's detection and handler read; half of it at most
+// goes to the head shared with libmagic
+#define FAST_READ_LIMIT (128u << 10)
+// Bytes --estimate samples from each large text file by default
+#define DEFAULT_ESTIMATE_BUDGET (4u << 20)
+// Text files up to this many times the budget are still counted exactly
+#define ESTIMATE_EXACT_FACTOR 8
+// Levels of nested archives --deep looks into by default
+#define DEFAULT_DEEP_DEPTH 2
+// Most levels --deep may be asked for; each holds a member buffer of 1 MiB
+#define DEEP_MAX_DEPTH 8
+// Bytes --deep may decompress from the members of one file by default
+#define DEFAULT_DEEP_BUDGET (64u << 20)
+// Members --deep reports for one file, nested ones included
+#define DEEP_MAX_MEMBERS 1000
+
+// Keys are borrowed (normally string literals); values live in the arena
 typedef struct {
-    char *key;
-    char *value;
+    const char *key;
+    const char *value;
 } KeyValue;
 
 typedef struct {
     KeyValue *data;
     size_t size;
     size_t capacity;
+    Arena arena;  // Holds copied values and keys; emptied all at once
 } InfoArray;
 
-extern InfoArray info_array;
+// Fields chosen with --fields, as display_info() names them
+typedef struct {
+    char **names;       // Requested keys, matched without regard to case
+    size_t count;
+    int wants_type;     // "MIME type" or "File type" is among them
+    int wants_handler;  // Some key that only a handler reports is among them
+} FieldSelection;
+
+// What running a handler may cost, cheapest first
+typedef enum {
+    HANDLER_COST_CHEAP,     // Parsed in-process from windows of the file
+    HANDLER_COST_EXTERNAL   // Spawns an external tool (identify, ffprobe, 7z, ...)
+} HandlerCost;
+
+// What --deep may still spend on a file, shared with the archives inside it
+typedef struct {
+    unsigned depth;    // Levels of archives whose members are analyzed, 0 for none
+    uint64_t bytes;    // Bytes members may still be decompressed or copied into
+    unsigned members;  // Members that may still be reported
+} DeepLimits;
+
+// Per-file analysis context: everything gathered about one file lives here,
+// so several files can be processed concurrently without shared state
+typedef struct {
+    const char *path;  // Path of the file being analyzed
+    InfoArray info;    // Key/value pairs collected for this file
+    int failed;        // Non-zero if the file could not be examined
+    char mime_type[128];    // MIME type from libmagic, empty if unknown
+    char description[512];  // libmagic's description, as printed by file -b
+    struct stat st;         // stat() of the file, valid unless failed is set
+    int fd;                 // The file, opened once for every stage; -1 if closed
+    const unsigned char *head;  // Leading bytes shared by detection and handlers
+    size_t head_length;     // Bytes in head; equals st_size when the file fits
+    HandlerCost max_cost;   // Most expensive handler or tool allowed for this file
+    const FieldSelection *fields;  // Fields to report, NULL for all of them
+    uint64_t read_limit;    // Bytes detection and handlers may read, 0 for no limit
+    int incremental;        // Count grown text files on from their checkpoints
+    TextCheckpoint resume;  // Verified checkpoint to count on from (counts.chars 0 if none)
+    TextCheckpoint checkpoint;  // Where this run's count stopped, for the cache
+    DigestAlgorithm digest; // Content digest to report (--hash), DIGEST_NONE for none
+    char digest_hex[DIGEST_HEX_SIZE];  // The digest once the file was read through, else empty
+    SniffMode sniff;        // Whether the signature table answers before libmagic (--sniff)
+    uint64_t estimate_budget;  // Bytes sampled from large text files (--estimate), 0 to count all
+    int estimated;          // Set when the text counts were extrapolated from samples
+    DeepLimits deep;        // Archive members to analyze (--deep)
+    unsigned tool_runs;     // External tools started for this file
+    unsigned tool_failures; // Tool runs that gave no output (missing, killed)
+    uint64_t tool_ns;       // Wall-clock time those tools took
+    ProfileData profile;    // Stage timings and counters under --profile
+} FileContext;
 
-void init_info_array();
-void add_info(const char *key, const char *value);
-void free_info_array();
-void get_basic_info(const char *path);
-void get_mime_type(const char *path);
-void process_file(const char *path);
-void display_info();
+void init_info_array(InfoArray *info);
+// Add a field; key must outlive the array (a literal or an arena string),
+// value is copied
+void add_info(InfoArray *info, const char *key, const char *value);
+// Add a field whose key is not static, copying both strings
+void add_info_copy(InfoArray *info, const char *key, const char *value);
+// Add a field without copying; both strings must outlive the array
+void add_info_borrowed(InfoArray *info, const char *key, const char *value);
+// Drop every field but keep the storage for the next file
+void reset_info_array(InfoArray *info);
+void free_info_array(InfoArray *info);
+// Parse a comma-separated list of field names
+// Returns 0, or -1 if the list names no field or memory runs out
+int parse_fields(const char *list, FieldSelection *fields);
+// Whether key is among the fields; every key is when fields is NULL
+int field_wanted(const FieldSelection *fields, const char *key);
+void free_fields(FieldSelection *fields);
+void init_file_context(FileContext *ctx, const char *path);
+// Reuse a context (initialized or zero-filled) for another file
+void reset_file_context(FileContext *ctx, const char *path);
+void free_file_context(FileContext *ctx);
+void get_basic_info(FileContext *ctx);
+void get_file_type(FileContext *ctx);
+// Close the file opened by get_basic_info() and drop its head bytes
+void close_file(FileContext *ctx);
+// Set up a window over the open file that serves the head without reading,
+// and that reads no more than ctx->read_limit allows; a file held in memory
+// (fd -1 with a head, as archive members are) gets a window over the head
+// Returns -1 if the file is neither open nor in memory
+int open_window(const FileContext *ctx, FileWindow *window);
+// Receives each piece of a file stream_file() reads
+typedef void (*StreamFn)(void *arg, const unsigned char *data, size_t len);
+// Pass the file's bytes from offset start to its end to fn (which may be
+// NULL), from the head as far as it reaches and then from the file. When
+// start is 0 the requested digest is computed from the same bytes, so a
+// handler that reads the whole file saves the digest a second read.
+// Returns 0, or -1 if the file cannot be read
+int stream_file(FileContext *ctx, uint64_t start, StreamFn fn, void *arg);
+void process_file(FileContext *ctx);
+// Detect the type of a file held in memory, its head_length bytes at head
+// (st.st_size may be larger when only its start is there), and run the
+// handler for it on those bytes alone; for archive members under --deep
+void analyze_member(FileContext *ctx);
+// Run a handler's helper tool; returns NULL without starting it when
+// ctx->max_cost rules external tools out
+char *run_tool(FileContext *ctx, const char *const argv[], int timeout_ms);
+void display_info(const FileContext *ctx, const char *title, FILE *out);
 
 #endif // FILE_INFO_H
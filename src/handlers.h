@@ -1,10 +1,12 @@
 #ifndef HANDLERS_H
 #define HANDLERS_H
 
-void get_text_file_info(const char *path);
-void get_image_info(const char *path);
-void get_video_duration(const char *path);
-void get_pdf_info(const char *path);
-void get_archive_info(const char *path);
+#include "file_info.h"
+
+void get_text_file_info(FileContext *ctx);
+void get_image_info(FileContext *ctx);
+void get_video_duration(FileContext *ctx);
+void get_pdf_info(FileContext *ctx);
+void get_archive_info(FileContext *ctx);
 
 #endif // HANDLERS_H
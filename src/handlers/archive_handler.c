@@ -1,62 +1,1075 @@
 // Include necessary header files
 #include "../file_info.h"  // For add_info() function
-#include "../utils.h"      // For execute_command() function
-#include <stdio.h>         // For sscanf()
-#include <stdlib.h>        // For free()
-#include <string.h>        // For strtok()
+#include "../utils.h"      // For FileWindow and byte order helpers
+#include <inttypes.h>      // For PRIu64
+#include <stdarg.h>        // For va_list in line_append()
+#include <stdio.h>         // For snprintf()
+#include <stdlib.h>        // For malloc(), free(), strtoull()
+#include <string.h>        // For memcmp(), strtok_r()
+#include <sys/stat.h>      // For S_IFREG
+#include <zlib.h>          // For inflating members under --deep
 
-// Function to extract information from archive files
-void get_archive_info(const char *path) {
+// The End of Central Directory record sits within the last 64 KiB + 22 bytes
+#define ZIP_EOCD_SEARCH (65535 + 22)
+// Only the start of a pax extended header is read; "size=" is near the front
+#define PAX_HEADER_READ 4096
+// Upper bound for concatenated xz streams
+#define MAX_XZ_STREAMS 100000
+// Wall-clock limit for the 7z fallback; listing huge archives takes a while
+#define SEVENZIP_TIMEOUT_MS 30000
+// Bytes of each member --deep keeps for detection and the handlers; larger
+// members are analyzed from their start
+#define DEEP_MEMBER_SIZE (1u << 20)
+// Compressed bytes read per refill of a member stream
+#define DEEP_INPUT_SIZE (64u << 10)
+// Longest member name kept
+#define DEEP_NAME_SIZE 1024
+// Longest Member field
+#define DEEP_LINE_SIZE 4096
+
+// What the indexers found; entries without a value are left out of the output
+typedef struct {
+    const char *format;      // Container or compressor name
+    uint64_t files;          // Entries that are not directories
+    uint64_t dirs;           // Directory entries
+    uint64_t size;           // Total uncompressed size in bytes
+    uint64_t compressed;     // Total compressed size of the members (ZIP)
+    uint64_t parts;          // Frames, streams or blocks
+    const char *parts_name;  // Label for parts, NULL if not reported
+    int has_entries;         // files/dirs are known
+    int has_size;            // size is known
+    int has_compressed;      // compressed is known
+} ArchiveSummary;
+
+// A ZIP member as the central directory describes it, for --deep
+typedef struct {
+    char name[DEEP_NAME_SIZE];
+    uint64_t size;           // Uncompressed size
+    uint64_t compressed;     // Size of its data in the archive
+    uint64_t local;          // Offset of its local header
+    int method;              // Compression method: 0 stored, 8 deflated, ...
+    int encrypted;
+} ZipMember;
+
+// Receives each ZIP member that is not a directory
+// Returns non-zero to stop the walk
+typedef int (*ZipVisitor)(void *arg, FileWindow *w, const ZipMember *member);
+
+// ---------------------------------------------------------------------------
+// ZIP and ZIP64: End of Central Directory, then the central directory only
+// ---------------------------------------------------------------------------
+
+// Locate the EOCD record by scanning the tail backwards for its signature
+static int zip_find_eocd(FileWindow *w, uint64_t *eocd, unsigned char *record) {
+    uint64_t size = w->size;
+    // Most archives have no comment, which puts the record in the last 22 bytes
+    const unsigned char *last = size >= 22 ? window_get(w, size - 22, 22) : NULL;
+    if (last != NULL && read_le32(last) == 0x06054b50 && read_le16(last + 20) == 0) {
+        *eocd = size - 22;
+        memcpy(record, last, 22);
+        return 0;
+    }
+    size_t tail = size < ZIP_EOCD_SEARCH ? (size_t)size : ZIP_EOCD_SEARCH;
+    unsigned char *buf = malloc(tail);
+    if (buf == NULL || window_read(w, buf, tail, size - tail) != (ssize_t)tail) {
+        free(buf);
+        return -1;
+    }
+    int status = -1;
+    for (size_t i = tail >= 22 ? tail - 22 + 1 : 0; i-- > 0;) {
+        if (read_le32(buf + i) == 0x06054b50) {
+            // The comment must fit in what follows
+            if (i + 22 + read_le16(buf + i + 20) <= tail) {
+                *eocd = size - tail + i;
+                memcpy(record, buf + i, 22);
+                status = 0;
+                break;
+            }
+        }
+    }
+    free(buf);
+    return status;
+}
+
+// Walk the central directory, handing each file's entry to visit when given
+static int index_zip(FileWindow *w, ArchiveSummary *sum, ZipVisitor visit, void *arg) {
+    uint64_t eocd;
+    unsigned char rec[22];
+    if (zip_find_eocd(w, &eocd, rec) != 0) {
+        return -1;
+    }
+    uint64_t entries = read_le16(rec + 10);
+    uint64_t cd_size = read_le32(rec + 12);
+    uint64_t cd_offset = read_le32(rec + 16);
+    sum->format = "ZIP";
+
+    // ZIP64: a locator just before the EOCD points at the 64-bit record
+    uint64_t directory_end = eocd;
+    const unsigned char *p = eocd >= 20 ? window_get(w, eocd - 20, 20) : NULL;
+    if (p != NULL && read_le32(p) == 0x07064b50) {
+        const unsigned char *z = window_get(w, read_le64(p + 8), 56);
+        if (z != NULL && read_le32(z) == 0x06064b50) {
+            directory_end = read_le64(p + 8);
+            entries = read_le64(z + 32);
+            cd_size = read_le64(z + 40);
+            cd_offset = read_le64(z + 48);
+            sum->format = "ZIP64";
+        }
+    }
+
+    // Self-extracting archives have data in front; the directory then ends
+    // right where the EOCD (or the ZIP64 record) begins, and the local
+    // headers are off by as much as the directory
+    uint64_t shift = 0;
+    p = window_get(w, cd_offset, 4);
+    if ((p == NULL || read_le32(p) != 0x02014b50) && entries > 0) {
+        if (directory_end < cd_size) {
+            return -1;
+        }
+        shift = directory_end - cd_size - cd_offset;
+        cd_offset = directory_end - cd_size;
+    }
+
+    // Walk the central directory headers; nothing is kept per entry
+    uint64_t offset = cd_offset;
+    for (uint64_t i = 0; i < entries; i++) {
+        p = window_get(w, offset, 46);
+        if (p == NULL || read_le32(p) != 0x02014b50) {
+            break;  // Truncated directory: report what was found
+        }
+        int flags = read_le16(p + 8);
+        int method = read_le16(p + 10);
+        uint64_t csize = read_le32(p + 20);
+        uint64_t usize = read_le32(p + 24);
+        uint16_t name_len = read_le16(p + 28);
+        uint16_t extra_len = read_le16(p + 30);
+        uint16_t comment_len = read_le16(p + 32);
+        uint64_t local = read_le32(p + 42);
+
+        // Directory names end with a slash
+        const unsigned char *last = name_len > 0 ? window_get(w, offset + 46 + name_len - 1, 1) : NULL;
+        int is_dir = last != NULL && *last == '/';
+
+        // Values that do not fit 32 bits are in the ZIP64 extra field, in this order
+        if ((usize == 0xFFFFFFFF || csize == 0xFFFFFFFF || local == 0xFFFFFFFF) &&
+            extra_len > 0) {
+            const unsigned char *extra = window_get(w, offset + 46 + name_len, extra_len);
+            for (size_t at = 0; extra != NULL && at + 4 <= extra_len;) {
+                uint16_t id = read_le16(extra + at), len = read_le16(extra + at + 2);
+                if (at + 4 + len > extra_len) {
+                    break;
+                }
+                if (id == 0x0001) {
+                    size_t field = at + 4;
+                    if (usize == 0xFFFFFFFF && field + 8 <= at + 4 + len) {
+                        usize = read_le64(extra + field);
+                        field += 8;
+                    }
+                    if (csize == 0xFFFFFFFF && field + 8 <= at + 4 + len) {
+                        csize = read_le64(extra + field);
+                        field += 8;
+                    }
+                    if (local == 0xFFFFFFFF && field + 8 <= at + 4 + len) {
+                        local = read_le64(extra + field);
+                    }
+                    break;
+                }
+                at += 4 + (size_t)len;
+            }
+        }
+
+        if (is_dir) {
+            sum->dirs++;
+        } else {
+            sum->files++;
+        }
+        sum->size += usize;
+        sum->compressed += csize;
+        uint64_t name_offset = offset + 46;
+        offset += 46 + (uint64_t)name_len + extra_len + comment_len;
+
+        if (visit != NULL && !is_dir) {
+            ZipMember member = {
+                .size = usize,
+                .compressed = csize,
+                .local = local + shift,
+                .method = method,
+                .encrypted = flags & 1,
+            };
+            size_t length = name_len < DEEP_NAME_SIZE ? name_len : DEEP_NAME_SIZE - 1;
+            const unsigned char *name = window_get(w, name_offset, length);
+            if (name != NULL) {
+                memcpy(member.name, name, length);
+            }
+            member.name[name != NULL ? length : 0] = '\0';
+            if (visit(arg, w, &member) != 0) {
+                break;
+            }
+        }
+    }
+    sum->has_entries = sum->has_size = sum->has_compressed = 1;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// tar: walk the 512-byte headers, stepping over the payloads
+// ---------------------------------------------------------------------------
+
+// Numeric header field: octal text, or base-256 when the top bit is set
+static uint64_t tar_number(const unsigned char *field, size_t len) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < len; i++) {
+            value = value << 8 | field[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < len && field[i] == ' ') {
+        i++;
+    }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value << 3 | (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+// Does the block hold a valid header? The checksum treats its own field as spaces
+static int tar_checksum_ok(const unsigned char *block) {
+    uint64_t stored = tar_number(block + 148, 8);
+    uint64_t sum = 0;
+    int64_t signed_sum = 0;
+    for (int i = 0; i < 512; i++) {
+        unsigned char c = i >= 148 && i < 156 ? ' ' : block[i];
+        sum += c;
+        signed_sum += (signed char)c;
+    }
+    return stored == sum || (int64_t)stored == signed_sum;
+}
+
+// Find "size=" and, when path is given, "path=" in the pax extended header
+// records ("<len> <key>=<value>\n") in buf, which is NUL-terminated
+// Returns 0 if a size was found
+static int pax_parse(char *buf, size_t len, uint64_t *size, char *path, size_t path_size) {
+    int found = -1;
+    char *p = buf;
+    while (p < buf + len) {
+        char *end;
+        unsigned long long record = strtoull(p, &end, 10);
+        if (record == 0 || end == p || *end != ' ') {
+            break;
+        }
+        if (strncmp(end + 1, "size=", 5) == 0) {
+            *size = strtoull(end + 6, NULL, 10);
+            found = 0;
+        } else if (path != NULL && strncmp(end + 1, "path=", 5) == 0) {
+            // The value runs to the newline that ends the record
+            const char *value = end + 6;
+            const char *stop = record <= (size_t)(buf + len - p) ? p + record - 1 : buf + len;
+            size_t n = stop > value ? (size_t)(stop - value) : 0;
+            n = n < path_size ? n : path_size - 1;
+            memcpy(path, value, n);
+            path[n] = '\0';
+        }
+        p += record;
+    }
+    return found;
+}
+
+// Find "size=" in the pax extended header at offset
+static int pax_size(FileWindow *w, uint64_t offset, uint64_t len, uint64_t *size) {
+    char buf[PAX_HEADER_READ + 1];
+    size_t want = len < PAX_HEADER_READ ? (size_t)len : PAX_HEADER_READ;
+    ssize_t got = window_read(w, buf, want, offset);
+    if (got <= 0) {
+        return -1;
+    }
+    buf[got] = '\0';
+    return pax_parse(buf, (size_t)got, size, NULL, 0);
+}
+
+static int index_tar(FileWindow *w, ArchiveSummary *sum) {
+    uint64_t offset = 0;
+    uint64_t next_size = UINT64_MAX;  // Size override from a pax header
+    int headers = 0;
+    while (offset + 512 <= w->size) {
+        const unsigned char *h = window_get(w, offset, 512);
+        if (h == NULL) {
+            break;
+        }
+        // The archive ends with zero blocks
+        if (h[0] == '\0' && memcmp(h, h + 1, 511) == 0) {
+            break;
+        }
+        if (!tar_checksum_ok(h)) {
+            if (headers == 0) {
+                return -1;  // Not a tar archive after all
+            }
+            break;
+        }
+        headers++;
+        uint64_t size = tar_number(h + 124, 12);
+        char type = (char)h[156];
+        uint64_t payload = (size + 511) & ~(uint64_t)511;
+
+        if (type == 'x') {
+            // pax header for the next entry: it may carry the real size
+            uint64_t value;
+            if (pax_size(w, offset + 512, size, &value) == 0) {
+                next_size = value;
+            }
+        } else if (type == 'g' || type == 'L' || type == 'K') {
+            // Global pax header, GNU long name or long link name: not entries
+        } else {
+            if (next_size != UINT64_MAX) {
+                size = next_size;
+                payload = (size + 511) & ~(uint64_t)511;
+                next_size = UINT64_MAX;
+            }
+            if (type == '5') {
+                sum->dirs++;
+            } else {
+                sum->files++;
+                // Links and device nodes have no data of their own
+                if (type == '0' || type == '\0' || type == '7' || type == 'S') {
+                    sum->size += size;
+                }
+            }
+            // Only these entry types are followed by data
+            if (type == '1' || type == '2' || type == '3' || type == '4' || type == '5' || type == '6') {
+                payload = 0;
+            }
+        }
+        // Skip straight to the next header without reading the payload
+        offset += 512 + payload;
+    }
+    if (headers == 0) {
+        return -1;
+    }
+    sum->format = "tar";
+    sum->has_entries = sum->has_size = 1;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Compressed streams: sizes from trailers and frame headers
+// ---------------------------------------------------------------------------
+
+// gzip keeps the uncompressed size modulo 2^32 in the last four bytes (ISIZE)
+static int index_gzip(FileWindow *w, ArchiveSummary *sum) {
+    const unsigned char *p = w->size >= 18 ? window_get(w, w->size - 4, 4) : NULL;
+    if (p == NULL) {
+        return -1;
+    }
+    sum->format = "gzip";
+    sum->size = read_le32(p);
+    sum->has_size = 1;
+    return 0;
+}
+
+// Read an xz variable-length integer through the window
+static int xz_vli(FileWindow *w, uint64_t *offset, uint64_t end, uint64_t *value) {
+    *value = 0;
+    for (int i = 0; i < 9 && *offset < end; i++) {
+        const unsigned char *p = window_get(w, (*offset)++, 1);
+        if (p == NULL) {
+            return -1;
+        }
+        *value |= (uint64_t)(*p & 0x7F) << (7 * i);
+        if ((*p & 0x80) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// xz: each stream ends with an index of (unpadded, uncompressed) block sizes,
+// located through the stream footer; streams are walked from the last one back
+static int index_xz(FileWindow *w, ArchiveSummary *sum) {
+    uint64_t end = w->size;
+    uint64_t streams = 0, blocks = 0, size = 0;
+    while (end > 0 && streams < MAX_XZ_STREAMS) {
+        // Stream padding: zero bytes, a multiple of four
+        const unsigned char *p;
+        while (end >= 4 && (p = window_get(w, end - 4, 4)) != NULL && read_le32(p) == 0) {
+            end -= 4;
+        }
+        if (end < 24) {
+            break;
+        }
+        // Stream footer: CRC32, backward size, flags, "YZ"
+        p = window_get(w, end - 12, 12);
+        if (p == NULL || p[10] != 'Y' || p[11] != 'Z') {
+            return -1;
+        }
+        uint64_t index_size = ((uint64_t)read_le32(p + 4) + 1) * 4;
+        if (index_size + 24 > end) {
+            return -1;
+        }
+        uint64_t index = end - 12 - index_size, offset = index;
+        uint64_t index_end = end - 12;
+        p = window_get(w, offset++, 1);
+        uint64_t records;
+        if (p == NULL || *p != 0x00 || xz_vli(w, &offset, index_end, &records) != 0) {
+            return -1;
+        }
+        // Each record: unpadded size, then uncompressed size
+        uint64_t blocks_size = 0;
+        for (uint64_t i = 0; i < records; i++) {
+            uint64_t unpadded, uncompressed;
+            if (xz_vli(w, &offset, index_end, &unpadded) != 0 ||
+                xz_vli(w, &offset, index_end, &uncompressed) != 0) {
+                return -1;
+            }
+            blocks_size += (unpadded + 3) & ~(uint64_t)3;
+            size += uncompressed;
+        }
+        blocks += records;
+        streams++;
+        // The stream starts with a 12-byte header before its blocks
+        if (blocks_size + 12 > index) {
+            return -1;
+        }
+        end = index - blocks_size - 12;
+    }
+    if (streams == 0) {
+        return -1;
+    }
+    sum->format = "xz";
+    sum->size = size;
+    sum->has_size = 1;
+    sum->parts = blocks;
+    sum->parts_name = "Blocks";
+    return 0;
+}
+
+// zstd: frames may declare their content size; blocks are skipped by their headers
+static int index_zstd(FileWindow *w, ArchiveSummary *sum) {
+    uint64_t offset = 0, frames = 0, size = 0;
+    int known = 1;
+    while (offset < w->size) {
+        const unsigned char *p = window_get(w, offset, 4);
+        if (p == NULL) {
+            return -1;
+        }
+        uint32_t magic = read_le32(p);
+        if ((magic & 0xFFFFFFF0) == 0x184D2A50) {
+            // Skippable frame: magic, 4-byte length, data
+            p = window_get(w, offset + 4, 4);
+            if (p == NULL) {
+                return -1;
+            }
+            offset += 8 + (uint64_t)read_le32(p);
+            continue;
+        }
+        if (magic != 0xFD2FB528) {
+            if (frames == 0) {
+                return -1;
+            }
+            break;  // Padding or junk after the last frame
+        }
+
+        // Frame header: descriptor, optional window, dictionary ID and content size
+        p = window_get(w, offset + 4, 1);
+        if (p == NULL) {
+            return -1;
+        }
+        int descriptor = *p;
+        int single_segment = (descriptor >> 5) & 1;
+        int fcs_flag = descriptor >> 6;
+        static const int dict_sizes[4] = { 0, 1, 2, 4 };
+        int dict_size = dict_sizes[descriptor & 3];
+        int fcs_size = fcs_flag == 0 ? single_segment : 1 << fcs_flag;
+        uint64_t header = 5 + !single_segment + dict_size;
+        if (fcs_size > 0) {
+            p = window_get(w, offset + header, fcs_size);
+            if (p == NULL) {
+                return -1;
+            }
+            uint64_t fcs = fcs_size == 1 ? p[0] :
+                           fcs_size == 2 ? (uint64_t)read_le16(p) + 256 :
+                           fcs_size == 4 ? read_le32(p) : read_le64(p);
+            size += fcs;
+        } else {
+            known = 0;  // Streaming compressors may leave the size out
+        }
+        offset += header + fcs_size;
+
+        // Step over the blocks to the next frame
+        for (;;) {
+            p = window_get(w, offset, 3);
+            if (p == NULL) {
+                return -1;
+            }
+            uint32_t block = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+            int last = block & 1;
+            int type = (block >> 1) & 3;
+            if (type == 3) {
+                return -1;  // Reserved block type
+            }
+            offset += 3 + (type == 1 ? 1 : block >> 3);  // RLE blocks store one byte
+            if (last) {
+                break;
+            }
+        }
+        if (descriptor & 4) {
+            offset += 4;  // Content checksum
+        }
+        frames++;
+    }
+    sum->format = "Zstandard";
+    sum->size = size;
+    sum->has_size = known && frames > 0;
+    sum->parts = frames;
+    sum->parts_name = "Frames";
+    return frames > 0 ? 0 : -1;
+}
+
+// Pick the indexer from the leading bytes; tar has no magic before offset 257
+static int index_archive(FileWindow *w, ArchiveSummary *sum) {
+    const unsigned char *p = window_get(w, 0, 6);
+    if (p != NULL && (memcmp(p, "PK\3\4", 4) == 0 || memcmp(p, "PK\5\6", 4) == 0)) {
+        return index_zip(w, sum, NULL, NULL);
+    }
+    if (p != NULL && p[0] == 0x1F && p[1] == 0x8B) {
+        return index_gzip(w, sum);
+    }
+    if (p != NULL && memcmp(p, "\xFD" "7zXZ\0", 6) == 0) {
+        return index_xz(w, sum);
+    }
+    if (p != NULL && (read_le32(p) == 0xFD2FB528 || (read_le32(p) & 0xFFFFFFF0) == 0x184D2A50)) {
+        return index_zstd(w, sum);
+    }
+    if (index_tar(w, sum) == 0) {
+        return 0;
+    }
+    // Self-extracting and other prefixed ZIP files only have the trailer to go by
+    memset(sum, 0, sizeof(*sum));
+    return p != NULL && p[0] == 'M' && p[1] == 'Z' ? index_zip(w, sum, NULL, NULL) : -1;
+}
+
+// Let 7-Zip list the formats the indexers do not read (7z, RAR, bzip2, ...)
+static void list_with_7z(FileContext *ctx) {
     // Prepare the command to list archive contents
-    // MAX_COMMAND_LENGTH is defined in utils.h
-    char command[MAX_COMMAND_LENGTH];
-    
-    // Use snprintf for safe string formatting
-    // '7z l' lists the contents of the archive
-    // The single quotes around %s prevent issues with spaces in filenames
-    snprintf(command, sizeof(command), "7z l '%s'", path);
+    // '7z l' lists the contents of the archive; only the summary at the end is used
+    // '--' stops switch parsing, so any path is taken as the archive name
+    const char *argv[] = { "7z", "l", "--", ctx->path, NULL };
 
     // Execute the command and get its output
-    char *output = execute_command(command);
-    
+    char *output = run_tool(ctx, argv, SEVENZIP_TIMEOUT_MS);
+
     // Check if the command execution was successful
     if (output) {
         // Variables to store archive information
-        char *line = strtok(output, "\n");  // Split output into lines
-        int file_count = 0;                 // Number of files in the archive
-        size_t total_size = 0;              // Total uncompressed size of files
+        char *save = NULL;                  // strtok_r state, private to this call
+        char *line = strtok_r(output, "\n", &save);  // Split output into lines
+        uint64_t file_count = 0;            // Number of files in the archive
+        uint64_t total_size = 0;            // Total uncompressed size of files
+        int found = 0;
 
-        // Iterate through each line of the output
+        // The summary is the last line mentioning files:
+        // "[date time] size [packed] N files[, M folders]"
+        char *summary = NULL;
         while (line) {
-            // Look for the line containing the file count
-            if (strstr(line, "files,")) {
-                // Extract the file count using sscanf
-                sscanf(line, "%d files,", &file_count);
-            } 
-            // Look for the line containing the total size
-            else if (strstr(line, "bytes")) {
-                // Extract the total size using sscanf
-                sscanf(line, "%zu bytes", &total_size);
+            if (strstr(line, " files")) {
+                summary = line;
             }
             // Move to the next line
-            line = strtok(NULL, "\n");
+            line = strtok_r(NULL, "\n", &save);
         }
 
-        // Prepare strings to store the extracted information
-        char count_str[50], size_str[50];
-        
-        // Format the file count as a string
-        snprintf(count_str, sizeof(count_str), "%d", file_count);
-        // Format the total size as a string
-        snprintf(size_str, sizeof(size_str), "%zu bytes", total_size);
+        if (summary) {
+            // Collect the numbers in front of "files"
+            uint64_t numbers[4];
+            int count = 0;
+            char *token_save = NULL;
+            *strstr(summary, " files") = '\0';
+            for (char *token = strtok_r(summary, " ", &token_save); token;
+                 token = strtok_r(NULL, " ", &token_save)) {
+                if (strspn(token, "0123456789") == strlen(token)) {
+                    numbers[count % 4] = strtoull(token, NULL, 10);
+                    count++;
+                }
+            }
+            // The count comes last and the size first
+            if (count >= 2) {
+                file_count = numbers[(count - 1) % 4];
+                total_size = numbers[(count - (count >= 3 ? 3 : 2)) % 4];
+                found = 1;
+            }
+        }
 
-        // Add the extracted information to the global info array
-        add_info("Files in archive", count_str);
-        add_info("Total uncompressed size", size_str);
+        if (found) {
+            // Prepare strings to store the extracted information
+            char count_str[50], size_str[50];
+
+            // Format the file count as a string
+            snprintf(count_str, sizeof(count_str), "%" PRIu64, file_count);
+            // Format the total size as a string
+            snprintf(size_str, sizeof(size_str), "%" PRIu64 " bytes", total_size);
+
+            // Add the extracted information to the file's info array
+            add_info(&ctx->info, "Files in archive", count_str);
+            add_info(&ctx->info, "Total uncompressed size", size_str);
+        }
 
-        // Free the memory allocated by execute_command()
+        // Free the memory allocated by run_tool()
         free(output);
     }
     // If output is NULL, the command failed, but we silently ignore it
-    // You might want to add error handling here in a more robust version
+}
+
+// ---------------------------------------------------------------------------
+// --deep: members decompressed into memory and analyzed like files
+// ---------------------------------------------------------------------------
+
+// A member's bytes in order: stored ones copied from the archive, deflated
+// ones inflated on the way, raw (ZIP) or wrapped in gzip headers
+typedef struct {
+    FileWindow *in;          // The archive, on disk or in memory
+    uint64_t offset;         // Next input byte
+    uint64_t end;            // End of the input
+    int inflating;           // The input is deflated
+    int gzip;                // ... with gzip headers, maybe several members of them
+    int finished;            // No more output: end of data, an error or the budget
+    uint64_t *budget;        // Bytes the outermost file may still decompress
+    z_stream z;
+    gz_header header;        // gzip header, for the name it may store
+    char gzip_name[DEEP_NAME_SIZE];
+    unsigned char input[DEEP_INPUT_SIZE];
+    unsigned char scratch[DEEP_INPUT_SIZE];  // Output nobody keeps, when skipping
+} MemberStream;
+
+// Start a stream over length bytes at offset; window_bits is 0 for stored
+// data, or as inflateInit2() takes it
+// Returns 0, or -1 if zlib cannot be set up
+static int stream_open(MemberStream *s, FileWindow *in, uint64_t offset, uint64_t length,
+                       int window_bits, uint64_t *budget) {
+    s->in = in;
+    s->offset = offset < in->size ? offset : in->size;
+    s->end = length < in->size - s->offset ? s->offset + length : in->size;
+    s->inflating = window_bits != 0;
+    s->gzip = window_bits > MAX_WBITS;
+    s->finished = 0;
+    s->budget = budget;
+    s->gzip_name[0] = '\0';
+    if (!s->inflating) {
+        return 0;
+    }
+    memset(&s->z, 0, sizeof(s->z));
+    if (inflateInit2(&s->z, window_bits) != Z_OK) {
+        s->inflating = 0;
+        s->finished = 1;
+        return -1;
+    }
+    if (s->gzip) {
+        memset(&s->header, 0, sizeof(s->header));
+        s->header.name = (Bytef *)s->gzip_name;
+        s->header.name_max = sizeof(s->gzip_name) - 1;
+        inflateGetHeader(&s->z, &s->header);
+    }
+    return 0;
+}
+
+static void stream_close(MemberStream *s) {
+    if (s->inflating) {
+        inflateEnd(&s->z);
+        s->inflating = 0;
+    }
+}
+
+// Put up to len bytes of the member in out; every byte counts against the
+// budget, which ends the stream when it runs out
+// Returns the number of bytes produced, fewer than len only at the end
+static size_t stream_read(MemberStream *s, unsigned char *out, size_t len) {
+    size_t done = 0;
+    while (done < len && !s->finished) {
+        size_t want = len - done;
+        if (*s->budget == 0) {
+            s->finished = 1;
+            break;
+        }
+        if (want > *s->budget) {
+            want = (size_t)*s->budget;
+        }
+        if (!s->inflating) {
+            if (want > s->end - s->offset) {
+                want = (size_t)(s->end - s->offset);
+            }
+            ssize_t n = want > 0 ? window_read(s->in, out + done, want, s->offset) : 0;
+            if (n <= 0) {
+                s->finished = 1;
+                break;
+            }
+            s->offset += (uint64_t)n;
+            done += (size_t)n;
+            *s->budget -= (uint64_t)n;
+            continue;
+        }
+        // Refill the input as the inflater uses it up
+        if (s->z.avail_in == 0) {
+            uint64_t left = s->end - s->offset;
+            size_t chunk = left < DEEP_INPUT_SIZE ? (size_t)left : DEEP_INPUT_SIZE;
+            ssize_t n = chunk > 0 ? window_read(s->in, s->input, chunk, s->offset) : 0;
+            if (n <= 0) {
+                s->finished = 1;
+                break;
+            }
+            s->offset += (uint64_t)n;
+            s->z.next_in = s->input;
+            s->z.avail_in = (uInt)n;
+        }
+        s->z.next_out = out + done;
+        s->z.avail_out = (uInt)want;
+        int status = inflate(&s->z, Z_NO_FLUSH);
+        size_t n = want - s->z.avail_out;
+        done += n;
+        *s->budget -= n;
+        if (status == Z_STREAM_END) {
+            // A gzip file may hold several members in a row
+            int more = s->z.avail_in > 0 || s->offset < s->end;
+            if (!s->gzip || !more || inflateReset(&s->z) != Z_OK) {
+                s->finished = 1;
+            }
+        } else if (status != Z_OK && !(status == Z_BUF_ERROR && n > 0)) {
+            s->finished = 1;  // Corrupt data, or trailing garbage
+        }
+    }
+    return done;
+}
+
+// Step over len bytes of the member; stored data is not even read
+static void stream_skip(MemberStream *s, uint64_t len) {
+    if (!s->inflating) {
+        uint64_t left = s->end - s->offset;
+        s->offset += len < left ? len : left;
+        s->finished |= len > left;
+        return;
+    }
+    while (len > 0 && !s->finished) {
+        size_t want = len < DEEP_INPUT_SIZE ? (size_t)len : DEEP_INPUT_SIZE;
+        len -= stream_read(s, s->scratch, want);
+    }
+}
+
+// Why a scan ended before the last member
+enum {
+    DEEP_COMPLETE,
+    DEEP_OUT_OF_BYTES,   // The byte budget ran out
+    DEEP_OUT_OF_MEMBERS  // As many members as may be reported were
+};
+
+// One archive's members being analyzed
+typedef struct {
+    FileContext *ctx;        // The archive; each member adds a Member field to it
+    FileContext member;      // Context reused for every member
+    unsigned char *buffer;   // The current member's first DEEP_MEMBER_SIZE bytes
+    MemberStream *stream;
+    uint64_t inspected;      // Members analyzed, nested ones included
+    int stopped;             // One of the DEEP_* values
+} DeepScan;
+
+// Append to a Member field, cutting it off when it gets too long
+__attribute__((format(printf, 2, 3)))
+static void line_append(char *line, const char *format, ...) {
+    size_t used = strlen(line);
+    if (used < DEEP_LINE_SIZE - 1) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(line + used, DEEP_LINE_SIZE - used, format, args);
+        va_end(args);
+    }
+}
+
+// Summarize an analyzed member in one Member field of the archive, followed
+// by the members of its own, if it is an archive too
+static void report_member(DeepScan *scan, const char *name, uint64_t size, size_t kept) {
+    const FileContext *m = &scan->member;
+    char line[DEEP_LINE_SIZE];
+    line[0] = '\0';
+    char *size_str = format_size((off_t)size);
+    line_append(line, "%s, %s", name, size_str != NULL ? size_str : "?");
+    free(size_str);
+    if (m->mime_type[0] != '\0') {
+        line_append(line, ", %s", m->mime_type);
+    }
+    for (size_t i = 0; i < m->info.size; i++) {
+        const char *key = m->info.data[i].key;
+        if (strcmp(key, "MIME type") != 0 && strcmp(key, "File type") != 0 &&
+            strcmp(key, "Member") != 0) {
+            line_append(line, ", %s: %s", key, m->info.data[i].value);
+        }
+    }
+    if (kept < size) {
+        char *kept_str = format_size((off_t)kept);
+        line_append(line, ", from its first %s", kept_str != NULL ? kept_str : "?");
+        free(kept_str);
+    }
+    add_info(&scan->ctx->info, "Member", line);
+
+    // Nested members carry the path through this one
+    for (size_t i = 0; i < m->info.size; i++) {
+        if (strcmp(m->info.data[i].key, "Member") == 0) {
+            line[0] = '\0';
+            line_append(line, "%s/%s", name, m->info.data[i].value);
+            add_info(&scan->ctx->info, "Member", line);
+        }
+    }
+}
+
+// Read the member of size bytes the stream is at (its first have bytes are
+// in the buffer already), analyze it and report it
+// Returns the bytes of it consumed, or -1 when a limit stops the scan
+static int64_t inspect_member(DeepScan *scan, const char *name, uint64_t size, size_t have) {
+    DeepLimits *limits = &scan->ctx->deep;
+    if (limits->members == 0) {
+        scan->stopped = DEEP_OUT_OF_MEMBERS;
+        return -1;
+    }
+    size_t want = size < DEEP_MEMBER_SIZE ? (size_t)size : DEEP_MEMBER_SIZE;
+    size_t kept = have;
+    if (kept < want) {
+        kept += stream_read(scan->stream, scan->buffer + kept, want - kept);
+    }
+    if (kept < want && limits->bytes == 0) {
+        scan->stopped = DEEP_OUT_OF_BYTES;
+        return -1;
+    }
+    limits->members--;
+
+    // The member gets what is left of the limits, one level down
+    FileContext *m = &scan->member;
+    reset_file_context(m, name);
+    memset(&m->st, 0, sizeof(m->st));
+    m->st.st_mode = S_IFREG | 0644;
+    m->st.st_size = (off_t)size;
+    m->head = scan->buffer;
+    m->head_length = kept;
+    m->read_limit = kept;
+    m->max_cost = HANDLER_COST_CHEAP;
+    m->deep = *limits;
+    m->deep.depth--;
+    analyze_member(m);
+    // Members of its own count too
+    scan->inspected += 1 + limits->members - m->deep.members;
+    limits->bytes = m->deep.bytes;
+    limits->members = m->deep.members;
+    report_member(scan, name, size, kept);
+    return (int64_t)kept;
+}
+
+// ZIP members: each one's local header leads to its data
+static int deep_zip_member(void *arg, FileWindow *w, const ZipMember *member) {
+    DeepScan *scan = arg;
+    const unsigned char *p = window_get(w, member->local, 30);
+    if (p == NULL || read_le32(p) != 0x04034b50 || member->encrypted ||
+        (member->method != 0 && member->method != 8)) {
+        // Nothing to analyze without decrypting or another decompressor
+        if (scan->ctx->deep.members == 0) {
+            scan->stopped = DEEP_OUT_OF_MEMBERS;
+            return 1;
+        }
+        char *size_str = format_size((off_t)member->size);
+        char line[DEEP_LINE_SIZE];
+        snprintf(line, sizeof(line), "%s, %s, %s", member->name, size_str != NULL ? size_str : "?",
+                 member->encrypted ? "encrypted" : p == NULL || read_le32(p) != 0x04034b50
+                                                ? "local header missing" : "compression not supported");
+        free(size_str);
+        add_info(&scan->ctx->info, "Member", line);
+        scan->ctx->deep.members--;
+        return 0;
+    }
+    uint64_t data = member->local + 30 + read_le16(p + 26) + read_le16(p + 28);
+    stream_open(scan->stream, w, data, member->compressed, member->method == 8 ? -MAX_WBITS : 0,
+                &scan->ctx->deep.bytes);
+    int64_t consumed = inspect_member(scan, member->name, member->size, 0);
+    stream_close(scan->stream);
+    return consumed < 0;
+}
+
+// tar entries as the stream gives them, the first header possibly read
+// already; payloads not analyzed are skipped, stored ones without reading
+static void deep_tar(DeepScan *scan, unsigned char *header, int have_header) {
+    MemberStream *s = scan->stream;
+    char name[DEEP_NAME_SIZE];
+    char long_name[DEEP_NAME_SIZE];  // From a GNU 'L' entry or a pax header
+    long_name[0] = '\0';
+    uint64_t next_size = UINT64_MAX; // Size override from a pax header
+    for (;;) {
+        if (!have_header && stream_read(s, header, 512) != 512) {
+            break;
+        }
+        have_header = 0;
+        if ((header[0] == '\0' && memcmp(header, header + 1, 511) == 0) ||
+            !tar_checksum_ok(header)) {
+            break;
+        }
+        uint64_t size = tar_number(header + 124, 12);
+        char type = (char)header[156];
+        if (type == 'L' || type == 'x') {
+            // A long name or a pax header for the next entry
+            char buf[PAX_HEADER_READ + 1];
+            size_t want = size < PAX_HEADER_READ ? (size_t)size : PAX_HEADER_READ;
+            size_t got = stream_read(s, (unsigned char *)buf, want);
+            buf[got] = '\0';
+            if (type == 'L') {
+                size_t length = strnlen(buf, sizeof(long_name) - 1);
+                memcpy(long_name, buf, length);
+                long_name[length] = '\0';
+            } else {
+                uint64_t value;
+                if (pax_parse(buf, got, &value, long_name, sizeof(long_name)) == 0) {
+                    next_size = value;
+                }
+            }
+            stream_skip(s, ((size + 511) & ~(uint64_t)511) - got);
+            continue;
+        }
+        if (next_size != UINT64_MAX && type != 'g' && type != 'K') {
+            size = next_size;
+            next_size = UINT64_MAX;
+        }
+        uint64_t consumed = 0;
+        if (type == '0' || type == '\0' || type == '7') {
+            if (long_name[0] != '\0') {
+                snprintf(name, sizeof(name), "%s", long_name);
+            } else if (header[345] != '\0' && memcmp(header + 257, "ustar", 5) == 0) {
+                // ustar splits long names into a prefix and the rest
+                snprintf(name, sizeof(name), "%.155s/%.100s", header + 345, header);
+            } else {
+                snprintf(name, sizeof(name), "%.100s", header);
+            }
+            int64_t n = inspect_member(scan, name, size, 0);
+            if (n < 0) {
+                break;
+            }
+            consumed = (uint64_t)n;
+        } else if (type != 'g' && type != 'K' && type != 'S') {
+            size = 0;  // Links, directories and devices carry no data
+        }
+        long_name[0] = '\0';
+        stream_skip(s, ((size + 511) & ~(uint64_t)511) - consumed);
+    }
+}
+
+// A gzip stream holds a tar archive, or a single file
+static void deep_gzip(DeepScan *scan, const ArchiveSummary *sum) {
+    MemberStream *s = scan->stream;
+    size_t got = stream_read(s, scan->buffer, 512);
+    if (got == 512 && tar_checksum_ok(scan->buffer)) {
+        deep_tar(scan, scan->buffer, 1);
+        return;
+    }
+    // The file's own name, as gzip stored it or without the suffix
+    char name[DEEP_NAME_SIZE];
+    if (s->gzip_name[0] != '\0') {
+        snprintf(name, sizeof(name), "%s", s->gzip_name);
+    } else {
+        const char *base = strrchr(scan->ctx->path, '/');
+        snprintf(name, sizeof(name), "%s", base != NULL ? base + 1 : scan->ctx->path);
+        size_t length = strlen(name);
+        if (length > 3 && strcmp(name + length - 3, ".gz") == 0) {
+            name[length - 3] = '\0';
+        }
+    }
+    // ISIZE has the size modulo 2^32; what was inflated may say more
+    uint64_t size = sum->size;
+    if (got < 512 && s->finished && *s->budget > 0) {
+        size = got;
+    }
+    inspect_member(scan, name, size > got ? size : got, got);
+}
+
+// Analyze the members of an indexed ZIP, tar or gzip file within the
+// limits of ctx->deep, and add a Member field for each of them
+static void inspect_members(FileContext *ctx, FileWindow *w, const ArchiveSummary *sum) {
+    int zip = strncmp(sum->format, "ZIP", 3) == 0;
+    int tar = strcmp(sum->format, "tar") == 0;
+    int gzip = strcmp(sum->format, "gzip") == 0;
+    if (!zip && !tar && !gzip) {
+        return;  // xz and Zstandard would need decompressors of their own
+    }
+    DeepScan scan = { .ctx = ctx };
+    scan.buffer = malloc(DEEP_MEMBER_SIZE);
+    scan.stream = calloc(1, sizeof(MemberStream));
+    if (scan.buffer == NULL || scan.stream == NULL) {
+        free(scan.buffer);
+        free(scan.stream);
+        return;
+    }
+    init_file_context(&scan.member, NULL);
+
+    if (zip) {
+        ArchiveSummary again;
+        memset(&again, 0, sizeof(again));
+        index_zip(w, &again, deep_zip_member, &scan);
+    } else if (tar) {
+        stream_open(scan.stream, w, 0, w->size, 0, &ctx->deep.bytes);
+        deep_tar(&scan, scan.buffer, 0);
+    } else if (stream_open(scan.stream, w, 0, w->size, MAX_WBITS + 16, &ctx->deep.bytes) == 0) {
+        deep_gzip(&scan, sum);
+    }
+    stream_close(scan.stream);
+    if (scan.stopped == DEEP_COMPLETE && ctx->deep.bytes == 0) {
+        scan.stopped = DEEP_OUT_OF_BYTES;  // Some member was cut short
+    }
+
+    char value[96];
+    snprintf(value, sizeof(value), "%" PRIu64 "%s", scan.inspected,
+             scan.stopped == DEEP_OUT_OF_BYTES ? " (stopped: byte budget used up)" :
+             scan.stopped == DEEP_OUT_OF_MEMBERS ? " (stopped: member limit reached)" : "");
+    add_info(&ctx->info, "Members inspected", value);
+
+    free_file_context(&scan.member);
+    free(scan.stream);
+    free(scan.buffer);
+}
+
+// Function to extract information from archive files
+void get_archive_info(FileContext *ctx) {
+    ArchiveSummary sum;
+    memset(&sum, 0, sizeof(sum));
+    int indexed = -1;
+
+    // Only headers, directories and trailers are read; memory use does not
+    // depend on the number of entries
+    FileWindow *window = malloc(sizeof(FileWindow));
+    if (window != NULL && open_window(ctx, window) == 0) {
+        indexed = index_archive(window, &sum);
+    }
+
+    if (indexed != 0) {
+        free(window);
+        list_with_7z(ctx);
+        return;
+    }
+
+    char value[64];
+    add_info(&ctx->info, "Archive format", sum.format);
+    if (sum.has_entries) {
+        snprintf(value, sizeof(value), "%" PRIu64, sum.files);
+        add_info(&ctx->info, "Files in archive", value);
+        if (sum.dirs > 0) {
+            snprintf(value, sizeof(value), "%" PRIu64, sum.dirs);
+            add_info(&ctx->info, "Directories", value);
+        }
+    }
+    if (sum.parts_name != NULL) {
+        snprintf(value, sizeof(value), "%" PRIu64, sum.parts);
+        add_info(&ctx->info, sum.parts_name, value);
+    }
+    if (sum.has_size) {
+        snprintf(value, sizeof(value), "%" PRIu64 " bytes", sum.size);
+        add_info(&ctx->info, "Total uncompressed size", value);
+    }
+    if (sum.has_compressed) {
+        snprintf(value, sizeof(value), "%" PRIu64 " bytes", sum.compressed);
+        add_info(&ctx->info, "Total compressed size", value);
+    }
+
+    // Under --deep, what the members are
+    if (ctx->deep.depth > 0) {
+        inspect_members(ctx, window, &sum);
+    }
+    free(window);
 }
@@ -1,44 +1,463 @@
 // Include necessary header files
 #include "../file_info.h"  // For add_info() function
-#include "../utils.h"      // For execute_command() function and MAX_COMMAND_LENGTH
-#include <stdio.h>         // For NULL
+#include "../utils.h"      // For FileWindow and byte order helpers
+#include <stdio.h>         // For snprintf()
 #include <stdlib.h>        // For free()
+#include <string.h>        // For memcmp()
 
-// Function to extract information from image files
-void get_image_info(const char *path) {
-    // Buffer to store the command
-    char command[MAX_COMMAND_LENGTH];
-    
+// Upper bounds for structure walks, so corrupt files cannot loop forever
+#define MAX_CHUNKS 100000
+#define MAX_FRAMES 1000000
+// Wall-clock limit for each identify run
+#define IDENTIFY_TIMEOUT_MS 10000
+
+// Image properties read straight from the file headers
+typedef struct {
+    uint32_t width;      // Width in pixels
+    uint32_t height;     // Height in pixels
+    int bit_depth;       // Bits per sample, 0 if unknown
+    const char *space;   // Color space name in ImageMagick's wording ("sRGB", "Gray", ...)
+    int indexed;         // Non-zero for palette images (ImageMagick's PseudoClass)
+    int alpha;           // Non-zero if there is an alpha channel
+    uint32_t frames;     // Number of frames or pages, 0 if unknown
+} ImageHeader;
+
+// PNG: IHDR is always the first chunk; acTL and tRNS may precede IDAT
+static int parse_png(FileWindow *w, ImageHeader *img) {
+    const unsigned char *p = window_get(w, 8, 25);
+    if (p == NULL || memcmp(p + 4, "IHDR", 4) != 0) {
+        return -1;
+    }
+    img->width = read_be32(p + 8);
+    img->height = read_be32(p + 12);
+    img->bit_depth = p[16];
+    int color_type = p[17];
+    img->space = (color_type & 2) ? "sRGB" : "Gray";  // Bit 1: color used
+    img->indexed = color_type == 3;                   // Palette
+    img->alpha = (color_type & 4) != 0;               // Bit 2: alpha channel
+    img->frames = 1;
+
+    // Walk the chunks before the image data for animation and transparency
+    uint64_t offset = 8;
+    for (int i = 0; i < MAX_CHUNKS; i++) {
+        const unsigned char *chunk = window_get(w, offset, 12);
+        if (chunk == NULL || memcmp(chunk + 4, "IDAT", 4) == 0 || memcmp(chunk + 4, "IEND", 4) == 0) {
+            break;
+        }
+        uint32_t length = read_be32(chunk);
+        if (memcmp(chunk + 4, "acTL", 4) == 0 && length >= 4) {
+            img->frames = read_be32(chunk + 8);  // APNG frame count
+        } else if (memcmp(chunk + 4, "tRNS", 4) == 0) {
+            img->alpha = 1;
+        }
+        offset += 12 + (uint64_t)length;
+    }
+    return 0;
+}
+
+// JPEG: walk the marker segments up to the first start-of-frame
+static int parse_jpeg(FileWindow *w, ImageHeader *img) {
+    uint64_t offset = 2;
+    for (int i = 0; i < MAX_CHUNKS; i++) {
+        const unsigned char *p = window_get(w, offset, 2);
+        if (p == NULL || p[0] != 0xFF) {
+            return -1;
+        }
+        int marker = p[1];
+        if (marker == 0xFF) {
+            offset++;  // Fill byte before the marker
+            continue;
+        }
+        if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            offset += 2;  // Markers without a payload
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            return -1;  // End of image or start of scan without any frame header
+        }
+        p = window_get(w, offset, 4);
+        if (p == NULL) {
+            return -1;
+        }
+        uint16_t length = read_be16(p + 2);
+        // SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            p = window_get(w, offset + 4, 6);
+            if (p == NULL) {
+                return -1;
+            }
+            img->bit_depth = p[0];
+            img->height = read_be16(p + 1);
+            img->width = read_be16(p + 3);
+            int components = p[5];
+            img->space = components == 1 ? "Gray" : components == 4 ? "CMYK" : "sRGB";
+            img->frames = 1;
+            return 0;
+        }
+        offset += 2 + (uint64_t)length;
+    }
+    return -1;
+}
+
+// Skip a chain of GIF data sub-blocks; returns the offset after the terminator
+static uint64_t skip_gif_blocks(FileWindow *w, uint64_t offset) {
+    for (;;) {
+        const unsigned char *p = window_get(w, offset, 1);
+        if (p == NULL) {
+            return 0;
+        }
+        if (p[0] == 0) {
+            return offset + 1;
+        }
+        offset += 1 + (uint64_t)p[0];
+    }
+}
+
+// GIF: logical screen descriptor, then count the image descriptors
+static int parse_gif(FileWindow *w, ImageHeader *img) {
+    const unsigned char *p = window_get(w, 6, 7);
+    if (p == NULL) {
+        return -1;
+    }
+    img->width = read_le16(p);
+    img->height = read_le16(p + 2);
+    img->bit_depth = 8;
+    img->space = "sRGB";
+    img->indexed = 1;
+    img->frames = 0;
+
+    // Skip the global color table if present
+    uint64_t offset = 13;
+    if (p[4] & 0x80) {
+        offset += 3u << ((p[4] & 7) + 1);
+    }
+
+    while (img->frames < MAX_FRAMES) {
+        p = window_get(w, offset, 1);
+        if (p == NULL || p[0] == 0x3B) {
+            break;  // Truncated file or trailer
+        }
+        if (p[0] == 0x21) {
+            // Extension: label byte, then sub-blocks
+            p = window_get(w, offset, 8);
+            if (p != NULL && p[1] == 0xF9 && (p[3] & 1)) {
+                img->alpha = 1;  // Graphic control extension with a transparent color
+            }
+            offset = skip_gif_blocks(w, offset + 2);
+        } else if (p[0] == 0x2C) {
+            // Image descriptor, optional local color table, LZW code size, data
+            p = window_get(w, offset, 10);
+            if (p == NULL) {
+                break;
+            }
+            img->frames++;
+            offset += 10;
+            if (p[9] & 0x80) {
+                offset += 3u << ((p[9] & 7) + 1);
+            }
+            offset = skip_gif_blocks(w, offset + 1);
+        } else {
+            break;
+        }
+        if (offset == 0) {
+            break;
+        }
+    }
+    if (img->frames == 0) {
+        img->frames = 1;
+    }
+    return 0;
+}
+
+// BMP: BITMAPCOREHEADER or BITMAPINFOHEADER and its later versions
+static int parse_bmp(FileWindow *w, ImageHeader *img) {
+    const unsigned char *p = window_get(w, 14, 4);
+    if (p == NULL) {
+        return -1;
+    }
+    uint32_t header_size = read_le32(p);
+    int bpp;
+    if (header_size == 12) {
+        p = window_get(w, 18, 8);
+        if (p == NULL) {
+            return -1;
+        }
+        img->width = read_le16(p);
+        img->height = read_le16(p + 2);
+        bpp = read_le16(p + 6);
+    } else if (header_size >= 40) {
+        // The alpha mask is only looked at when the longer header is really there
+        int with_masks = header_size >= 56;
+        p = window_get(w, 18, with_masks ? 52 : 12);
+        if (p == NULL) {
+            return -1;
+        }
+        int32_t width = (int32_t)read_le32(p);
+        int32_t height = (int32_t)read_le32(p + 4);
+        // Negative heights mark top-down bitmaps
+        img->width = width < 0 ? -(uint32_t)width : (uint32_t)width;
+        img->height = height < 0 ? -(uint32_t)height : (uint32_t)height;
+        bpp = read_le16(p + 10);
+        // V3 and later headers carry an alpha mask right after the color masks
+        if (with_masks && bpp == 32 && read_le32(p + 48) != 0) {
+            img->alpha = 1;
+        }
+    } else {
+        return -1;
+    }
+    img->indexed = bpp <= 8;
+    img->bit_depth = bpp >= 24 ? 8 : bpp == 16 ? 5 : bpp;
+    img->space = "sRGB";
+    img->frames = 1;
+    return 0;
+}
+
+// WebP: lossy (VP8), lossless (VP8L) or extended (VP8X) RIFF container
+static int parse_webp(FileWindow *w, ImageHeader *img) {
+    const unsigned char *p = window_get(w, 12, 18);
+    if (p == NULL) {
+        return -1;
+    }
+    img->bit_depth = 8;
+    img->space = "sRGB";
+    img->frames = 1;
+    if (memcmp(p, "VP8 ", 4) == 0) {
+        // Frame tag (3 bytes) and start code 9D 01 2A precede the size fields
+        if (p[11] != 0x9D || p[12] != 0x01 || p[13] != 0x2A) {
+            return -1;
+        }
+        img->width = read_le16(p + 14) & 0x3FFF;
+        img->height = read_le16(p + 16) & 0x3FFF;
+        return 0;
+    }
+    if (memcmp(p, "VP8L", 4) == 0) {
+        if (p[8] != 0x2F) {
+            return -1;
+        }
+        uint32_t bits = read_le32(p + 9);
+        img->width = (bits & 0x3FFF) + 1;
+        img->height = ((bits >> 14) & 0x3FFF) + 1;
+        img->alpha = (bits >> 28) & 1;
+        return 0;
+    }
+    if (memcmp(p, "VP8X", 4) == 0) {
+        int flags = p[8];
+        img->alpha = (flags & 0x10) != 0;
+        img->width = (p[12] | p[13] << 8 | (uint32_t)p[14] << 16) + 1;
+        img->height = (p[15] | p[16] << 8 | (uint32_t)p[17] << 16) + 1;
+        if (flags & 0x02) {
+            // Animated: every frame is an ANMF chunk
+            img->frames = 0;
+            uint64_t offset = 12;
+            for (int i = 0; i < MAX_CHUNKS; i++) {
+                const unsigned char *chunk = window_get(w, offset, 8);
+                if (chunk == NULL) {
+                    break;
+                }
+                if (memcmp(chunk, "ANMF", 4) == 0) {
+                    img->frames++;
+                }
+                uint32_t size = read_le32(chunk + 4);
+                offset += 8 + (uint64_t)size + (size & 1);  // Chunks are padded to even sizes
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// Read a 16-bit TIFF value in the file's byte order
+static uint32_t tiff16(const unsigned char *p, int big) {
+    return big ? read_be16(p) : read_le16(p);
+}
+
+// Read a 32-bit TIFF value in the file's byte order
+static uint32_t tiff32(const unsigned char *p, int big) {
+    return big ? read_be32(p) : read_le32(p);
+}
+
+// TIFF: tags of the first IFD, then follow the IFD chain to count pages
+static int parse_tiff(FileWindow *w, ImageHeader *img, int big) {
+    const unsigned char *p = window_get(w, 4, 4);
+    if (p == NULL) {
+        return -1;
+    }
+    uint64_t ifd = tiff32(p, big);
+    int photometric = -1, samples = 1, extra = 0;
+
+    while (ifd != 0 && img->frames < MAX_FRAMES) {
+        p = window_get(w, ifd, 2);
+        if (p == NULL) {
+            break;
+        }
+        uint32_t entries = tiff16(p, big);
+        if (img->frames == 0) {
+            // Only the first page's tags describe the image
+            for (uint32_t i = 0; i < entries; i++) {
+                const unsigned char *e = window_get(w, ifd + 2 + 12 * (uint64_t)i, 12);
+                if (e == NULL) {
+                    return -1;
+                }
+                uint32_t tag = tiff16(e, big), type = tiff16(e + 2, big);
+                uint32_t count = tiff32(e + 4, big);
+                // SHORT values sit in the first half of the value field
+                uint32_t value = type == 3 ? tiff16(e + 8, big) : tiff32(e + 8, big);
+                if (tag == 256) {
+                    img->width = value;
+                } else if (tag == 257) {
+                    img->height = value;
+                } else if (tag == 258) {
+                    // More than two SHORTs don't fit, the field holds an offset instead
+                    if (count > 2) {
+                        const unsigned char *v = window_get(w, tiff32(e + 8, big), 2);
+                        value = v != NULL ? tiff16(v, big) : 0;
+                    }
+                    img->bit_depth = value;
+                } else if (tag == 262) {
+                    photometric = value;
+                } else if (tag == 277) {
+                    samples = value;
+                } else if (tag == 338) {
+                    extra = 1;
+                }
+            }
+        }
+        img->frames++;
+        p = window_get(w, ifd + 2 + 12 * (uint64_t)entries, 4);
+        uint64_t next = p != NULL ? tiff32(p, big) : 0;
+        // Only follow forward links, which also rules out cycles
+        ifd = next > ifd ? next : 0;
+    }
+    if (img->width == 0 || img->height == 0) {
+        return -1;
+    }
+
+    switch (photometric) {
+    case 0:
+    case 1:
+        img->space = "Gray";
+        img->alpha = extra || samples > 1;
+        break;
+    case 3:
+        img->space = "sRGB";
+        img->indexed = 1;
+        break;
+    case 5:
+        img->space = "CMYK";
+        img->alpha = extra || samples > 4;
+        break;
+    case 6:
+        img->space = "YCbCr";
+        break;
+    default:
+        img->space = "sRGB";
+        img->alpha = extra || samples > 3;
+        break;
+    }
+    return 0;
+}
+
+// Recognize the format from its signature and parse the header
+static int parse_image_header(FileWindow *w, ImageHeader *img) {
+    const unsigned char *p = window_get(w, 0, 16);
+    if (p == NULL) {
+        return -1;
+    }
+    if (memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        return parse_png(w, img);
+    }
+    if (p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF) {
+        return parse_jpeg(w, img);
+    }
+    if (memcmp(p, "GIF87a", 6) == 0 || memcmp(p, "GIF89a", 6) == 0) {
+        return parse_gif(w, img);
+    }
+    if (p[0] == 'B' && p[1] == 'M') {
+        return parse_bmp(w, img);
+    }
+    if (memcmp(p, "RIFF", 4) == 0 && memcmp(p + 8, "WEBP", 4) == 0) {
+        return parse_webp(w, img);
+    }
+    if (memcmp(p, "II*\0", 4) == 0) {
+        return parse_tiff(w, img, 0);
+    }
+    if (memcmp(p, "MM\0*", 4) == 0) {
+        return parse_tiff(w, img, 1);
+    }
+    return -1;
+}
+
+// Ask ImageMagick for formats the built-in parser does not know
+static void identify_image(FileContext *ctx) {
     // Prepare command to get image dimensions
     // 'identify' is a command-line utility from ImageMagick
-    // -format '%wx%h' specifies the output format: width x height
-    snprintf(command, sizeof(command), "identify -format '%%wx%%h' '%s'", path);
-    
+    // -format %wx%h specifies the output format: width x height
+    const char *dimensions_argv[] = { "identify", "-format", "%wx%h", ctx->path, NULL };
+
     // Execute the command and get its output
-    char *output = execute_command(command);
-    
+    char *output = run_tool(ctx, dimensions_argv, IDENTIFY_TIMEOUT_MS);
+
     // Check if the command execution was successful
     if (output) {
-        // Add the dimensions to the global info array
-        add_info("Dimensions", output);
-        
-        // Free the memory allocated by execute_command()
+        // Add the dimensions to the file's info array
+        add_info(&ctx->info, "Dimensions", output);
+
+        // Free the memory allocated by run_tool()
         free(output);
     }
 
     // Prepare command to get image color space
-    // -format '%r' specifies the output format: color space
-    snprintf(command, sizeof(command), "identify -format '%%r' '%s'", path);
-    
+    // -format %r specifies the output format: color space
+    const char *space_argv[] = { "identify", "-format", "%r", ctx->path, NULL };
+
     // Execute the command and get its output
-    output = execute_command(command);
-    
+    output = run_tool(ctx, space_argv, IDENTIFY_TIMEOUT_MS);
+
     // Check if the command execution was successful
     if (output) {
-        // Add the color space to the global info array
-        add_info("Color space", output);
-        
-        // Free the memory allocated by execute_command()
+        // Add the color space to the file's info array
+        add_info(&ctx->info, "Color space", output);
+
+        // Free the memory allocated by run_tool()
         free(output);
     }
 }
+
+// Function to extract information from image files
+void get_image_info(FileContext *ctx) {
+    ImageHeader img = {0};
+    int parsed = -1;
+
+    // Read only the headers, a few kilobytes at most for common formats
+    FileWindow *window = malloc(sizeof(FileWindow));
+    if (window != NULL && open_window(ctx, window) == 0) {
+        parsed = parse_image_header(window, &img);
+    }
+    free(window);
+
+    // Unknown or damaged header: let ImageMagick have a go
+    if (parsed != 0) {
+        identify_image(ctx);
+        return;
+    }
+
+    char value[64];
+
+    // Width x height, as identify's %wx%h prints it
+    snprintf(value, sizeof(value), "%ux%u", img.width, img.height);
+    add_info(&ctx->info, "Dimensions", value);
+
+    // Storage class, color space and alpha, as identify's %r prints it
+    snprintf(value, sizeof(value), "%s %s%s", img.indexed ? "PseudoClass" : "DirectClass",
+             img.space, img.alpha ? " Alpha" : "");
+    add_info(&ctx->info, "Color space", value);
+
+    if (img.bit_depth > 0) {
+        snprintf(value, sizeof(value), "%d", img.bit_depth);
+        add_info(&ctx->info, "Bit depth", value);
+    }
+    if (img.frames > 0) {
+        snprintf(value, sizeof(value), "%u", img.frames);
+        add_info(&ctx->info, "Frames", value);
+    }
+}
@@ -1,53 +1,1259 @@
+// Define _GNU_SOURCE for memmem()
+#define _GNU_SOURCE
+
 // Include necessary header files
 #include "../file_info.h"  // For add_info() function
-#include "../utils.h"      // For execute_command() function and MAX_COMMAND_LENGTH
-#include <stdio.h>         // For NULL
-#include <stdlib.h>        // For free()
-#include <string.h>        // For strtok(), strlen()
+#include "../utils.h"      // For FileWindow
+#include <stdio.h>         // For snprintf()
+#include <stdlib.h>        // For malloc(), free(), strtoll()
+#include <string.h>        // For strchr(), memcmp(), memmem()
+#include <zlib.h>          // For inflating xref and object streams
 
-// Function to extract information from PDF files
-void get_pdf_info(const char *path) {
-    // Buffer to store the command
-    char command[MAX_COMMAND_LENGTH];
-    
+// The spec puts startxref in the last 1024 bytes; leave room for junk after %%EOF
+#define TAIL_SIZE 4096
+// Limits that keep damaged or hostile files from costing unbounded work
+#define MAX_XREF_SECTIONS 64
+#define MAX_SUBSECTIONS 100000
+#define MAX_OBJECT_SIZE (1 << 20)
+#define MAX_STREAM_SIZE (64 << 20)
+#define MAX_DEPTH 32
+// Wall-clock limit for the pdfinfo fallback
+#define PDFINFO_TIMEOUT_MS 10000
+
+// One cross-reference section, either a classic table or an xref stream
+typedef struct {
+    uint64_t offset;          // File offset of the table ("xref" keyword)
+    unsigned char *entries;   // Decoded stream rows, NULL for tables
+    size_t entries_len;
+    int widths[3];            // Stream field widths (/W)
+    int64_t *index;           // Stream (first, count) pairs (/Index)
+    size_t index_pairs;
+} XrefSection;
+
+// Where an object lives according to the cross-reference data
+typedef struct {
+    int type;         // 0 free/missing, 1 at a file offset, 2 inside an object stream
+    uint64_t field2;  // File offset, or object stream number
+    uint64_t field3;  // Index inside the object stream
+} XrefEntry;
+
+// An open document
+typedef struct {
+    uint64_t size;
+    FileWindow window;                        // Small reads, and the file's head
+    XrefSection sections[MAX_XREF_SECTIONS];  // Newest first
+    int section_count;
+    int64_t root;                             // Catalog object number
+    int64_t info;                             // Info dictionary object number, 0 if none
+    int encrypted;
+    int64_t objstm_num;                       // Number of the cached object stream
+    unsigned char *objstm;                    // Its decoded data
+    size_t objstm_len;
+    size_t objstm_first;                      // Offset of its first member (/First)
+} PdfDoc;
+
+// A loaded object; body points at the value after "n g obj"
+typedef struct {
+    unsigned char *buf;      // Owned bytes of the object
+    size_t len;
+    size_t body;             // Offset of the value within buf
+    uint64_t file_offset;    // File offset of buf[0], or UINT64_MAX for stream members
+} PdfObject;
+
+// A cursor over PDF syntax
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} Lex;
+
+// ---------------------------------------------------------------------------
+// Lexical helpers
+// ---------------------------------------------------------------------------
+
+static int is_space(int c) {
+    return c == 0 || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+static int is_delimiter(int c) {
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' ||
+           c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+// Skip whitespace and comments
+static void lex_skip_space(Lex *lx) {
+    while (lx->p < lx->end) {
+        if (*lx->p == '%') {
+            while (lx->p < lx->end && *lx->p != '\n' && *lx->p != '\r') {
+                lx->p++;
+            }
+        } else if (is_space(*lx->p)) {
+            lx->p++;
+        } else {
+            break;
+        }
+    }
+}
+
+// Does the input continue with the given keyword?
+static int lex_keyword(Lex *lx, const char *word) {
+    lex_skip_space(lx);
+    size_t len = strlen(word);
+    if ((size_t)(lx->end - lx->p) < len || memcmp(lx->p, word, len) != 0) {
+        return 0;
+    }
+    if (lx->p + len < lx->end && !is_space(lx->p[len]) && !is_delimiter(lx->p[len])) {
+        return 0;
+    }
+    lx->p += len;
+    return 1;
+}
+
+// Parse an integer (a real is truncated)
+static int lex_int(Lex *lx, int64_t *value) {
+    lex_skip_space(lx);
+    const unsigned char *p = lx->p;
+    int negative = 0;
+    if (p < lx->end && (*p == '+' || *p == '-')) {
+        negative = *p++ == '-';
+    }
+    if (p >= lx->end || *p < '0' || *p > '9') {
+        return -1;
+    }
+    int64_t v = 0;
+    while (p < lx->end && *p >= '0' && *p <= '9' && v < INT64_MAX / 10) {
+        v = v * 10 + (*p++ - '0');
+    }
+    // Skip a fractional part
+    if (p < lx->end && *p == '.') {
+        p++;
+        while (p < lx->end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    *value = negative ? -v : v;
+    lx->p = p;
+    return 0;
+}
+
+// Parse a real number
+static int lex_real(Lex *lx, double *value) {
+    lex_skip_space(lx);
+    char text[64];
+    size_t n = 0;
+    while (lx->p + n < lx->end && n < sizeof(text) - 1 &&
+           (strchr("+-.0123456789", lx->p[n]) != NULL)) {
+        text[n] = lx->p[n];
+        n++;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    text[n] = '\0';
+    *value = strtod(text, NULL);
+    lx->p += n;
+    return 0;
+}
+
+// Parse an indirect reference "num gen R"; leaves the cursor alone otherwise
+static int lex_ref(Lex *lx, int64_t *num) {
+    Lex save = *lx;
+    int64_t gen;
+    if (lex_int(lx, num) == 0 && lex_int(lx, &gen) == 0 && lex_keyword(lx, "R")) {
+        return 0;
+    }
+    *lx = save;
+    return -1;
+}
+
+// Skip over one complete value of any type
+static int lex_skip_value(Lex *lx, int depth) {
+    lex_skip_space(lx);
+    if (lx->p >= lx->end || depth > MAX_DEPTH) {
+        return -1;
+    }
+    int c = *lx->p;
+    if (c == '<' && lx->p + 1 < lx->end && lx->p[1] == '<') {
+        // Dictionary: key/value pairs up to ">>"
+        lx->p += 2;
+        for (;;) {
+            lex_skip_space(lx);
+            if (lx->p + 1 < lx->end && lx->p[0] == '>' && lx->p[1] == '>') {
+                lx->p += 2;
+                return 0;
+            }
+            if (lex_skip_value(lx, depth + 1) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (c == '[') {
+        lx->p++;
+        for (;;) {
+            lex_skip_space(lx);
+            if (lx->p < lx->end && *lx->p == ']') {
+                lx->p++;
+                return 0;
+            }
+            if (lex_skip_value(lx, depth + 1) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (c == '(') {
+        // Literal string with balanced parentheses and backslash escapes
+        int nesting = 0;
+        while (lx->p < lx->end) {
+            c = *lx->p++;
+            if (c == '\\') {
+                lx->p++;
+            } else if (c == '(') {
+                nesting++;
+            } else if (c == ')' && --nesting == 0) {
+                return 0;
+            }
+        }
+        return -1;
+    }
+    if (c == '<') {
+        const unsigned char *close = memchr(lx->p, '>', lx->end - lx->p);
+        if (close == NULL) {
+            return -1;
+        }
+        lx->p = close + 1;
+        return 0;
+    }
+    if (c == '/' || c == '{' || c == '}') {
+        lx->p++;  // Name, or a PostScript brace that is a token by itself
+    } else if (c == ']' || c == '>' || c == ')') {
+        return -1;
+    } else {
+        // A number may be the start of a reference
+        int64_t num;
+        if (lex_ref(lx, &num) == 0) {
+            return 0;
+        }
+    }
+    // Name, number, boolean, null or other bare token
+    while (lx->p < lx->end && !is_space(*lx->p) && !is_delimiter(*lx->p)) {
+        lx->p++;
+    }
+    return 0;
+}
+
+// Find key in the dictionary at the cursor; value is positioned at its value
+static int dict_get(Lex dict, const char *key, Lex *value) {
+    lex_skip_space(&dict);
+    if (dict.end - dict.p < 2 || dict.p[0] != '<' || dict.p[1] != '<') {
+        return -1;
+    }
+    dict.p += 2;
+    size_t key_len = strlen(key);
+    for (int i = 0; i < 10000; i++) {
+        lex_skip_space(&dict);
+        if (dict.p >= dict.end || *dict.p != '/') {
+            return -1;  // End of dictionary (">>") or malformed
+        }
+        const unsigned char *name = ++dict.p;
+        while (dict.p < dict.end && !is_space(*dict.p) && !is_delimiter(*dict.p)) {
+            dict.p++;
+        }
+        if ((size_t)(dict.p - name) == key_len && memcmp(name, key, key_len) == 0) {
+            *value = dict;
+            lex_skip_space(value);
+            return 0;
+        }
+        if (lex_skip_value(&dict, 0) != 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Does the value at the cursor equal the name /name?
+static int is_name(Lex value, const char *name) {
+    lex_skip_space(&value);
+    size_t len = strlen(name);
+    return value.p < value.end && *value.p == '/' && (size_t)(value.end - value.p) > len &&
+           memcmp(value.p + 1, name, len) == 0 &&
+           (value.p + 1 + len == value.end || is_space(value.p[1 + len]) ||
+            is_delimiter(value.p[1 + len]));
+}
+
+// ---------------------------------------------------------------------------
+// Objects and streams
+// ---------------------------------------------------------------------------
+
+static int load_object(PdfDoc *doc, int64_t num, PdfObject *obj, int depth);
+
+static void free_object(PdfObject *obj) {
+    free(obj->buf);
+    obj->buf = NULL;
+}
+
+// Cursor over a loaded object's value
+static Lex object_lex(const PdfObject *obj) {
+    Lex lx = { obj->buf + obj->body, obj->buf + obj->len };
+    return lx;
+}
+
+// Read an integer value, following a reference if needed
+static int get_int(PdfDoc *doc, Lex value, int64_t *out, int depth) {
+    int64_t num;
+    if (lex_ref(&value, &num) == 0) {
+        PdfObject obj;
+        if (depth > MAX_DEPTH || load_object(doc, num, &obj, depth + 1) != 0) {
+            return -1;
+        }
+        Lex lx = object_lex(&obj);
+        int status = lex_int(&lx, out);
+        free_object(&obj);
+        return status;
+    }
+    return lex_int(&value, out);
+}
+
+// Inflate zlib data into a new buffer
+static unsigned char *inflate_data(const unsigned char *data, size_t len, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        return NULL;
+    }
+    size_t cap = len * 4 + 1024, used = 0;
+    unsigned char *out = malloc(cap);
+    zs.next_in = (unsigned char *)data;
+    zs.avail_in = (uInt)len;
+    int status = Z_OK;
+    while (out != NULL && status == Z_OK) {
+        if (used == cap) {
+            unsigned char *bigger = cap < MAX_STREAM_SIZE ? realloc(out, cap * 2) : NULL;
+            if (bigger == NULL) {
+                free(out);
+                out = NULL;
+                break;
+            }
+            out = bigger;
+            cap *= 2;
+        }
+        zs.next_out = out + used;
+        zs.avail_out = (uInt)(cap - used);
+        status = inflate(&zs, Z_NO_FLUSH);
+        used = cap - zs.avail_out;
+        if (status == Z_BUF_ERROR && zs.avail_in == 0) {
+            break;  // Truncated stream: keep what was decoded
+        }
+    }
+    inflateEnd(&zs);
+    if (out != NULL && status != Z_STREAM_END && status != Z_BUF_ERROR && status != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    *out_len = used;
+    return out;
+}
+
+// Undo PNG row predictors (Predictor >= 10) in place; returns the new length
+static size_t unpredict_png(unsigned char *data, size_t len, int columns) {
+    size_t row = (size_t)columns + 1;
+    size_t rows = len / row;
+    unsigned char *prev = calloc(columns, 1);
+    if (prev == NULL) {
+        return 0;
+    }
+    for (size_t r = 0; r < rows; r++) {
+        unsigned char *src = data + r * row;
+        unsigned char *dst = data + r * columns;  // Rows shrink by the filter byte
+        int filter = src[0];
+        for (int i = 0; i < columns; i++) {
+            int left = i > 0 ? dst[i - 1] : 0;
+            int up = prev[i];
+            int upleft = i > 0 ? prev[i - 1] : 0;
+            int x = src[i + 1];
+            switch (filter) {
+            case 1: x += left; break;
+            case 2: x += up; break;
+            case 3: x += (left + up) / 2; break;
+            case 4: {
+                int pa = abs(up - upleft), pb = abs(left - upleft), pc = abs(left + up - 2 * upleft);
+                x += pa <= pb && pa <= pc ? left : pb <= pc ? up : upleft;
+                break;
+            }
+            default: break;
+            }
+            dst[i] = (unsigned char)x;
+        }
+        memcpy(prev, dst, columns);
+    }
+    free(prev);
+    return rows * columns;
+}
+
+// Read and decode the stream of an object loaded from the file
+static unsigned char *load_stream(PdfDoc *doc, PdfObject *obj, size_t *out_len, int depth) {
+    Lex dict = object_lex(obj), value;
+    Lex after = dict;
+    if (obj->file_offset == UINT64_MAX || lex_skip_value(&after, 0) != 0 ||
+        !lex_keyword(&after, "stream")) {
+        return NULL;
+    }
+    // The data starts after the end-of-line that follows "stream"
+    if (after.p < after.end && *after.p == '\r') {
+        after.p++;
+    }
+    if (after.p < after.end && *after.p == '\n') {
+        after.p++;
+    }
+    uint64_t start = obj->file_offset + (uint64_t)(after.p - obj->buf);
+
+    int64_t length;
+    if (dict_get(dict, "Length", &value) != 0 || get_int(doc, value, &length, depth) != 0 ||
+        length < 0 || length > MAX_STREAM_SIZE || start + (uint64_t)length > doc->size) {
+        return NULL;
+    }
+    unsigned char *raw = malloc(length > 0 ? length : 1);
+    if (raw == NULL || window_read(&doc->window, raw, length, start) != length) {
+        free(raw);
+        return NULL;
+    }
+
+    // Only Flate (alone or as a one-element array) is needed for xref and object streams
+    if (dict_get(dict, "Filter", &value) != 0) {
+        *out_len = length;
+        return raw;
+    }
+    if (value.p < value.end && *value.p == '[') {
+        value.p++;
+    }
+    if (!is_name(value, "FlateDecode")) {
+        free(raw);
+        return NULL;
+    }
+    size_t len;
+    unsigned char *data = inflate_data(raw, length, &len);
+    free(raw);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    Lex parms, pred;
+    int64_t predictor = 1, columns = 1;
+    if (dict_get(dict, "DecodeParms", &parms) == 0) {
+        if (dict_get(parms, "Predictor", &pred) == 0) {
+            lex_int(&pred, &predictor);
+        }
+        if (dict_get(parms, "Columns", &pred) == 0) {
+            lex_int(&pred, &columns);
+        }
+    }
+    if (predictor >= 10 && columns > 0 && columns < 1024) {
+        len = unpredict_png(data, len, (int)columns);
+    } else if (predictor != 1) {
+        free(data);
+        return NULL;
+    }
+    *out_len = len;
+    return data;
+}
+
+// Read the object whose "num gen obj" header is at a file offset
+static int load_object_at(PdfDoc *doc, uint64_t offset, PdfObject *obj) {
+    size_t cap = 4096;
+    for (;;) {
+        if (offset >= doc->size) {
+            return -1;
+        }
+        size_t want = doc->size - offset < cap ? (size_t)(doc->size - offset) : cap;
+        unsigned char *buf = malloc(want);
+        ssize_t got = buf != NULL ? window_read(&doc->window, buf, want, offset) : -1;
+        if (got <= 0) {
+            free(buf);
+            return -1;
+        }
+        Lex lx = { buf, buf + got };
+        int64_t num, gen;
+        if (lex_int(&lx, &num) != 0 || lex_int(&lx, &gen) != 0 || !lex_keyword(&lx, "obj")) {
+            free(buf);
+            return -1;
+        }
+        // The whole value must be in the buffer; streams only need their dictionary
+        Lex value = lx;
+        if (lex_skip_value(&value, 0) == 0 || (size_t)got < want || cap >= MAX_OBJECT_SIZE) {
+            obj->buf = buf;
+            obj->len = got;
+            obj->body = lx.p - buf;
+            obj->file_offset = offset;
+            return 0;
+        }
+        free(buf);
+        cap *= 4;
+    }
+}
+
+// Look an object up in one cross-reference section
+static int section_lookup(PdfDoc *doc, const XrefSection *section, int64_t num, XrefEntry *entry) {
+    if (section->entries != NULL) {
+        // Xref stream: rows of three big-endian fields
+        int row = section->widths[0] + section->widths[1] + section->widths[2];
+        size_t first_row = 0;
+        for (size_t i = 0; i < section->index_pairs; i++) {
+            int64_t first = section->index[2 * i], count = section->index[2 * i + 1];
+            if (num >= first && num < first + count) {
+                size_t at = (first_row + (size_t)(num - first)) * row;
+                if (at + row > section->entries_len) {
+                    return -1;
+                }
+                const unsigned char *p = section->entries + at;
+                uint64_t fields[3];
+                for (int f = 0; f < 3; f++) {
+                    fields[f] = 0;
+                    for (int b = 0; b < section->widths[f]; b++) {
+                        fields[f] = fields[f] << 8 | *p++;
+                    }
+                }
+                // A missing type field defaults to 1
+                entry->type = section->widths[0] == 0 ? 1 : (int)fields[0];
+                entry->field2 = fields[1];
+                entry->field3 = fields[2];
+                return 0;
+            }
+            first_row += (size_t)count;
+        }
+        return -1;
+    }
+
+    // Classic table: walk the subsection headers, skipping their entries
+    uint64_t offset = section->offset + 4;
+    for (int i = 0; i < MAX_SUBSECTIONS; i++) {
+        const unsigned char *p = window_get(&doc->window, offset, 64);
+        if (p == NULL) {
+            p = window_get(&doc->window, offset, (size_t)(doc->size - offset));
+        }
+        if (p == NULL) {
+            return -1;
+        }
+        Lex lx = { p, p + window_span(&doc->window, p) };
+        int64_t first, count;
+        if (lex_int(&lx, &first) != 0 || lex_int(&lx, &count) != 0 || count < 0) {
+            return -1;  // Reached "trailer"
+        }
+        // Entries start on the next line and are normally 20 bytes each
+        while (lx.p < lx.end && (*lx.p == ' ' || *lx.p == '\t')) {
+            lx.p++;
+        }
+        while (lx.p < lx.end && (*lx.p == '\r' || *lx.p == '\n')) {
+            lx.p++;
+        }
+        uint64_t entries = offset + (uint64_t)(lx.p - p);
+        // Some writers use 19- or 21-byte entries; measure the first one
+        int width = 20;
+        const unsigned char *e = window_get(&doc->window, entries, 21);
+        if (e != NULL) {
+            width = e[18] == '\n' || (e[18] == '\r' && e[19] != '\n') ? 19 :
+                    e[19] == '\r' && e[20] == '\n' ? 21 : 20;
+        }
+        if (num >= first && num < first + count) {
+            e = window_get(&doc->window, entries + (uint64_t)(num - first) * width, 18);
+            if (e == NULL) {
+                return -1;
+            }
+            Lex fields = { e, e + 18 };
+            int64_t off, gen;
+            if (lex_int(&fields, &off) != 0 || lex_int(&fields, &gen) != 0) {
+                return -1;
+            }
+            lex_skip_space(&fields);
+            entry->type = fields.p < fields.end && *fields.p == 'n' ? 1 : 0;
+            entry->field2 = (uint64_t)off;
+            entry->field3 = 0;
+            return 0;
+        }
+        offset = entries + (uint64_t)count * width;
+    }
+    return -1;
+}
+
+// Extract object num from object stream stream_num
+static int load_from_object_stream(PdfDoc *doc, int64_t stream_num, int64_t num,
+                                   PdfObject *obj, int depth) {
+    // Decode the stream unless it is the one decoded last time
+    if (doc->objstm == NULL || doc->objstm_num != stream_num) {
+        PdfObject stream;
+        if (load_object(doc, stream_num, &stream, depth + 1) != 0) {
+            return -1;
+        }
+        size_t len;
+        unsigned char *data = load_stream(doc, &stream, &len, depth + 1);
+        Lex value;
+        int64_t first = -1;
+        if (dict_get(object_lex(&stream), "First", &value) == 0) {
+            lex_int(&value, &first);
+        }
+        free_object(&stream);
+        if (data == NULL || first < 0 || (size_t)first > len) {
+            free(data);
+            return -1;
+        }
+        free(doc->objstm);
+        doc->objstm = data;
+        doc->objstm_len = len;
+        doc->objstm_first = (size_t)first;
+        doc->objstm_num = stream_num;
+    }
+
+    // The header lists "number offset" pairs, offsets relative to /First
+    Lex header = { doc->objstm, doc->objstm + doc->objstm_first };
+    int64_t n, off;
+    while (lex_int(&header, &n) == 0 && lex_int(&header, &off) == 0) {
+        if (n != num) {
+            continue;
+        }
+        // The member runs up to where the next one starts
+        int64_t next_n, next_off;
+        size_t start = doc->objstm_first + (size_t)off;
+        size_t end = doc->objstm_len;
+        if (lex_int(&header, &next_n) == 0 && lex_int(&header, &next_off) == 0 &&
+            doc->objstm_first + (size_t)next_off <= end) {
+            end = doc->objstm_first + (size_t)next_off;
+        }
+        if (off < 0 || start >= end) {
+            return -1;
+        }
+        obj->buf = malloc(end - start);
+        if (obj->buf == NULL) {
+            return -1;
+        }
+        memcpy(obj->buf, doc->objstm + start, end - start);
+        obj->len = end - start;
+        obj->body = 0;
+        obj->file_offset = UINT64_MAX;  // Not backed by the file, so no stream data
+        return 0;
+    }
+    return -1;
+}
+
+// Load object num, consulting the newest cross-reference section first
+static int load_object(PdfDoc *doc, int64_t num, PdfObject *obj, int depth) {
+    if (depth > MAX_DEPTH) {
+        return -1;
+    }
+    for (int i = 0; i < doc->section_count; i++) {
+        XrefEntry entry;
+        if (section_lookup(doc, &doc->sections[i], num, &entry) != 0) {
+            continue;
+        }
+        if (entry.type == 1) {
+            return load_object_at(doc, entry.field2, obj);
+        }
+        if (entry.type == 2) {
+            return load_from_object_stream(doc, (int64_t)entry.field2, num, obj, depth);
+        }
+        // Free in this section: look on in the older ones, since in hybrid
+        // files the xref stream that follows carries the live entry
+    }
+    return -1;
+}
+
+// Load the dictionary a value refers to, or copy a direct one
+static int get_dict(PdfDoc *doc, Lex value, PdfObject *obj, int depth) {
+    int64_t num;
+    if (lex_ref(&value, &num) == 0) {
+        return load_object(doc, num, obj, depth + 1);
+    }
+    size_t len = value.end - value.p;
+    obj->buf = malloc(len > 0 ? len : 1);
+    if (obj->buf == NULL) {
+        return -1;
+    }
+    memcpy(obj->buf, value.p, len);
+    obj->len = len;
+    obj->body = 0;
+    obj->file_offset = UINT64_MAX;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Cross-reference sections and trailers
+// ---------------------------------------------------------------------------
+
+// Values collected from the newest trailer that has them
+typedef struct {
+    int64_t root, info, prev, xref_stm;
+    int encrypted;
+} Trailer;
+
+// Read the trailer keys that matter from a dictionary
+static void read_trailer(Lex dict, Trailer *trailer) {
+    Lex value;
+    int64_t num;
+    trailer->prev = trailer->xref_stm = -1;
+    if (dict_get(dict, "Root", &value) == 0 && lex_ref(&value, &num) == 0) {
+        trailer->root = num;
+    }
+    if (dict_get(dict, "Info", &value) == 0 && lex_ref(&value, &num) == 0) {
+        trailer->info = num;
+    }
+    if (dict_get(dict, "Prev", &value) == 0) {
+        lex_int(&value, &trailer->prev);
+    }
+    if (dict_get(dict, "XRefStm", &value) == 0) {
+        lex_int(&value, &trailer->xref_stm);
+    }
+    if (dict_get(dict, "Encrypt", &value) == 0) {
+        trailer->encrypted = 1;
+    }
+}
+
+// Load an xref stream section at offset and read its dictionary as a trailer
+static int add_stream_section(PdfDoc *doc, uint64_t offset, Trailer *trailer) {
+    PdfObject obj;
+    if (doc->section_count == MAX_XREF_SECTIONS || load_object_at(doc, offset, &obj) != 0) {
+        return -1;
+    }
+    Lex dict = object_lex(&obj), value;
+    XrefSection *section = &doc->sections[doc->section_count];
+    memset(section, 0, sizeof(*section));
+
+    // Field widths
+    int ok = dict_get(dict, "W", &value) == 0 && value.p < value.end && *value.p == '[';
+    if (ok) {
+        value.p++;
+        for (int f = 0; f < 3 && ok; f++) {
+            int64_t w;
+            ok = lex_int(&value, &w) == 0 && w >= 0 && w <= 8;
+            section->widths[f] = (int)w;
+        }
+    }
+    // Object number ranges, [0 Size] by default
+    int64_t size = 0;
+    if (ok && dict_get(dict, "Size", &value) == 0) {
+        lex_int(&value, &size);
+    }
+    if (ok && dict_get(dict, "Index", &value) == 0 && value.p < value.end && *value.p == '[') {
+        value.p++;
+        size_t cap = 0;
+        int64_t first, count;
+        while (lex_int(&value, &first) == 0 && lex_int(&value, &count) == 0) {
+            if (section->index_pairs == cap) {
+                cap = cap ? cap * 2 : 8;
+                int64_t *grown = realloc(section->index, cap * 2 * sizeof(int64_t));
+                if (grown == NULL) {
+                    break;
+                }
+                section->index = grown;
+            }
+            section->index[2 * section->index_pairs] = first;
+            section->index[2 * section->index_pairs + 1] = count;
+            section->index_pairs++;
+        }
+    } else if (ok) {
+        section->index = malloc(2 * sizeof(int64_t));
+        if (section->index != NULL) {
+            section->index[0] = 0;
+            section->index[1] = size;
+            section->index_pairs = 1;
+        }
+    }
+    if (ok) {
+        section->entries = load_stream(doc, &obj, &section->entries_len, 0);
+    }
+    if (!ok || section->entries == NULL || section->index == NULL) {
+        free(section->index);
+        free(section->entries);
+        free_object(&obj);
+        return -1;
+    }
+    Trailer here = *trailer;
+    read_trailer(dict, &here);
+    *trailer = here;
+    free_object(&obj);
+    doc->section_count++;
+    return 0;
+}
+
+// Load the classic table at offset and read its trailer dictionary
+static int add_table_section(PdfDoc *doc, uint64_t offset, Trailer *trailer) {
+    if (doc->section_count == MAX_XREF_SECTIONS) {
+        return -1;
+    }
+    XrefSection *section = &doc->sections[doc->section_count];
+    memset(section, 0, sizeof(*section));
+    section->offset = offset;
+
+    // Skip the subsections to find the trailer
+    uint64_t pos = offset + 4;
+    for (int i = 0; i < MAX_SUBSECTIONS; i++) {
+        size_t avail = doc->size - pos < 40 ? (size_t)(doc->size - pos) : 40;
+        const unsigned char *p = pos < doc->size ? window_get(&doc->window, pos, avail) : NULL;
+        if (p == NULL) {
+            return -1;
+        }
+        Lex lx = { p, p + avail };
+        int64_t first, count;
+        if (lex_keyword(&lx, "trailer")) {
+            pos += (uint64_t)(lx.p - p);
+            break;
+        }
+        if (lex_int(&lx, &first) != 0 || lex_int(&lx, &count) != 0 || count < 0) {
+            return -1;
+        }
+        while (lx.p < lx.end && (*lx.p == ' ' || *lx.p == '\t')) {
+            lx.p++;
+        }
+        while (lx.p < lx.end && (*lx.p == '\r' || *lx.p == '\n')) {
+            lx.p++;
+        }
+        uint64_t entries = pos + (uint64_t)(lx.p - p);
+        int width = 20;
+        const unsigned char *e = count > 0 ? window_get(&doc->window, entries, 21) : NULL;
+        if (e != NULL) {
+            width = e[18] == '\n' || (e[18] == '\r' && e[19] != '\n') ? 19 :
+                    e[19] == '\r' && e[20] == '\n' ? 21 : 20;
+        }
+        pos = entries + (uint64_t)count * width;
+    }
+
+    // The trailer dictionary follows the keyword
+    PdfObject obj;
+    size_t want = doc->size - pos < 8192 ? (size_t)(doc->size - pos) : 8192;
+    obj.buf = malloc(want > 0 ? want : 1);
+    if (obj.buf == NULL || window_read(&doc->window, obj.buf, want, pos) <= 0) {
+        free(obj.buf);
+        return -1;
+    }
+    obj.len = want;
+    obj.body = 0;
+    read_trailer(object_lex(&obj), trailer);
+    free(obj.buf);
+    doc->section_count++;
+    return 0;
+}
+
+// Find startxref in the tail and load every section along the /Prev chain
+static int load_xref(PdfDoc *doc) {
+    unsigned char tail[TAIL_SIZE + 1];
+    size_t want = doc->size < TAIL_SIZE ? (size_t)doc->size : TAIL_SIZE;
+    uint64_t tail_start = doc->size - want;
+    if (window_read(&doc->window, tail, want, tail_start) != (ssize_t)want) {
+        return -1;
+    }
+    // Use the last startxref in the file
+    const unsigned char *found = NULL;
+    for (const unsigned char *p = tail; (p = memmem(p, want - (p - tail), "startxref", 9)) != NULL; p++) {
+        found = p;
+    }
+    if (found == NULL) {
+        return -1;
+    }
+    Lex lx = { found + 9, tail + want };
+    int64_t offset;
+    if (lex_int(&lx, &offset) != 0) {
+        return -1;
+    }
+
+    Trailer newest = { .root = 0, .info = 0 };
+    for (int i = 0; i < MAX_XREF_SECTIONS && offset > 0 && (uint64_t)offset < doc->size; i++) {
+        Trailer trailer = { .root = 0, .info = 0 };
+        const unsigned char *p = window_get(&doc->window, (uint64_t)offset, 4);
+        int status;
+        if (p != NULL && memcmp(p, "xref", 4) == 0) {
+            status = add_table_section(doc, (uint64_t)offset, &trailer);
+            // Hybrid files: the xref stream fills in what the table marks free
+            if (status == 0 && trailer.xref_stm > 0) {
+                Trailer ignored = { .root = 0, .info = 0 };
+                add_stream_section(doc, (uint64_t)trailer.xref_stm, &ignored);
+            }
+        } else {
+            status = add_stream_section(doc, (uint64_t)offset, &trailer);
+        }
+        if (status != 0) {
+            break;
+        }
+        // Keys in newer trailers win
+        if (newest.root == 0) {
+            newest.root = trailer.root;
+        }
+        if (newest.info == 0) {
+            newest.info = trailer.info;
+        }
+        newest.encrypted |= trailer.encrypted;
+        offset = trailer.prev;
+    }
+    doc->root = newest.root;
+    doc->info = newest.info;
+    doc->encrypted = newest.encrypted;
+    return doc->section_count > 0 && doc->root > 0 ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Document information
+// ---------------------------------------------------------------------------
+
+// Append a code point to a UTF-8 buffer
+static size_t put_utf8(char *out, size_t pos, size_t size, uint32_t cp) {
+    char enc[4];
+    size_t n;
+    if (cp < 0x80) {
+        enc[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        enc[0] = (char)(0xC0 | cp >> 6);
+        enc[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        enc[0] = (char)(0xE0 | cp >> 12);
+        enc[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        enc[0] = (char)(0xF0 | cp >> 18);
+        enc[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        enc[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    if (pos + n >= size) {
+        return pos;
+    }
+    memcpy(out + pos, enc, n);
+    return pos + n;
+}
+
+// Decode a literal or hex string value into UTF-8 text
+static int decode_string(Lex value, char *out, size_t size) {
+    unsigned char raw[1024];
+    size_t len = 0;
+    lex_skip_space(&value);
+    if (value.p >= value.end || size == 0) {
+        return -1;
+    }
+    if (*value.p == '(') {
+        // Literal string: balanced parentheses and backslash escapes
+        int nesting = 1;
+        value.p++;
+        while (value.p < value.end && len < sizeof(raw)) {
+            int c = *value.p++;
+            if (c == '(') {
+                nesting++;
+            } else if (c == ')' && --nesting == 0) {
+                break;
+            } else if (c == '\\' && value.p < value.end) {
+                c = *value.p++;
+                switch (c) {
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case '\r':
+                    if (value.p < value.end && *value.p == '\n') {
+                        value.p++;
+                    }
+                    continue;  // Line continuation
+                case '\n':
+                    continue;
+                default:
+                    if (c >= '0' && c <= '7') {
+                        // Up to three octal digits
+                        int v = c - '0';
+                        for (int i = 0; i < 2 && value.p < value.end && *value.p >= '0' && *value.p <= '7'; i++) {
+                            v = v * 8 + (*value.p++ - '0');
+                        }
+                        c = v & 0xFF;
+                    }
+                    break;
+                }
+            }
+            raw[len++] = (unsigned char)c;
+        }
+    } else if (*value.p == '<') {
+        // Hex string: pairs of hex digits, whitespace ignored, odd digit padded
+        int high = -1;
+        value.p++;
+        while (value.p < value.end && *value.p != '>' && len < sizeof(raw)) {
+            int c = *value.p++, v;
+            if (c >= '0' && c <= '9') {
+                v = c - '0';
+            } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                v = (c | 0x20) - 'a' + 10;
+            } else {
+                continue;
+            }
+            if (high < 0) {
+                high = v;
+            } else {
+                raw[len++] = (unsigned char)(high << 4 | v);
+                high = -1;
+            }
+        }
+        if (high >= 0 && len < sizeof(raw)) {
+            raw[len++] = (unsigned char)(high << 4);
+        }
+    } else {
+        return -1;
+    }
+
+    size_t pos = 0;
+    if (len >= 2 && raw[0] == 0xFE && raw[1] == 0xFF) {
+        // UTF-16BE with byte order mark
+        for (size_t i = 2; i + 1 < len; i += 2) {
+            uint32_t cp = (uint32_t)raw[i] << 8 | raw[i + 1];
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 3 < len) {
+                uint32_t low = (uint32_t)raw[i + 2] << 8 | raw[i + 3];
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            if (cp >= 0x20) {
+                pos = put_utf8(out, pos, size, cp);
+            }
+        }
+    } else if (len >= 3 && raw[0] == 0xEF && raw[1] == 0xBB && raw[2] == 0xBF) {
+        // UTF-8 with byte order mark (PDF 2.0)
+        for (size_t i = 3; i < len && pos + 1 < size; i++) {
+            if (raw[i] >= 0x20) {
+                out[pos++] = (char)raw[i];
+            }
+        }
+    } else {
+        // PDFDocEncoding, treated as Latin-1
+        for (size_t i = 0; i < len; i++) {
+            if (raw[i] >= 0x20) {
+                pos = put_utf8(out, pos, size, raw[i]);
+            }
+        }
+    }
+    out[pos] = '\0';
+    return 0;
+}
+
+// Turn "D:YYYYMMDDHHmmSSOHH'mm'" into "YYYY-MM-DD HH:MM:SS +HH:MM"
+static void format_date(const char *in, char *out, size_t size) {
+    const char *p = strncmp(in, "D:", 2) == 0 ? in + 2 : in;
+    size_t digits = strspn(p, "0123456789");
+    if (digits < 4) {
+        snprintf(out, size, "%s", in);
+        return;
+    }
+    // Missing fields default to the start of the period
+    char d[15] = "00000101000000";
+    memcpy(d, p, digits < 14 ? digits : 14);
+    char zone[8] = "";
+    const char *z = p + digits;
+    if (*z == 'Z') {
+        snprintf(zone, sizeof(zone), " UTC");
+    } else if ((*z == '+' || *z == '-') && strspn(z + 1, "0123456789") >= 2) {
+        char mm[3] = "00";
+        if (z[3] == '\'' && strspn(z + 4, "0123456789") >= 2) {
+            memcpy(mm, z + 4, 2);
+        }
+        snprintf(zone, sizeof(zone), " %c%.2s:%s", z[0], z + 1, mm);
+    }
+    snprintf(out, size, "%.4s-%.2s-%.2s %.2s:%.2s:%.2s%s", d, d + 4, d + 6, d + 8, d + 10, d + 12, zone);
+}
+
+// Read a text string value, following a reference if needed
+static int get_text(PdfDoc *doc, Lex value, char *out, size_t size) {
+    int64_t num;
+    if (lex_ref(&value, &num) == 0) {
+        PdfObject obj;
+        if (load_object(doc, num, &obj, 1) != 0) {
+            return -1;
+        }
+        int status = decode_string(object_lex(&obj), out, size);
+        free_object(&obj);
+        return status;
+    }
+    return decode_string(value, out, size);
+}
+
+// Size of the first page, walking down the page tree (MediaBox is inheritable)
+static int first_page_size(PdfDoc *doc, PdfObject *pages, double *width, double *height) {
+    PdfObject node = *pages, next;
+    int owned = 0, found = -1;
+    for (int depth = 0; depth < MAX_DEPTH; depth++) {
+        Lex dict = object_lex(&node), value;
+        int64_t num;
+        if (dict_get(dict, "MediaBox", &value) == 0) {
+            PdfObject box;
+            if (get_dict(doc, value, &box, 0) == 0) {
+                Lex lx = object_lex(&box);
+                double v[4];
+                lex_skip_space(&lx);
+                if (lx.p < lx.end && *lx.p == '[') {
+                    lx.p++;
+                    if (lex_real(&lx, &v[0]) == 0 && lex_real(&lx, &v[1]) == 0 &&
+                        lex_real(&lx, &v[2]) == 0 && lex_real(&lx, &v[3]) == 0) {
+                        *width = v[2] - v[0];
+                        *height = v[3] - v[1];
+                        found = 0;
+                    }
+                }
+                free_object(&box);
+            }
+        }
+        if (dict_get(dict, "Type", &value) == 0 && is_name(value, "Page")) {
+            break;
+        }
+        // Descend into the first kid
+        if (dict_get(dict, "Kids", &value) != 0 || value.p >= value.end || *value.p != '[') {
+            break;
+        }
+        value.p++;
+        if (lex_ref(&value, &num) != 0 || load_object(doc, num, &next, 0) != 0) {
+            break;
+        }
+        if (owned) {
+            free_object(&node);
+        }
+        node = next;
+        owned = 1;
+    }
+    if (owned) {
+        free_object(&node);
+    }
+    return found;
+}
+
+// Read everything pdfinfo would report from the catalog, page tree and Info
+static int read_pdf(FileContext *ctx) {
+    PdfDoc *doc = calloc(1, sizeof(PdfDoc));
+    if (doc == NULL) {
+        return -1;
+    }
+    doc->objstm_num = -1;
+    int status = -1;
+    char version[16] = "";
+    PdfObject catalog = { 0 }, pages = { 0 };
+    Lex value;
+
+    if (open_window(ctx, &doc->window) != 0) {
+        goto done;
+    }
+    doc->size = doc->window.size;
+
+    // Header: "%PDF-1.7"
+    const unsigned char *p = window_get(&doc->window, 0, 8);
+    if (p == NULL || memcmp(p, "%PDF-", 5) != 0) {
+        goto done;
+    }
+    size_t n = 0;
+    while (n < sizeof(version) - 1 && n < 3 && ((p[5 + n] >= '0' && p[5 + n] <= '9') || p[5 + n] == '.')) {
+        version[n] = (char)p[5 + n];
+        n++;
+    }
+    version[n] = '\0';
+
+    // Catalog and page tree
+    if (load_xref(doc) != 0 || load_object(doc, doc->root, &catalog, 0) != 0 ||
+        dict_get(object_lex(&catalog), "Pages", &value) != 0 ||
+        get_dict(doc, value, &pages, 0) != 0) {
+        goto done;
+    }
+    int64_t count;
+    if (dict_get(object_lex(&pages), "Count", &value) != 0 || get_int(doc, value, &count, 0) != 0) {
+        goto done;
+    }
+
+    // Document information dictionary; its strings are unreadable if encrypted
+    static const char *const info_keys[] = {
+        "Title", "Subject", "Keywords", "Author", "Creator", "Producer", "CreationDate", "ModDate"
+    };
+    PdfObject info;
+    if (doc->info > 0 && !doc->encrypted && load_object(doc, doc->info, &info, 0) == 0) {
+        for (size_t i = 0; i < sizeof(info_keys) / sizeof(info_keys[0]); i++) {
+            char text[1024], date[1024];
+            if (dict_get(object_lex(&info), info_keys[i], &value) != 0 ||
+                get_text(doc, value, text, sizeof(text)) != 0 || text[0] == '\0') {
+                continue;
+            }
+            if (strstr(info_keys[i], "Date") != NULL) {
+                format_date(text, date, sizeof(date));
+                add_info(&ctx->info, info_keys[i], date);
+            } else {
+                add_info(&ctx->info, info_keys[i], text);
+            }
+        }
+        free_object(&info);
+    }
+
+    char text[64];
+    snprintf(text, sizeof(text), "%lld", (long long)count);
+    add_info(&ctx->info, "Pages", text);
+    add_info(&ctx->info, "Encrypted", doc->encrypted ? "yes" : "no");
+    double width, height;
+    if (first_page_size(doc, &pages, &width, &height) == 0) {
+        snprintf(text, sizeof(text), "%g x %g pts", width, height);
+        add_info(&ctx->info, "Page size", text);
+    }
+    add_info(&ctx->info, "PDF version", version);
+    status = 0;
+
+done:
+    free_object(&catalog);
+    free_object(&pages);
+    for (int i = 0; i < doc->section_count; i++) {
+        free(doc->sections[i].entries);
+        free(doc->sections[i].index);
+    }
+    free(doc->objstm);
+    free(doc);
+    return status;
+}
+
+// Let Poppler's pdfinfo handle files the built-in reader cannot
+static void run_pdfinfo(FileContext *ctx) {
     // Prepare command to get PDF information
     // 'pdfinfo' is a command-line utility that extracts metadata from PDF files
-    snprintf(command, sizeof(command), "pdfinfo '%s'", path);
-    
+    const char *argv[] = { "pdfinfo", ctx->path, NULL };
+
     // Execute the command and get its output
-    char *output = execute_command(command);
-    
+    char *output = run_tool(ctx, argv, PDFINFO_TIMEOUT_MS);
+
     // Check if the command execution was successful
     if (output) {
-        // Use strtok to split the output into lines
-        // strtok modifies the original string, replacing delimiters with null characters
-        char *line = strtok(output, "\n");
-        
+        // Use strtok_r to split the output into lines
+        // strtok_r modifies the original string, replacing delimiters with null characters
+        char *save = NULL;
+        char *line = strtok_r(output, "\n", &save);
+
         // Process each line of the output
         while (line) {
-            // Use strtok again to split each line into key and value
-            // Note: this modifies 'line', replacing the first ':' with a null character
-            char *key = strtok(line, ":");
-            char *value = strtok(NULL, ":");
-            
+            // Split at the first ':' only, so values such as dates stay whole
+            char *value = strchr(line, ':');
+
             // Check if both key and value were found
-            if (key && value) {
+            if (value) {
+                *value++ = '\0';
                 // Trim leading whitespace from value
                 // This is a common C idiom for skipping leading spaces
                 while (*value == ' ') value++;
-                
-                // Add the key-value pair to the global info array
-                add_info(key, value);
+
+                // Add the key-value pair to the file's info array
+                add_info_copy(&ctx->info, line, value);
             }
-            
+
             // Move to the next line
-            // Subsequent calls to strtok with NULL continue from where it left off
-            line = strtok(NULL, "\n");
+            // Subsequent calls to strtok_r with NULL continue from where it left off
+            line = strtok_r(NULL, "\n", &save);
         }
-        
-        // Free the memory allocated by execute_command()
+
+        // Free the memory allocated by run_tool()
         free(output);
     }
     // If output is NULL, the command failed, but we silently ignore it
     // You might want to add error handling here in a more robust version
 }
+
+// Function to extract information from PDF files
+void get_pdf_info(FileContext *ctx) {
+    // Read the trailer, the cross-reference data and a handful of objects
+    size_t before = ctx->info.size;
+    if (read_pdf(ctx) == 0) {
+        return;
+    }
+    // Drop anything a half-successful read added before falling back;
+    // its strings stay in the arena until the context is reset
+    ctx->info.size = before;
+    run_pdfinfo(ctx);
+}
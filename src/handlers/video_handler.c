@@ -1,48 +1,699 @@
 // Include necessary header files
 #include "../file_info.h"  // For add_info() function
-#include "../utils.h"      // For execute_command() function and MAX_COMMAND_LENGTH
+#include "../utils.h"      // For FileWindow and byte order helpers
+#include <inttypes.h>      // For PRIu64
+#include <math.h>          // For isfinite()
 #include <stdio.h>         // For snprintf()
 #include <stdlib.h>        // For atof(), free()
+#include <string.h>        // For memcmp(), memcpy()
 
-// Function to extract duration information from video files
-void get_video_duration(const char *path) {
-    // Buffer to store the command
-    char command[MAX_COMMAND_LENGTH];
-    
+// Upper bound for elements visited per level, so corrupt files cannot loop forever
+#define MAX_ELEMENTS 100000
+// Wall-clock limit for the ffprobe fallback
+#define FFPROBE_TIMEOUT_MS 15000
+// Longest duration believed, in seconds (about 31 years); header fields
+// claiming more are corrupt or crafted
+#define MAX_DURATION 1e9
+
+// What the container headers tell us about a video
+typedef struct {
+    double duration;         // Duration in seconds, negative if unknown
+    char video_codec[32];    // Fourcc or Matroska codec ID of the first video track
+    char audio_codec[32];    // Same for the first audio track
+    uint32_t width;          // Resolution of the first video track
+    uint32_t height;
+    int tracks;              // Number of tracks
+} VideoHeader;
+
+// Whether a duration computed from container fields can be shown and summed
+static int plausible_duration(double duration) {
+    return isfinite(duration) && duration >= 0 && duration <= MAX_DURATION;
+}
+
+// ---------------------------------------------------------------------------
+// ISO base media file format (MP4, MOV, M4V, 3GP)
+// ---------------------------------------------------------------------------
+
+// A box header: where it starts, where its payload starts and where it ends
+typedef struct {
+    char type[5];
+    uint64_t payload;  // Offset of the payload
+    uint64_t end;      // Offset just past the box
+} Box;
+
+// Read the box header at offset; fails if it does not fit inside limit
+static int read_box(FileWindow *w, uint64_t offset, uint64_t limit, Box *box) {
+    const unsigned char *p = window_get(w, offset, 8);
+    if (p == NULL) {
+        return -1;
+    }
+    uint64_t size = read_be32(p);
+    memcpy(box->type, p + 4, 4);
+    box->type[4] = '\0';
+    box->payload = offset + 8;
+    if (size == 1) {
+        // 64-bit size follows the type
+        p = window_get(w, offset + 8, 8);
+        if (p == NULL) {
+            return -1;
+        }
+        size = read_be64(p);
+        box->payload += 8;
+    } else if (size == 0) {
+        size = limit - offset;  // Box extends to the end of its parent
+    }
+    if (size < box->payload - offset || size > limit - offset) {
+        return -1;
+    }
+    box->end = offset + size;
+    return 0;
+}
+
+// Find the first child of the given type between start and end
+static int find_box(FileWindow *w, uint64_t start, uint64_t end, const char *type, Box *box) {
+    uint64_t offset = start;
+    for (int i = 0; i < MAX_ELEMENTS && offset < end; i++) {
+        if (read_box(w, offset, end, box) != 0) {
+            return -1;
+        }
+        if (memcmp(box->type, type, 4) == 0) {
+            return 0;
+        }
+        offset = box->end;
+    }
+    return -1;
+}
+
+// Read a (timescale, duration) pair from a version 0 or 1 mvhd/mdhd payload
+static int read_time(FileWindow *w, const Box *box, uint32_t *timescale, uint64_t *duration) {
+    const unsigned char *p = window_get(w, box->payload, 32);
+    if (p == NULL) {
+        return -1;
+    }
+    if (p[0] == 1) {
+        // Version 1: 64-bit creation and modification times and duration
+        *timescale = read_be32(p + 20);
+        *duration = read_be64(p + 24);
+    } else {
+        *timescale = read_be32(p + 12);
+        *duration = read_be32(p + 16);
+        if (*duration == 0xFFFFFFFF) {
+            *duration = 0;  // All ones means unknown
+        }
+    }
+    return 0;
+}
+
+// Number of tracks whose timescale is remembered for fragmented files
+#define MAX_TIMESCALES 16
+
+// Track ID to media timescale, needed to convert fragment times
+typedef struct {
+    uint32_t track_id[MAX_TIMESCALES];
+    uint32_t timescale[MAX_TIMESCALES];
+    int count;
+} TrackTimescales;
+
+// Parse one trak box: handler type, codec and dimensions
+static void parse_trak(FileWindow *w, const Box *trak, VideoHeader *video, double *longest,
+                       TrackTimescales *scales) {
+    Box mdia, box;
+    char handler[5] = "";
+    char codec[5] = "";
+    uint32_t width = 0, height = 0, track_id = 0;
+
+    video->tracks++;
+
+    // Track header: the track ID, then 16.16 fixed-point width and height at the end
+    if (find_box(w, trak->payload, trak->end, "tkhd", &box) == 0) {
+        const unsigned char *p = window_get(w, box.payload, 24);
+        int v1 = p != NULL && p[0] == 1;
+        if (p != NULL) {
+            track_id = read_be32(p + (v1 ? 20 : 12));
+        }
+        p = window_get(w, box.payload + (v1 ? 88 : 76), 8);
+        if (p != NULL) {
+            width = read_be32(p) >> 16;
+            height = read_be32(p + 4) >> 16;
+        }
+    }
+
+    if (find_box(w, trak->payload, trak->end, "mdia", &mdia) != 0) {
+        return;
+    }
+    // Media header: per-track duration, used when the movie header has none
+    if (find_box(w, mdia.payload, mdia.end, "mdhd", &box) == 0) {
+        uint32_t timescale;
+        uint64_t duration;
+        if (read_time(w, &box, &timescale, &duration) == 0 && timescale > 0) {
+            if ((double)duration / timescale > *longest) {
+                *longest = (double)duration / timescale;
+            }
+            if (scales->count < MAX_TIMESCALES) {
+                scales->track_id[scales->count] = track_id;
+                scales->timescale[scales->count++] = timescale;
+            }
+        }
+    }
+    // Handler: 'vide', 'soun', 'text', ...
+    if (find_box(w, mdia.payload, mdia.end, "hdlr", &box) == 0) {
+        const unsigned char *p = window_get(w, box.payload + 8, 4);
+        if (p != NULL) {
+            memcpy(handler, p, 4);
+            handler[4] = '\0';
+        }
+    }
+    // Sample description: the first entry's type is the codec fourcc
+    Box minf, stbl;
+    if (find_box(w, mdia.payload, mdia.end, "minf", &minf) == 0 &&
+        find_box(w, minf.payload, minf.end, "stbl", &stbl) == 0 &&
+        find_box(w, stbl.payload, stbl.end, "stsd", &box) == 0) {
+        const unsigned char *p = window_get(w, box.payload + 8, 36);
+        if (p != NULL) {
+            memcpy(codec, p + 4, 4);
+            codec[4] = '\0';
+            // Visual sample entries store the coded size after 24 reserved bytes
+            if (strcmp(handler, "vide") == 0) {
+                width = read_be16(p + 32);
+                height = read_be16(p + 34);
+            }
+        }
+    }
+
+    if (strcmp(handler, "vide") == 0 && video->video_codec[0] == '\0') {
+        snprintf(video->video_codec, sizeof(video->video_codec), "%s", codec);
+        video->width = width;
+        video->height = height;
+    } else if (strcmp(handler, "soun") == 0 && video->audio_codec[0] == '\0') {
+        snprintf(video->audio_codec, sizeof(video->audio_codec), "%s", codec);
+    }
+}
+
+// Fragmented files without a total: find where the last fragment of any
+// track ends, from its decode time (tfdt) plus its sample durations (trun)
+static double fragment_duration(FileWindow *w, const TrackTimescales *scales) {
+    double longest = 0;
+    Box moof, traf, box;
+    uint64_t offset = 0;
+    for (int i = 0; i < MAX_ELEMENTS && offset < w->size; i++) {
+        if (read_box(w, offset, w->size, &moof) != 0) {
+            break;
+        }
+        offset = moof.end;
+        if (memcmp(moof.type, "moof", 4) != 0) {
+            continue;
+        }
+        uint64_t pos = moof.payload;
+        for (int j = 0; j < MAX_ELEMENTS && pos < moof.end; j++) {
+            if (read_box(w, pos, moof.end, &traf) != 0) {
+                break;
+            }
+            pos = traf.end;
+            if (memcmp(traf.type, "traf", 4) != 0) {
+                continue;
+            }
+
+            // Track fragment header: track ID and an optional default duration
+            uint32_t track_id = 0, default_duration = 0;
+            if (find_box(w, traf.payload, traf.end, "tfhd", &box) == 0) {
+                const unsigned char *p = window_get(w, box.payload, 8);
+                if (p != NULL) {
+                    uint32_t flags = read_be32(p) & 0xFFFFFF;
+                    track_id = read_be32(p + 4);
+                    // Skip base data offset (0x01) and sample description index (0x02)
+                    uint64_t field = box.payload + 8 + (flags & 0x01 ? 8 : 0) + (flags & 0x02 ? 4 : 0);
+                    if (flags & 0x08) {
+                        p = window_get(w, field, 4);
+                        default_duration = p != NULL ? read_be32(p) : 0;
+                    }
+                }
+            }
+            uint32_t timescale = 0;
+            for (int k = 0; k < scales->count; k++) {
+                if (scales->track_id[k] == track_id) {
+                    timescale = scales->timescale[k];
+                }
+            }
+            if (timescale == 0) {
+                continue;
+            }
+
+            // Decode time of the fragment's first sample
+            uint64_t end = 0;
+            if (find_box(w, traf.payload, traf.end, "tfdt", &box) == 0) {
+                const unsigned char *p = window_get(w, box.payload, 12);
+                if (p != NULL) {
+                    end = p[0] == 1 ? read_be64(p + 4) : read_be32(p + 4);
+                }
+            }
+
+            // Add up the durations of the samples in each run
+            uint64_t run = traf.payload;
+            for (int k = 0; k < MAX_ELEMENTS && run < traf.end; k++) {
+                if (read_box(w, run, traf.end, &box) != 0) {
+                    break;
+                }
+                run = box.end;
+                const unsigned char *p = window_get(w, box.payload, 8);
+                if (memcmp(box.type, "trun", 4) != 0 || p == NULL) {
+                    continue;
+                }
+                uint32_t flags = read_be32(p) & 0xFFFFFF;
+                uint32_t samples = read_be32(p + 4);
+                if (!(flags & 0x100)) {
+                    end += (uint64_t)samples * default_duration;
+                    continue;
+                }
+                // Per-sample fields: duration, size, flags, composition offset
+                uint64_t sample = box.payload + 8 + (flags & 0x01 ? 4 : 0) + (flags & 0x04 ? 4 : 0);
+                uint64_t stride = 4 * (1 + !!(flags & 0x200) + !!(flags & 0x400) + !!(flags & 0x800));
+                for (uint32_t n = 0; n < samples; n++) {
+                    p = window_get(w, sample + n * stride, 4);
+                    if (p == NULL) {
+                        break;
+                    }
+                    end += read_be32(p);
+                }
+            }
+            if ((double)end / timescale > longest) {
+                longest = (double)end / timescale;
+            }
+        }
+    }
+    return longest;
+}
+
+// Walk the top-level boxes to moov, wherever it is, and read its children
+static int parse_mp4(FileWindow *w, VideoHeader *video) {
+    Box moov, box;
+    // Top-level boxes are skipped by their sizes, so a trailing moov costs a seek
+    if (find_box(w, 0, w->size, "moov", &moov) != 0) {
+        return -1;
+    }
+
+    uint32_t timescale = 0;
+    uint64_t duration = 0;
+    if (find_box(w, moov.payload, moov.end, "mvhd", &box) == 0) {
+        read_time(w, &box, &timescale, &duration);
+    }
+
+    // Fragmented files keep the overall duration in mvex/mehd
+    Box mvex;
+    if (duration == 0 && find_box(w, moov.payload, moov.end, "mvex", &mvex) == 0 &&
+        find_box(w, mvex.payload, mvex.end, "mehd", &box) == 0) {
+        const unsigned char *p = window_get(w, box.payload, 12);
+        if (p != NULL) {
+            duration = p[0] == 1 ? read_be64(p + 4) : read_be32(p + 4);
+        }
+    }
+
+    // Visit every track
+    double longest = 0;
+    TrackTimescales scales = { .count = 0 };
+    uint64_t offset = moov.payload;
+    for (int i = 0; i < MAX_ELEMENTS && offset < moov.end; i++) {
+        if (read_box(w, offset, moov.end, &box) != 0) {
+            break;
+        }
+        if (memcmp(box.type, "trak", 4) == 0) {
+            parse_trak(w, &box, video, &longest, &scales);
+        }
+        offset = box.end;
+    }
+
+    double seconds = -1;
+    if (duration > 0 && timescale > 0) {
+        seconds = (double)duration / timescale;
+    } else if (longest > 0) {
+        seconds = longest;
+    } else if (find_box(w, moov.payload, moov.end, "mvex", &mvex) == 0) {
+        // Fragmented without a declared total: the fragments tell
+        longest = fragment_duration(w, &scales);
+        if (longest > 0) {
+            seconds = longest;
+        }
+    }
+    if (plausible_duration(seconds)) {
+        video->duration = seconds;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Matroska and WebM (EBML)
+// ---------------------------------------------------------------------------
+
+// Element IDs used below, with their length markers kept as in the spec
+#define EBML_SEGMENT       0x18538067
+#define EBML_SEEKHEAD      0x114D9B74
+#define EBML_SEEK          0x4DBB
+#define EBML_SEEKID        0x53AB
+#define EBML_SEEKPOSITION  0x53AC
+#define EBML_INFO          0x1549A966
+#define EBML_TIMECODESCALE 0x2AD7B1
+#define EBML_DURATION      0x4489
+#define EBML_TRACKS        0x1654AE6B
+#define EBML_TRACKENTRY    0xAE
+#define EBML_TRACKTYPE     0x83
+#define EBML_CODECID       0x86
+#define EBML_VIDEO         0xE0
+#define EBML_PIXELWIDTH    0xB0
+#define EBML_PIXELHEIGHT   0xBA
+#define EBML_CLUSTER       0x1F43B675
+
+// Marker for elements whose size is not known (live streams)
+#define EBML_UNKNOWN_SIZE UINT64_MAX
+
+// An element header
+typedef struct {
+    uint32_t id;
+    uint64_t data;  // Offset of the element's data
+    uint64_t end;   // Offset just past the element, or EBML_UNKNOWN_SIZE
+} Element;
+
+// Read a variable-length integer; keep_marker keeps the length bits (for IDs)
+static int read_vint(FileWindow *w, uint64_t offset, int keep_marker, uint64_t *value, int *length) {
+    const unsigned char *p = window_get(w, offset, 1);
+    if (p == NULL || p[0] == 0) {
+        return -1;
+    }
+    int len = 1;
+    while (!(p[0] & (0x80 >> (len - 1)))) {
+        len++;
+    }
+    p = window_get(w, offset, len);
+    if (p == NULL) {
+        return -1;
+    }
+    uint64_t v = keep_marker ? p[0] : p[0] & (0xFF >> len);
+    int all_ones = v == (uint64_t)(0xFF >> len);
+    for (int i = 1; i < len; i++) {
+        v = v << 8 | p[i];
+        all_ones = all_ones && p[i] == 0xFF;
+    }
+    // A size with every value bit set means "unknown"
+    *value = !keep_marker && all_ones ? EBML_UNKNOWN_SIZE : v;
+    *length = len;
+    return 0;
+}
+
+// Read the element header at offset
+static int read_element(FileWindow *w, uint64_t offset, Element *el) {
+    uint64_t id, size;
+    int id_len, size_len;
+    if (read_vint(w, offset, 1, &id, &id_len) != 0 || id_len > 4 ||
+        read_vint(w, offset + id_len, 0, &size, &size_len) != 0) {
+        return -1;
+    }
+    el->id = (uint32_t)id;
+    el->data = offset + id_len + size_len;
+    el->end = size == EBML_UNKNOWN_SIZE || size > w->size ? EBML_UNKNOWN_SIZE : el->data + size;
+    return 0;
+}
+
+// Read an unsigned integer element's value
+static uint64_t read_uint(FileWindow *w, const Element *el) {
+    uint64_t len = el->end - el->data;
+    const unsigned char *p = len <= 8 ? window_get(w, el->data, len) : NULL;
+    uint64_t v = 0;
+    for (uint64_t i = 0; p != NULL && i < len; i++) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+// Read a 4- or 8-byte big-endian float element's value
+static double read_float(FileWindow *w, const Element *el) {
+    uint64_t len = el->end - el->data;
+    const unsigned char *p = window_get(w, el->data, len);
+    if (p == NULL) {
+        return -1;
+    }
+    if (len == 4) {
+        uint32_t bits = read_be32(p);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    if (len == 8) {
+        uint64_t bits = read_be64(p);
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    return -1;
+}
+
+// Segment/Info: TimecodeScale (ns per tick) and Duration (in ticks)
+static void parse_mkv_info(FileWindow *w, const Element *info, VideoHeader *video) {
+    uint64_t scale = 1000000;  // Default: milliseconds
+    double ticks = -1;
+    Element el;
+    uint64_t offset = info->data;
+    for (int i = 0; i < MAX_ELEMENTS && offset < info->end; i++) {
+        if (read_element(w, offset, &el) != 0 || el.end == EBML_UNKNOWN_SIZE) {
+            break;
+        }
+        if (el.id == EBML_TIMECODESCALE) {
+            scale = read_uint(w, &el);
+        } else if (el.id == EBML_DURATION) {
+            ticks = read_float(w, &el);
+        }
+        offset = el.end;
+    }
+    // The float may be anything, infinities and NaN included
+    if (ticks >= 0 && plausible_duration(ticks * scale / 1e9)) {
+        video->duration = ticks * scale / 1e9;
+    }
+}
+
+// Segment/Tracks: codec IDs and the first video track's pixel size
+static void parse_mkv_tracks(FileWindow *w, const Element *tracks, VideoHeader *video) {
+    Element entry, el, sub;
+    uint64_t offset = tracks->data;
+    for (int i = 0; i < MAX_ELEMENTS && offset < tracks->end; i++) {
+        if (read_element(w, offset, &entry) != 0 || entry.end == EBML_UNKNOWN_SIZE) {
+            break;
+        }
+        offset = entry.end;
+        if (entry.id != EBML_TRACKENTRY) {
+            continue;
+        }
+        video->tracks++;
+
+        uint64_t type = 0, width = 0, height = 0;
+        char codec[32] = "";
+        uint64_t pos = entry.data;
+        for (int j = 0; j < MAX_ELEMENTS && pos < entry.end; j++) {
+            if (read_element(w, pos, &el) != 0 || el.end == EBML_UNKNOWN_SIZE) {
+                break;
+            }
+            if (el.id == EBML_TRACKTYPE) {
+                type = read_uint(w, &el);
+            } else if (el.id == EBML_CODECID && el.end - el.data < sizeof(codec)) {
+                const unsigned char *p = window_get(w, el.data, el.end - el.data);
+                if (p != NULL) {
+                    memcpy(codec, p, el.end - el.data);
+                    codec[el.end - el.data] = '\0';
+                }
+            } else if (el.id == EBML_VIDEO) {
+                uint64_t vpos = el.data;
+                for (int k = 0; k < MAX_ELEMENTS && vpos < el.end; k++) {
+                    if (read_element(w, vpos, &sub) != 0 || sub.end == EBML_UNKNOWN_SIZE) {
+                        break;
+                    }
+                    if (sub.id == EBML_PIXELWIDTH) {
+                        width = read_uint(w, &sub);
+                    } else if (sub.id == EBML_PIXELHEIGHT) {
+                        height = read_uint(w, &sub);
+                    }
+                    vpos = sub.end;
+                }
+            }
+            pos = el.end;
+        }
+
+        // Track types: 1 video, 2 audio
+        if (type == 1 && video->video_codec[0] == '\0') {
+            snprintf(video->video_codec, sizeof(video->video_codec), "%s", codec);
+            video->width = (uint32_t)width;
+            video->height = (uint32_t)height;
+        } else if (type == 2 && video->audio_codec[0] == '\0') {
+            snprintf(video->audio_codec, sizeof(video->audio_codec), "%s", codec);
+        }
+    }
+}
+
+// Use the SeekHead index to find Info or Tracks placed after the clusters
+static void parse_mkv_seekhead(FileWindow *w, const Element *head, uint64_t segment_data,
+                               uint64_t *info_pos, uint64_t *tracks_pos) {
+    Element seek, el;
+    uint64_t offset = head->data;
+    for (int i = 0; i < MAX_ELEMENTS && offset < head->end; i++) {
+        if (read_element(w, offset, &seek) != 0 || seek.end == EBML_UNKNOWN_SIZE) {
+            break;
+        }
+        offset = seek.end;
+        if (seek.id != EBML_SEEK) {
+            continue;
+        }
+        uint64_t id = 0, position = 0;
+        uint64_t pos = seek.data;
+        for (int j = 0; j < 4 && pos < seek.end; j++) {
+            if (read_element(w, pos, &el) != 0 || el.end == EBML_UNKNOWN_SIZE) {
+                break;
+            }
+            if (el.id == EBML_SEEKID) {
+                id = read_uint(w, &el);  // The ID is stored as raw bytes
+            } else if (el.id == EBML_SEEKPOSITION) {
+                position = read_uint(w, &el);
+            }
+            pos = el.end;
+        }
+        // Positions are relative to the start of the segment's data
+        if (id == EBML_INFO) {
+            *info_pos = segment_data + position;
+        } else if (id == EBML_TRACKS) {
+            *tracks_pos = segment_data + position;
+        }
+    }
+}
+
+// Walk the Segment's top-level elements, skipping clusters
+static int parse_mkv(FileWindow *w, VideoHeader *video) {
+    Element header, segment, el;
+    if (read_element(w, 0, &header) != 0 || header.end == EBML_UNKNOWN_SIZE ||
+        read_element(w, header.end, &segment) != 0 || segment.id != EBML_SEGMENT) {
+        return -1;
+    }
+    uint64_t segment_end = segment.end == EBML_UNKNOWN_SIZE ? w->size : segment.end;
+    uint64_t info_pos = 0, tracks_pos = 0;
+    int have_info = 0, have_tracks = 0;
+
+    uint64_t offset = segment.data;
+    for (int i = 0; i < MAX_ELEMENTS && offset < segment_end && !(have_info && have_tracks); i++) {
+        if (read_element(w, offset, &el) != 0) {
+            break;
+        }
+        if (el.id == EBML_CLUSTER || el.end == EBML_UNKNOWN_SIZE) {
+            break;  // Media data from here on; the index tells us where the rest is
+        }
+        if (el.id == EBML_SEEKHEAD) {
+            parse_mkv_seekhead(w, &el, segment.data, &info_pos, &tracks_pos);
+        } else if (el.id == EBML_INFO) {
+            parse_mkv_info(w, &el, video);
+            have_info = 1;
+        } else if (el.id == EBML_TRACKS) {
+            parse_mkv_tracks(w, &el, video);
+            have_tracks = 1;
+        }
+        offset = el.end;
+    }
+
+    // Jump straight to whatever the walk did not reach
+    if (!have_info && info_pos != 0 && read_element(w, info_pos, &el) == 0 &&
+        el.id == EBML_INFO && el.end != EBML_UNKNOWN_SIZE) {
+        parse_mkv_info(w, &el, video);
+        have_info = 1;
+    }
+    if (!have_tracks && tracks_pos != 0 && read_element(w, tracks_pos, &el) == 0 &&
+        el.id == EBML_TRACKS && el.end != EBML_UNKNOWN_SIZE) {
+        parse_mkv_tracks(w, &el, video);
+        have_tracks = 1;
+    }
+    return have_info || have_tracks ? 0 : -1;
+}
+
+// Recognize the container from its first bytes and parse it
+static int parse_video_header(FileWindow *w, VideoHeader *video) {
+    const unsigned char *p = window_get(w, 0, 12);
+    if (p == NULL) {
+        return -1;
+    }
+    if (read_be32(p) == 0x1A45DFA3) {
+        return parse_mkv(w, video);
+    }
+    // ISO files open with ftyp; older QuickTime files may start with other atoms
+    if (memcmp(p + 4, "ftyp", 4) == 0 || memcmp(p + 4, "moov", 4) == 0 ||
+        memcmp(p + 4, "mdat", 4) == 0 || memcmp(p + 4, "wide", 4) == 0 ||
+        memcmp(p + 4, "free", 4) == 0 || memcmp(p + 4, "skip", 4) == 0) {
+        return parse_mp4(w, video);
+    }
+    return -1;
+}
+
+// Ask ffprobe for the duration of containers the built-in parser does not know
+static double probe_duration(FileContext *ctx) {
     // Prepare ffprobe command to get video duration
     // -v error: Set loglevel to error to suppress unnecessary output
     // -show_entries format=duration: Only show the duration information
     // -of default=noprint_wrappers=1:nokey=1: Format output without labels, just the value
-    snprintf(command, sizeof(command),
-             "ffprobe -v error -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 '%s'",
-             path);
-    
+    // -i: the input, given explicitly so a path starting with '-' is not an option
+    const char *argv[] = {
+        "ffprobe", "-v", "error", "-show_entries", "format=duration",
+        "-of", "default=noprint_wrappers=1:nokey=1", "-i", ctx->path, NULL
+    };
+
     // Execute the command and get its output
-    char *output = execute_command(command);
-    
+    char *output = run_tool(ctx, argv, FFPROBE_TIMEOUT_MS);
+
     // Check if the command execution was successful
-    if (output) {
-        // Convert the string output to a double (duration in seconds)
-        double duration = atof(output);
-        
-        // Calculate hours, minutes, seconds, and milliseconds
-        int hours = (int)duration / 3600;
-        int minutes = ((int)duration % 3600) / 60;
-        int seconds = (int)duration % 60;
-        int milliseconds = (int)((duration - (int)duration) * 1000);
-        
+    if (output == NULL) {
+        return -1;
+    }
+    // Convert the string output to a double (duration in seconds)
+    double duration = atof(output);
+
+    // Free the memory allocated by run_tool()
+    free(output);
+    return duration;
+}
+
+// Function to extract duration information from video files
+void get_video_duration(FileContext *ctx) {
+    VideoHeader video = { .duration = -1 };
+
+    // Seek straight to the relevant boxes or elements instead of reading the file
+    FileWindow *window = malloc(sizeof(FileWindow));
+    if (window != NULL && open_window(ctx, window) == 0) {
+        parse_video_header(window, &video);
+    }
+    free(window);
+
+    // Unknown container or no duration in its headers: fall back to ffprobe
+    double duration = video.duration >= 0 ? video.duration : probe_duration(ctx);
+    if (plausible_duration(duration)) {
+        // Split whole milliseconds into hours, minutes, seconds and the rest
+        uint64_t total_ms = (uint64_t)(duration * 1000);
+        uint64_t hours = total_ms / 3600000;
+        unsigned minutes = (unsigned)(total_ms / 60000 % 60);
+        unsigned seconds = (unsigned)(total_ms / 1000 % 60);
+        unsigned milliseconds = (unsigned)(total_ms % 1000);
+
         // Prepare a formatted string with the duration
         char duration_str[30];
         snprintf(duration_str, sizeof(duration_str),
-                 "%02d:%02d:%02d.%03d",
+                 "%02" PRIu64 ":%02u:%02u.%03u",
                  hours, minutes, seconds, milliseconds);
-        
-        // Add the formatted duration to the global info array
-        add_info("Duration", duration_str);
-        
-        // Free the memory allocated by execute_command()
-        free(output);
-    }
-    // If output is NULL, the command failed, but we silently ignore it
-    // You might want to add error handling here in a more robust version
+
+        // Add the formatted duration to the file's info array
+        add_info(&ctx->info, "Duration", duration_str);
+    }
+
+    // Report what the headers revealed along the way
+    char value[64];
+    if (video.video_codec[0] != '\0') {
+        add_info(&ctx->info, "Video codec", video.video_codec);
+    }
+    if (video.width > 0 && video.height > 0) {
+        snprintf(value, sizeof(value), "%ux%u", video.width, video.height);
+        add_info(&ctx->info, "Resolution", value);
+    }
+    if (video.audio_codec[0] != '\0') {
+        add_info(&ctx->info, "Audio codec", video.audio_codec);
+    }
+    if (video.tracks > 0) {
+        snprintf(value, sizeof(value), "%d", video.tracks);
+        add_info(&ctx->info, "Tracks", value);
+    }
 }
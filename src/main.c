@@ -1,16 +1,106 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>     // getopt_long() for command line parsing
 #include "file_info.h"  // Includes functions for processing and displaying file information
+#include "batch.h"      // Worker pool for analyzing many files per invocation
+#include "detect.h"     // Release of the cached libmagic cookies
+#include "cache.h"      // Results kept between runs
+#include "profile.h"    // --profile timings and counters
+#include "server.h"     // Resident server and its client
+#include "walk.h"       // -r: directory trees summarized as a whole
+#include "watch.h"      // --watch: files analyzed as they change
+#include "utils.h"      // Stopping external tools along with inf
 #include "version.h"    // Contains version information for the utility
 
+// Long-only options have no short letter, so give them codes above char range
+enum {
+    OPT_FILES_FROM = 256,
+    OPT_CACHE,
+    OPT_NO_CACHE,
+    OPT_REBUILD_CACHE,
+    OPT_PROFILE,
+    OPT_SERVE,
+    OPT_CLIENT,
+    OPT_PREFETCH,
+    OPT_PREFETCH_MEMORY,
+    OPT_NO_TOOLS,
+    OPT_FIELDS,
+    OPT_FAST,
+    OPT_INCREMENTAL,
+    OPT_HASH,
+    OPT_SNIFF,
+    OPT_WATCH,
+    OPT_DEBOUNCE,
+    OPT_ESTIMATE,
+    OPT_DEEP,
+    OPT_DEEP_BUDGET
+};
+
+// Defaults for --prefetch and --prefetch-memory
+#define DEFAULT_PREFETCH_DEPTH 256
+#define DEFAULT_PREFETCH_MEMORY_MIB 64
+
 // Function to print usage instructions
 void print_usage(const char* program_name) {
-    printf("Usage: %s [OPTION] <file_path>\n", program_name);
-    printf("Get information about a file.\n\n");
+    printf("Usage: %s [OPTION]... <file_path>...\n", program_name);
+    printf("Get information about files.\n\n");
     printf("Options:\n");
-    printf("  -h, --help     Display this help and exit\n");
-    printf("  -v, --version  Output version information and exit\n");
+    printf("  -h, --help             Display this help and exit\n");
+    printf("  -v, --version          Output version information and exit\n");
+    printf("  -j, --jobs=N           Analyze up to N files in parallel (default: CPU count)\n");
+    printf("      --files-from=FILE  Also read paths from FILE, one per line ('-' for stdin)\n");
+    printf("  -0, --null             Paths in the list are NUL-separated; reads stdin\n");
+    printf("                         when --files-from is not given\n");
+    printf("  -u, --unordered        Print results as they complete, not in input order\n");
+    printf("  -r, --recursive        Walk directories and print one summary of every file\n");
+    printf("                         in them: files and bytes per type, a size histogram,\n");
+    printf("                         and total lines, durations and pages\n");
+    printf("      --watch            Watch the given directories and the trees below them,\n");
+    printf("                         analyzing each file after it is written or moved in\n");
+    printf("                         until interrupted\n");
+    printf("      --debounce=MS      With --watch, wait until a file has not changed for MS\n");
+    printf("                         milliseconds before analyzing it (default %d)\n",
+           DEFAULT_DEBOUNCE_MS);
+    printf("      --cache[=FILE]     Reuse results for files unchanged since an earlier run\n");
+    printf("                         (default FILE: ~/.cache/inf/cache.bin)\n");
+    printf("      --no-cache         Do not read or write the cache\n");
+    printf("      --rebuild-cache    Ignore cached results and cache this run's afresh\n");
+    printf("      --incremental      Like --cache, and count lines, words and characters\n");
+    printf("                         of grown text files from where the last run stopped\n");
+    printf("      --profile          Print per-file stage timings and counters to stderr,\n");
+    printf("                         and a summary after several files\n");
+    printf("      --prefetch[=DEPTH] Open and read up to DEPTH files ahead of the workers\n");
+    printf("                         (default %d), using io_uring where available\n",
+           DEFAULT_PREFETCH_DEPTH);
+    printf("      --prefetch-memory=MIB  Memory for read-ahead data (default %d)\n",
+           DEFAULT_PREFETCH_MEMORY_MIB);
+    printf("      --fields=LIST      Report only these comma-separated fields, e.g.\n");
+    printf("                         'Size,MIME type,Lines'; stages they do not need are skipped\n");
+    printf("      --fast             Read at most %u KiB of each file and run no external\n",
+           FAST_READ_LIMIT >> 10);
+    printf("                         tools; fields that need more are left out\n");
+    printf("      --hash=ALG         Add a content digest: xxh3, blake3 or sha256; text files\n");
+    printf("                         are digested in the pass that counts them\n");
+    printf("      --estimate[=MIB]   Estimate lines and words of text files larger than\n");
+    printf("                         %d times MIB from MIB of samples (default %u), with\n",
+           ESTIMATE_EXACT_FACTOR, DEFAULT_ESTIMATE_BUDGET >> 20);
+    printf("                         95%% confidence intervals\n");
+    printf("      --deep[=DEPTH]     Analyze the members of ZIP, tar and gzip files in\n");
+    printf("                         memory, down to DEPTH nested archives (default %d,\n",
+           DEFAULT_DEEP_DEPTH);
+    printf("                         at most %d)\n", DEEP_MAX_DEPTH);
+    printf("      --deep-budget=MIB  Bytes --deep may decompress per file (default %u)\n",
+           DEFAULT_DEEP_BUDGET >> 20);
+    printf("      --sniff[=check]    Take the type of common formats from a built-in table\n");
+    printf("                         of signatures, asking libmagic only about the rest;\n");
+    printf("                         'check' compares the table with libmagic instead\n");
+    printf("      --no-tools         Do not start external tools (identify, ffprobe,\n");
+    printf("                         pdfinfo, 7z); report what inf parses itself\n");
+    printf("      --serve=SOCKET     Stay resident and answer clients on a Unix socket\n");
+    printf("                         until interrupted\n");
+    printf("      --client=SOCKET    Have the server on SOCKET analyze the files; falls\n");
+    printf("                         back to analyzing them here if it is not running\n");
 }
 
 // Function to print version information
@@ -18,30 +108,322 @@ void print_version() {
     printf("inf version %s\n", FILE_INFO_VERSION);
 }
 
+// State shared by the output sink across files
+typedef struct {
+    int batch;         // Non-zero when several files may be printed
+    int flush;         // Non-zero to flush each record as soon as it is printed
+    size_t printed;    // Number of records printed so far
+} OutputState;
+
+// Print one finished file; single-file runs keep the classic heading
+static void print_result(const FileContext *ctx, void *arg) {
+    OutputState *out = arg;
+    if (out->batch) {
+        // Separate records with a blank line and title each with its path
+        if (out->printed > 0) {
+            putchar('\n');
+        }
+        display_info(ctx, ctx->path, stdout);
+    } else {
+        display_info(ctx, "File Information", stdout);
+    }
+    if (out->flush) {
+        fflush(stdout);
+    }
+    if (profile_is_enabled()) {
+        profile_print_file(&ctx->profile, ctx->path, stderr);
+        profile_record(&ctx->profile);
+    }
+    out->printed++;
+}
+
 int main(int argc, char *argv[]) {
-    // Check if at least one argument is provided
-    if (argc < 2) {
+    static const struct option long_options[] = {
+        {"help",       no_argument,       NULL, 'h'},
+        {"version",    no_argument,       NULL, 'v'},
+        {"jobs",       required_argument, NULL, 'j'},
+        {"files-from", required_argument, NULL, OPT_FILES_FROM},
+        {"null",       no_argument,       NULL, '0'},
+        {"unordered",  no_argument,       NULL, 'u'},
+        {"recursive",  no_argument,       NULL, 'r'},
+        {"cache",         optional_argument, NULL, OPT_CACHE},
+        {"no-cache",      no_argument,       NULL, OPT_NO_CACHE},
+        {"rebuild-cache", no_argument,       NULL, OPT_REBUILD_CACHE},
+        {"incremental",   no_argument,       NULL, OPT_INCREMENTAL},
+        {"profile",       no_argument,       NULL, OPT_PROFILE},
+        {"serve",         required_argument, NULL, OPT_SERVE},
+        {"client",        required_argument, NULL, OPT_CLIENT},
+        {"prefetch",        optional_argument, NULL, OPT_PREFETCH},
+        {"prefetch-memory", required_argument, NULL, OPT_PREFETCH_MEMORY},
+        {"no-tools",        no_argument,       NULL, OPT_NO_TOOLS},
+        {"fields",          required_argument, NULL, OPT_FIELDS},
+        {"fast",            no_argument,       NULL, OPT_FAST},
+        {"hash",            required_argument, NULL, OPT_HASH},
+        {"sniff",           optional_argument, NULL, OPT_SNIFF},
+        {"watch",           no_argument,       NULL, OPT_WATCH},
+        {"debounce",        required_argument, NULL, OPT_DEBOUNCE},
+        {"estimate",        optional_argument, NULL, OPT_ESTIMATE},
+        {"deep",            optional_argument, NULL, OPT_DEEP},
+        {"deep-budget",     required_argument, NULL, OPT_DEEP_BUDGET},
+        {NULL, 0, NULL, 0}
+    };
+
+    BatchOptions opts = {
+        .jobs = default_job_count(),
+        .unordered = 0,
+        .prefetch_depth = 0,
+        .prefetch_memory = (size_t)DEFAULT_PREFETCH_MEMORY_MIB << 20,
+        .max_cost = HANDLER_COST_EXTERNAL,
+        .deep_budget = (uint64_t)DEFAULT_DEEP_BUDGET,
+    };
+    const char *files_from = NULL;  // Path list file, if any
+    int null_separated = 0;         // Whether the path list uses NUL separators
+    int use_cache = 0;              // Whether to consult and update the cache
+    int rebuild_cache = 0;          // Whether to discard what the cache holds
+    const char *cache_path = NULL;  // Cache file, NULL for the default
+    const char *serve_path = NULL;  // Socket to serve on, if any
+    const char *client_path = NULL; // Socket of a server to use, if any
+    FieldSelection fields = { 0 };  // Storage for --fields
+    int recursive = 0;              // Whether to summarize directory trees
+    int watch = 0;                  // Whether to analyze files as they change
+    unsigned debounce_ms = DEFAULT_DEBOUNCE_MS;  // Quiet time --watch waits for
+
+    // Parse command line options
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hvj:0ur", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            print_usage(argv[0]);
+            return 0;  // Exit successfully after printing help
+        case 'v':
+            print_version();
+            return 0;  // Exit successfully after printing version
+        case 'j':
+            opts.jobs = atoi(optarg);
+            if (opts.jobs < 1) {
+                fprintf(stderr, "Invalid job count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_FILES_FROM:
+            files_from = optarg;
+            break;
+        case '0':
+            null_separated = 1;
+            break;
+        case 'u':
+            opts.unordered = 1;
+            break;
+        case 'r':
+            recursive = 1;
+            break;
+        case OPT_WATCH:
+            watch = 1;
+            break;
+        case OPT_DEBOUNCE: {
+            char *end;
+            unsigned long ms = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || ms > 60000) {
+                fprintf(stderr, "Invalid debounce time: %s\n", optarg);
+                return 1;
+            }
+            debounce_ms = (unsigned)ms;
+            break;
+        }
+        case OPT_CACHE:
+            use_cache = 1;
+            cache_path = optarg;
+            break;
+        case OPT_NO_CACHE:
+            use_cache = 0;
+            rebuild_cache = 0;
+            opts.incremental = 0;
+            break;
+        case OPT_REBUILD_CACHE:
+            use_cache = 1;
+            rebuild_cache = 1;
+            break;
+        case OPT_INCREMENTAL:
+            use_cache = 1;
+            opts.incremental = 1;
+            break;
+        case OPT_SERVE:
+            serve_path = optarg;
+            break;
+        case OPT_CLIENT:
+            client_path = optarg;
+            break;
+        case OPT_PREFETCH:
+            opts.prefetch_depth = optarg != NULL ? atoi(optarg) : DEFAULT_PREFETCH_DEPTH;
+            if (opts.prefetch_depth < 1) {
+                fprintf(stderr, "Invalid prefetch depth: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_PREFETCH_MEMORY: {
+            int mib = atoi(optarg);
+            if (mib < 1) {
+                fprintf(stderr, "Invalid prefetch memory: %s\n", optarg);
+                return 1;
+            }
+            opts.prefetch_memory = (size_t)mib << 20;
+            break;
+        }
+        case OPT_NO_TOOLS:
+            opts.max_cost = HANDLER_COST_CHEAP;
+            break;
+        case OPT_FIELDS:
+            free_fields(&fields);
+            if (parse_fields(optarg, &fields) != 0) {
+                fprintf(stderr, "Invalid field list: %s\n", optarg);
+                return 1;
+            }
+            opts.fields = &fields;
+            break;
+        case OPT_FAST:
+            opts.max_cost = HANDLER_COST_CHEAP;
+            opts.read_limit = FAST_READ_LIMIT;
+            break;
+        case OPT_HASH:
+            if (digest_parse(optarg, &opts.digest) != 0) {
+                fprintf(stderr, "Invalid hash algorithm: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_ESTIMATE: {
+            int mib = optarg != NULL ? atoi(optarg) : (int)(DEFAULT_ESTIMATE_BUDGET >> 20);
+            if (mib < 1) {
+                fprintf(stderr, "Invalid estimate budget: %s\n", optarg);
+                return 1;
+            }
+            opts.estimate_budget = (uint64_t)mib << 20;
+            break;
+        }
+        case OPT_DEEP: {
+            int depth = optarg != NULL ? atoi(optarg) : DEFAULT_DEEP_DEPTH;
+            if (depth < 1 || depth > DEEP_MAX_DEPTH) {
+                fprintf(stderr, "Invalid deep depth: %s\n", optarg);
+                return 1;
+            }
+            opts.deep_depth = (unsigned)depth;
+            break;
+        }
+        case OPT_DEEP_BUDGET: {
+            int mib = atoi(optarg);
+            if (mib < 1 || mib > 4095) {
+                fprintf(stderr, "Invalid deep budget: %s\n", optarg);
+                return 1;
+            }
+            opts.deep_budget = (uint64_t)mib << 20;
+            break;
+        }
+        case OPT_SNIFF:
+            if (optarg == NULL) {
+                opts.sniff = SNIFF_ON;
+            } else if (strcmp(optarg, "check") == 0) {
+                opts.sniff = SNIFF_CHECK;
+            } else {
+                fprintf(stderr, "Invalid sniff mode: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_PROFILE:
+            if (profile_enable() != 0) {
+                fprintf(stderr, "Cannot profile: inf was built with -Dprofiling=false\n");
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;  // Exit with error code on unknown options
+        }
+    }
+
+    // Ctrl-C and kill end the tools inf started too, not only inf
+    stop_tools_on_signal();
+
+    // Server mode: no paths of its own, just answer clients until stopped
+    if (serve_path != NULL) {
+        // Results are written back as it goes, not only when it stops
+        if (use_cache && cache_open(cache_path, rebuild_cache) == 0) {
+            cache_flush_periodically();
+        }
+        int status = serve(serve_path, &opts);
+        cache_close();
+        detect_cleanup();
+        free_fields(&fields);
+        return status == 0 ? 0 : 1;
+    }
+
+    // Collect paths from the remaining arguments and the optional list
+    PathSource source = {
+        .paths = argv + optind,
+        .count = (size_t)(argc - optind),
+        .next = 0,
+        .list = NULL,
+        .delimiter = null_separated ? '\0' : '\n',
+    };
+    if (files_from != NULL && strcmp(files_from, "-") != 0) {
+        source.list = fopen(files_from, "r");
+        if (source.list == NULL) {
+            fprintf(stderr, "Cannot open file list: %s\n", files_from);
+            return 1;
+        }
+    } else if (files_from != NULL || null_separated) {
+        source.list = stdin;
+    }
+
+    // Check if at least one path can be expected
+    if (source.count == 0 && source.list == NULL) {
         print_usage(argv[0]);  // Print usage if no arguments
         return 1;  // Exit with error code
     }
 
-    // Check for help option
-    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
-        print_usage(argv[0]);
-        return 0;  // Exit successfully after printing help
+    if (watch && (recursive || client_path != NULL)) {
+        fprintf(stderr, "Cannot combine --watch with -r or --client\n");
+        return 1;
     }
 
-    // Check for version option
-    if (strcmp(argv[1], "-v") == 0 || strcmp(argv[1], "--version") == 0) {
-        print_version();
-        return 0;  // Exit successfully after printing version
+    // Without a usable cache every file is simply analyzed from scratch
+    if (use_cache && cache_open(cache_path, rebuild_cache) == 0 && watch) {
+        // Watching does not end on its own: write results back as it goes,
+        // so the next event on a file finds its checkpoint
+        cache_flush_periodically();
+    }
+
+    // A lone path argument keeps the original single-file output
+    OutputState out = { .batch = source.count != 1 || source.list != NULL, .printed = 0 };
+    size_t failed;
+    if (watch) {
+        // Records are titled with their paths and reach a pipe right away
+        out.batch = 1;
+        out.flush = 1;
+        long status = watch_run(&opts, debounce_ms, path_source_next, &source, print_result, &out);
+        failed = status < 0 ? 1 : (size_t)status;
+    } else if (recursive) {
+        // Trees are walked here; a server only analyzes the files it is sent
+        failed = walk_run(&opts, path_source_next, &source, stdout);
+    } else {
+        long remote = -1;
+        if (client_path != NULL) {
+            remote = run_client(client_path, &opts, path_source_next, &source, print_result, &out);
+            if (remote < 0) {
+                fprintf(stderr, "Cannot reach inf server at %s, analyzing here\n", client_path);
+            }
+        }
+        failed = remote >= 0 ? (size_t)remote
+                             : batch_run(&opts, path_source_next, &source, print_result, &out);
+    }
+
+    if (source.list != NULL && source.list != stdin) {
+        fclose(source.list);
+    }
+    // Several files: say where the time went overall
+    if (profile_is_enabled() && (out.printed > 1 || recursive || watch)) {
+        profile_print_summary(stderr);
     }
+    cache_close();     // Save what this run learned
+    detect_cleanup();  // Close the magic cookies the workers left behind
+    free_fields(&fields);
 
-    const char *file_path = argv[1];  // Get the file path from command line argument
-    init_info_array();  // Initialize the info array (defined in file_info.h)
-    process_file(file_path);  // Process the file and gather information
-    display_info();  // Display the gathered information
-    free_info_array();  // Free the memory used by the info array
-    
-    return 0;  // Exit successfully
+    return failed ? 1 : 0;  // Exit with error code if any file could not be examined
 }
@@ -0,0 +1,379 @@
+// Define _GNU_SOURCE to enable O_NOATIME and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "prefetch.h"          // Declarations for the functions defined in this file
+#include "utils.h"             // read_at()
+#include <errno.h>             // errno, EPERM, EINTR
+#include <fcntl.h>             // open() and its flags
+#include <linux/io_uring.h>    // io_uring structures and opcodes
+#include <pthread.h>           // Completion and pool threads
+#include <stdint.h>            // uintptr_t
+#include <stdlib.h>            // calloc(), free()
+#include <string.h>            // memset()
+#include <sys/mman.h>          // mmap() of the rings
+#include <sys/stat.h>          // fstat()
+#include <sys/syscall.h>       // io_uring_setup and io_uring_enter numbers
+#include <unistd.h>            // syscall(), close()
+
+// The thread pool fallback never grows beyond this many threads
+#define MAX_PREFETCH_THREADS 64
+// Deeper queues than this are clamped
+#define MAX_PREFETCH_DEPTH 4096
+// user_data of the no-op that tells the completion thread to stop
+#define STOP_TOKEN 0
+// Flags of every prefetch open; O_NONBLOCK keeps a FIFO from blocking it
+#define OPEN_FLAGS (O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC)
+
+// Steps of a request on the io_uring backend
+enum {
+    STEP_OPEN,  // openat() submitted
+    STEP_READ   // read() of the head submitted
+};
+
+// The submission and completion rings shared with the kernel
+typedef struct {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;  // The two ring mappings (the same one on newer kernels)
+    size_t sq_map_size, cq_map_size, sqes_size;
+} Ring;
+
+struct Prefetcher {
+    int depth;                  // Requests allowed in flight at once
+    int use_ring;               // io_uring backend rather than the thread pool
+    Ring ring;
+    pthread_mutex_t lock;       // Protects everything below and the submission ring
+    pthread_cond_t work_ready;  // Signalled when a request is queued or on stop
+    pthread_cond_t finished;    // Signalled when a request is done
+    PrefetchRequest *queue_head, *queue_tail;  // Submitted but not started
+    int in_flight;              // Requests started on the ring and not done
+    int stopping;               // Set once the pool threads should exit
+    pthread_t *threads;         // Completion thread, or the pool
+    int thread_count;
+};
+
+// ---------------------------------------------------------------------------
+// io_uring backend
+// ---------------------------------------------------------------------------
+
+// Create a ring with room for entries submissions; returns 0 or -1
+static int ring_setup(Ring *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    // Map the submission ring, the completion ring and the submission entries
+    ring->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_map_size > ring->sq_map_size) {
+        ring->sq_map_size = ring->cq_map_size;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    ring->cq_map = single ? ring->sq_map
+                          : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = ring->cq_map == MAP_FAILED
+                     ? MAP_FAILED
+                     : mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_map != MAP_FAILED && !single) {
+            munmap(ring->cq_map, ring->cq_map_size);
+        }
+        munmap(ring->sq_map, ring->sq_map_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    char *sq = ring->sq_map, *cq = ring->cq_map;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void ring_teardown(Ring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+// Queue one operation and hand it to the kernel (lock held)
+// The ring has room for every request in flight, so it never fills up
+static void ring_push(Ring *ring, const struct io_uring_sqe *sqe) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    ring->sqes[index] = *sqe;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0 && errno == EINTR) {
+    }
+}
+
+static void push_open(Prefetcher *pf, PrefetchRequest *req) {
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_OPENAT;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = (uintptr_t)req->path;
+    sqe.open_flags = req->flags;
+    sqe.user_data = (uintptr_t)req;
+    req->state = STEP_OPEN;
+    ring_push(&pf->ring, &sqe);
+}
+
+static void push_read(Prefetcher *pf, PrefetchRequest *req, size_t len) {
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = req->fd;
+    sqe.addr = (uintptr_t)req->buffer;
+    sqe.len = (unsigned)len;
+    sqe.off = 0;
+    sqe.user_data = (uintptr_t)req;
+    req->state = STEP_READ;
+    ring_push(&pf->ring, &sqe);
+}
+
+// Mark a request done and start the next queued one (lock held)
+static void ring_finish(Prefetcher *pf, PrefetchRequest *req) {
+    req->done = 1;
+    pthread_cond_broadcast(&pf->finished);
+    pf->in_flight--;
+    PrefetchRequest *next = pf->queue_head;
+    if (next != NULL) {
+        pf->queue_head = next->next;
+        pf->in_flight++;
+        push_open(pf, next);
+    }
+}
+
+// How much of an open file to read ahead; 0 for anything but regular files
+static size_t read_length(const PrefetchRequest *req) {
+    struct stat st;
+    if (fstat(req->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return 0;
+    }
+    return (uint64_t)st.st_size < req->capacity ? (size_t)st.st_size : req->capacity;
+}
+
+// Take the next step of a request whose operation completed with res (lock held)
+static void ring_complete(Prefetcher *pf, PrefetchRequest *req, int res) {
+    if (req->state == STEP_OPEN) {
+        if (res == -EPERM && (req->flags & O_NOATIME)) {
+            // O_NOATIME is refused on files we do not own
+            req->flags &= ~O_NOATIME;
+            push_open(pf, req);
+            return;
+        }
+        if (res < 0) {
+            ring_finish(pf, req);  // The worker's own open reports the error
+            return;
+        }
+        req->fd = res;
+        // The inode is in memory once the open is done, so fstat() is cheap
+        size_t len = read_length(req);
+        if (len > 0) {
+            push_read(pf, req, len);
+            return;
+        }
+    } else if (res > 0) {
+        req->length = (size_t)res;
+    }
+    ring_finish(pf, req);
+}
+
+// Reap completions and move each request along until told to stop
+static void *ring_thread(void *arg) {
+    Prefetcher *pf = arg;
+    Ring *ring = &pf->ring;
+    for (;;) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            continue;
+        }
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        uint64_t token = cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+        if (token == STOP_TOKEN) {
+            break;
+        }
+        pthread_mutex_lock(&pf->lock);
+        ring_complete(pf, (PrefetchRequest *)(uintptr_t)token, res);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Thread pool backend
+// ---------------------------------------------------------------------------
+
+// Open and read one request with blocking calls
+static void run_request(PrefetchRequest *req) {
+    req->fd = open(req->path, req->flags);
+    if (req->fd == -1 && errno == EPERM) {
+        req->fd = open(req->path, req->flags & ~O_NOATIME);
+    }
+    if (req->fd == -1) {
+        return;
+    }
+    size_t len = read_length(req);
+    ssize_t n = len > 0 ? read_at(req->fd, req->buffer, len, 0) : 0;
+    req->length = n > 0 ? (size_t)n : 0;
+}
+
+static void *pool_thread(void *arg) {
+    Prefetcher *pf = arg;
+    pthread_mutex_lock(&pf->lock);
+    for (;;) {
+        while (pf->queue_head == NULL && !pf->stopping) {
+            pthread_cond_wait(&pf->work_ready, &pf->lock);
+        }
+        PrefetchRequest *req = pf->queue_head;
+        if (req == NULL) {
+            break;
+        }
+        pf->queue_head = req->next;
+
+        // Block on the file system without holding the lock
+        pthread_mutex_unlock(&pf->lock);
+        run_request(req);
+        pthread_mutex_lock(&pf->lock);
+
+        req->done = 1;
+        pthread_cond_broadcast(&pf->finished);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Interface
+// ---------------------------------------------------------------------------
+
+Prefetcher *prefetch_start(int depth) {
+    if (depth < 1) {
+        depth = 1;
+    } else if (depth > MAX_PREFETCH_DEPTH) {
+        depth = MAX_PREFETCH_DEPTH;
+    }
+    Prefetcher *pf = calloc(1, sizeof(Prefetcher));
+    if (pf == NULL) {
+        return NULL;
+    }
+    pf->depth = depth;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->work_ready, NULL);
+    pthread_cond_init(&pf->finished, NULL);
+
+    // One slot more than the depth for the no-op that stops the ring
+    pf->use_ring = ring_setup(&pf->ring, (unsigned)depth + 1) == 0;
+    int wanted = pf->use_ring ? 1 : (depth < MAX_PREFETCH_THREADS ? depth : MAX_PREFETCH_THREADS);
+    pf->threads = calloc(wanted, sizeof(pthread_t));
+    if (pf->threads != NULL) {
+        void *(*run)(void *) = pf->use_ring ? ring_thread : pool_thread;
+        while (pf->thread_count < wanted &&
+               pthread_create(&pf->threads[pf->thread_count], NULL, run, pf) == 0) {
+            pf->thread_count++;
+        }
+    }
+    if (pf->thread_count == 0) {
+        if (pf->use_ring) {
+            ring_teardown(&pf->ring);
+        }
+        pthread_cond_destroy(&pf->finished);
+        pthread_cond_destroy(&pf->work_ready);
+        pthread_mutex_destroy(&pf->lock);
+        free(pf->threads);
+        free(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+const char *prefetch_backend(const Prefetcher *pf) {
+    return pf->use_ring ? "io_uring" : "threads";
+}
+
+void prefetch_submit(Prefetcher *pf, PrefetchRequest *req) {
+    req->fd = -1;
+    req->length = 0;
+    req->done = 0;
+    req->flags = OPEN_FLAGS | O_NOATIME;
+    req->next = NULL;
+
+    pthread_mutex_lock(&pf->lock);
+    if (pf->use_ring && pf->in_flight < pf->depth) {
+        pf->in_flight++;
+        push_open(pf, req);
+    } else {
+        // Wait for a free place in the ring, or for a pool thread
+        if (pf->queue_head == NULL) {
+            pf->queue_head = req;
+        } else {
+            pf->queue_tail->next = req;
+        }
+        pf->queue_tail = req;
+        pthread_cond_signal(&pf->work_ready);
+    }
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_wait(Prefetcher *pf, PrefetchRequest *req) {
+    pthread_mutex_lock(&pf->lock);
+    while (!req->done) {
+        pthread_cond_wait(&pf->finished, &pf->lock);
+    }
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_stop(Prefetcher *pf) {
+    pthread_mutex_lock(&pf->lock);
+    pf->stopping = 1;
+    if (pf->use_ring) {
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = STOP_TOKEN;
+        ring_push(&pf->ring, &sqe);
+    }
+    pthread_cond_broadcast(&pf->work_ready);
+    pthread_mutex_unlock(&pf->lock);
+
+    for (int i = 0; i < pf->thread_count; i++) {
+        pthread_join(pf->threads[i], NULL);
+    }
+    if (pf->use_ring) {
+        ring_teardown(&pf->ring);
+    }
+    pthread_cond_destroy(&pf->finished);
+    pthread_cond_destroy(&pf->work_ready);
+    pthread_mutex_destroy(&pf->lock);
+    free(pf->threads);
+    free(pf);
+}
@@ -0,0 +1,37 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+
+// A file to open and start reading ahead of the worker that analyzes it.
+// The caller owns the request and its buffer; the prefetcher fills in the
+// results and sets done.
+typedef struct PrefetchRequest {
+    const char *path;        // File to open; must stay valid until done
+    unsigned char *buffer;   // Receives the file's first bytes
+    size_t capacity;         // Size of buffer
+    int fd;                  // Opened descriptor, or -1 if the open failed
+    size_t length;           // Bytes read into buffer (0 for non-regular files)
+    int done;                // Set once the results above are final
+    // Used by the prefetcher while the request is in flight
+    int state;               // Step of the request, for the io_uring backend
+    int flags;               // open() flags, retried without O_NOATIME
+    struct PrefetchRequest *next;  // Next request waiting to start
+} PrefetchRequest;
+
+typedef struct Prefetcher Prefetcher;
+
+// Start a prefetcher that keeps up to depth files in flight, through
+// io_uring when the kernel allows it and a pool of threads otherwise
+// Returns NULL if neither can be set up
+Prefetcher *prefetch_start(int depth);
+// "io_uring" or "threads"
+const char *prefetch_backend(const Prefetcher *pf);
+// Queue a request; it is started as soon as fewer than depth are in flight
+void prefetch_submit(Prefetcher *pf, PrefetchRequest *req);
+// Wait until a submitted request is done
+void prefetch_wait(Prefetcher *pf, PrefetchRequest *req);
+// Stop the prefetcher; every submitted request must be done
+void prefetch_stop(Prefetcher *pf);
+
+#endif // PREFETCH_H
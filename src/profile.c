@@ -0,0 +1,334 @@
+// Define _GNU_SOURCE to enable certain GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "profile.h"   // Declarations for the functions defined in this file
+#include <fcntl.h>     // open()
+#include <stdlib.h>    // strtoull()
+#include <string.h>    // memset(), strcmp(), strncmp()
+#include <time.h>      // clock_gettime()
+#include <unistd.h>    // read(), close()
+
+// Per-file latencies are bucketed by powers of two microseconds
+#define HISTOGRAM_BUCKETS 32
+// Handlers tracked separately in the summary
+#define MAX_HANDLERS 16
+
+#if INF_PROFILING
+// The model is fixed so reading it from malloc() below needs no allocation
+_Thread_local ProfileData *profile_current __attribute__((tls_model("initial-exec")));
+#endif
+
+// Whether --profile was given
+static int enabled;
+
+// Names of the stages, in ProfileStage order
+static const char *const stage_names[PROFILE_STAGES] = {
+    "stat", "cache_lookup", "read", "magic_load", "detect", "handler", "digest", "cache_store"
+};
+
+// Totals for one handler
+typedef struct {
+    const char *name;
+    size_t files;
+    uint64_t ns;          // Whole-file time of the files it handled
+    uint64_t handler_ns;  // Time spent in the handler itself
+} HandlerTotals;
+
+// Everything the summary reports; updated by profile_record()
+static struct {
+    size_t files;
+    uint64_t total_ns;
+    uint64_t stage_ns[PROFILE_STAGES];
+    uint64_t stage_max_ns[PROFILE_STAGES];
+    uint64_t tool_ns;
+    unsigned long spawns;
+    uint64_t bytes_read;
+    uint64_t read_calls;
+    uint64_t write_calls;
+    uint64_t allocations;
+    int have_io;
+    int have_allocations;
+    HandlerTotals handlers[MAX_HANDLERS];
+    int handler_count;
+    size_t histogram[HISTOGRAM_BUCKETS];
+} totals;
+
+// ---------------------------------------------------------------------------
+// Allocation counting
+// ---------------------------------------------------------------------------
+
+// glibc exports its allocator under internal names, so inf can count the
+// calls made on a profiled thread (libmagic's included) and pass them on.
+// That replaces malloc() for the whole process, which breaks a preloaded
+// allocator whose free() then gets glibc's blocks, and anything else linked
+// with inf's objects; builds only do it when configured with
+// -Dcount_allocations=true. Sanitizer builds replace the allocator
+// themselves and are left alone.
+#if INF_PROFILING && INF_COUNT_ALLOCATIONS && defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCATIONS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    if (profile_current != NULL) {
+        profile_current->allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (profile_current != NULL) {
+        profile_current->allocations++;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (profile_current != NULL) {
+        profile_current->allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
+#else
+#define COUNT_ALLOCATIONS 0
+#endif
+
+// ---------------------------------------------------------------------------
+// Per-file probes
+// ---------------------------------------------------------------------------
+
+int profile_enable(void) {
+    if (!INF_PROFILING) {
+        return -1;
+    }
+    enabled = 1;
+    return 0;
+}
+
+int profile_is_enabled(void) {
+    return enabled;
+}
+
+uint64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#if INF_PROFILING
+// Read the calling thread's rchar, syscr and syscw from /proc
+// Returns the bytes the read itself returned, or -1 if they are unavailable
+static ssize_t read_io_counters(uint64_t counters[3]) {
+    int fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+
+    // Lines look like "rchar: 12345"
+    static const char *const names[3] = { "rchar: ", "syscr: ", "syscw: " };
+    int found = 0;
+    for (char *line = buf; line != NULL && *line != '\0'; ) {
+        for (int i = 0; i < 3; i++) {
+            size_t len = strlen(names[i]);
+            if (strncmp(line, names[i], len) == 0) {
+                counters[i] = strtoull(line + len, NULL, 10);
+                found++;
+            }
+        }
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+    return found == 3 ? n : -1;
+}
+#endif
+
+void profile_begin(ProfileData *profile) {
+#if INF_PROFILING
+    if (!enabled) {
+        return;
+    }
+    memset(profile, 0, sizeof(*profile));
+    // The read that takes this snapshot is itself counted by the next one
+    ssize_t n = read_io_counters(profile->io_start);
+    if (n >= 0) {
+        profile->io_start[0] += (uint64_t)n;
+        profile->io_start[1] += 1;
+        profile->have_io = 1;
+    }
+    profile->have_allocations = COUNT_ALLOCATIONS;
+    profile->total_ns = profile_now();
+    profile_current = profile;
+#else
+    (void)profile;
+#endif
+}
+
+void profile_end(ProfileData *profile, unsigned spawns, uint64_t tool_ns) {
+#if INF_PROFILING
+    if (profile_current != profile) {
+        return;
+    }
+    profile_current = NULL;
+    profile->total_ns = profile_now() - profile->total_ns;
+    profile->spawns = spawns;
+    profile->tool_ns = tool_ns;
+
+    uint64_t now[3];
+    if (profile->have_io && read_io_counters(now) >= 0) {
+        profile->bytes_read = now[0] - profile->io_start[0];
+        profile->read_calls = now[1] - profile->io_start[1];
+        profile->write_calls = now[2] - profile->io_start[2];
+    } else {
+        profile->have_io = 0;
+    }
+#else
+    (void)profile;
+    (void)spawns;
+    (void)tool_ns;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Reports
+// ---------------------------------------------------------------------------
+
+// Nanoseconds as milliseconds for printing
+static double ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+void profile_print_file(const ProfileData *profile, const char *path, FILE *out) {
+    fprintf(out, "profile: total_ms=%.3f", ms(profile->total_ns));
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        fprintf(out, " %s_ms=%.3f", stage_names[i], ms(profile->stage_ns[i]));
+    }
+    fprintf(out, " tools_ms=%.3f handler=%s spawns=%u", ms(profile->tool_ns),
+            profile->handler != NULL ? profile->handler : "none", profile->spawns);
+    if (profile->have_io) {
+        fprintf(out, " bytes_read=%llu read_calls=%llu write_calls=%llu",
+                (unsigned long long)profile->bytes_read,
+                (unsigned long long)profile->read_calls,
+                (unsigned long long)profile->write_calls);
+    }
+    if (profile->have_allocations) {
+        fprintf(out, " allocations=%llu", (unsigned long long)profile->allocations);
+    }
+    // The path goes last so it may contain spaces
+    fprintf(out, " path=%s\n", path);
+}
+
+void profile_record(const ProfileData *profile) {
+    totals.files++;
+    totals.total_ns += profile->total_ns;
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        totals.stage_ns[i] += profile->stage_ns[i];
+        if (profile->stage_ns[i] > totals.stage_max_ns[i]) {
+            totals.stage_max_ns[i] = profile->stage_ns[i];
+        }
+    }
+    totals.tool_ns += profile->tool_ns;
+    totals.spawns += profile->spawns;
+    totals.bytes_read += profile->bytes_read;
+    totals.read_calls += profile->read_calls;
+    totals.write_calls += profile->write_calls;
+    totals.allocations += profile->allocations;
+    totals.have_io |= profile->have_io;
+    totals.have_allocations |= profile->have_allocations;
+
+    // Handler names are literals, so comparing pointers would do; strcmp is safer
+    const char *name = profile->handler != NULL ? profile->handler : "none";
+    int h = 0;
+    while (h < totals.handler_count && strcmp(totals.handlers[h].name, name) != 0) {
+        h++;
+    }
+    if (h == totals.handler_count && h < MAX_HANDLERS) {
+        totals.handlers[totals.handler_count++].name = name;
+    }
+    if (h < totals.handler_count) {
+        totals.handlers[h].files++;
+        totals.handlers[h].ns += profile->total_ns;
+        totals.handlers[h].handler_ns += profile->stage_ns[PROFILE_HANDLER];
+    }
+
+    // Bucket i holds files that took [2^i, 2^(i+1)) microseconds
+    uint64_t us = profile->total_ns / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    totals.histogram[bucket]++;
+}
+
+void profile_print_summary(FILE *out) {
+    if (totals.files == 0) {
+        return;
+    }
+    fprintf(out, "\nProfile summary: %zu files, %.3f ms in process_file\n\n",
+            totals.files, ms(totals.total_ns));
+
+    // Stages: where the time went
+    fprintf(out, "%-14s %12s %10s %10s\n", "Stage", "Total ms", "Mean ms", "Max ms");
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        fprintf(out, "%-14s %12.3f %10.3f %10.3f\n", stage_names[i], ms(totals.stage_ns[i]),
+                ms(totals.stage_ns[i]) / totals.files, ms(totals.stage_max_ns[i]));
+    }
+    fprintf(out, "%-14s %12.3f %10.3f\n", "  tools", ms(totals.tool_ns),
+            ms(totals.tool_ns) / totals.files);
+
+    // Handlers: which kinds of file were expensive
+    fprintf(out, "\n%-14s %12s %10s %10s %10s\n", "Handler", "Files", "File ms", "Mean ms",
+            "Handler ms");
+    for (int h = 0; h < totals.handler_count; h++) {
+        const HandlerTotals *t = &totals.handlers[h];
+        fprintf(out, "%-14s %12zu %10.3f %10.3f %10.3f\n", t->name, t->files, ms(t->ns),
+                ms(t->ns) / t->files, ms(t->handler_ns));
+    }
+
+    // Counters
+    fprintf(out, "\nTools spawned: %lu\n", totals.spawns);
+    if (totals.have_io) {
+        fprintf(out, "Bytes read: %llu in %llu read calls, %llu write calls\n",
+                (unsigned long long)totals.bytes_read, (unsigned long long)totals.read_calls,
+                (unsigned long long)totals.write_calls);
+    }
+    if (totals.have_allocations) {
+        fprintf(out, "Allocations: %llu (%.1f per file)\n",
+                (unsigned long long)totals.allocations,
+                (double)totals.allocations / totals.files);
+    }
+
+    // Latency histogram over the occupied range of buckets
+    int first = 0, last = HISTOGRAM_BUCKETS - 1;
+    while (totals.histogram[first] == 0) {
+        first++;
+    }
+    while (totals.histogram[last] == 0) {
+        last--;
+    }
+    size_t peak = 0;
+    for (int i = first; i <= last; i++) {
+        if (totals.histogram[i] > peak) {
+            peak = totals.histogram[i];
+        }
+    }
+    fprintf(out, "\nTime per file:\n");
+    for (int i = first; i <= last; i++) {
+        int bar = (int)(totals.histogram[i] * 40 / peak);
+        fprintf(out, "  %10llu - %-10llu us |%-40.*s| %zu\n",
+                i == 0 ? 0ULL : 1ULL << i, (1ULL << (i + 1)) - 1, bar,
+                "########################################", totals.histogram[i]);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Builds configured with -Dprofiling=false compile every probe away
+#ifndef INF_PROFILING
+#define INF_PROFILING 1
+#endif
+// Builds configured with -Dcount_allocations=true also count allocations
+#ifndef INF_COUNT_ALLOCATIONS
+#define INF_COUNT_ALLOCATIONS 0
+#endif
+
+// Stages of process_file(), timed separately
+typedef enum {
+    PROFILE_STAT,          // Opening the file, fstat() and the basic fields
+    PROFILE_CACHE_LOOKUP,  // Looking the file up in the result cache
+    PROFILE_READ,          // Reading the head every later stage shares
+    PROFILE_MAGIC_LOAD,    // Loading a libmagic database (first file per thread)
+    PROFILE_DETECT,        // libmagic queries, excluding the load
+    PROFILE_HANDLER,       // The type-specific handler, including its tools
+    PROFILE_DIGEST,        // Reading a file its handler did not read for --hash
+    PROFILE_CACHE_STORE,   // Remembering the results
+    PROFILE_STAGES
+} ProfileStage;
+
+// What one file cost; all zero unless --profile is given
+typedef struct {
+    uint64_t stage_ns[PROFILE_STAGES];  // Time spent in each stage
+    uint64_t total_ns;          // Time spent in process_file()
+    uint64_t tool_ns;           // Part of the handler time spent in external tools
+    const char *handler;        // Name of the handler that ran, NULL if none
+    unsigned spawns;            // External tools started
+    uint64_t bytes_read;        // Bytes the thread read (kernel count, includes libmagic)
+    uint64_t read_calls;        // read-family system calls
+    uint64_t write_calls;       // write-family system calls
+    uint64_t allocations;       // malloc/calloc/realloc calls
+    int have_io;                // Whether the three I/O counters are known
+    int have_allocations;       // Whether allocations were counted
+    uint64_t io_start[3];       // Kernel counters when the file was started
+} ProfileData;
+
+// Time a stage: PROFILE_BEGIN(t); ... PROFILE_END(PROFILE_DETECT, t);
+#if INF_PROFILING
+// Profile of the file the calling thread is analyzing, NULL when profiling
+// is off; every probe is a single test of this pointer
+extern _Thread_local ProfileData *profile_current __attribute__((tls_model("initial-exec")));
+#define PROFILE_ON (profile_current != NULL)
+#define PROFILE_BEGIN(t) uint64_t t = PROFILE_ON ? profile_now() : 0
+#define PROFILE_END(stage, t)                                               \
+    do {                                                                    \
+        if (PROFILE_ON) {                                                   \
+            profile_current->stage_ns[stage] += profile_now() - (t);        \
+        }                                                                   \
+    } while (0)
+#else
+#define PROFILE_ON 0
+#define PROFILE_BEGIN(t) uint64_t t = 0
+#define PROFILE_END(stage, t) ((void)(t))
+#endif
+
+// Turn profiling on for this run; returns -1 if the build has no probes
+int profile_enable(void);
+// Whether --profile is in effect
+int profile_is_enabled(void);
+// Monotonic clock in nanoseconds
+uint64_t profile_now(void);
+// Start and finish profiling one file on the calling thread
+void profile_begin(ProfileData *profile);
+void profile_end(ProfileData *profile, unsigned spawns, uint64_t tool_ns);
+// Print one file's breakdown as a single key=value line
+void profile_print_file(const ProfileData *profile, const char *path, FILE *out);
+// Add one file to the totals; call for each file, one at a time
+void profile_record(const ProfileData *profile);
+// Print per-stage totals, per-handler totals and a latency histogram
+void profile_print_summary(FILE *out);
+
+#endif // PROFILE_H
@@ -0,0 +1,184 @@
+// Include necessary header files
+#include "registry.h"   // Contains declarations for functions defined in this file
+#include "handlers.h"   // The handlers the registry dispatches to
+#include <pthread.h>    // pthread_once() for building the index
+#include <stdint.h>     // uint32_t for the hash
+#include <string.h>     // strcmp(), strncmp()
+
+// What each handler reports, including what its fallback tool prints
+static const char *const text_fields[] = {
+    "Lines", "Words", "Characters", "Code points", "Estimate", NULL
+};
+static const char *const image_fields[] = {
+    "Dimensions", "Color space", "Bit depth", "Frames", NULL
+};
+static const char *const video_fields[] = {
+    "Duration", "Resolution", "Video codec", "Audio codec", "Tracks", NULL
+};
+static const char *const pdf_fields[] = {
+    "Title", "Subject", "Keywords", "Author", "Creator", "Producer", "CreationDate", "ModDate",
+    "Custom Metadata", "Metadata Stream", "Tagged", "UserProperties", "Suspects", "Form",
+    "JavaScript", "Pages", "Encrypted", "Page size", "Page rot", "File size", "Optimized",
+    "PDF version", NULL
+};
+static const char *const archive_fields[] = {
+    "Archive format", "Files in archive", "Directories", "Blocks", "Frames",
+    "Total compressed size", "Total uncompressed size", "Member", "Members inspected", NULL
+};
+
+// One entry per handler and cost; the MIME table below points into these
+static const HandlerEntry text_entry = {
+    "text", get_text_file_info, HANDLER_COST_CHEAP, text_fields
+};
+// PNG, JPEG, GIF, WebP and TIFF walk their chunks or segments to the one
+// they need; BMP has it all in its headers
+static const HandlerEntry image_walk_entry = {
+    "image", get_image_info, HANDLER_COST_CHEAP, image_fields
+};
+// Anything else goes straight to ImageMagick's identify
+static const HandlerEntry image_tool_entry = {
+    "image", get_image_info, HANDLER_COST_EXTERNAL, image_fields
+};
+// MP4 boxes and Matroska elements can sit anywhere, moov often at the end
+static const HandlerEntry video_walk_entry = {
+    "video", get_video_duration, HANDLER_COST_CHEAP, video_fields
+};
+// Other containers are handed to ffprobe
+static const HandlerEntry video_tool_entry = {
+    "video", get_video_duration, HANDLER_COST_EXTERNAL, video_fields
+};
+// The cross-reference table is found from the tail and points anywhere
+static const HandlerEntry pdf_entry = {
+    "pdf", get_pdf_info, HANDLER_COST_CHEAP, pdf_fields
+};
+// Zip's central directory is at the end, tar and zstd are walked from the
+// start, gzip has its size in the last four bytes
+static const HandlerEntry archive_walk_entry = {
+    "archive", get_archive_info, HANDLER_COST_CHEAP, archive_fields
+};
+// Formats without an in-process index are listed by 7z
+static const HandlerEntry archive_tool_entry = {
+    "archive", get_archive_info, HANDLER_COST_EXTERNAL, archive_fields
+};
+
+// A MIME type, as libmagic reports it, and its handler
+typedef struct {
+    const char *mime_type;
+    const HandlerEntry *entry;
+} MimeHandler;
+
+// Exact MIME types; types not listed fall back to their major type below
+static const MimeHandler mime_handlers[] = {
+    // Structured text that libmagic files under application/
+    { "application/json", &text_entry },
+    { "application/javascript", &text_entry },
+    { "application/xml", &text_entry },
+    { "application/x-ndjson", &text_entry },
+    { "application/postscript", &text_entry },
+    // Images with an in-process header parser
+    { "image/png", &image_walk_entry },
+    { "image/apng", &image_walk_entry },
+    { "image/jpeg", &image_walk_entry },
+    { "image/gif", &image_walk_entry },
+    { "image/webp", &image_walk_entry },
+    { "image/tiff", &image_walk_entry },
+    { "image/bmp", &image_walk_entry },
+    { "image/x-ms-bmp", &image_walk_entry },
+    // ISO media and Matroska
+    { "video/mp4", &video_walk_entry },
+    { "video/quicktime", &video_walk_entry },
+    { "video/3gpp", &video_walk_entry },
+    { "video/3gpp2", &video_walk_entry },
+    { "video/x-m4v", &video_walk_entry },
+    { "video/x-matroska", &video_walk_entry },
+    { "video/webm", &video_walk_entry },
+    { "audio/mp4", &video_walk_entry },
+    { "audio/x-m4a", &video_walk_entry },
+    // Documents
+    { "application/pdf", &pdf_entry },
+    // Archives and compressed files
+    { "application/zip", &archive_walk_entry },
+    { "application/x-tar", &archive_walk_entry },
+    { "application/gzip", &archive_walk_entry },
+    { "application/x-gzip", &archive_walk_entry },
+    { "application/x-xz", &archive_walk_entry },
+    { "application/zstd", &archive_walk_entry },
+    { "application/x-zstd", &archive_walk_entry },
+    { "application/x-7z-compressed", &archive_tool_entry },
+    { "application/x-rar", &archive_tool_entry },
+    { "application/vnd.rar", &archive_tool_entry },
+    { "application/x-bzip2", &archive_tool_entry },
+    { "application/x-lzip", &archive_tool_entry },
+    { "application/x-lzma", &archive_tool_entry },
+    { "application/x-archive", &archive_tool_entry },
+    { "application/x-cpio", &archive_tool_entry },
+    { "application/vnd.ms-cab-compressed", &archive_tool_entry },
+};
+
+// Major types whose every subtype has a handler
+static const MimeHandler prefix_handlers[] = {
+    { "text/", &text_entry },
+    { "image/", &image_tool_entry },
+    { "video/", &video_tool_entry },
+};
+
+// Open-addressed index over mime_handlers; a power of two at least twice as
+// large as the table, so probes stay short
+#define INDEX_SIZE 128
+static const MimeHandler *mime_index[INDEX_SIZE];
+static pthread_once_t mime_index_once = PTHREAD_ONCE_INIT;
+
+// FNV-1a over a NUL-terminated string
+static uint32_t hash_mime(const char *s) {
+    uint32_t hash = 2166136261u;
+    for (; *s != '\0'; s++) {
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
+    }
+    return hash;
+}
+
+// Fill the index once, from whichever thread looks something up first
+static void build_mime_index(void) {
+    _Static_assert(sizeof(mime_handlers) / sizeof(mime_handlers[0]) <= INDEX_SIZE / 2,
+                   "INDEX_SIZE too small for mime_handlers");
+    for (size_t i = 0; i < sizeof(mime_handlers) / sizeof(mime_handlers[0]); i++) {
+        uint32_t slot = hash_mime(mime_handlers[i].mime_type) & (INDEX_SIZE - 1);
+        while (mime_index[slot] != NULL) {
+            slot = (slot + 1) & (INDEX_SIZE - 1);
+        }
+        mime_index[slot] = &mime_handlers[i];
+    }
+}
+
+// Find the handler for a MIME type
+const HandlerEntry *find_handler(const char *mime_type) {
+    pthread_once(&mime_index_once, build_mime_index);
+    // An exact entry wins over the major type
+    uint32_t slot = hash_mime(mime_type) & (INDEX_SIZE - 1);
+    while (mime_index[slot] != NULL) {
+        if (strcmp(mime_index[slot]->mime_type, mime_type) == 0) {
+            return mime_index[slot]->entry;
+        }
+        slot = (slot + 1) & (INDEX_SIZE - 1);
+    }
+    for (size_t i = 0; i < sizeof(prefix_handlers) / sizeof(prefix_handlers[0]); i++) {
+        const char *prefix = prefix_handlers[i].mime_type;
+        if (strncmp(mime_type, prefix, strlen(prefix)) == 0) {
+            return prefix_handlers[i].entry;
+        }
+    }
+    return NULL;
+}
+
+// Whether the handler reports any of the fields
+int handler_wanted(const HandlerEntry *entry, const FieldSelection *fields) {
+    if (fields == NULL) {
+        return 1;
+    }
+    for (const char *const *key = entry->fields; *key != NULL; key++) {
+        if (field_wanted(fields, *key)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "file_info.h"
+
+// A handler and what it needs, for one group of MIME types
+typedef struct {
+    const char *name;               // Short name, as --profile prints it
+    void (*run)(FileContext *ctx);  // Adds the handler's fields to ctx
+    HandlerCost cost;               // Whether the handler spawns a tool (file_info.h)
+    const char *const *fields;      // Keys it may report, NULL-terminated
+} HandlerEntry;
+
+// Find the handler for a MIME type: an exact entry, else one for its major
+// type ("text/", "image/", "video/"). Returns NULL when no handler applies.
+const HandlerEntry *find_handler(const char *mime_type);
+// Whether the handler reports any of the fields (all of them when NULL)
+int handler_wanted(const HandlerEntry *entry, const FieldSelection *fields);
+
+#endif // REGISTRY_H
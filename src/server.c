@@ -0,0 +1,672 @@
+// Define _GNU_SOURCE to enable accept4(), signalfd() and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "server.h"       // Declarations for the functions defined in this file
+#include "detect.h"       // Preloading magic cookies before the first request
+#include "utils.h"        // stop_tools_when_readable()
+#include <errno.h>        // errno, EINTR, EMFILE, ENFILE
+#include <poll.h>         // poll()
+#include <pthread.h>      // Connection and writer threads
+#include <signal.h>       // sigset_t, pthread_sigmask()
+#include <stdio.h>        // fprintf()
+#include <stdlib.h>       // malloc(), realloc(), free()
+#include <string.h>       // memcpy(), strlen(), strerror()
+#include <sys/signalfd.h> // signalfd() for a clean shutdown
+#include <sys/socket.h>   // socket(), bind(), listen(), accept4(), send(), recv()
+#include <sys/stat.h>     // umask()
+#include <sys/un.h>       // struct sockaddr_un
+#include <unistd.h>       // close(), unlink(), getcwd()
+
+// Frames larger than this are treated as a broken peer
+#define MAX_FRAME_LENGTH (16u << 20)
+// The client sends paths in batches of about this many bytes
+#define CLIENT_FLUSH_SIZE 4096
+// Pause before accepting again once descriptors or memory ran out
+#define ACCEPT_RETRY_MS 100
+
+// Frame types; see server.h
+enum {
+    FRAME_OPTIONS = 'O',
+    FRAME_FIELDS = 'F',
+    FRAME_PATH = 'P',
+    FRAME_END = 'E',
+    FRAME_RESULT = 'R',
+    FRAME_DONE = 'D'
+};
+
+// A growable byte buffer frames are assembled in
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} FrameBuffer;
+
+// ---------------------------------------------------------------------------
+// Framing
+// ---------------------------------------------------------------------------
+
+// Write all of buf; never raises SIGPIPE. Returns 0, or -1 if the peer is gone
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Read exactly len bytes. Returns 0, or -1 on error or end of stream
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Make room for n more bytes
+static int buffer_reserve(FrameBuffer *b, size_t n) {
+    if (b->len + n <= b->cap) {
+        return 0;
+    }
+    size_t cap = b->cap ? b->cap : 1024;
+    while (cap < b->len + n) {
+        cap *= 2;
+    }
+    unsigned char *data = realloc(b->data, cap);
+    if (data == NULL) {
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Append a frame header; the length is patched by end_frame()
+static int begin_frame(FrameBuffer *b, int type, size_t *start) {
+    if (buffer_reserve(b, 5) != 0) {
+        return -1;
+    }
+    *start = b->len;
+    b->data[b->len] = (unsigned char)type;
+    b->len += 5;
+    return 0;
+}
+
+static void end_frame(FrameBuffer *b, size_t start) {
+    put_u32(b->data + start + 1, (uint32_t)(b->len - start - 5));
+}
+
+// Append raw bytes to the frame being built
+static int put_bytes(FrameBuffer *b, const void *p, size_t n) {
+    if (buffer_reserve(b, n) != 0) {
+        return -1;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+// Append a string preceded by its u32 length
+static int put_string(FrameBuffer *b, const char *s) {
+    unsigned char len[4];
+    size_t n = strlen(s);
+    put_u32(len, (uint32_t)n);
+    return put_bytes(b, len, 4) == 0 && put_bytes(b, s, n) == 0 ? 0 : -1;
+}
+
+// Read one frame; the payload is malloc'd and NUL-terminated for convenience
+// Returns 0, or -1 on error, end of stream or an oversized frame
+static int read_frame(int fd, int *type, char **payload, uint32_t *length) {
+    unsigned char header[5];
+    if (read_full(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    *type = header[0];
+    *length = get_u32(header + 1);
+    if (*length > MAX_FRAME_LENGTH) {
+        return -1;
+    }
+    *payload = malloc(*length + 1);
+    if (*payload == NULL) {
+        return -1;
+    }
+    if (read_full(fd, *payload, *length) != 0) {
+        free(*payload);
+        return -1;
+    }
+    (*payload)[*length] = '\0';
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Server
+// ---------------------------------------------------------------------------
+
+// One client connection being served
+typedef struct Connection {
+    int fd;
+    BatchOptions opts;         // The server's options, adjusted for this client
+    FieldSelection fields;     // Fields the client asked for, if it sent any
+    int ended;                 // Set once the client sent 'E' or hung up
+    int broken;                // Set once a write failed; later results are dropped
+    char *pending[2];          // Paths read ahead while choosing the job count
+    int pending_count;
+    FrameBuffer out;           // Result frame being assembled
+    struct Connection *next;   // Next entry in the list of open connections
+} Connection;
+
+// Open connections, so shutdown can stop their reads
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connections_done = PTHREAD_COND_INITIALIZER;
+static Connection *connections = NULL;
+
+// Read the next path the client sent, handling any other frames on the way
+static char *read_path(Connection *conn) {
+    while (!conn->ended) {
+        int type;
+        char *payload;
+        uint32_t length;
+        if (read_frame(conn->fd, &type, &payload, &length) != 0) {
+            conn->ended = 1;
+            break;
+        }
+        if (type == FRAME_PATH && length > 0) {
+            return payload;
+        }
+        if (type == FRAME_OPTIONS && length > 0) {
+            conn->opts.unordered = payload[0] & 1;
+            // A client may rule out tools for itself, never allow them
+            if (payload[0] & 2) {
+                conn->opts.max_cost = HANDLER_COST_CHEAP;
+            }
+            if (payload[0] & 4) {
+                conn->opts.max_cost = HANDLER_COST_CHEAP;
+                conn->opts.read_limit = FAST_READ_LIMIT;
+            }
+            // Bits 3 and 4 choose a digest, in place of the server's own
+            int digest = (payload[0] >> 3) & 3;
+            if (digest != DIGEST_NONE) {
+                conn->opts.digest = (DigestAlgorithm)digest;
+            }
+            // Bits 5 and 6 turn the signature table on or to checking
+            int sniff = (payload[0] >> 5) & 3;
+            if (sniff == SNIFF_ON || sniff == SNIFF_CHECK) {
+                conn->opts.sniff = (SniffMode)sniff;
+            }
+            // Newer clients follow with the --estimate budget in KiB
+            if (length >= 5) {
+                uint32_t budget = get_u32((const unsigned char *)payload + 1);
+                if (budget != 0) {
+                    conn->opts.estimate_budget = (uint64_t)budget << 10;
+                }
+            }
+            // ... and then the --deep depth and budget in KiB
+            if (length >= 10 && payload[5] != 0) {
+                unsigned depth = (unsigned char)payload[5];
+                conn->opts.deep_depth = depth < DEEP_MAX_DEPTH ? depth : DEEP_MAX_DEPTH;
+                conn->opts.deep_budget = (uint64_t)get_u32((const unsigned char *)payload + 6) << 10;
+            }
+        } else if (type == FRAME_FIELDS && conn->fields.count == 0 &&
+                   parse_fields(payload, &conn->fields) == 0) {
+            conn->opts.fields = &conn->fields;
+        } else if (type == FRAME_END) {
+            conn->ended = 1;
+        }
+        // Anything else is skipped, so newer clients can add frame types
+        free(payload);
+    }
+    return NULL;
+}
+
+// Next path from the client, after any that were read ahead
+static char *connection_next(void *arg) {
+    Connection *conn = arg;
+    if (conn->pending_count > 0) {
+        char *path = conn->pending[0];
+        conn->pending[0] = conn->pending[1];
+        conn->pending_count--;
+        return path;
+    }
+    return read_path(conn);
+}
+
+// Send one finished file back to the client
+static void connection_sink(const FileContext *ctx, void *arg) {
+    Connection *conn = arg;
+    if (conn->broken) {
+        return;
+    }
+    FrameBuffer *b = &conn->out;
+    b->len = 0;
+    size_t start;
+    unsigned char count[4];
+    unsigned char flags = ctx->failed ? 1 : 0;
+    put_u32(count, (uint32_t)ctx->info.size);
+    int status = begin_frame(b, FRAME_RESULT, &start) | put_bytes(b, &flags, 1) |
+                 put_string(b, ctx->path) | put_bytes(b, count, 4);
+    for (size_t i = 0; i < ctx->info.size && status == 0; i++) {
+        status = put_string(b, ctx->info.data[i].key) | put_string(b, ctx->info.data[i].value);
+    }
+    if (status == 0) {
+        end_frame(b, start);
+        status = write_full(conn->fd, b->data, b->len);
+    }
+    if (status != 0) {
+        // Nobody is listening any more: stop reading paths so the batch
+        // drains instead of analyzing the rest of the client's list
+        conn->broken = 1;
+        shutdown(conn->fd, SHUT_RD);
+    }
+}
+
+// Serve one client: analyze its paths, then report how many failed
+static void *connection_thread(void *arg) {
+    Connection *conn = arg;
+
+    // A lone path (the common upload-hook case) needs no read-ahead, and
+    // no window of slots beyond its own
+    char *path;
+    while (conn->pending_count < 2 && (path = read_path(conn)) != NULL) {
+        conn->pending[conn->pending_count++] = path;
+    }
+    if (conn->pending_count < 2) {
+        conn->opts.jobs = 1;
+        conn->opts.prefetch_depth = 0;
+    }
+
+    size_t failed = batch_run(&conn->opts, connection_next, conn, connection_sink, conn);
+
+    unsigned char done[9] = { FRAME_DONE };
+    put_u32(done + 1, 4);
+    put_u32(done + 5, (uint32_t)failed);
+    if (!conn->broken) {
+        write_full(conn->fd, done, sizeof(done));
+    }
+
+    // Leave the list of open connections
+    pthread_mutex_lock(&connections_lock);
+    Connection **link = &connections;
+    while (*link != conn) {
+        link = &(*link)->next;
+    }
+    *link = conn->next;
+    pthread_cond_broadcast(&connections_done);
+    pthread_mutex_unlock(&connections_lock);
+
+    close(conn->fd);
+    free(conn->out.data);
+    free_fields(&conn->fields);
+    free(conn);
+    return NULL;
+}
+
+// Bind a listening socket at path, replacing a stale socket file left by a
+// server that is no longer running. Returns the descriptor or -1
+static int listen_at(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Cannot serve: socket path too long: %s\n", path);
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        fprintf(stderr, "Cannot create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    // Only the owner may connect
+    mode_t old_mask = umask(077);
+    int status = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (status != 0 && errno == EADDRINUSE) {
+        // Someone answering means the socket is live; otherwise it is stale
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe != -1 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) != 0 &&
+            errno == ECONNREFUSED) {
+            unlink(path);
+            status = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe != -1) {
+            close(probe);
+        }
+    }
+    umask(old_mask);
+    if (status != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve(const char *socket_path, const BatchOptions *opts) {
+    // SIGINT and SIGTERM are read from a descriptor, so no thread is
+    // interrupted and the accept loop can stop cleanly
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        fprintf(stderr, "Cannot watch for signals: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int listen_fd = listen_at(socket_path);
+    if (listen_fd == -1) {
+        close(signal_fd);
+        return -1;
+    }
+    stop_tools_when_readable(signal_fd);  // The tools would outlive us
+
+    // Load a cookie per worker now rather than on the first request
+    detect_preload(opts->jobs);
+
+    // One pool of -j workers analyzes the files of every client, so -j
+    // bounds the whole server however many clients there are; without it
+    // each client gets workers of its own
+    BatchOptions shared = *opts;
+    shared.pool = batch_pool_start(opts->jobs);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    struct pollfd fds[2] = {
+        { .fd = listen_fd, .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+    for (;;) {
+        int ready = poll(fds, 2, fds[0].fd == -1 ? ACCEPT_RETRY_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Cannot wait for connections: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;  // Asked to stop
+        }
+        if (ready == 0) {
+            fds[0].fd = listen_fd;  // Paused long enough, try again
+            continue;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            // The listener stays readable while descriptors or memory are
+            // short, so leave it out of the poll for a while instead of
+            // spinning on it; a client that gave up already needs nothing
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                fds[0].fd = -1;
+            }
+            continue;
+        }
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->opts = shared;
+
+        pthread_mutex_lock(&connections_lock);
+        conn->next = connections;
+        connections = conn;
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, connection_thread, conn) != 0) {
+            connections = conn->next;
+            close(fd);
+            free(conn);
+        }
+        pthread_mutex_unlock(&connections_lock);
+    }
+
+    // Stop accepting, end every client's input and let them finish
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&connections_lock);
+    for (Connection *conn = connections; conn != NULL; conn = conn->next) {
+        shutdown(conn->fd, SHUT_RD);
+    }
+    while (connections != NULL) {
+        pthread_cond_wait(&connections_done, &connections_lock);
+    }
+    pthread_mutex_unlock(&connections_lock);
+
+    batch_pool_stop(shared.pool);
+    pthread_attr_destroy(&attr);
+    stop_tools_when_readable(-1);
+    close(signal_fd);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Client
+// ---------------------------------------------------------------------------
+
+// State of the thread that sends paths while the results are read
+typedef struct {
+    int fd;
+    const BatchOptions *opts;
+    BatchSource source;
+    void *source_arg;
+    const char *cwd;    // The client's working directory, or NULL if unknown
+} ClientWriter;
+
+// The server resolves paths against its own working directory, so relative
+// ones go out with the client's in front. The "/./" after it marks what was
+// added, and it comes off the paths in the results again, so they read as
+// they were given.
+#define CLIENT_CWD_MARK "/./"
+
+// Send the options, every path and the end marker, a few KiB at a time
+static void *client_writer(void *arg) {
+    ClientWriter *writer = arg;
+    FrameBuffer b = { 0 };
+    size_t start;
+    const BatchOptions *opts = writer->opts;
+    unsigned char flags = (opts->unordered ? 1 : 0) |
+                          (opts->max_cost < HANDLER_COST_EXTERNAL ? 2 : 0) |
+                          (opts->read_limit != 0 ? 4 : 0) |
+                          (unsigned char)(opts->digest << 3) |
+                          (unsigned char)(opts->sniff << 5);
+    // The --estimate budget in KiB follows, then the --deep depth and
+    // budget in KiB; servers that predate them read only what they know
+    unsigned char extra[9];
+    put_u32(extra, (uint32_t)(opts->estimate_budget >> 10));
+    extra[4] = (unsigned char)opts->deep_depth;
+    put_u32(extra + 5, (uint32_t)(opts->deep_budget >> 10));
+    int status = begin_frame(&b, FRAME_OPTIONS, &start) | put_bytes(&b, &flags, 1) |
+                 put_bytes(&b, extra, sizeof(extra));
+    if (status == 0) {
+        end_frame(&b, start);
+    }
+    // The field names go back out as the list they were parsed from
+    if (status == 0 && opts->fields != NULL) {
+        status = begin_frame(&b, FRAME_FIELDS, &start);
+        for (size_t i = 0; status == 0 && i < opts->fields->count; i++) {
+            const char *name = opts->fields->names[i];
+            status = (i > 0 ? put_bytes(&b, ",", 1) : 0) | put_bytes(&b, name, strlen(name));
+        }
+        if (status == 0) {
+            end_frame(&b, start);
+        }
+    }
+
+    char *path;
+    while (status == 0 && (path = writer->source(writer->source_arg)) != NULL) {
+        status = begin_frame(&b, FRAME_PATH, &start);
+        if (path[0] != '/' && writer->cwd != NULL) {
+            status |= put_bytes(&b, writer->cwd, strlen(writer->cwd)) |
+                      put_bytes(&b, CLIENT_CWD_MARK, strlen(CLIENT_CWD_MARK));
+        }
+        status |= put_bytes(&b, path, strlen(path));
+        free(path);
+        if (status == 0) {
+            end_frame(&b, start);
+        }
+        if (status == 0 && b.len >= CLIENT_FLUSH_SIZE) {
+            status = write_full(writer->fd, b.data, b.len);
+            b.len = 0;
+        }
+    }
+    if (status == 0 && begin_frame(&b, FRAME_END, &start) == 0) {
+        end_frame(&b, start);
+        write_full(writer->fd, b.data, b.len);
+    }
+    // Closing our side tells the server no more paths are coming even if
+    // the end marker could not be sent
+    shutdown(writer->fd, SHUT_WR);
+    free(b.data);
+    return NULL;
+}
+
+// Rebuild a finished file from a result frame and hand it to sink
+// Returns 0, or -1 if the frame is malformed
+static int deliver_result(FileContext *ctx, const unsigned char *p, uint32_t length,
+                          const char *cwd, BatchSink sink, void *sink_arg) {
+    const unsigned char *end = p + length;
+    reset_file_context(ctx, NULL);
+    Arena *arena = &ctx->info.arena;
+
+    if (end - p < 5) {
+        return -1;
+    }
+    ctx->failed = p[0] & 1;
+    uint32_t n = get_u32(p + 1);
+    p += 5;
+    if ((uint32_t)(end - p) < n) {
+        return -1;
+    }
+    // Relative paths were sent with the working directory in front
+    size_t added = cwd != NULL ? strlen(cwd) + strlen(CLIENT_CWD_MARK) : 0;
+    if (added > 0 && n > added && memcmp(p, cwd, added - strlen(CLIENT_CWD_MARK)) == 0 &&
+        memcmp(p + added - strlen(CLIENT_CWD_MARK), CLIENT_CWD_MARK, strlen(CLIENT_CWD_MARK)) == 0) {
+        ctx->path = arena_strndup(arena, (const char *)p + added, n - added);
+    } else {
+        ctx->path = arena_strndup(arena, (const char *)p, n);
+    }
+    p += n;
+
+    if (end - p < 4) {
+        return -1;
+    }
+    uint32_t count = get_u32(p);
+    p += 4;
+    for (uint32_t i = 0; i < count; i++) {
+        const char *strings[2];
+        for (int s = 0; s < 2; s++) {
+            if (end - p < 4 || (uint32_t)(end - p - 4) < get_u32(p)) {
+                return -1;
+            }
+            n = get_u32(p);
+            strings[s] = arena_strndup(arena, (const char *)p + 4, n);
+            p += 4 + n;
+        }
+        if (strings[0] != NULL && strings[1] != NULL) {
+            add_info_borrowed(&ctx->info, strings[0], strings[1]);
+        }
+    }
+    if (ctx->path == NULL) {
+        return -1;
+    }
+    // Only the server knows why it failed and said so on its own stderr
+    if (ctx->failed) {
+        fprintf(stderr, "Cannot examine file: %s\n", ctx->path);
+    }
+    sink(ctx, sink_arg);
+    return 0;
+}
+
+long run_client(const char *socket_path, const BatchOptions *opts, BatchSource source,
+                void *source_arg, BatchSink sink, void *sink_arg) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memcpy(addr.sun_path, socket_path, strlen(socket_path) + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Paths go out on a second thread, so neither side can stall the other
+    // when a long list fills the socket buffers in both directions
+    char *cwd = getcwd(NULL, 0);
+    ClientWriter writer = { fd, opts, source, source_arg, cwd };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, client_writer, &writer) != 0) {
+        free(cwd);
+        close(fd);
+        return -1;
+    }
+
+    FileContext ctx;
+    init_file_context(&ctx, NULL);
+    long failed = -2;  // Still waiting for the done frame
+    int type;
+    char *payload;
+    uint32_t length;
+    while (failed == -2 && read_frame(fd, &type, &payload, &length) == 0) {
+        if (type == FRAME_RESULT) {
+            if (deliver_result(&ctx, (const unsigned char *)payload, length, cwd, sink, sink_arg) != 0) {
+                free(payload);
+                break;
+            }
+        } else if (type == FRAME_DONE && length >= 4) {
+            failed = get_u32((const unsigned char *)payload);
+        }
+        free(payload);
+    }
+    if (failed == -2) {
+        fprintf(stderr, "Cannot read results from %s\n", socket_path);
+        failed = 1;
+        // Unblock the writer if it is still sending
+        shutdown(fd, SHUT_RDWR);
+    }
+
+    pthread_join(thread, NULL);
+    free(cwd);
+    free_file_context(&ctx);
+    close(fd);
+    return failed;
+}
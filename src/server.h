@@ -0,0 +1,40 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "batch.h"
+
+// A resident inf keeps its magic cookies loaded and answers requests on a
+// Unix domain socket. Both directions use frames made of a one-byte type, a
+// four-byte big-endian payload length and the payload:
+//
+//   client -> server  'O' options: one byte, bit 0 set for unordered output,
+//                     bit 1 to run no external tools, bit 2 for --fast,
+//                     bits 3-4 for the --hash digest (a DigestAlgorithm)
+//                     bits 5-6 for the --sniff mode (a SniffMode);
+//                     then the --estimate budget in KiB as a u32, 0 for off;
+//                     then the --deep depth in one byte, 0 for off, and its
+//                     budget in KiB as a u32
+//                     'F' comma-separated names of the fields to report
+//                     'P' a path to analyze, resolved against the server's
+//                         working directory (clients send absolute ones)
+//                     'E' no more paths
+//   server -> client  'R' a result: flags (bit 0: failed), the path and its
+//                         entries, every string preceded by its u32 length
+//                     'D' done: u32 count of files that could not be examined
+
+// Serve requests on socket_path until SIGINT or SIGTERM, analyzing each
+// connection's paths with the given batch options on opts->jobs workers
+// shared by all connections
+// Returns 0 after a clean shutdown, -1 if the socket cannot be set up
+int serve(const char *socket_path, const BatchOptions *opts);
+
+// Send every path from source to the server at socket_path and pass the
+// results to sink in the order the server sends them
+// Returns the number of files that could not be examined, or -1 if the
+// server cannot be reached (nothing has been sent to sink in that case)
+// Only the options a client may choose (-u, --no-tools, --fast, --fields,
+// --hash, --sniff, --estimate, --deep) are passed on; the server's own options decide the rest
+long run_client(const char *socket_path, const BatchOptions *opts, BatchSource source,
+                void *source_arg, BatchSink sink, void *sink_arg);
+
+#endif // SERVER_H
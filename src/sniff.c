@@ -0,0 +1,580 @@
+// Include necessary header files
+#include "sniff.h"      // Declarations for this file
+#include <ctype.h>      // isalnum(), isupper()
+#include <pthread.h>    // pthread_once() for building the index
+#include <stdint.h>     // uint8_t, uint32_t
+#include <string.h>     // memcmp(), memchr()
+#include <strings.h>    // strncasecmp()
+
+// libmagic runs thousands of rules over every file. Most files are one of a
+// few dozen formats that a handful of leading bytes settle, so these are
+// looked up in a table first: the head's first byte picks the signatures that
+// can match, and each is compared in full. The answers are the MIME types
+// this build's libmagic gives for the same bytes (--sniff=check compares the
+// two); where libmagic looks further, to tell a JAR from a ZIP or a PIE from
+// a shared library, the table leaves the file to it.
+
+// Bytes of the head scanned for Matroska's DocType
+#define EBML_SCAN_BYTES 64
+// Where the ustar magic and the header checksum sit in a tar header
+#define TAR_MAGIC_OFFSET 257
+#define TAR_CHECKSUM_OFFSET 148
+#define TAR_HEADER_BYTES 512
+// Bytes of text searched for signs of source code or other text formats
+#define TEXT_SCAN_BYTES 8192
+// Lines libmagic's CSV test looks at before it decides
+#define CSV_LINES 10
+
+// The types the table reports
+static const SniffType png_type = { "image/png", "PNG image data" };
+static const SniffType jpeg_type = { "image/jpeg", "JPEG image data" };
+static const SniffType gif_type = { "image/gif", "GIF image data" };
+static const SniffType webp_type = { "image/webp", "RIFF (little-endian) data, Web/P image" };
+static const SniffType tiff_type = { "image/tiff", "TIFF image data" };
+static const SniffType bigtiff_type = { "image/tiff", "Big TIFF image data" };
+static const SniffType bmp_type = { "image/bmp", "PC bitmap" };
+static const SniffType wav_type = { "audio/x-wav", "RIFF (little-endian) data, WAVE audio" };
+static const SniffType avi_type = { "video/x-msvideo", "RIFF (little-endian) data, AVI" };
+static const SniffType flac_type = { "audio/flac", "FLAC audio bitstream data" };
+static const SniffType matroska_type = { "video/x-matroska", "Matroska data" };
+static const SniffType webm_type = { "video/webm", "WebM" };
+static const SniffType pdf_type = { "application/pdf", "PDF document" };
+static const SniffType zip_type = { "application/zip", "Zip archive data" };
+static const SniffType gzip_type = { "application/gzip", "gzip compressed data" };
+static const SniffType xz_type = { "application/x-xz", "XZ compressed data" };
+static const SniffType zstd_type = { "application/zstd", "Zstandard compressed data" };
+static const SniffType bzip2_type = { "application/x-bzip2", "bzip2 compressed data" };
+static const SniffType lzip_type = { "application/x-lzip", "lzip compressed data" };
+static const SniffType sevenzip_type = { "application/x-7z-compressed", "7-zip archive data" };
+static const SniffType rar_type = { "application/x-rar", "RAR archive data" };
+static const SniffType tar_type = { "application/x-tar", "POSIX tar archive" };
+static const SniffType sqlite_type = { "application/vnd.sqlite3", "SQLite 3.x database" };
+static const SniffType wasm_type = { "application/wasm", "WebAssembly (wasm) binary module" };
+static const SniffType object_type = { "application/x-object", "ELF relocatable" };
+static const SniffType executable_type = { "application/x-executable", "ELF executable" };
+static const SniffType core_type = { "application/x-coredump", "ELF core file" };
+static const SniffType ascii_type = { "text/plain", "ASCII text" };
+static const SniffType utf8_type = { "text/plain", "Unicode text, UTF-8 text" };
+static const SniffType utf8_bom_type = { "text/plain", "Unicode text, UTF-8 (with BOM) text" };
+
+// ISO media major brands (ftyp, offset 8) and what libmagic makes of them
+typedef struct {
+    char brand[5];
+    SniffType type;
+} IsoBrand;
+
+static const IsoBrand iso_brands[] = {
+    { "isom", { "video/mp4", "ISO Media, MP4 Base Media v1" } },
+    { "iso2", { "video/mp4", "ISO Media, MP4 Base Media v2" } },
+    { "iso3", { "video/mp4", "ISO Media, MP4 Base Media" } },
+    { "iso4", { "video/mp4", "ISO Media, MP4 Base Media v4" } },
+    { "iso5", { "video/mp4", "ISO Media, MP4 Base Media v5" } },
+    { "iso6", { "video/mp4", "ISO Media, MP4 Base Media v6" } },
+    { "isml", { "video/mp4", "ISO Media, MP4 Base Media v2" } },
+    { "mp41", { "video/mp4", "ISO Media, MP4 v1" } },
+    { "mp42", { "video/mp4", "ISO Media, MP4 v2" } },
+    { "avc1", { "video/mp4", "ISO Media, MPEG v4 system, 3GPP JVT AVC" } },
+    { "dash", { "video/mp4", "ISO Media, MPEG v4 system, Dynamic Adaptive Streaming over HTTP" } },
+    { "M4V ", { "video/x-m4v", "ISO Media, Apple iTunes Video (.M4V) Video" } },
+    { "M4A ", { "audio/x-m4a", "ISO Media, Apple iTunes ALAC/AAC-LC (.M4A) Audio" } },
+    { "M4B ", { "audio/mp4", "ISO Media, Apple iTunes ALAC/AAC-LC (.M4B) Audio Book" } },
+    { "qt  ", { "video/quicktime", "ISO Media, Apple QuickTime movie" } },
+    { "3gp4", { "video/3gpp", "ISO Media, MPEG v4 system, 3GPP" } },
+    { "3gp5", { "video/3gpp", "ISO Media, MPEG v4 system, 3GPP" } },
+    { "3gp6", { "video/3gpp", "ISO Media, MPEG v4 system, 3GPP" } },
+    { "3gp7", { "video/3gpp", "ISO Media, MPEG v4 system, 3GPP" } },
+    { "3g2a", { "video/3gpp2", "ISO Media, MPEG v4 system, 3GPP2" } },
+    { "3g2b", { "video/3gpp2", "ISO Media, MPEG v4 system, 3GPP2" } },
+    { "3g2c", { "video/3gpp2", "ISO Media, MPEG v4 system, 3GPP2" } },
+    { "heic", { "image/heic", "ISO Media, HEIF Image HEVC Main or Main Still Picture Profile" } },
+    { "heix", { "image/heic", "ISO Media, HEIF Image HEVC Main 10 Profile" } },
+    { "mif1", { "image/heif", "ISO Media, HEIF Image" } },
+    { "avif", { "image/avif", "ISO Media, AVIF Image" } },
+};
+
+// A Zip's first entry names these when the archive is a document, a Java or
+// Android package, and so on, which libmagic tells apart
+static const char *const zip_special_entries[] = {
+    "mimetype", "META-INF/", "[Content_Types].xml", "_rels/", "docProps/", "word/", "xl/",
+    "ppt/", "AndroidManifest.xml", "classes.dex", "resources.arsc", "res/", "doc.kml",
+};
+
+// Read little- and big-endian integers from the head
+static uint32_t le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint16_t be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// GIF87a or GIF89a
+static const SniffType *sniff_gif(const unsigned char *head, size_t length) {
+    if (length < 6 || (head[4] != '7' && head[4] != '9') || head[5] != 'a') {
+        return NULL;
+    }
+    return &gif_type;
+}
+
+// TIFF, unless it is a Canon raw file built on it
+static const SniffType *sniff_tiff(const unsigned char *head, size_t length) {
+    if (length >= 10 && head[0] == 'I' && head[8] == 'C' && head[9] == 'R') {
+        return NULL;
+    }
+    return &tiff_type;
+}
+
+// A Windows or OS/2 bitmap has an info header of one of the known sizes
+static const SniffType *sniff_bmp(const unsigned char *head, size_t length) {
+    if (length < 18) {
+        return NULL;
+    }
+    switch (le32(head + 14)) {
+    case 12: case 40: case 52: case 56: case 64: case 108: case 124:
+        return &bmp_type;
+    default:
+        return NULL;
+    }
+}
+
+// RIFF holds WebP images, WAVE audio and AVI video
+static const SniffType *sniff_riff(const unsigned char *head, size_t length) {
+    if (length < 12) {
+        return NULL;
+    }
+    if (memcmp(head + 8, "WEBP", 4) == 0) {
+        return &webp_type;
+    }
+    if (memcmp(head + 8, "WAVE", 4) == 0) {
+        return &wav_type;
+    }
+    if (memcmp(head + 8, "AVI ", 4) == 0) {
+        return &avi_type;
+    }
+    return NULL;
+}
+
+// The EBML header names the document type, Matroska or WebM
+static const SniffType *sniff_ebml(const unsigned char *head, size_t length) {
+    size_t end = length < EBML_SCAN_BYTES ? length : EBML_SCAN_BYTES;
+    // DocType is element 0x4282 with a one-byte size
+    for (size_t i = 4; i + 3 <= end; i++) {
+        if (head[i] != 0x42 || head[i + 1] != 0x82) {
+            continue;
+        }
+        size_t size = head[i + 2] & 0x7f;
+        const unsigned char *value = head + i + 3;
+        if (!(head[i + 2] & 0x80) || i + 3 + size > end) {
+            return NULL;
+        }
+        if (size == 8 && memcmp(value, "matroska", 8) == 0) {
+            return &matroska_type;
+        }
+        if (size == 4 && memcmp(value, "webm", 4) == 0) {
+            return &webm_type;
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+// A Zip whose first entry is nothing libmagic files under another type
+static const SniffType *sniff_zip(const unsigned char *head, size_t length) {
+    // The local file header is 30 bytes, followed by the name
+    if (length < 30) {
+        return NULL;
+    }
+    size_t name_length = le16(head + 26);
+    if (30 + name_length > length) {
+        return NULL;
+    }
+    const char *name = (const char *)head + 30;
+    for (size_t i = 0; i < sizeof(zip_special_entries) / sizeof(zip_special_entries[0]); i++) {
+        size_t special = strlen(zip_special_entries[i]);
+        if (name_length >= special && memcmp(name, zip_special_entries[i], special) == 0) {
+            return NULL;
+        }
+    }
+    return &zip_type;
+}
+
+// bzip2 gives the block size as a digit
+static const SniffType *sniff_bzip2(const unsigned char *head, size_t length) {
+    if (length < 4 || head[3] < '1' || head[3] > '9') {
+        return NULL;
+    }
+    return &bzip2_type;
+}
+
+// RAR 1.5 to 4 and RAR 5
+static const SniffType *sniff_rar(const unsigned char *head, size_t length) {
+    if (length < 8 || (head[6] != 0 && (head[6] != 1 || head[7] != 0))) {
+        return NULL;
+    }
+    return &rar_type;
+}
+
+// Relocatable objects, static executables and core files; whether a shared
+// object is a PIE takes libmagic's look at its dynamic section
+static const SniffType *sniff_elf(const unsigned char *head, size_t length) {
+    if (length < 18 || (head[5] != 1 && head[5] != 2)) {
+        return NULL;
+    }
+    uint16_t type = head[5] == 1 ? le16(head + 16) : be16(head + 16);
+    switch (type) {
+    case 1: return &object_type;
+    case 2: return &executable_type;
+    case 4: return &core_type;
+    default: return NULL;
+    }
+}
+
+// ISO base media: the ftyp box comes first and its major brand decides
+static const SniffType *sniff_iso_media(const unsigned char *head, size_t length) {
+    if (length < 12 || memcmp(head + 4, "ftyp", 4) != 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(iso_brands) / sizeof(iso_brands[0]); i++) {
+        if (memcmp(head + 8, iso_brands[i].brand, 4) == 0) {
+            return &iso_brands[i].type;
+        }
+    }
+    return NULL;
+}
+
+// A ustar header whose checksum holds, as libmagic verifies it
+static const SniffType *sniff_tar(const unsigned char *head, size_t length) {
+    if (length < TAR_HEADER_BYTES || memcmp(head + TAR_MAGIC_OFFSET, "ustar", 5) != 0) {
+        return NULL;
+    }
+    // The stored sum is octal, and counts its own field as spaces
+    uint32_t sum = 0;
+    for (size_t i = 0; i < TAR_HEADER_BYTES; i++) {
+        int in_field = i >= TAR_CHECKSUM_OFFSET && i < TAR_CHECKSUM_OFFSET + 8;
+        sum += in_field ? ' ' : head[i];
+    }
+    uint32_t stored = 0;
+    size_t i = TAR_CHECKSUM_OFFSET;
+    while (i < TAR_CHECKSUM_OFFSET + 8 && head[i] == ' ') {
+        i++;
+    }
+    int digits = 0;
+    for (; i < TAR_CHECKSUM_OFFSET + 8 && head[i] >= '0' && head[i] <= '7'; i++, digits++) {
+        stored = stored * 8 + (uint32_t)(head[i] - '0');
+    }
+    if (digits == 0 || stored != sum) {
+        return NULL;
+    }
+    return &tar_type;
+}
+
+// Characters that open scripts, markup, JSON, troff and the like
+static const char markup_starts[] = "<{[%@.\\:;!$'(=+";
+// Characters that hardly occur in prose but in JSON, C and their kin
+static const char code_chars[] = "{}\\";
+// How mail, news and a few other text formats libmagic knows begin
+static const char *const text_headers[] = {
+    "From:", "From ", "Date:", "Path:", "Xref:", "Received:", "Relay-Version:", "Article",
+    "Pipe to", "Forward to", "MIME-Version:", "Content-Type:", "Return-Path:", "Delivered-To:",
+    "Newsgroups:", "Subject:", "Message-ID:", "Manifest-Version:", "Signature-Version:", "WEBVTT",
+    "GIMP ", "true", "core", "spec", "push",
+};
+// Words libmagic's rules for scripts, source code, makefiles, diffs, m4 and
+// gettext catalogs look for at the start of a line
+static const char *const code_words[] = {
+    "import ", "export ", "require", "module ", "class ", "def ", "package ", "using ",
+    "namespace ", "template", "function", "var ", "let ", "const ", "public ", "private ",
+    "protected ", "static ", "struct ", "typedef ", "sub ", "use ", "try:", "except", "dnl",
+    "divert", "diff ", "Index:", "Only in ", "Common subdirectories", "--- ", "+++ ", "CFLAGS",
+    "VPATH", "LDFLAGS", "all:", "msgid", "BEGIN", "END", "#!", "/*", "-----BEGIN", "AC_",
+    "extern", "char", "double", "float", "int ", "void ", "union", "enum ", "unsigned", "signed",
+    "long ", "short ", "bool ", "inline", "finally:", "module.", "module[", "exports",
+};
+// Preprocessor directives, which may have blanks after the '#'
+static const char *const directives[] = {
+    "if", "define", "include", "import", "pragma", "endif", "undef", "error", "else", "elif",
+    "line",
+};
+// Tags libmagic takes for HTML wherever they appear in its first 4 KiB
+static const char *const html_tags[] = {
+    "a href", "head", "html", "script", "style", "table", "title", "svg",
+};
+
+// Whether text starts with one of count prefixes
+static int starts_with_any(const unsigned char *text, const unsigned char *end,
+                           const char *const *prefixes, size_t count) {
+    if (text == end) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (prefixes[i][0] != (char)text[0]) {
+            continue;
+        }
+        size_t n = strlen(prefixes[i]);
+        if ((size_t)(end - text) >= n && memcmp(text, prefixes[i], n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether the '<' at tag opens markup: a declaration, a processing
+// instruction or one of html_tags, in any case
+static int opens_markup(const unsigned char *tag, const unsigned char *end) {
+    if (tag + 1 < end && (tag[1] == '!' || tag[1] == '?')) {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(html_tags) / sizeof(html_tags[0]); i++) {
+        size_t n = strlen(html_tags[i]);
+        if ((size_t)(end - tag) > n && strncasecmp((const char *)tag + 1, html_tags[i], n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether the '#' at hash starts a preprocessor directive, spaced or not
+static int directive(const unsigned char *hash, const unsigned char *end) {
+    const unsigned char *p = hash + 1;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return starts_with_any(p, end, directives, sizeof(directives) / sizeof(directives[0]));
+}
+
+// Whether the line at line, a Python or JavaScript import, holds " import"
+static int imports(const unsigned char *line, const unsigned char *end) {
+    const unsigned char *eol = memchr(line, '\n', (size_t)(end - line));
+    size_t n = (size_t)((eol != NULL ? eol : end) - line);
+    for (size_t i = 0; i + 7 <= n; i++) {
+        if (memcmp(line + i, " import", 7) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether libmagic's text rules could find something in the first
+// TEXT_SCAN_BYTES, which is as far as most of them look: a first line like a
+// mail or news header, a line opening with a keyword, markup, or characters
+// of code. Far more text than those rules would claim is turned away, so
+// what passes is plain text to libmagic as well.
+static int looks_like_code(const unsigned char *head, size_t length) {
+    const unsigned char *end = head + (length < TEXT_SCAN_BYTES ? length : TEXT_SCAN_BYTES);
+    // Two capitals begin many binary signatures, HP-GL's commands among them
+    if (starts_with_any(head, end, text_headers, sizeof(text_headers) / sizeof(text_headers[0])) ||
+        (end - head >= 2 && isupper(head[0]) && isupper(head[1]))) {
+        return 1;
+    }
+    int line_start = 1;
+    for (const unsigned char *p = head; p < end; p++) {
+        unsigned char c = *p;
+        if (c == '\n') {
+            line_start = 1;
+            continue;
+        }
+        if (line_start && (c == ' ' || c == '\t')) {
+            continue;
+        }
+        if (line_start &&
+            (starts_with_any(p, end, code_words, sizeof(code_words) / sizeof(code_words[0])) ||
+             (end - p >= 5 && memcmp(p, "from ", 5) == 0 && imports(p, end)) ||
+             (c == '#' && directive(p, end)) || (c == '.' && p + 1 < end && isalpha(p[1])))) {
+            return 1;
+        }
+        line_start = 0;
+        if (memchr(code_chars, c, sizeof(code_chars) - 1) != NULL ||
+            (c == '<' && opens_markup(p, end)) ||
+            (c == '=' && p + 1 < end && p[1] == '=') ||
+            (c == '_' && p + 1 < end && p[1] == '_') ||
+            (c == '@' && p + 1 < end && p[1] == '@') ||
+            (c == ':' && p + 1 < end && p[1] == ':') ||
+            (c == '"' && p + 2 < end && p[1] == '"' && p[2] == '"') ||
+            (c == '\'' && p + 2 < end && p[1] == '\'' && p[2] == '\'')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether libmagic would call the text comma-separated values: the first
+// line has commas, and the following ones (up to CSV_LINES) as many
+static int looks_csv(const unsigned char *p, const unsigned char *end) {
+    size_t fields = 0, first = 0, lines = 0;
+    while (p < end) {
+        switch (*p++) {
+        case '"':
+            // A quoted field may hold commas and newlines
+            while (p < end && *p++ != '"') {
+            }
+            break;
+        case ',':
+            fields++;
+            break;
+        case '\n':
+            if (++lines == CSV_LINES) {
+                return first != 0 && first == fields;
+            }
+            if (first == 0) {
+                if (fields == 0) {
+                    return 0;
+                }
+                first = fields;
+            } else if (first != fields) {
+                return 0;
+            }
+            fields = 0;
+            break;
+        default:
+            break;
+        }
+    }
+    return first != 0 && lines > 2;
+}
+
+// Plain text, ASCII or UTF-8, that gives libmagic's text rules nothing to
+// go on: no script, markup, source code, mail, JSON or CSV
+static const SniffType *sniff_text(const unsigned char *head, size_t length) {
+    // libmagic has no rule for a file of one byte
+    if (length < 2) {
+        return NULL;
+    }
+    const unsigned char *p = head, *end = head + length;
+    int bom = length >= 3 && memcmp(head, "\xef\xbb\xbf", 3) == 0;
+    if (bom) {
+        p += 3;
+    }
+    int utf8 = 0;
+    while (p < end) {
+        unsigned char c = *p;
+        if (c < 0x80) {
+            // Control characters other than BEL to CR and ESC make it data
+            if (c < 0x07 || (c > 0x0d && c < 0x20 && c != 0x1b) || c == 0x7f) {
+                return NULL;
+            }
+            p++;
+            continue;
+        }
+        // A well-formed, shortest-form UTF-8 sequence
+        size_t extra = c >= 0xc2 && c <= 0xdf ? 1 : c >= 0xe0 && c <= 0xef ? 2 :
+                       c >= 0xf0 && c <= 0xf4 ? 3 : 0;
+        if (extra == 0 || (size_t)(end - p) <= extra) {
+            return NULL;
+        }
+        uint32_t cp = c & (0x3f >> extra);
+        for (size_t i = 1; i <= extra; i++) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return NULL;
+            }
+            cp = cp << 6 | (p[i] & 0x3f);
+        }
+        if ((extra == 2 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) ||
+            (extra == 3 && (cp < 0x10000 || cp > 0x10ffff))) {
+            return NULL;
+        }
+        utf8 = 1;
+        p += extra + 1;
+    }
+
+    // The first character of most text formats' signatures
+    const unsigned char *start = head + (bom ? 3 : 0);
+    while (start < end && (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r')) {
+        start++;
+    }
+    if (start == end || memchr(markup_starts, *start, sizeof(markup_starts) - 1) != NULL) {
+        return NULL;
+    }
+    if (looks_csv(head, end) || looks_like_code(start, (size_t)(end - start))) {
+        return NULL;
+    }
+    return bom ? &utf8_bom_type : utf8 ? &utf8_type : &ascii_type;
+}
+
+// A signature at the start of the file
+typedef struct {
+    const char *magic;      // The leading bytes
+    size_t length;
+    const SniffType *type;  // The type, when those bytes settle it
+    // Otherwise decides from the rest of the head; NULL leaves it to libmagic
+    const SniffType *(*refine)(const unsigned char *head, size_t length);
+} Signature;
+
+// Signatures at offset 0, longest first where one begins another
+static const Signature signatures[] = {
+    { "\x89PNG\r\n\x1a\n", 8, &png_type, NULL },
+    { "\xff\xd8\xff", 3, &jpeg_type, NULL },
+    { "GIF8", 4, NULL, sniff_gif },
+    { "II*\0", 4, NULL, sniff_tiff },
+    { "MM\0*", 4, NULL, sniff_tiff },
+    { "II+\0", 4, &bigtiff_type, NULL },
+    { "MM\0+", 4, &bigtiff_type, NULL },
+    { "BM", 2, NULL, sniff_bmp },
+    { "RIFF", 4, NULL, sniff_riff },
+    { "fLaC", 4, &flac_type, NULL },
+    { "\x1a\x45\xdf\xa3", 4, NULL, sniff_ebml },
+    { "%PDF-", 5, &pdf_type, NULL },
+    { "PK\x03\x04", 4, NULL, sniff_zip },
+    { "\x1f\x8b\x08", 3, &gzip_type, NULL },
+    { "\xfd" "7zXZ\0", 6, &xz_type, NULL },
+    { "\x28\xb5\x2f\xfd", 4, &zstd_type, NULL },
+    { "BZh", 3, NULL, sniff_bzip2 },
+    { "LZIP", 4, &lzip_type, NULL },
+    { "7z\xbc\xaf\x27\x1c", 6, &sevenzip_type, NULL },
+    { "Rar!\x1a\x07", 6, NULL, sniff_rar },
+    { "SQLite format 3\0", 16, &sqlite_type, NULL },
+    { "\0asm", 4, &wasm_type, NULL },
+    { "\177ELF", 4, NULL, sniff_elf },
+};
+
+#define SIGNATURE_COUNT (sizeof(signatures) / sizeof(signatures[0]))
+// Marks the end of a chain in the index
+#define NO_SIGNATURE UINT8_MAX
+
+// Formats that no fixed leading bytes identify, tried when no signature does
+static const SniffType *(*const fallbacks[])(const unsigned char *head, size_t length) = {
+    sniff_iso_media, sniff_tar, sniff_text,
+};
+
+// For each first byte, the first signature starting with it; each signature
+// links to the next one with the same first byte
+static uint8_t first_signature[256];
+static uint8_t next_signature[SIGNATURE_COUNT];
+static pthread_once_t index_once = PTHREAD_ONCE_INIT;
+
+// Chain the signatures by first byte, keeping their order in the table
+static void build_index(void) {
+    _Static_assert(SIGNATURE_COUNT < NO_SIGNATURE, "too many signatures for the index");
+    memset(first_signature, NO_SIGNATURE, sizeof(first_signature));
+    for (size_t i = SIGNATURE_COUNT; i-- > 0;) {
+        uint8_t first = (uint8_t)signatures[i].magic[0];
+        next_signature[i] = first_signature[first];
+        first_signature[first] = (uint8_t)i;
+    }
+}
+
+// Classify the head from the signature table, then the fallbacks
+const SniffType *sniff_type(const unsigned char *head, size_t length) {
+    if (head == NULL || length == 0) {
+        return NULL;
+    }
+    pthread_once(&index_once, build_index);
+    for (uint8_t i = first_signature[head[0]]; i != NO_SIGNATURE; i = next_signature[i]) {
+        const Signature *sig = &signatures[i];
+        if (length < sig->length || memcmp(head, sig->magic, sig->length) != 0) {
+            continue;
+        }
+        // A file that starts like a format but fails its checks is left to libmagic
+        return sig->type != NULL ? sig->type : sig->refine(head, length);
+    }
+    for (size_t i = 0; i < sizeof(fallbacks) / sizeof(fallbacks[0]); i++) {
+        const SniffType *type = fallbacks[i](head, length);
+        if (type != NULL) {
+            return type;
+        }
+    }
+    return NULL;
+}
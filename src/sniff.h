@@ -0,0 +1,27 @@
+#ifndef SNIFF_H
+#define SNIFF_H
+
+#include <stddef.h>
+
+// How the built-in signature table takes part in type detection (--sniff)
+typedef enum {
+    SNIFF_OFF,    // libmagic alone decides
+    SNIFF_ON,     // The table decides the formats it knows; libmagic the rest
+    SNIFF_CHECK   // libmagic decides, and the table's answer is compared with it
+} SniffMode;
+
+// A file type the table can vouch for
+typedef struct {
+    const char *mime_type;  // As libmagic reports it
+    const char *name;       // The start of libmagic's description
+} SniffType;
+
+// Classify a file from its leading bytes (its first length bytes; the whole
+// file when it is that short) the way libmagic would for the most common
+// formats: images, ISO media and Matroska, PDF, archives and compressed
+// files, ELF objects and plain text.
+// Returns NULL when the bytes are not certain to be one of them, and
+// libmagic has to decide
+const SniffType *sniff_type(const unsigned char *head, size_t length);
+
+#endif // SNIFF_H
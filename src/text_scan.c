@@ -0,0 +1,308 @@
+// Define _GNU_SOURCE to enable certain GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "text_scan.h"   // Declarations for this file
+#include "utils.h"       // read_at()
+#include <math.h>        // sqrt() for the confidence intervals
+#include <pthread.h>     // pthread_once() for one-time kernel selection
+#include <stdlib.h>      // malloc(), free()
+#include <zlib.h>        // crc32() over checkpoint blocks
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // SSE2 and AVX2 intrinsics
+#define TEXT_SCAN_X86 1
+#endif
+
+// Word boundaries are the same three bytes the original fgetc loop used
+static inline int is_space(unsigned char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\t';
+}
+
+// Reset all counters to zero
+void text_counts_init(TextCounts *counts) {
+    counts->lines = 0;
+    counts->words = 0;
+    counts->chars = 0;
+    counts->code_points = 0;
+    counts->in_word = 0;
+}
+
+// Portable byte-at-a-time kernel, also used for the tails of the SIMD kernels
+static void scan_scalar(TextCounts *counts, const unsigned char *data, size_t len) {
+    uint64_t lines = 0, words = 0, code_points = 0;
+    int in_word = counts->in_word;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = data[i];
+        lines += ch == '\n';
+        // Every byte except a UTF-8 continuation byte starts a code point
+        code_points += (ch & 0xC0) != 0x80;
+        if (is_space(ch)) {
+            in_word = 0;
+        } else if (!in_word) {
+            in_word = 1;
+            words++;
+        }
+    }
+    counts->lines += lines;
+    counts->words += words;
+    counts->chars += len;
+    counts->code_points += code_points;
+    counts->in_word = in_word;
+}
+
+#ifdef TEXT_SCAN_X86
+// The SIMD kernels classify 64 bytes at a time into bit masks (bit i set
+// when byte i matches) and count with popcount. A word starts wherever a
+// non-space byte follows a space byte; the byte before the block is
+// represented by a carry bit that is set when the scan is not in a word.
+
+// Fold 64-byte masks into the counters
+static inline void count_block(uint64_t newline, uint64_t space, uint64_t lead,
+                               uint64_t *lines, uint64_t *words, uint64_t *code_points,
+                               uint64_t *prev_space) {
+    uint64_t starts = ~space & ((space << 1) | *prev_space);
+    *lines += (uint64_t)__builtin_popcountll(newline);
+    *words += (uint64_t)__builtin_popcountll(starts);
+    *code_points += (uint64_t)__builtin_popcountll(lead);
+    *prev_space = space >> 63;
+}
+
+// SSE2 kernel: four 16-byte vectors per block
+__attribute__((target("sse2")))
+static void scan_sse2(TextCounts *counts, const unsigned char *data, size_t len) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    // Continuation bytes are 0x80-0xBF, i.e. below -64 as signed bytes
+    const __m128i cont = _mm_set1_epi8((char)0xBF);
+    uint64_t lines = 0, words = 0, code_points = 0;
+    uint64_t prev_space = !counts->in_word;
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        uint64_t newline = 0, space = 0, lead = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + i + part * 16));
+            __m128i is_nl = _mm_cmpeq_epi8(v, nl);
+            __m128i is_ws = _mm_or_si128(is_nl, _mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                                                             _mm_cmpeq_epi8(v, tab)));
+            __m128i is_lead = _mm_cmpgt_epi8(v, cont);
+            newline |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_nl) << (part * 16);
+            space |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_ws) << (part * 16);
+            lead |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_lead) << (part * 16);
+        }
+        count_block(newline, space, lead, &lines, &words, &code_points, &prev_space);
+    }
+
+    counts->lines += lines;
+    counts->words += words;
+    counts->chars += i;
+    counts->code_points += code_points;
+    counts->in_word = !prev_space;
+    scan_scalar(counts, data + i, len - i);
+}
+
+// AVX2 kernel: two 32-byte vectors per block
+__attribute__((target("avx2,popcnt")))
+static void scan_avx2(TextCounts *counts, const unsigned char *data, size_t len) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cont = _mm256_set1_epi8((char)0xBF);
+    uint64_t lines = 0, words = 0, code_points = 0;
+    uint64_t prev_space = !counts->in_word;
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        uint64_t newline = 0, space = 0, lead = 0;
+        for (int part = 0; part < 2; part++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + i + part * 32));
+            __m256i is_nl = _mm256_cmpeq_epi8(v, nl);
+            __m256i is_ws = _mm256_or_si256(is_nl, _mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                                                                   _mm256_cmpeq_epi8(v, tab)));
+            __m256i is_lead = _mm256_cmpgt_epi8(v, cont);
+            newline |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_nl) << (part * 32);
+            space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_ws) << (part * 32);
+            lead |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_lead) << (part * 32);
+        }
+        count_block(newline, space, lead, &lines, &words, &code_points, &prev_space);
+    }
+
+    counts->lines += lines;
+    counts->words += words;
+    counts->chars += i;
+    counts->code_points += code_points;
+    counts->in_word = !prev_space;
+    scan_scalar(counts, data + i, len - i);
+}
+#endif // TEXT_SCAN_X86
+
+// Kernel picked once for this CPU
+typedef void (*ScanKernel)(TextCounts *counts, const unsigned char *data, size_t len);
+static ScanKernel scan_kernel = scan_scalar;
+static const char *scan_kernel_name = "scalar";
+static pthread_once_t scan_kernel_once = PTHREAD_ONCE_INIT;
+
+// Choose the widest kernel the running CPU supports
+static void select_kernel(void) {
+#ifdef TEXT_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        scan_kernel = scan_avx2;
+        scan_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_kernel = scan_sse2;
+        scan_kernel_name = "sse2";
+    }
+#endif
+}
+
+// Name of the kernel in use, for diagnostics
+const char *text_scan_kernel_name(void) {
+    pthread_once(&scan_kernel_once, select_kernel);
+    return scan_kernel_name;
+}
+
+// Add the counts of one piece of the stream
+void text_scan_update(TextCounts *counts, const unsigned char *data, size_t len) {
+    pthread_once(&scan_kernel_once, select_kernel);
+    scan_kernel(counts, data, len);
+}
+
+// CRC-32 of the block that ends at offset, or -1 if it cannot be read
+static int64_t block_crc(int fd, uint64_t offset) {
+    unsigned char block[TEXT_CHECKPOINT_BLOCK];
+    size_t len = offset < sizeof(block) ? (size_t)offset : sizeof(block);
+    if (read_at(fd, block, len, (off_t)(offset - len)) != (ssize_t)len) {
+        return -1;
+    }
+    return (int64_t)crc32(0L, block, (uInt)len);
+}
+
+// Remember how far a count got and what the bytes just before looked like
+int text_checkpoint_make(int fd, const TextCounts *counts, TextCheckpoint *cp) {
+    int64_t crc = block_crc(fd, counts->chars);
+    if (crc < 0) {
+        return -1;
+    }
+    cp->counts = *counts;
+    cp->block_crc = (uint32_t)crc;
+    return 0;
+}
+
+// A truncated or rewritten file fails one of the checks and is counted afresh;
+// a rotated one has a new inode and never gets here
+int text_checkpoint_valid(int fd, uint64_t size, const TextCheckpoint *cp) {
+    if (cp->counts.chars == 0 || cp->counts.chars > size) {
+        return 0;
+    }
+    return block_crc(fd, cp->counts.chars) == (int64_t)cp->block_crc;
+}
+
+// splitmix64: the next pseudo-random number from state
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Densities (counts per byte) of one quantity over the sampled blocks
+typedef struct {
+    double sum;      // Sum of the densities
+    double squares;  // Sum of their squares
+    double total;    // Density times stretch length, summed: the estimate
+} Sample;
+
+static void sample_add(Sample *sample, uint64_t count, size_t block_size, uint64_t stretch) {
+    double density = (double)count / (double)block_size;
+    sample->sum += density;
+    sample->squares += density * density;
+    sample->total += density * (double)stretch;
+}
+
+// Half-width of the 95% confidence interval of sample's estimate over rest
+// bytes; the spread between stretches stands in for the spread within them,
+// which overstates it when the density drifts along the file
+static uint64_t sample_margin(const Sample *sample, unsigned blocks, size_t block_size,
+                              uint64_t rest) {
+    double mean = sample->sum / blocks;
+    double variance = (sample->squares - blocks * mean * mean) / (blocks - 1);
+    if (variance <= 0) {
+        return 0;
+    }
+    // Only the part of the file not sampled is uncertain
+    double unsampled = 1.0 - (double)blocks * block_size / (double)rest;
+    return (uint64_t)(1.96 * (double)rest * sqrt(variance / blocks * unsampled) + 0.5);
+}
+
+// Stratified sampling: one block at a random place in each stretch
+int text_scan_estimate(int fd, uint64_t size, const unsigned char *head, size_t head_length,
+                       uint64_t budget, uint64_t seed, TextEstimate *estimate) {
+    if (head_length > size) {
+        head_length = (size_t)size;
+    }
+    uint64_t rest = size - head_length;
+    size_t block_size = ESTIMATE_BLOCK_SIZE;
+    if (budget / block_size < ESTIMATE_MIN_BLOCKS) {
+        block_size = (size_t)(budget / ESTIMATE_MIN_BLOCKS);
+        if (block_size < ESTIMATE_MIN_BLOCK_SIZE) {
+            block_size = ESTIMATE_MIN_BLOCK_SIZE;
+        }
+    }
+    uint64_t blocks = budget / block_size;
+    // Each stretch must hold its block, and two are needed for a spread
+    if (blocks > rest / block_size) {
+        blocks = rest / block_size;
+    }
+    if (blocks < 2) {
+        return 0;
+    }
+
+    // Read the byte before each block as well, for the word it may continue
+    unsigned char *buffer = malloc(block_size + 1);
+    if (buffer == NULL) {
+        return -1;
+    }
+    Sample lines = { 0 }, words = { 0 }, code_points = { 0 };
+    uint64_t stretch = rest / blocks;
+    uint64_t state = seed;
+    for (uint64_t i = 0; i < blocks; i++) {
+        uint64_t start = head_length + i * stretch;
+        uint64_t length = i + 1 < blocks ? stretch : size - start;
+        uint64_t offset = start + next_random(&state) % (length - block_size + 1);
+        size_t before = offset > 0 ? 1 : 0;
+        size_t want = block_size + before;
+        if (read_at(fd, buffer, want, (off_t)(offset - before)) != (ssize_t)want) {
+            free(buffer);
+            return -1;
+        }
+        TextCounts counts;
+        text_counts_init(&counts);
+        text_scan_update(&counts, buffer, before);
+        int in_word = counts.in_word;
+        text_counts_init(&counts);
+        counts.in_word = in_word;
+        text_scan_update(&counts, buffer + before, block_size);
+        sample_add(&lines, counts.lines, block_size, length);
+        sample_add(&words, counts.words, block_size, length);
+        sample_add(&code_points, counts.code_points, block_size, length);
+    }
+    free(buffer);
+
+    // The head is known exactly; the estimates cover the rest
+    TextCounts *total = &estimate->counts;
+    text_counts_init(total);
+    text_scan_update(total, head, head_length);
+    total->lines += (uint64_t)(lines.total + 0.5);
+    total->words += (uint64_t)(words.total + 0.5);
+    total->code_points += (uint64_t)(code_points.total + 0.5);
+    total->chars = size;
+    estimate->lines_margin = sample_margin(&lines, (unsigned)blocks, block_size, rest);
+    estimate->words_margin = sample_margin(&words, (unsigned)blocks, block_size, rest);
+    estimate->code_points_margin = sample_margin(&code_points, (unsigned)blocks, block_size, rest);
+    estimate->blocks = (unsigned)blocks;
+    estimate->block_size = block_size;
+    return (int)blocks;
+}
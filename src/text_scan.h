@@ -0,0 +1,64 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Running line/word/character counts over a byte stream. The stream can be
+// fed in pieces of any size; in_word carries word state across them.
+typedef struct {
+    uint64_t lines;        // Number of '\n' bytes
+    uint64_t words;        // Number of runs of non-whitespace bytes
+    uint64_t chars;        // Number of bytes
+    uint64_t code_points;  // Number of UTF-8 code points (non-continuation bytes)
+    int in_word;           // Whether the last byte seen belonged to a word
+} TextCounts;
+
+// Bytes before a checkpoint's offset that must be unchanged for it to hold
+#define TEXT_CHECKPOINT_BLOCK 4096
+
+// Where counting a file stopped, so a file that has only grown since can be
+// counted on from there instead of from its first byte
+typedef struct {
+    TextCounts counts;   // Counts of the file's first counts.chars bytes
+    uint32_t block_crc;  // CRC-32 of the TEXT_CHECKPOINT_BLOCK bytes before that
+} TextCheckpoint;
+
+// Bytes in each block an estimate samples, unless the budget is too small
+// for ESTIMATE_MIN_BLOCKS of them
+#define ESTIMATE_BLOCK_SIZE (64u << 10)
+#define ESTIMATE_MIN_BLOCKS 16
+// Smallest block an estimate samples
+#define ESTIMATE_MIN_BLOCK_SIZE 4096
+
+// Counts extrapolated from blocks sampled across a file, each with the
+// half-width of its 95% confidence interval
+typedef struct {
+    TextCounts counts;            // Estimated totals; chars is exact
+    uint64_t lines_margin;
+    uint64_t words_margin;
+    uint64_t code_points_margin;
+    unsigned blocks;              // Blocks sampled
+    size_t block_size;            // Bytes in each of them
+} TextEstimate;
+
+void text_counts_init(TextCounts *counts);
+void text_scan_update(TextCounts *counts, const unsigned char *data, size_t len);
+// Record that fd's first counts->chars bytes gave counts
+// Returns 0, or -1 if the block before that offset cannot be read
+int text_checkpoint_make(int fd, const TextCounts *counts, TextCheckpoint *cp);
+// Whether fd, now size bytes long, still holds what cp counted: it has not
+// shrunk and the block before the checkpoint is unchanged
+int text_checkpoint_valid(int fd, uint64_t size, const TextCheckpoint *cp);
+// Estimate the counts of fd's first size bytes from about budget bytes:
+// the first head_length of them, given in head, are counted exactly, and
+// one block is read from a random place in each of equal stretches of the
+// rest. The places follow from seed, so an unchanged file gets the same
+// estimate every time.
+// Returns the number of blocks sampled, 0 if the rest is too short to hold
+// two blocks that fit the budget, or -1 on a read error
+int text_scan_estimate(int fd, uint64_t size, const unsigned char *head, size_t head_length,
+                       uint64_t budget, uint64_t seed, TextEstimate *estimate);
+const char *text_scan_kernel_name(void);
+
+#endif // TEXT_SCAN_H
@@ -1,54 +1,244 @@
+// Define _GNU_SOURCE for pipe2()
+#define _GNU_SOURCE
+
 // Include the header file for this source file
 #include "utils.h"
 
 // Include necessary standard library headers
-#include <stdio.h>   // For FILE*, popen(), pclose(), fgets()
-#include <stdlib.h>  // For malloc(), free()
-#include <string.h>  // For strcpy(), strlen()
-
-// Function to execute a shell command and return its output
-char *execute_command(const char *command) {
-    // popen() creates a pipe, forks, and invokes the shell to execute the command
-    // "r" means we're opening the pipe for reading
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        // If popen() fails, return NULL
+#include <stdio.h>   // For snprintf()
+#include <stdlib.h>  // For malloc(), realloc(), free()
+#include <string.h>  // For strlen(), memcpy()
+#include <errno.h>   // For errno, EINTR
+#include <fcntl.h>   // For O_CLOEXEC, O_RDONLY
+#include <poll.h>    // For poll()
+#include <signal.h>  // For kill(), sigaction(), SIGKILL
+#include <spawn.h>   // For posix_spawnp()
+#include <sys/wait.h> // For waitpid()
+#include <time.h>    // For clock_gettime()
+#include <unistd.h>  // For pread(), read(), close()
+
+// The environment handed to child processes
+extern char **environ;
+
+// Tools running at once that stop_tools() can reach; more than this are
+// still held to their timeouts
+#define MAX_RUNNING_TOOLS 256
+
+// Process groups of the running tools, 0 in free places. A signal handler
+// walks them, so they are plain words changed with atomic operations.
+static pid_t running_tools[MAX_RUNNING_TOOLS];
+// Set once stop_tools() has run; no tool is started after that
+static volatile sig_atomic_t tools_stopped;
+// Descriptor that turns readable when inf is asked to stop, -1 if none
+static int stop_fd = -1;
+
+// Note a started tool's process group
+// Returns its place, or -1 if every place is taken
+static int track_tool(pid_t pid) {
+    for (int i = 0; i < MAX_RUNNING_TOOLS; i++) {
+        pid_t expected = 0;
+        if (__atomic_compare_exchange_n(&running_tools[i], &expected, pid, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Send sig to every running tool and refuse to start more; only calls
+// functions that are safe in a signal handler
+static void stop_tools(int sig) {
+    tools_stopped = 1;
+    for (int i = 0; i < MAX_RUNNING_TOOLS; i++) {
+        pid_t pid = __atomic_load_n(&running_tools[i], __ATOMIC_SEQ_CST);
+        if (pid > 0) {
+            kill(-pid, sig);
+        }
+    }
+}
+
+// Pass the signal on to the tools, then end as it would have ended inf
+static void stop_tools_and_exit(int sig) {
+    stop_tools(sig);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void stop_tools_on_signal(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_tools_and_exit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+}
+
+void stop_tools_when_readable(int fd) {
+    stop_fd = fd;
+}
+
+// Monotonic clock in nanoseconds, for timeouts and timings
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Run argv[0] (looked up in PATH) with the given arguments and return its
+// standard output as a NUL-terminated string the caller must free
+// No shell is involved, so arguments are passed through exactly as given
+// The child is killed if it runs longer than timeout_ms (0 means no limit)
+// or prints more than MAX_OUTPUT_LENGTH bytes
+// Returns NULL if the program could not be started or was killed
+char *execute_command(const char *const argv[], int timeout_ms, CommandResult *result) {
+    CommandResult local;
+    if (result == NULL) {
+        result = &local;
+    }
+    result->exit_status = -1;
+    result->timed_out = 0;
+    result->elapsed_ns = 0;
+    if (tools_stopped) {
+        return NULL;  // inf is shutting down
+    }
+
+    // A pipe for the child's standard output; O_CLOEXEC keeps the ends from
+    // leaking into children that other threads start at the same time
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
         return NULL;
     }
 
-    // Allocate memory for the output string
-    // We're using MAX_OUTPUT_LENGTH defined in utils.h
-    char *output = malloc(MAX_OUTPUT_LENGTH);
-    if (output == NULL) {
-        // If malloc fails, close the pipe and return NULL
-        pclose(fp);
+    // stdin from /dev/null, stdout into the pipe, stderr shared with us
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], 1);
+
+    // Own process group, so a timeout also kills anything the tool started;
+    // a terminal's Ctrl-C does not reach it there, stop_tools() passes it on.
+    // No signals blocked either: --serve and --watch block SIGINT and SIGTERM
+    // in every thread, and the tool would inherit that
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+
+    uint64_t start = monotonic_ns();
+    pid_t pid;
+    int status = posix_spawnp(&pid, argv[0], &actions, &attr, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(pipe_fds[1]);
+    if (status != 0) {
+        // Most often the tool is not installed
+        close(pipe_fds[0]);
         return NULL;
     }
+    int place = track_tool(pid);
+    if (tools_stopped) {
+        kill(-pid, SIGKILL);  // Started as inf was being stopped
+    }
 
-    // Initialize the output length to 0
-    size_t output_len = 0;
-    // Create a buffer for reading chunks of output
-    char buffer[128];
-
-    // Read the output of the command in chunks
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        size_t len = strlen(buffer);
-        // Check if we have enough space in our output buffer
-        if (output_len + len < MAX_OUTPUT_LENGTH - 1) {
-            // If we do, copy the chunk to our output buffer
-            strcpy(output + output_len, buffer);
-            output_len += len;
-        } else {
-            // If we don't have enough space, break the loop
-            // This prevents buffer overflow
+    // Read until end of file, growing the buffer as needed
+    size_t capacity = 4096, length = 0;
+    char *output = malloc(capacity);
+    int killed = 0;
+    uint64_t deadline = start + (uint64_t)timeout_ms * 1000000u;
+    while (output != NULL) {
+        // Wait no longer than the time left
+        int wait_ms = -1;
+        if (timeout_ms > 0) {
+            uint64_t now = monotonic_ns();
+            if (now >= deadline) {
+                result->timed_out = 1;
+                break;
+            }
+            wait_ms = (int)((deadline - now + 999999) / 1000000);
+        }
+        // Only polled, never read: whoever owns it still sees the stop
+        struct pollfd pfds[2] = {
+            { .fd = pipe_fds[0], .events = POLLIN },
+            { .fd = tools_stopped ? -1 : stop_fd, .events = POLLIN },
+        };
+        int ready = poll(pfds, 2, wait_ms);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
             break;
         }
+        if (pfds[1].revents != 0) {
+            stop_tools(SIGTERM);  // Its output ends when it does
+        }
+        if (pfds[0].revents == 0) {
+            continue;  // The deadline check above ends the loop
+        }
+
+        // Keep one byte spare for the terminating NUL
+        if (capacity - length < 2) {
+            char *bigger = capacity < MAX_OUTPUT_LENGTH ? realloc(output, capacity * 2) : NULL;
+            if (bigger == NULL) {
+                killed = 1;  // Runaway output
+                break;
+            }
+            output = bigger;
+            capacity *= 2;
+        }
+        ssize_t n = read(pipe_fds[0], output + length, capacity - length - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;  // End of output (or a read error)
+        }
+        length += n;
     }
+    close(pipe_fds[0]);
 
-    // Close the pipe
-    pclose(fp);
+    // Stop the child if it outlived its welcome
+    if (result->timed_out || killed || output == NULL) {
+        kill(-pid, SIGKILL);
+        timeout_ms = 0;
+    }
 
-    // Return the collected output
+    // Reap it; a child that closed its output but keeps running is still
+    // held to the deadline
+    for (;;) {
+        int wait_status;
+        pid_t done = waitpid(pid, &wait_status, timeout_ms > 0 ? WNOHANG : 0);
+        if (done == pid) {
+            if (WIFEXITED(wait_status)) {
+                result->exit_status = WEXITSTATUS(wait_status);
+            }
+            break;
+        }
+        if (done < 0 && errno != EINTR) {
+            break;
+        }
+        if (done == 0 && monotonic_ns() >= deadline) {
+            result->timed_out = 1;
+            kill(-pid, SIGKILL);
+            timeout_ms = 0;  // Block until it is gone
+        } else if (done == 0) {
+            struct timespec pause = { 0, 1000000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    result->elapsed_ns = monotonic_ns() - start;
+    if (place >= 0) {
+        __atomic_store_n(&running_tools[place], 0, __ATOMIC_SEQ_CST);
+    }
+
+    if (output == NULL || result->timed_out || killed) {
+        free(output);
+        return NULL;
+    }
+    output[length] = '\0';
     return output;
 }
 
@@ -82,3 +272,92 @@ char* format_size(off_t size) {
     // Return the formatted string
     return result;
 }
+
+// Read exactly len bytes at offset unless end of file comes first
+// Returns the number of bytes read, or -1 on error
+ssize_t read_at(int fd, void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        // pread() leaves the file position alone, so windows can share a descriptor
+        ssize_t n = pread(fd, (char *)buf + done, len - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;  // End of file
+        }
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+// Prepare a window over fd, whose first head_length bytes are already in head
+void window_init(FileWindow *window, int fd, uint64_t size, const unsigned char *head,
+                 size_t head_length) {
+    window->fd = fd;
+    window->size = size;
+    window->head = head;
+    window->head_length = head != NULL ? head_length : 0;
+    window->budget = UINT64_MAX;  // Callers that must bound their I/O lower it
+    window->start = 0;
+    window->length = 0;
+}
+
+// Get a pointer to len bytes at offset, or NULL if they lie past end of file
+// or reading them would exceed the window's budget
+// The pointer stays valid until the next call on the same window
+const unsigned char *window_get(FileWindow *window, uint64_t offset, size_t len) {
+    if (len > WINDOW_SIZE || offset > window->size || len > window->size - offset) {
+        return NULL;
+    }
+    // Serve the range from the head or the cached bytes when possible
+    if (offset + len <= window->head_length) {
+        return window->head + offset;
+    }
+    if (offset >= window->start && offset + len <= window->start + window->length) {
+        return window->data + (offset - window->start);
+    }
+    // Otherwise reload the window so that it starts at the requested offset,
+    // as far as the budget allows
+    size_t want = window->budget < WINDOW_SIZE ? (size_t)window->budget : WINDOW_SIZE;
+    if (want < len) {
+        return NULL;
+    }
+    ssize_t n = read_at(window->fd, window->data, want, (off_t)offset);
+    if (n < (ssize_t)len) {
+        window->length = 0;
+        return NULL;
+    }
+    window->budget -= (uint64_t)n;
+    window->start = offset;
+    window->length = n;
+    return window->data;
+}
+
+// Number of bytes that may be read from p, a pointer window_get() returned
+size_t window_span(const FileWindow *window, const unsigned char *p) {
+    if (window->head_length > 0 && p >= window->head && p < window->head + window->head_length) {
+        return (size_t)(window->head + window->head_length - p);
+    }
+    return (size_t)(window->data + window->length - p);
+}
+
+// Copy len bytes at offset into buf, like read_at(), for reads too large
+// for the window; ranges inside the head cost no I/O
+ssize_t window_read(FileWindow *window, void *buf, size_t len, uint64_t offset) {
+    if (offset <= window->head_length && len <= window->head_length - offset) {
+        memcpy(buf, window->head + offset, len);
+        return (ssize_t)len;
+    }
+    if (len > window->budget) {
+        return -1;
+    }
+    ssize_t n = read_at(window->fd, buf, len, (off_t)offset);
+    if (n > 0) {
+        window->budget -= (uint64_t)n;
+    }
+    return n;
+}
@@ -1,12 +1,71 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-#define MAX_COMMAND_LENGTH 1024
-#define MAX_OUTPUT_LENGTH 4096
+// Output of an external tool beyond this many bytes gets the tool killed
+#define MAX_OUTPUT_LENGTH (64 << 20)
 
-char *execute_command(const char *command);
+// Bytes held by a FileWindow; header parsers rarely need more at once
+#define WINDOW_SIZE 16384
+
+// Buffered random access to a file: parsers ask for byte ranges and the
+// window only issues a pread() when the range is neither in the file's
+// shared head bytes nor already loaded
+typedef struct {
+    int fd;                           // File being read
+    uint64_t size;                    // Size of the file in bytes
+    const unsigned char *head;        // The file's first bytes, read once for all stages
+    size_t head_length;               // Number of bytes in head
+    uint64_t budget;                  // Bytes it may still read from fd
+    uint64_t start;                   // File offset of data[0]
+    size_t length;                    // Number of valid bytes in data
+    unsigned char data[WINDOW_SIZE];  // Cached bytes
+} FileWindow;
+
+// How a child process started by execute_command() went
+typedef struct {
+    int exit_status;      // Exit code, -1 if it did not exit normally
+    int timed_out;        // Non-zero if it was killed at its deadline
+    uint64_t elapsed_ns;  // Wall-clock time from spawn to reap
+} CommandResult;
+
+char *execute_command(const char *const argv[], int timeout_ms, CommandResult *result);
+// Tools run in process groups of their own, which a terminal's signals do
+// not reach. Have SIGINT, SIGTERM and SIGHUP stop the running tools before
+// they end inf
+void stop_tools_on_signal(void);
+// Where those signals are blocked and read from fd instead, stop the tools
+// once fd turns readable; -1 forgets it
+void stop_tools_when_readable(int fd);
 char* format_size(off_t size);
+ssize_t read_at(int fd, void *buf, size_t len, off_t offset);
+void window_init(FileWindow *window, int fd, uint64_t size, const unsigned char *head,
+                 size_t head_length);
+const unsigned char *window_get(FileWindow *window, uint64_t offset, size_t len);
+size_t window_span(const FileWindow *window, const unsigned char *p);
+ssize_t window_read(FileWindow *window, void *buf, size_t len, uint64_t offset);
+
+// Decode fixed-width integers stored big- or little-endian
+static inline uint16_t read_be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+static inline uint32_t read_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+static inline uint64_t read_be64(const unsigned char *p) {
+    return (uint64_t)read_be32(p) << 32 | read_be32(p + 4);
+}
+static inline uint16_t read_le16(const unsigned char *p) {
+    return (uint16_t)(p[1] << 8 | p[0]);
+}
+static inline uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+static inline uint64_t read_le64(const unsigned char *p) {
+    return (uint64_t)read_le32(p + 4) << 32 | read_le32(p);
+}
 
 #endif // UTILS_H
@@ -0,0 +1,803 @@
+// Define _GNU_SOURCE to enable O_NOATIME and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "walk.h"           // Declarations for this file
+#include "file_info.h"      // process_file() and the info it collects
+#include "profile.h"        // Per-file totals under --profile
+#include "utils.h"          // format_size()
+#include <dirent.h>         // DT_* entry types
+#include <errno.h>          // errno, EINTR, EPERM
+#include <fcntl.h>          // openat(), fstatat() and their flags
+#include <pthread.h>        // Worker threads, the per-queue locks and idle waits
+#include <stdint.h>         // uint64_t
+#include <stdlib.h>         // malloc(), realloc(), free(), qsort(), strtoull()
+#include <string.h>         // strcmp(), strlen(), memcpy()
+#include <sys/stat.h>       // struct stat
+#include <sys/syscall.h>    // SYS_getdents64
+#include <unistd.h>         // syscall(), close()
+
+// Bytes of directory entries fetched per getdents64() call
+#define DENTS_BUFFER_SIZE (64 << 10)
+// Files of size 0, then sizes in [2^(i-1), 2^i) for bucket i
+#define SIZE_BUCKETS 65
+// Hard-linked inodes are remembered in this many independently locked sets
+#define LINK_STRIPES 64
+// Root arguments queued per worker before the feeding thread waits; keeps
+// memory bounded for endless lists such as find -print0
+#define ROOTS_PER_JOB 64
+
+// Layout of the records getdents64() returns
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Files and bytes of one MIME type
+typedef struct {
+    char *mime_type;  // Owned; NULL marks an empty slot
+    uint64_t files;
+    uint64_t bytes;
+} TypeTotals;
+
+// Everything one worker counted; workers only ever touch their own shard,
+// and the shards are added up once every worker is done
+typedef struct {
+    TypeTotals *types;     // Open-addressed by MIME type
+    size_t type_count;
+    size_t type_capacity;  // A power of two, or 0 before the first file
+    uint64_t files, bytes, dirs, other, hard_links, failed;
+    uint64_t sizes[SIZE_BUCKETS];
+    uint64_t text_files, lines;
+    uint64_t video_files;
+    double duration;       // Seconds
+    uint64_t pdf_files, pages;
+    uint64_t sniff_agreed, sniff_differed, sniff_unmatched;  // --sniff=check verdicts
+} WalkShard;
+
+// A queued path: a directory found while walking, or a root argument that
+// has not been looked at yet and may be a directory, a file or neither
+typedef struct {
+    char *path;  // Owned
+    int root;
+} WorkItem;
+
+// Paths one worker is to visit. The owner takes the newest (depth first, so
+// the queue stays short); idle workers steal the oldest.
+typedef struct {
+    pthread_mutex_t lock;
+    WorkItem *items;
+    size_t head, tail, capacity;
+} WorkQueue;
+
+// Inodes with several links that have been counted already
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t (*keys)[2];  // (dev, ino + 1), all zero for an empty slot
+    size_t count;
+    size_t capacity;
+} LinkSet;
+
+typedef struct Walk Walk;
+
+// One walking thread and what it works with
+typedef struct {
+    Walk *walk;
+    int id;
+    WalkShard shard;
+    FileContext ctx;      // Reused for every file
+    char *path;           // Path of the entry being visited
+    size_t path_capacity;
+    unsigned char *dents; // getdents64() buffer
+} Walker;
+
+struct Walk {
+    const BatchOptions *opts;
+    int jobs;
+    WorkQueue *queues;
+    Walker *walkers;      // jobs workers, then one whose shard takes the totals
+    size_t pending;       // Paths queued or being visited; atomic
+    size_t queued;        // Paths waiting in the queues; atomic
+    size_t roots;         // Root arguments queued or being visited; atomic
+    int sleepers;         // Threads waiting on wake; atomic
+    pthread_mutex_t idle_lock;  // Held to wait on wake
+    pthread_cond_t wake;  // Broadcast when a path is queued, a root is done or the walk ends
+    LinkSet links[LINK_STRIPES];
+    pthread_mutex_t profile_lock;  // Serializes profile_record() under --profile
+};
+
+// ---------------------------------------------------------------------------
+// Shards
+// ---------------------------------------------------------------------------
+
+// FNV-1a over a NUL-terminated string
+static uint64_t hash_string(const char *s) {
+    uint64_t hash = 14695981039346656037u;
+    for (; *s != '\0'; s++) {
+        hash = (hash ^ (unsigned char)*s) * 1099511628211u;
+    }
+    return hash;
+}
+
+// Find or add the totals of a MIME type; NULL if memory runs out
+static TypeTotals *shard_type(WalkShard *shard, const char *mime_type) {
+    // Keep the table at most half full
+    if (shard->type_count * 2 >= shard->type_capacity) {
+        size_t capacity = shard->type_capacity ? shard->type_capacity * 2 : 64;
+        TypeTotals *types = calloc(capacity, sizeof(TypeTotals));
+        if (types == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i < shard->type_capacity; i++) {
+            if (shard->types[i].mime_type == NULL) {
+                continue;
+            }
+            size_t slot = hash_string(shard->types[i].mime_type) & (capacity - 1);
+            while (types[slot].mime_type != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            types[slot] = shard->types[i];
+        }
+        free(shard->types);
+        shard->types = types;
+        shard->type_capacity = capacity;
+    }
+    size_t slot = hash_string(mime_type) & (shard->type_capacity - 1);
+    while (shard->types[slot].mime_type != NULL) {
+        if (strcmp(shard->types[slot].mime_type, mime_type) == 0) {
+            return &shard->types[slot];
+        }
+        slot = (slot + 1) & (shard->type_capacity - 1);
+    }
+    char *copy = strdup(mime_type);
+    if (copy == NULL) {
+        return NULL;
+    }
+    shard->types[slot].mime_type = copy;
+    shard->type_count++;
+    return &shard->types[slot];
+}
+
+// Size histogram bucket of a file
+static int size_bucket(uint64_t size) {
+    return size == 0 ? 0 : 64 - __builtin_clzll(size);
+}
+
+// Add one analyzed file to a shard
+static void shard_add(WalkShard *shard, const FileContext *ctx) {
+    if (ctx->failed) {
+        shard->failed++;
+        return;
+    }
+    uint64_t size = (uint64_t)ctx->st.st_size;
+    shard->files++;
+    shard->bytes += size;
+    shard->sizes[size_bucket(size)]++;
+    // Type detection is skipped when --fields asks only for stat() fields
+    TypeTotals *type = shard_type(shard, ctx->mime_type[0] != '\0' ? ctx->mime_type : "(not detected)");
+    if (type != NULL) {
+        type->files++;
+        type->bytes += size;
+    }
+    // The handlers' own fields carry the numbers to add up
+    const InfoArray *info = &ctx->info;
+    for (size_t i = 0; i < info->size; i++) {
+        const char *key = info->data[i].key, *value = info->data[i].value;
+        if (strcmp(key, "Lines") == 0) {
+            shard->text_files++;
+            shard->lines += strtoull(value, NULL, 10);
+        } else if (strcmp(key, "Duration") == 0) {
+            // HH:MM:SS.mmm, as the video handler prints it
+            int hours, minutes, seconds, milliseconds;
+            if (sscanf(value, "%d:%d:%d.%d", &hours, &minutes, &seconds, &milliseconds) == 4) {
+                shard->video_files++;
+                shard->duration += hours * 3600.0 + minutes * 60.0 + seconds + milliseconds / 1000.0;
+            }
+        } else if (strcmp(key, "Pages") == 0) {
+            shard->pdf_files++;
+            shard->pages += strtoull(value, NULL, 10);
+        } else if (strcmp(key, "Signature table") == 0) {
+            // "agrees", "differs: TYPE" or "no match"
+            shard->sniff_agreed += value[0] == 'a';
+            shard->sniff_differed += value[0] == 'd';
+            shard->sniff_unmatched += value[0] == 'n';
+        }
+    }
+}
+
+// Add everything from one shard to another and release it
+static void shard_merge(WalkShard *into, WalkShard *from) {
+    into->files += from->files;
+    into->bytes += from->bytes;
+    into->dirs += from->dirs;
+    into->other += from->other;
+    into->hard_links += from->hard_links;
+    into->failed += from->failed;
+    for (int i = 0; i < SIZE_BUCKETS; i++) {
+        into->sizes[i] += from->sizes[i];
+    }
+    into->text_files += from->text_files;
+    into->lines += from->lines;
+    into->video_files += from->video_files;
+    into->duration += from->duration;
+    into->pdf_files += from->pdf_files;
+    into->pages += from->pages;
+    into->sniff_agreed += from->sniff_agreed;
+    into->sniff_differed += from->sniff_differed;
+    into->sniff_unmatched += from->sniff_unmatched;
+    for (size_t i = 0; i < from->type_capacity; i++) {
+        if (from->types[i].mime_type == NULL) {
+            continue;
+        }
+        TypeTotals *type = shard_type(into, from->types[i].mime_type);
+        if (type != NULL) {
+            type->files += from->types[i].files;
+            type->bytes += from->types[i].bytes;
+        }
+        free(from->types[i].mime_type);
+    }
+    free(from->types);
+    from->types = NULL;
+    from->type_count = from->type_capacity = 0;
+}
+
+static void shard_free(WalkShard *shard) {
+    for (size_t i = 0; i < shard->type_capacity; i++) {
+        free(shard->types[i].mime_type);
+    }
+    free(shard->types);
+}
+
+// ---------------------------------------------------------------------------
+// Hard links
+// ---------------------------------------------------------------------------
+
+// Remember an inode; returns 1 the first time it is seen, 0 afterwards
+// Only files with several links get here, so the stripes are rarely contended
+static int link_first_seen(Walk *walk, uint64_t dev, uint64_t ino) {
+    uint64_t hash = (dev * 0x9E3779B97F4A7C15u) ^ (ino * 0xC2B2AE3D27D4EB4Fu);
+    LinkSet *set = &walk->links[hash % LINK_STRIPES];
+    int first = 1;
+    pthread_mutex_lock(&set->lock);
+    if (set->count * 2 >= set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 256;
+        uint64_t (*keys)[2] = calloc(capacity, sizeof(*keys));
+        if (keys == NULL) {
+            // Without room to remember it, count the file again
+            pthread_mutex_unlock(&set->lock);
+            return 1;
+        }
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->keys[i][1] == 0) {
+                continue;
+            }
+            uint64_t h = (set->keys[i][0] * 0x9E3779B97F4A7C15u) ^
+                         ((set->keys[i][1] - 1) * 0xC2B2AE3D27D4EB4Fu);
+            size_t slot = (h >> 6) & (capacity - 1);
+            while (keys[slot][1] != 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            keys[slot][0] = set->keys[i][0];
+            keys[slot][1] = set->keys[i][1];
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->capacity = capacity;
+    }
+    // The stripe took the low bits of the hash, so the slot uses the others
+    size_t slot = (hash >> 6) & (set->capacity - 1);
+    while (set->keys[slot][1] != 0) {
+        if (set->keys[slot][0] == dev && set->keys[slot][1] == ino + 1) {
+            first = 0;
+            break;
+        }
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    if (first) {
+        set->keys[slot][0] = dev;
+        set->keys[slot][1] = ino + 1;
+        set->count++;
+    }
+    pthread_mutex_unlock(&set->lock);
+    return first;
+}
+
+// ---------------------------------------------------------------------------
+// Work queues
+// ---------------------------------------------------------------------------
+
+// Wake the threads waiting for work or for room, if there are any
+static void walk_wake(Walk *walk) {
+    if (__atomic_load_n(&walk->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&walk->idle_lock);
+        pthread_cond_broadcast(&walk->wake);
+        pthread_mutex_unlock(&walk->idle_lock);
+    }
+}
+
+// Queue a path (owned) on a worker's queue; root is set for root arguments
+static void queue_push(Walk *walk, int id, char *path, int root) {
+    WorkQueue *q = &walk->queues[id];
+    __atomic_add_fetch(&walk->pending, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity) {
+        if (q->head > 0) {
+            // Reuse the room that thieves left at the front
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(WorkItem));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            size_t capacity = q->capacity ? q->capacity * 2 : 64;
+            WorkItem *items = realloc(q->items, capacity * sizeof(WorkItem));
+            if (items == NULL) {
+                pthread_mutex_unlock(&q->lock);
+                fprintf(stderr, "Cannot queue directory: %s\n", path);
+                free(path);
+                walk->walkers[id].shard.failed++;
+                if (root) {
+                    __atomic_sub_fetch(&walk->roots, 1, __ATOMIC_SEQ_CST);
+                }
+                __atomic_sub_fetch(&walk->pending, 1, __ATOMIC_SEQ_CST);
+                walk_wake(walk);
+                return;
+            }
+            q->items = items;
+            q->capacity = capacity;
+        }
+    }
+    q->items[q->tail++] = (WorkItem){ .path = path, .root = root };
+    pthread_mutex_unlock(&q->lock);
+    __atomic_add_fetch(&walk->queued, 1, __ATOMIC_SEQ_CST);
+    walk_wake(walk);
+}
+
+// Take the newest path from a worker's own queue
+// Returns 0, or -1 if the queue is empty
+static int queue_pop(WorkQueue *q, WorkItem *item) {
+    int status = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        *item = q->items[--q->tail];
+        status = 0;
+    }
+    if (q->tail == q->head) {
+        q->head = q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return status;
+}
+
+// Take the oldest path from another worker's queue; the oldest are the
+// closest to the root and so tend to hold the most work
+// Returns 0, or -1 if the queue is empty
+static int queue_steal(WorkQueue *q, WorkItem *item) {
+    int status = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        *item = q->items[q->head++];
+        status = 0;
+    }
+    if (q->tail == q->head) {
+        q->head = q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Visiting entries
+// ---------------------------------------------------------------------------
+
+// Make w->path hold dir/name; returns -1 if memory runs out
+static int set_path(Walker *w, const char *dir, const char *name) {
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    // No doubled slash after a root given as "dir/" or "/"
+    int slash = dir_len > 0 && dir[dir_len - 1] != '/';
+    size_t need = dir_len + slash + name_len + 1;
+    if (need > w->path_capacity) {
+        char *path = realloc(w->path, need);
+        if (path == NULL) {
+            return -1;
+        }
+        w->path = path;
+        w->path_capacity = need;
+    }
+    memcpy(w->path, dir, dir_len);
+    if (slash) {
+        w->path[dir_len] = '/';
+    }
+    memcpy(w->path + dir_len + slash, name, name_len + 1);
+    return 0;
+}
+
+// Analyze a regular file found as name in dir_fd (w->path is its full path)
+static void visit_file(Walker *w, int dir_fd, const char *name, const struct stat *st) {
+    Walk *walk = w->walk;
+    // Every link after the first to the same inode adds nothing new
+    if (st->st_nlink > 1 && !link_first_seen(walk, st->st_dev, st->st_ino)) {
+        w->shard.hard_links++;
+        return;
+    }
+    // Open relative to the directory; process_file() takes the descriptor over
+    int flags = O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC | O_NOFOLLOW;
+    int fd = openat(dir_fd, name, flags | O_NOATIME);
+    if (fd == -1 && errno == EPERM) {
+        fd = openat(dir_fd, name, flags);
+    }
+    batch_start_file(&w->ctx, walk->opts, w->path);
+    w->ctx.fd = fd;
+    process_file(&w->ctx);
+    if (profile_is_enabled()) {
+        pthread_mutex_lock(&walk->profile_lock);
+        profile_record(&w->ctx.profile);
+        pthread_mutex_unlock(&walk->profile_lock);
+    }
+    shard_add(&w->shard, &w->ctx);
+}
+
+// Visit one directory entry: queue directories, analyze regular files
+static void visit_entry(Walker *w, int dir_fd, const char *dir, const char *name, unsigned type) {
+    if (set_path(w, dir, name) != 0) {
+        w->shard.failed++;
+        return;
+    }
+    if (type == DT_DIR) {
+        char *copy = strdup(w->path);
+        if (copy != NULL) {
+            queue_push(w->walk, w->id, copy, 0);
+        } else {
+            w->shard.failed++;
+        }
+        return;
+    }
+    // Symbolic links are not followed, and devices, FIFOs and sockets not read
+    if (type != DT_REG && type != DT_UNKNOWN) {
+        w->shard.other++;
+        return;
+    }
+    // Some file systems do not fill in d_type; the link count is needed anyway
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        fprintf(stderr, "Cannot stat file: %s\n", w->path);
+        w->shard.failed++;
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        visit_entry(w, dir_fd, dir, name, DT_DIR);
+    } else if (S_ISREG(st.st_mode)) {
+        visit_file(w, dir_fd, name, &st);
+    } else {
+        w->shard.other++;
+    }
+}
+
+// Read a directory and visit its entries
+static void read_directory(Walker *w, const char *dir) {
+    int dir_fd = openat(AT_FDCWD, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        fprintf(stderr, "Cannot open directory: %s\n", dir);
+        w->shard.failed++;
+        return;
+    }
+    w->shard.dirs++;
+    for (;;) {
+        long n = syscall(SYS_getdents64, dir_fd, w->dents, DENTS_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "Cannot read directory: %s\n", dir);
+            w->shard.failed++;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (long offset = 0; offset < n;) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(w->dents + offset);
+            offset += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            visit_entry(w, dir_fd, dir, d->d_name, d->d_type);
+        }
+    }
+    close(dir_fd);
+}
+
+// Visit a root argument: read it if it is a directory, analyze it if it is
+// a regular file. Symbolic links to roots are followed, like find -H
+static void visit_root(Walker *w, const char *root) {
+    struct stat st;
+    if (stat(root, &st) != 0) {
+        fprintf(stderr, "Cannot stat file: %s\n", root);
+        w->shard.failed++;
+    } else if (S_ISDIR(st.st_mode)) {
+        read_directory(w, root);
+    } else if (S_ISREG(st.st_mode) && set_path(w, root, "") == 0) {
+        // set_path() added a slash; a root file is opened by its path
+        w->path[strlen(root)] = '\0';
+        visit_file(w, AT_FDCWD, root, &st);
+    } else {
+        w->shard.other++;
+    }
+}
+
+// Worker: visit paths from its own queue, or stolen ones, until none are
+// left anywhere
+static void *walk_thread(void *arg) {
+    Walker *w = arg;
+    Walk *walk = w->walk;
+    for (;;) {
+        WorkItem item;
+        int found = queue_pop(&walk->queues[w->id], &item) == 0;
+        for (int i = 1; !found && i < walk->jobs; i++) {
+            found = queue_steal(&walk->queues[(w->id + i) % walk->jobs], &item) == 0;
+        }
+        if (found) {
+            __atomic_sub_fetch(&walk->queued, 1, __ATOMIC_SEQ_CST);
+            if (item.root) {
+                visit_root(w, item.path);
+                __atomic_sub_fetch(&walk->roots, 1, __ATOMIC_SEQ_CST);
+            } else {
+                read_directory(w, item.path);
+            }
+            free(item.path);
+            __atomic_sub_fetch(&walk->pending, 1, __ATOMIC_SEQ_CST);
+            walk_wake(walk);
+            continue;
+        }
+        // Nothing queued: wait for more, or stop once nothing is being
+        // visited either, since only a path being visited can queue more
+        pthread_mutex_lock(&walk->idle_lock);
+        __atomic_add_fetch(&walk->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&walk->queued, __ATOMIC_SEQ_CST) == 0 &&
+               __atomic_load_n(&walk->pending, __ATOMIC_SEQ_CST) != 0) {
+            pthread_cond_wait(&walk->wake, &walk->idle_lock);
+        }
+        __atomic_sub_fetch(&walk->sleepers, 1, __ATOMIC_SEQ_CST);
+        int done = __atomic_load_n(&walk->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&walk->idle_lock);
+        if (done) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+
+// Larger totals first
+static int compare_types(const void *a, const void *b) {
+    const TypeTotals *x = a, *y = b;
+    if (x->bytes != y->bytes) {
+        return x->bytes > y->bytes ? -1 : 1;
+    }
+    return strcmp(x->mime_type, y->mime_type);
+}
+
+// Add a count to the summary
+static void add_count(InfoArray *info, const char *key, uint64_t value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+    add_info(info, key, text);
+}
+
+// Print the summary, the per-type table and the size histogram
+static void print_report(WalkShard *total, FILE *out) {
+    // The summary uses the same layout as a single file's information
+    FileContext summary;
+    init_file_context(&summary, NULL);
+    InfoArray *info = &summary.info;
+    add_count(info, "Files", total->files);
+    char *size = format_size((off_t)total->bytes);
+    if (size != NULL) {
+        add_info(info, "Total size", size);
+        free(size);
+    }
+    add_count(info, "Directories", total->dirs);
+    if (total->hard_links > 0) {
+        add_count(info, "Hard links counted once", total->hard_links);
+    }
+    if (total->other > 0) {
+        add_count(info, "Links and special files", total->other);
+    }
+    if (total->failed > 0) {
+        add_count(info, "Not examined", total->failed);
+    }
+    if (total->text_files > 0) {
+        add_count(info, "Text lines", total->lines);
+    }
+    if (total->video_files > 0) {
+        char text[64];
+        uint64_t ms = (uint64_t)(total->duration * 1000 + 0.5);
+        snprintf(text, sizeof(text), "%02llu:%02llu:%02llu.%03llu",
+                 (unsigned long long)(ms / 3600000), (unsigned long long)(ms / 60000 % 60),
+                 (unsigned long long)(ms / 1000 % 60), (unsigned long long)(ms % 1000));
+        add_info(info, "Video duration", text);
+    }
+    if (total->pdf_files > 0) {
+        add_count(info, "PDF pages", total->pages);
+    }
+    if (total->sniff_agreed + total->sniff_differed + total->sniff_unmatched > 0) {
+        char text[96];
+        snprintf(text, sizeof(text), "%llu agree, %llu differ, %llu no match",
+                 (unsigned long long)total->sniff_agreed, (unsigned long long)total->sniff_differed,
+                 (unsigned long long)total->sniff_unmatched);
+        add_info(info, "Signature table", text);
+    }
+    display_info(&summary, "Summary", out);
+    free_file_context(&summary);
+
+    // Types by the space they take
+    TypeTotals *types = malloc((total->type_count + 1) * sizeof(TypeTotals));
+    if (types != NULL) {
+        size_t count = 0;
+        int width = (int)strlen("MIME type");
+        for (size_t i = 0; i < total->type_capacity; i++) {
+            if (total->types[i].mime_type != NULL) {
+                types[count++] = total->types[i];
+                int len = (int)strlen(total->types[i].mime_type);
+                width = len > width ? len : width;
+            }
+        }
+        qsort(types, count, sizeof(TypeTotals), compare_types);
+        fprintf(out, "\n%-*s %12s %12s\n", width, "MIME type", "Files", "Size");
+        for (size_t i = 0; i < count; i++) {
+            char *bytes = format_size((off_t)types[i].bytes);
+            fprintf(out, "%-*s %12llu %12s\n", width, types[i].mime_type,
+                    (unsigned long long)types[i].files, bytes != NULL ? bytes : "?");
+            free(bytes);
+        }
+        free(types);
+    }
+
+    // Power-of-two size classes, the empty ones left out
+    fprintf(out, "\n%-23s %12s\n", "File size", "Files");
+    for (int i = 0; i < SIZE_BUCKETS; i++) {
+        if (total->sizes[i] == 0) {
+            continue;
+        }
+        char range[64];
+        if (i == 0) {
+            snprintf(range, sizeof(range), "empty");
+        } else {
+            char *low = format_size((off_t)(1ull << (i - 1)));
+            char *high = i < 63 ? format_size((off_t)(1ull << i)) : NULL;
+            snprintf(range, sizeof(range), "%s - %s", low != NULL ? low : "?",
+                     high != NULL ? high : "");
+            free(low);
+            free(high);
+        }
+        fprintf(out, "%-23s %12llu\n", range, (unsigned long long)total->sizes[i]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Entry point
+// ---------------------------------------------------------------------------
+
+static int walker_init(Walker *w, Walk *walk, int id) {
+    memset(w, 0, sizeof(*w));
+    w->walk = walk;
+    w->id = id;
+    init_file_context(&w->ctx, NULL);
+    w->dents = malloc(DENTS_BUFFER_SIZE);
+    return w->dents != NULL ? 0 : -1;
+}
+
+static void walker_free(Walker *w) {
+    free_file_context(&w->ctx);
+    free(w->path);
+    free(w->dents);
+    shard_free(&w->shard);
+}
+
+size_t walk_run(const BatchOptions *opts, BatchSource source, void *source_arg, FILE *out) {
+    int jobs = opts->jobs > 1 ? opts->jobs : 1;
+    Walk walk = { .opts = opts, .jobs = jobs };
+    pthread_mutex_init(&walk.profile_lock, NULL);
+    pthread_mutex_init(&walk.idle_lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+    for (int i = 0; i < LINK_STRIPES; i++) {
+        pthread_mutex_init(&walk.links[i].lock, NULL);
+    }
+    walk.queues = calloc(jobs, sizeof(WorkQueue));
+    // One walker per thread, and one more for the totals
+    walk.walkers = calloc(jobs + 1, sizeof(Walker));
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    int ready = walk.queues != NULL && walk.walkers != NULL && threads != NULL;
+    int initialized = 0;
+    while (ready && initialized <= jobs) {
+        ready = walker_init(&walk.walkers[initialized], &walk, initialized) == 0;
+        initialized++;
+    }
+    if (!ready) {
+        fprintf(stderr, "Cannot allocate memory for the walk\n");
+        for (int i = 0; i < initialized; i++) {
+            walker_free(&walk.walkers[i]);
+        }
+        free(walk.queues);
+        free(walk.walkers);
+        free(threads);
+        return 1;
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_mutex_init(&walk.queues[i].lock, NULL);
+    }
+
+    // Hold the walk open while the roots are being queued, so that workers
+    // finding the queues empty early do not stop
+    walk.pending = 1;
+    int started = 0;
+    while (started < jobs &&
+           pthread_create(&threads[started], NULL, walk_thread, &walk.walkers[started]) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        // No threads: this thread walks everything itself
+        walk.jobs = 1;
+    }
+
+    // Roots, files as well as directories, are spread over the queues for
+    // the workers to look at; this thread only waits when too many are
+    // queued already
+    Walker *self = &walk.walkers[jobs];
+    size_t max_roots = (size_t)jobs * ROOTS_PER_JOB;
+    char *root;
+    int next_queue = 0;
+    while ((root = source(source_arg)) != NULL) {
+        if (started > 0 && __atomic_load_n(&walk.roots, __ATOMIC_SEQ_CST) >= max_roots) {
+            pthread_mutex_lock(&walk.idle_lock);
+            __atomic_add_fetch(&walk.sleepers, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&walk.roots, __ATOMIC_SEQ_CST) >= max_roots) {
+                pthread_cond_wait(&walk.wake, &walk.idle_lock);
+            }
+            __atomic_sub_fetch(&walk.sleepers, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&walk.idle_lock);
+        }
+        __atomic_add_fetch(&walk.roots, 1, __ATOMIC_SEQ_CST);
+        queue_push(&walk, next_queue, root, 1);
+        next_queue = (next_queue + 1) % walk.jobs;
+    }
+    __atomic_sub_fetch(&walk.pending, 1, __ATOMIC_SEQ_CST);
+    walk_wake(&walk);
+    if (started == 0) {
+        walk_thread(&walk.walkers[0]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Every shard is final now; add them up without any locking
+    WalkShard *total = &self->shard;
+    for (int i = 0; i < jobs; i++) {
+        shard_merge(total, &walk.walkers[i].shard);
+    }
+    print_report(total, out);
+    size_t failed = (size_t)total->failed;
+
+    for (int i = 0; i <= jobs; i++) {
+        walker_free(&walk.walkers[i]);
+    }
+    for (int i = 0; i < jobs; i++) {
+        free(walk.queues[i].items);
+        pthread_mutex_destroy(&walk.queues[i].lock);
+    }
+    for (int i = 0; i < LINK_STRIPES; i++) {
+        free(walk.links[i].keys);
+        pthread_mutex_destroy(&walk.links[i].lock);
+    }
+    pthread_mutex_destroy(&walk.profile_lock);
+    pthread_mutex_destroy(&walk.idle_lock);
+    pthread_cond_destroy(&walk.wake);
+    free(walk.queues);
+    free(walk.walkers);
+    free(threads);
+    return failed;
+}
@@ -0,0 +1,17 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include "batch.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// Walk every path from source, directory trees included, on opts->jobs
+// threads; analyze each regular file once (hard links are counted once) and
+// print one report for all of them to out: files and bytes per MIME type, a
+// size histogram, and lines, durations and pages summed over the files.
+// Memory does not grow with the number of files, only with the number of
+// directories waiting to be read and of distinct MIME types.
+// Returns the number of entries that could not be examined
+size_t walk_run(const BatchOptions *opts, BatchSource source, void *source_arg, FILE *out);
+
+#endif // WALK_H
@@ -0,0 +1,548 @@
+// Define _GNU_SOURCE to enable ppoll(), signalfd() and other GNU extensions in glibc
+#define _GNU_SOURCE
+
+// Include necessary header files
+#include "watch.h"          // Declarations for this file
+#include "detect.h"         // Loading the magic cookies before the first change
+#include "utils.h"          // stop_tools_when_readable()
+#include <dirent.h>         // opendir(), readdir(), DT_* entry types
+#include <errno.h>          // errno, EINTR, EAGAIN, ENOSPC
+#include <fcntl.h>          // fstatat() flags
+#include <poll.h>           // ppoll()
+#include <signal.h>         // sigset_t, pthread_sigmask()
+#include <stdint.h>         // uint32_t, uint64_t
+#include <stdio.h>          // fprintf()
+#include <stdlib.h>         // malloc(), calloc(), realloc(), free()
+#include <string.h>         // strcmp(), strncmp(), strlen(), memcpy()
+#include <sys/inotify.h>    // inotify_init1(), inotify_add_watch()
+#include <sys/signalfd.h>   // signalfd() for a clean shutdown
+#include <sys/stat.h>       // struct stat
+#include <time.h>           // clock_gettime()
+#include <unistd.h>         // read(), close()
+
+// Files that may wait for their debounce window at once
+#define PENDING_MAX 4096
+// Hash chains over the waiting files; a power of two
+#define PENDING_BUCKETS 8192
+// Bytes of events fetched per read()
+#define EVENT_BUFFER_SIZE 16384
+// An event naming a file takes at least a header and a header-sized name,
+// so one read() yields at most this many of them
+#define EVENTS_PER_READ (EVENT_BUFFER_SIZE / (2 * sizeof(struct inotify_event)))
+// Entries of a directory listed before looking at events again
+#define SCAN_STEP 256
+// Events each directory is watched for; IN_CREATE only matters for
+// subdirectories, IN_MOVED_FROM and IN_DELETE take files off the waiting list
+#define DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM | IN_DELETE | \
+                    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+// End of a chain or list of waiting files
+#define NO_ENTRY -1
+
+// A changed file waiting for its debounce window to pass
+typedef struct {
+    char *path;    // Owned path, NULL when the entry is free
+    uint64_t due;  // When it may be analyzed, in monotonic nanoseconds
+    uint32_t hash; // Hash of path
+    int chain;     // Next entry in the same bucket, or in the free list
+    int older;     // Neighbours in the order of their last event
+    int newer;
+} PendingFile;
+
+// A directory whose entries still have to be listed
+typedef struct ScanDir {
+    struct ScanDir *next;
+    int queue_files;  // Whether the files in it count as changed
+    char path[];
+} ScanDir;
+
+// Everything watch_next() works with
+typedef struct {
+    int inotify_fd;
+    int signal_fd;
+    uint64_t debounce_ns;
+    char **dirs;             // Directory of each watch descriptor, NULL if unused
+    size_t dir_slots;        // Entries in dirs
+    size_t watched;          // Directories watched
+    PendingFile pending[PENDING_MAX];
+    int buckets[PENDING_BUCKETS];
+    int oldest;              // Waiting file due first, or NO_ENTRY
+    int newest;              // Waiting file due last, or NO_ENTRY
+    int free_entry;          // First free entry, or NO_ENTRY
+    size_t pending_count;    // Files waiting
+    ScanDir *scan_head;      // Directories to list, oldest first
+    ScanDir *scan_tail;
+    ScanDir *scanning;       // Directory being listed, or NULL
+    DIR *scan_stream;        // Its open stream
+    int stopping;            // Set once no more paths will be handed out
+    // Events as read(); inotify records are aligned like the structure
+    unsigned char events[EVENT_BUFFER_SIZE]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+} Watcher;
+
+// Monotonic clock in nanoseconds, for the debounce windows
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// FNV-1a over a path
+static uint32_t path_hash(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+// dir and name joined by one slash, as a malloc'd string
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_length = strlen(dir), name_length = strlen(name);
+    if (dir_length > 1 && dir[dir_length - 1] == '/') {
+        dir_length--;
+    }
+    char *path = malloc(dir_length + name_length + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, dir, dir_length);
+    path[dir_length] = '/';
+    memcpy(path + dir_length + 1, name, name_length + 1);
+    return path;
+}
+
+// Take entry i out of the order of last events
+static void pending_unlink(Watcher *w, int i) {
+    PendingFile *entry = &w->pending[i];
+    if (entry->older != NO_ENTRY) {
+        w->pending[entry->older].newer = entry->newer;
+    } else {
+        w->oldest = entry->newer;
+    }
+    if (entry->newer != NO_ENTRY) {
+        w->pending[entry->newer].older = entry->older;
+    } else {
+        w->newest = entry->older;
+    }
+}
+
+// Put entry i last in the order of last events
+static void pending_append(Watcher *w, int i) {
+    PendingFile *entry = &w->pending[i];
+    entry->older = w->newest;
+    entry->newer = NO_ENTRY;
+    if (w->newest != NO_ENTRY) {
+        w->pending[w->newest].newer = i;
+    } else {
+        w->oldest = i;
+    }
+    w->newest = i;
+}
+
+// Record a change to path (taking ownership of it): a file already waiting
+// starts its window over, any other takes a free entry
+static void pending_touch(Watcher *w, char *path) {
+    if (path == NULL) {
+        return;
+    }
+    uint64_t due = monotonic_ns() + w->debounce_ns;
+    uint32_t hash = path_hash(path);
+    int *bucket = &w->buckets[hash & (PENDING_BUCKETS - 1)];
+    for (int i = *bucket; i != NO_ENTRY; i = w->pending[i].chain) {
+        PendingFile *entry = &w->pending[i];
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            entry->due = due;
+            pending_unlink(w, i);
+            pending_append(w, i);
+            free(path);
+            return;
+        }
+    }
+    // Callers check for room, so this only guards against a miscount
+    int i = w->free_entry;
+    if (i == NO_ENTRY) {
+        free(path);
+        return;
+    }
+    PendingFile *entry = &w->pending[i];
+    w->free_entry = entry->chain;
+    entry->path = path;
+    entry->due = due;
+    entry->hash = hash;
+    entry->chain = *bucket;
+    *bucket = i;
+    pending_append(w, i);
+    w->pending_count++;
+}
+
+// Free entry i and hand over its path
+static char *pending_remove(Watcher *w, int i) {
+    PendingFile *entry = &w->pending[i];
+    int *link = &w->buckets[entry->hash & (PENDING_BUCKETS - 1)];
+    while (*link != i) {
+        link = &w->pending[*link].chain;
+    }
+    *link = entry->chain;
+    pending_unlink(w, i);
+    char *path = entry->path;
+    entry->path = NULL;
+    entry->chain = w->free_entry;
+    w->free_entry = i;
+    w->pending_count--;
+    return path;
+}
+
+// Remove the file due first and hand over its path
+static char *pending_pop(Watcher *w) {
+    return pending_remove(w, w->oldest);
+}
+
+// Forget a waiting file that was deleted or renamed away before its window
+// passed; under its new name it has an event of its own
+static void pending_drop(Watcher *w, const char *path) {
+    uint32_t hash = path_hash(path);
+    for (int i = w->buckets[hash & (PENDING_BUCKETS - 1)]; i != NO_ENTRY; i = w->pending[i].chain) {
+        if (w->pending[i].hash == hash && strcmp(w->pending[i].path, path) == 0) {
+            free(pending_remove(w, i));
+            return;
+        }
+    }
+}
+
+// Watch the directory at path, or take over its watch after it moved
+// Returns 0, or -1 if it cannot be watched
+static int watch_directory(Watcher *w, const char *path) {
+    int wd = inotify_add_watch(w->inotify_fd, path, DIR_EVENTS);
+    if (wd == -1) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Cannot watch %s: too many watches (see fs.inotify.max_user_watches)\n",
+                    path);
+        } else if (errno != ENOENT) {
+            fprintf(stderr, "Cannot watch %s: %s\n", path, strerror(errno));
+        }
+        return -1;
+    }
+    if ((size_t)wd >= w->dir_slots) {
+        size_t slots = w->dir_slots > 0 ? w->dir_slots : 64;
+        while (slots <= (size_t)wd) {
+            slots *= 2;
+        }
+        char **dirs = realloc(w->dirs, slots * sizeof(char *));
+        if (dirs == NULL) {
+            inotify_rm_watch(w->inotify_fd, wd);
+            return -1;
+        }
+        memset(dirs + w->dir_slots, 0, (slots - w->dir_slots) * sizeof(char *));
+        w->dirs = dirs;
+        w->dir_slots = slots;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        inotify_rm_watch(w->inotify_fd, wd);
+        return -1;
+    }
+    if (w->dirs[wd] != NULL) {
+        free(w->dirs[wd]);  // The same directory under its new name
+    } else {
+        w->watched++;
+    }
+    w->dirs[wd] = copy;
+    return 0;
+}
+
+// Stop watching the tree at path, which has moved out of its place; if it
+// moved within a watched tree, it is watched again under its new name
+static void forget_tree(Watcher *w, const char *path) {
+    size_t length = strlen(path);
+    for (size_t wd = 0; wd < w->dir_slots; wd++) {
+        const char *dir = w->dirs[wd];
+        if (dir != NULL && strncmp(dir, path, length) == 0 &&
+            (dir[length] == '\0' || dir[length] == '/')) {
+            inotify_rm_watch(w->inotify_fd, (int)wd);
+            free(w->dirs[wd]);
+            w->dirs[wd] = NULL;
+            w->watched--;
+        }
+    }
+    // Files waiting in it are no longer where they were
+    for (int i = 0; i < PENDING_MAX; i++) {
+        const char *file = w->pending[i].path;
+        if (file != NULL && strncmp(file, path, length) == 0 && file[length] == '/') {
+            free(pending_remove(w, i));
+        }
+    }
+}
+
+// Have the entries of the directory at path listed
+static void queue_scan(Watcher *w, const char *path, int queue_files) {
+    size_t length = strlen(path);
+    ScanDir *scan = malloc(sizeof(ScanDir) + length + 1);
+    if (scan == NULL) {
+        return;
+    }
+    scan->next = NULL;
+    scan->queue_files = queue_files;
+    memcpy(scan->path, path, length + 1);
+    if (w->scan_tail != NULL) {
+        w->scan_tail->next = scan;
+    } else {
+        w->scan_head = scan;
+    }
+    w->scan_tail = scan;
+}
+
+// List up to SCAN_STEP entries of the directories waiting to be listed:
+// watch the subdirectories and, where asked, count the files as changed
+// Returns 1 if there is more to list, 0 when done or out of room for files
+static int scan_step(Watcher *w) {
+    for (int listed = 0; listed < SCAN_STEP; listed++) {
+        if (w->scan_stream == NULL) {
+            ScanDir *scan = w->scan_head;
+            if (scan == NULL) {
+                return 0;
+            }
+            w->scan_head = scan->next;
+            if (w->scan_head == NULL) {
+                w->scan_tail = NULL;
+            }
+            w->scan_stream = opendir(scan->path);
+            if (w->scan_stream == NULL) {
+                free(scan);  // Gone again already
+                continue;
+            }
+            w->scanning = scan;
+        }
+        // Each entry may add a file, so wait while every entry is taken
+        if (w->scanning->queue_files && w->pending_count >= PENDING_MAX) {
+            return 0;
+        }
+        struct dirent *entry = readdir(w->scan_stream);
+        if (entry == NULL) {
+            closedir(w->scan_stream);
+            w->scan_stream = NULL;
+            free(w->scanning);
+            w->scanning = NULL;
+            continue;
+        }
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(w->scan_stream), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) {
+            char *path = join_path(w->scanning->path, name);
+            if (path != NULL && watch_directory(w, path) == 0) {
+                queue_scan(w, path, w->scanning->queue_files);
+            }
+            free(path);
+        } else if (type == DT_REG && w->scanning->queue_files) {
+            pending_touch(w, join_path(w->scanning->path, name));
+        }
+    }
+    return 1;
+}
+
+// Read the events waiting on the inotify descriptor and act on them
+static void read_events(Watcher *w) {
+    ssize_t length = read(w->inotify_fd, w->events, sizeof(w->events));
+    if (length <= 0) {
+        return;  // EAGAIN: another wakeup took them
+    }
+    const unsigned char *end = w->events + length;
+    const unsigned char *next;
+    for (const unsigned char *p = w->events; p < end; p = next) {
+        const struct inotify_event *event = (const struct inotify_event *)p;
+        next = p + sizeof(*event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+            fprintf(stderr, "Cannot keep up with changes: the kernel dropped some\n");
+            continue;
+        }
+        if (event->wd < 0 || (size_t)event->wd >= w->dir_slots || w->dirs[event->wd] == NULL) {
+            continue;  // A watch already forgotten
+        }
+        if (event->mask & IN_IGNORED) {
+            // The directory is gone
+            free(w->dirs[event->wd]);
+            w->dirs[event->wd] = NULL;
+            w->watched--;
+            continue;
+        }
+        if (event->len == 0) {
+            continue;  // About the directory itself
+        }
+        char *path = join_path(w->dirs[event->wd], event->name);
+        if (event->mask & IN_ISDIR) {
+            if (path == NULL) {
+                continue;
+            }
+            if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+                forget_tree(w, path);
+            } else if (watch_directory(w, path) == 0) {
+                // Files written before the watch was in place have no events
+                queue_scan(w, path, 1);
+            }
+            free(path);
+        } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            pending_touch(w, path);
+        } else if (path != NULL && (event->mask & (IN_MOVED_FROM | IN_DELETE))) {
+            pending_drop(w, path);
+            free(path);
+        } else {
+            free(path);
+        }
+    }
+    if (w->watched == 0) {
+        fprintf(stderr, "Cannot watch any longer: every directory is gone\n");
+        w->stopping = 1;
+    }
+}
+
+// BatchSource handing out changed files once their window has passed;
+// sleeps in ppoll() while there is nothing to do
+static char *watch_next(void *arg) {
+    Watcher *w = arg;
+    while (!w->stopping) {
+        uint64_t now = monotonic_ns();
+        if (w->oldest != NO_ENTRY && w->pending[w->oldest].due <= now) {
+            return pending_pop(w);
+        }
+        int scanning = scan_step(w);
+
+        // Read events only while a whole buffer of them would fit, leaving
+        // the rest queued in the kernel
+        struct pollfd fds[2] = {
+            { .fd = w->signal_fd, .events = POLLIN },
+            { .fd = w->inotify_fd, .events = POLLIN },
+        };
+        nfds_t count = w->pending_count + EVENTS_PER_READ <= PENDING_MAX ? 2 : 1;
+        // With more to list, only look at what has arrived meanwhile
+        struct timespec timeout = { 0, 0 };
+        struct timespec *wait = &timeout;
+        if (!scanning && w->oldest != NO_ENTRY) {
+            uint64_t due = w->pending[w->oldest].due;
+            uint64_t delay = due > now ? due - now : 0;
+            timeout.tv_sec = (time_t)(delay / 1000000000u);
+            timeout.tv_nsec = (long)(delay % 1000000000u);
+        } else if (!scanning) {
+            wait = NULL;  // Idle until something happens
+        }
+        if (ppoll(fds, count, wait, NULL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Cannot wait for changes: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[0].revents != 0) {
+            break;  // Asked to stop
+        }
+        if (count > 1 && (fds[1].revents & POLLIN)) {
+            read_events(w);
+        }
+    }
+    w->stopping = 1;
+    return NULL;
+}
+
+// Release everything the watcher holds
+static void free_watcher(Watcher *w) {
+    for (int i = 0; i < PENDING_MAX; i++) {
+        free(w->pending[i].path);
+    }
+    for (size_t wd = 0; wd < w->dir_slots; wd++) {
+        free(w->dirs[wd]);
+    }
+    free(w->dirs);
+    if (w->scan_stream != NULL) {
+        closedir(w->scan_stream);
+    }
+    free(w->scanning);
+    while (w->scan_head != NULL) {
+        ScanDir *next = w->scan_head->next;
+        free(w->scan_head);
+        w->scan_head = next;
+    }
+    if (w->inotify_fd != -1) {
+        close(w->inotify_fd);
+    }
+    if (w->signal_fd != -1) {
+        stop_tools_when_readable(-1);
+        close(w->signal_fd);
+    }
+    free(w);
+}
+
+long watch_run(const BatchOptions *opts, unsigned debounce_ms, BatchSource source,
+               void *source_arg, BatchSink sink, void *sink_arg) {
+    Watcher *w = calloc(1, sizeof(Watcher));
+    if (w == NULL) {
+        fprintf(stderr, "Cannot watch for changes: %s\n", strerror(errno));
+        return -1;
+    }
+    w->debounce_ns = (uint64_t)debounce_ms * 1000000u;
+    w->oldest = w->newest = NO_ENTRY;
+    for (int i = 0; i < PENDING_BUCKETS; i++) {
+        w->buckets[i] = NO_ENTRY;
+    }
+    for (int i = 0; i < PENDING_MAX; i++) {
+        w->pending[i].chain = i + 1 < PENDING_MAX ? i + 1 : NO_ENTRY;
+    }
+    w->free_entry = 0;
+
+    // SIGINT and SIGTERM are read from a descriptor, like the server does,
+    // so the workers finish the files they hold and the cache gets saved;
+    // SIGHUP too, as a watch often outlives the terminal that started it
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    w->signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->signal_fd == -1 || w->inotify_fd == -1) {
+        fprintf(stderr, "Cannot watch for changes: %s\n", strerror(errno));
+        free_watcher(w);
+        return -1;
+    }
+    stop_tools_when_readable(w->signal_fd);  // The tools would outlive us
+
+    // Watch every tree before the first change is looked at; what is in
+    // them already does not count as changed
+    char *root;
+    while ((root = source(source_arg)) != NULL) {
+        struct stat st;
+        if (stat(root, &st) != 0) {
+            fprintf(stderr, "Cannot watch %s: %s\n", root, strerror(errno));
+        } else if (!S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "Cannot watch %s: %s\n", root, strerror(ENOTDIR));
+        } else if (watch_directory(w, root) == 0) {
+            queue_scan(w, root, 0);
+        }
+        free(root);
+    }
+    while (scan_step(w)) {
+    }
+    if (w->watched == 0) {
+        free_watcher(w);
+        return -1;
+    }
+    fprintf(stderr, "Watching %zu directories\n", w->watched);
+
+    // Load the cookies now, so the first change is not slowed down by it
+    detect_preload(opts->jobs);
+
+    // Results stream out as they finish
+    BatchOptions watch_opts = *opts;
+    watch_opts.unordered = 1;
+    size_t failed = batch_run(&watch_opts, watch_next, w, sink, sink_arg);
+    free_watcher(w);
+    return (long)failed;
+}
@@ -0,0 +1,23 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "batch.h"
+
+// Debounce window of --watch when --debounce is not given
+#define DEFAULT_DEBOUNCE_MS 50
+
+// Watch every directory from source, and the directories below them, with
+// inotify until SIGINT, SIGTERM or SIGHUP. A file is analyzed once it has
+// been closed after writing or moved into a watched tree and debounce_ms have
+// passed without another such event for it; results go to sink as they
+// finish. Files already present are not analyzed, except those in
+// directories created or moved in while watching.
+// At most a fixed number of files wait for their window at a time: when
+// they are all taken, events stay in the kernel's queue until some are
+// handed on, so a storm of writes cannot make memory grow.
+// Returns the number of files that could not be examined, or -1 if no
+// directory could be watched
+long watch_run(const BatchOptions *opts, unsigned debounce_ms, BatchSource source,
+               void *source_arg, BatchSink sink, void *sink_arg);
+
+#endif // WATCH_H